@@ -0,0 +1,144 @@
+// On-device benchmark: SHA-512 and HMAC-SHA512 at DoLynk payload sizes,
+//   - in software (mbedtls while the SHA engine is held elsewhere, which is
+//     what a second concurrent DoLynk request used to get),
+//   - through mbedtls' streaming API (the previous signing path),
+//   - in one pass on the SHA engine (Sha512, the current path),
+// then two tasks signing at once to check results stay correct.
+//
+// Build, flash and watch: pio run -e bench_sha -t upload -t monitor
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include "Sha512.h"
+
+#if CONFIG_IDF_TARGET_ESP32 && CONFIG_MBEDTLS_HARDWARE_SHA
+#include <sha/sha_parallel_engine.h>
+#define HAVE_ENGINE 1
+#else
+#define HAVE_ENGINE 0
+#endif
+
+static const size_t SIZES[] = { 64, 130, 320, 1024, 4096 }; // body, signing string, replies
+static const int ROUNDS = 200;
+static const char KEY[] = "0123456789abcdef0123456789abcdef"; // SECRET_ACCESS_KEY length
+static uint8_t data[4096];
+
+enum Path { PATH_SOFTWARE, PATH_MBEDTLS, PATH_ENGINE, PATH_COUNT };
+static const char* const PATH_NAMES[PATH_COUNT] = { "software", "mbedtls", "engine" };
+
+// Keep the engine busy so mbedtls falls back to software
+static void holdEngine(bool hold) {
+#if HAVE_ENGINE
+  if (hold) esp_sha_lock_engine(SHA2_512);
+  else esp_sha_unlock_engine(SHA2_512);
+#endif
+}
+
+static void hashWith(Path path, const uint8_t* in, size_t len, uint8_t out[SHA512_DIGEST_SIZE]) {
+  if (path == PATH_ENGINE) Sha512::hash(in, len, out);
+  else Sha512::hashMbedtls(in, len, out);
+}
+
+static void hmacWith(Path path, const uint8_t* in, size_t len, uint8_t out[SHA512_DIGEST_SIZE]) {
+  const char* parts[] = { (const char*)in };
+  size_t lengths[] = { len };
+  if (path == PATH_ENGINE) Sha512::hmac(KEY, strlen(KEY), parts, lengths, 1, out);
+  else Sha512::hmacMbedtls(KEY, strlen(KEY), parts, lengths, 1, out);
+}
+
+// Microseconds per call
+static double timeIt(Path path, bool hmac, size_t len) {
+  uint8_t out[SHA512_DIGEST_SIZE];
+  holdEngine(path == PATH_SOFTWARE);
+  int64_t start = esp_timer_get_time();
+  for (int i = 0; i < ROUNDS; i++) {
+    if (hmac) hmacWith(path, data, len, out);
+    else hashWith(path, data, len, out);
+  }
+  int64_t us = esp_timer_get_time() - start;
+  holdEngine(false);
+  return (double)us / ROUNDS;
+}
+
+static bool sameDigests(size_t len) {
+  uint8_t a[SHA512_DIGEST_SIZE], b[SHA512_DIGEST_SIZE], c[SHA512_DIGEST_SIZE], d[SHA512_DIGEST_SIZE];
+  hashWith(PATH_MBEDTLS, data, len, a);
+  hashWith(PATH_ENGINE, data, len, b);
+  hmacWith(PATH_MBEDTLS, data, len, c);
+  hmacWith(PATH_ENGINE, data, len, d);
+  return memcmp(a, b, sizeof(a)) == 0 && memcmp(c, d, sizeof(c)) == 0;
+}
+
+/* =========================================================
+   CONCURRENT SIGNING
+   ========================================================= */
+struct Signer {
+  uint8_t expected[SHA512_DIGEST_SIZE];
+  uint32_t mismatches;
+  SemaphoreHandle_t done;
+};
+
+static void signerTask(void* arg) {
+  Signer* s = (Signer*)arg;
+  uint8_t out[SHA512_DIGEST_SIZE];
+  for (int i = 0; i < ROUNDS; i++) {
+    hmacWith(PATH_ENGINE, data, 320, out);
+    if (memcmp(out, s->expected, sizeof(out)) != 0) s->mismatches++;
+  }
+  xSemaphoreGive(s->done);
+  vTaskDelete(NULL);
+}
+
+static void concurrent() {
+  Signer signers[2];
+  int64_t start = esp_timer_get_time();
+  for (int core = 0; core < 2; core++) {
+    Signer& s = signers[core];
+    hmacWith(PATH_MBEDTLS, data, 320, s.expected);
+    s.mismatches = 0;
+    s.done = xSemaphoreCreateBinary();
+    xTaskCreatePinnedToCore(signerTask, "signer", 4096, &s, 1, NULL, core);
+  }
+  for (Signer& s : signers) {
+    xSemaphoreTake(s.done, portMAX_DELAY);
+    vSemaphoreDelete(s.done);
+  }
+  double us = (double)(esp_timer_get_time() - start) / (2 * ROUNDS);
+  Serial.printf("\n2 tasks x %d HMACs of 320 B on both cores: %.1f us each, %u mismatches\n",
+                ROUNDS, us, (unsigned)(signers[0].mismatches + signers[1].mismatches));
+}
+
+void setup() {
+  Serial.begin(115200);
+  delay(500);
+  for (size_t i = 0; i < sizeof(data); i++) data[i] = esp_random();
+
+  Serial.printf("\nSHA-512 at %u MHz, SHA engine %s, %d rounds\n", (unsigned)getCpuFrequencyMhz(),
+                Sha512::hardware() ? "used" : "not available", ROUNDS);
+  for (int hmac = 0; hmac < 2; hmac++) {
+    Serial.printf("\n%-12s %6s", hmac ? "HMAC" : "hash", "bytes");
+    for (int p = 0; p < PATH_COUNT; p++) Serial.printf(" %10s us %8s", PATH_NAMES[p], "KB/s");
+    Serial.println();
+    for (size_t len : SIZES) {
+      Serial.printf("%-12s %6u", sameDigests(len) ? "" : "MISMATCH", (unsigned)len);
+      for (int p = 0; p < PATH_COUNT; p++) {
+        double us = timeIt((Path)p, hmac, len);
+        Serial.printf(" %13.1f %8.0f", us, len / us * 1e6 / 1024);
+      }
+      Serial.println();
+    }
+  }
+
+  // A toggle signs one request per ability: a body hash and an HMAC each
+  Serial.printf("\nPer lock change (3 signed requests):");
+  for (int p = 0; p < PATH_COUNT; p++) {
+    double us = 3 * (timeIt((Path)p, false, 130) + timeIt((Path)p, true, 320));
+    Serial.printf(" %s %.0f us%s", PATH_NAMES[p], us, p + 1 < PATH_COUNT ? "," : "\n");
+  }
+
+  concurrent();
+}
+
+void loop() {
+  delay(1000);
+}
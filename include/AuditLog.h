@@ -0,0 +1,115 @@
+#ifndef AUDIT_LOG_H
+#define AUDIT_LOG_H
+
+#include <Arduino.h>
+
+// Label of the data partition in partitions.csv that holds the log
+#ifndef AUDIT_PARTITION
+#define AUDIT_PARTITION "audit"
+#endif
+
+// Devices flashed before the audit log have this unused SPIFFS partition at
+// the same offset and size instead; OTA updates don't change the table
+#define AUDIT_LEGACY_PARTITION "spiffs"
+#define AUDIT_LEGACY_ADDRESS 0x3D0000
+#define AUDIT_LEGACY_SIZE 0x20000
+
+// Records accepted by record() but not yet written to flash
+#ifndef AUDIT_QUEUE_DEPTH
+#define AUDIT_QUEUE_DEPTH 16
+#endif
+
+#define AUDIT_SECTOR_SIZE 4096 // flash erase unit
+#define AUDIT_HEADER_SIZE 16   // per sector: magic, sequence, time range
+
+enum AuditEvent : uint8_t {
+  AUDIT_POWER_ON = 1, // cold boot: power cut or reset
+  AUDIT_UNLOCK,
+  AUDIT_LOCK,
+  AUDIT_PIN,          // PIN entry that changed nothing; the result says why
+  AUDIT_SYNC,         // lock state sent to DoLynk; the result says how it went
+};
+
+// Who: keypad credentials are slots from 0 (0 is DEVICE_PASSWORD)
+#define AUDIT_SLOT_API 0xFE  // local LAN API
+#define AUDIT_SLOT_NONE 0xFF
+
+enum AuditResult : uint8_t {
+  AUDIT_OK,
+  AUDIT_DENIED,    // wrong PIN
+  AUDIT_TIMEOUT,   // entry abandoned
+  AUDIT_ACKED,     // DoLynk confirmed
+  AUDIT_UNACKED,   // DoLynk did not confirm; maintenance retries
+  AUDIT_DEFERRED,  // not sent (backend down or busy); maintenance sends it
+};
+
+// One record as stored, 8 bytes
+struct AuditRecord {
+  uint32_t time;  // Unix seconds, 0 if the clock wasn't set yet
+  uint8_t event;  // AuditEvent
+  uint8_t slot;
+  uint8_t result; // AuditResult
+  uint8_t check;  // CRC-8 of the above; a write torn by a power cut fails it
+};
+
+#define AUDIT_RECORDS_PER_SECTOR ((AUDIT_SECTOR_SIZE - AUDIT_HEADER_SIZE) / sizeof(AuditRecord))
+
+// What a query cost
+struct AuditQueryStats {
+  uint32_t records;     // matching records
+  uint16_t sectorsRead; // sectors whose records were read
+  uint16_t sectors;     // sectors holding records
+  uint32_t ms;
+};
+
+typedef void (*AuditVisitor)(void* ctx, const AuditRecord& record);
+typedef void (*AuditSink)(void* ctx, const char* data, size_t len);
+
+/*
+ * Append-only audit trail of who locked and unlocked the site, PIN failures
+ * and DoLynk syncs, in its own flash partition. The partition is a ring of
+ * 4 KB sectors filled with fixed-size records; the oldest sector is erased
+ * when the log wraps. Each sector's header carries the time range of its
+ * records, and those headers (12 bytes of RAM per sector) are the index:
+ * a time-range query reads only the sectors that overlap it. Records are
+ * queued by any task and written by the network task.
+ */
+class AuditLog {
+public:
+  /**
+   * Create the record queue. The partition is opened on first use.
+   */
+  static void begin();
+
+  /**
+   * Queue a record stamped with the current time. Any task; never blocks,
+   * dropped if the queue is full.
+   */
+  static void record(AuditEvent event, uint8_t slot, AuditResult result);
+
+  /**
+   * Write the queued records. Call from the network task.
+   */
+  static void flush();
+
+  /**
+   * Visit the records from..to (Unix seconds, inclusive), oldest first.
+   * from 0 and to UINT32_MAX visit everything, undated records included.
+   * Network task only.
+   */
+  static AuditQueryStats query(uint32_t from, uint32_t to, AuditVisitor visit, void* ctx);
+
+  /**
+   * query() as CSV, "time,event,slot,result" lines in 512-byte chunks,
+   * ending with a "# records, sectors read, ms" summary line
+   */
+  static AuditQueryStats exportCsv(uint32_t from, uint32_t to, AuditSink sink, void* ctx);
+
+  /**
+   * Write what is still queued. Call before sleeping, once the network
+   * task has stopped.
+   */
+  static void end();
+};
+
+#endif // AUDIT_LOG_H
@@ -0,0 +1,101 @@
+#ifndef CPU_POWER_H
+#define CPU_POWER_H
+
+#include <Arduino.h>
+
+// CPU clock while a performance lock is held (TLS handshakes, request
+// signing, JSON parsing)
+#ifndef CPU_MAX_MHZ
+#define CPU_MAX_MHZ 240
+#endif
+
+// CPU clock otherwise. Below 80 MHz the APB bus slows down with the CPU,
+// which shifts LED PWM and fade timing, and WiFi needs at least 80.
+#ifndef CPU_IDLE_MHZ
+#define CPU_IDLE_MHZ 80
+#endif
+
+// Energy estimate only (ESP32 datasheet typicals): CPU current is roughly
+// base + per-MHz (26 mA at 80 MHz, 50 mA at 240 MHz), plus the radio's
+// average while WiFi or ESP-NOW is up
+#ifndef POWER_CPU_BASE_MA
+#define POWER_CPU_BASE_MA 14
+#endif
+#ifndef POWER_CPU_UA_PER_MHZ
+#define POWER_CPU_UA_PER_MHZ 150
+#endif
+#ifndef POWER_RADIO_MA
+#define POWER_RADIO_MA 80
+#endif
+#ifndef POWER_SUPPLY_MV
+#define POWER_SUPPLY_MV 3300
+#endif
+
+enum PowerPhase : uint8_t {
+  PHASE_IDLE,     // keypad and LEDs only: CPU_IDLE_MHZ
+  PHASE_RADIO,    // radio up, waiting on the network: 80 MHz or more
+  PHASE_COMPUTE,  // a performance lock is held: CPU_MAX_MHZ
+  PHASE_COUNT
+};
+
+// Awake time and estimated energy since begin()
+struct PowerUsage {
+  uint64_t phaseUs[PHASE_COUNT];
+  uint64_t energyUj;      // at the clocks actually used
+  uint64_t fixedClockUj;  // the same time at CPU_MAX_MHZ throughout
+};
+
+/*
+ * Dynamic CPU frequency: the clock stays low while the firmware only scans
+ * the keypad and drives LEDs, and goes to full speed while CPU-bound work
+ * holds a performance lock. Uses ESP-IDF power management when the core is
+ * built with CONFIG_PM_ENABLE, setCpuFrequencyMhz() otherwise.
+ */
+class CpuPower {
+public:
+  /**
+   * Drop to the idle clock and start accounting. Call first in setup().
+   */
+  static void begin();
+
+  /**
+   * Performance lock, counted, so it can be taken from several tasks
+   * (DoLynk fan-out). Prefer PerformanceLock.
+   */
+  static void acquire();
+  static void release();
+
+  /**
+   * Tell the accounting (and the clock floor) that WiFi or ESP-NOW came up
+   * or went down
+   */
+  static void radio(bool on);
+
+  /**
+   * @return time per phase and estimated energy since begin()
+   */
+  static PowerUsage usage();
+
+  /**
+   * Add what was used since the last call to the power metrics. Called
+   * when metrics are sampled.
+   */
+  static void sample();
+
+  /**
+   * Print this boot's phase times and energy estimate, and update the
+   * metrics. Call just before sleeping.
+   */
+  static void end();
+};
+
+// Holds the performance lock for a scope
+class PerformanceLock {
+public:
+  PerformanceLock() { CpuPower::acquire(); }
+  ~PerformanceLock() { CpuPower::release(); }
+  PerformanceLock(const PerformanceLock&) = delete;
+  PerformanceLock& operator=(const PerformanceLock&) = delete;
+};
+
+#endif // CPU_POWER_H
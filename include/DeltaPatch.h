@@ -0,0 +1,124 @@
+#ifndef DELTA_PATCH_H
+#define DELTA_PATCH_H
+
+#include <Arduino.h>
+#include <mbedtls/sha256.h>
+
+// Delta file layout (produced by tools/make_delta.py):
+//   header     "RVD2", source size, target size (u32 LE), SHA-256 of source, SHA-256 of target
+//   signature  ECDSA P-256 over the header's SHA-256, r and s (32 bytes each, big-endian)
+//   payload    LZSS-compressed stream of patch records:
+//                seek   signed varint, moves the source pointer
+//                diff   varint length, then bytes added to the source bytes
+//                extra  varint length, then bytes copied as-is
+#define DELTA_MAGIC          "RVD2"
+#define DELTA_HEADER_SIZE    76
+#define DELTA_SIGNATURE_SIZE 64 // checked by Ota, not by the decoder
+#define DELTA_WINDOW_BITS    12 // LZSS window, also the decoder's RAM buffer
+
+enum DeltaStatus {
+  DELTA_OK = 0,
+  DELTA_ERR_HEADER = -1,   // bad magic or sizes
+  DELTA_ERR_CORRUPT = -2,  // payload doesn't decode
+  DELTA_ERR_RANGE = -3,    // patch reads outside the source or writes past the target
+  DELTA_ERR_READ = -4,     // source read failed
+  DELTA_ERR_WRITE = -5,    // target write failed
+  DELTA_ERR_SIZE = -6,     // payload ended before the whole target was produced
+  DELTA_ERR_HASH = -7,     // target doesn't match the expected SHA-256
+};
+
+struct DeltaHeader {
+  uint32_t sourceSize;
+  uint32_t targetSize;
+  uint8_t sourceHash[32];
+  uint8_t targetHash[32];
+};
+
+// Source image reader and target writer, e.g. the running and the inactive
+// OTA partitions. Both return false on failure.
+typedef bool (*DeltaReadFn)(void* ctx, uint32_t offset, uint8_t* dst, size_t len);
+typedef bool (*DeltaWriteFn)(void* ctx, const uint8_t* src, size_t len);
+
+/**
+ * Streaming delta decoder: payload bytes go in as they arrive, target bytes
+ * come out in small chunks. Needs a few KB of RAM whatever the image size.
+ */
+class DeltaPatch {
+public:
+  /**
+   * Parse the fixed-size header at the start of a delta file
+   * @return DELTA_OK or DELTA_ERR_HEADER
+   */
+  static int parseHeader(const uint8_t* data, size_t len, DeltaHeader& header);
+
+  DeltaPatch(const DeltaHeader& header, DeltaReadFn read, DeltaWriteFn write, void* ctx);
+  ~DeltaPatch();
+
+  /**
+   * Decode the next part of the payload (everything after the header)
+   * @return DELTA_OK, or the first error; later calls keep returning it
+   */
+  int feed(const uint8_t* data, size_t len);
+
+  /**
+   * Flush the last output and check the target's size and SHA-256
+   */
+  int finish();
+
+  /**
+   * @return target bytes produced so far
+   */
+  uint32_t written() const { return outPos; }
+
+private:
+  enum LzState { LZ_FLAGS, LZ_ITEM, LZ_MATCH_LOW, LZ_MATCH_EXT };
+  enum PatchState { P_SEEK, P_DIFF_LEN, P_DIFF, P_EXTRA_LEN, P_EXTRA };
+
+  static const size_t WINDOW = 1 << DELTA_WINDOW_BITS;
+  static const size_t OUT_CHUNK = 512;
+  static const size_t SOURCE_CHUNK = 256;
+
+  DeltaHeader hdr;
+  DeltaReadFn readSource;
+  DeltaWriteFn writeTarget;
+  void* ctx;
+  int status;
+
+  // LZSS layer
+  uint8_t window[WINDOW];
+  size_t windowPos;
+  LzState lzState;
+  uint8_t flags;
+  uint8_t flagsLeft;
+  uint16_t matchOffset;
+  uint32_t matchLength;
+  uint64_t matchExtra;    // varint with the rest of a long match's length
+  uint8_t matchHigh;
+  uint8_t extShift;
+
+  // Patch record layer
+  PatchState patchState;
+  uint64_t varint;
+  uint8_t varintShift;
+  uint32_t remaining;
+  int64_t sourcePos;
+
+  // Source read cache and target output buffer
+  uint8_t sourceCache[SOURCE_CHUNK];
+  int64_t sourceCacheStart;
+  uint8_t out[OUT_CHUNK];
+  size_t outUsed;
+  uint32_t outPos;
+  mbedtls_sha256_context sha;
+
+  void lzByte(uint8_t b);
+  void emit(uint8_t b);
+  void patchByte(uint8_t b);
+  bool varintByte(uint8_t b);
+  bool sourceByte(uint8_t& b);
+  void put(uint8_t b);
+  void flushOut();
+  void fail(int error) { if (status == DELTA_OK) status = error; }
+};
+
+#endif // DELTA_PATCH_H
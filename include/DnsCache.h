@@ -0,0 +1,57 @@
+#ifndef DNS_CACHE_H
+#define DNS_CACHE_H
+
+#include <Arduino.h>
+#include <WiFiClientSecure.h>
+
+// How long a resolved address is trusted (seconds). The Arduino resolver
+// doesn't report record TTLs, so this is a fixed upper bound; maintenance
+// runs re-resolve entries before they expire.
+#ifndef DNS_CACHE_TTL_S
+#define DNS_CACHE_TTL_S 86400
+#endif
+
+// Hosts remembered (DoLynk, Mailtrap, ...); the oldest entry is replaced
+#ifndef DNS_CACHE_SIZE
+#define DNS_CACHE_SIZE 4
+#endif
+
+#define DNS_HOST_MAX 48 // longer host names are looked up every time
+
+// One cached address, kept in the RTC state block
+struct DnsCacheEntry {
+  char host[DNS_HOST_MAX];
+  uint32_t ip;
+  uint32_t expiresAt;  // s on the RTC clock
+};
+
+/*
+ * Resolver cache that survives deep sleep, so the first request of a wake
+ * connects straight to a known address instead of waiting on DNS.
+ */
+class DnsCache {
+public:
+  /**
+   * Open a TLS connection to the host of url, using a cached address when
+   * there is one. If the cached address doesn't answer it is dropped and the
+   * host looked up again. HTTPClient then reuses the open connection.
+   * Safe to call from several tasks at once.
+   * @param timeoutMs bound on the whole connect, a retry after a stale
+   *                  address included
+   * @return true if connected
+   */
+  static bool connect(WiFiClientSecure& client, const char* url, uint32_t timeoutMs);
+
+  /**
+   * Look up again every cached host that expires within the given time.
+   * Call while online, e.g. from a maintenance run.
+   */
+  static void refresh(uint32_t withinS);
+
+  /**
+   * Print this boot's hits, misses and the time they saved, if any
+   */
+  static void report();
+};
+
+#endif // DNS_CACHE_H
@@ -3,12 +3,119 @@
 
 #include <Arduino.h>
 
+// Check DoLynk's reported ability status against the acknowledged state
+// every N calls to sync_alarms() (i.e. every N maintenance runs) to catch drift
+#ifndef DOLYNK_VERIFY_INTERVAL
+#define DOLYNK_VERIFY_INTERVAL 4
+#endif
+
+// Longest an app access token is kept (seconds); the reply's expireTime is
+// used when shorter. A token is replaced once it has less than the margin left.
+#ifndef DOLYNK_TOKEN_TTL_S
+#define DOLYNK_TOKEN_TTL_S 86400
+#endif
+#ifndef DOLYNK_TOKEN_MARGIN_S
+#define DOLYNK_TOKEN_MARGIN_S 300
+#endif
+
+// Total time budget for one DoLynk operation, including all retries (ms)
+#ifndef DOLYNK_DEADLINE_MS
+#define DOLYNK_DEADLINE_MS 8000
+#endif
+
+// Attempts per operation for transient errors (timeouts, 408/429/5xx)
+#ifndef DOLYNK_MAX_ATTEMPTS
+#define DOLYNK_MAX_ATTEMPTS 4
+#endif
+
+// Exponential backoff between attempts, full jitter up to the cap (ms)
+#ifndef DOLYNK_BACKOFF_BASE_MS
+#define DOLYNK_BACKOFF_BASE_MS 250
+#endif
+#ifndef DOLYNK_BACKOFF_MAX_MS
+#define DOLYNK_BACKOFF_MAX_MS 2000
+#endif
+
+// Consecutive failed operations before the circuit opens, and how long it
+// stays open before a single probe is allowed through (ms)
+#ifndef DOLYNK_BREAKER_THRESHOLD
+#define DOLYNK_BREAKER_THRESHOLD 3
+#endif
+#ifndef DOLYNK_BREAKER_COOLDOWN_MS
+#define DOLYNK_BREAKER_COOLDOWN_MS 60000
+#endif
+
+// Returned instead of an HTTP code when no request was attempted
+#define DOLYNK_ERR_CIRCUIT_OPEN -100
+#define DOLYNK_ERR_DEADLINE     -101
+#define DOLYNK_ERR_NO_MEMORY    -102 // request didn't fit in the session arena
+
+// Per-session arena for request strings and the parsed reply (bytes). Each
+// session holds one, so this is also the cost of each parallel request.
+#ifndef DOLYNK_ARENA_SIZE
+#define DOLYNK_ARENA_SIZE 4096
+#endif
+
+// Upper bound on DOLYNK_DEVICES entries (sizes the RTC acknowledged-state table)
+#ifndef DOLYNK_MAX_DEVICES
+#define DOLYNK_MAX_DEVICES 8
+#endif
+
+// Devices (bits, by DOLYNK_DEVICES index) armed by this lock's own keypad. A
+// gateway leaves the ones its ESP-NOW leaves arm out of this mask.
+#ifndef DOLYNK_OWN_DEVICES
+#define DOLYNK_OWN_DEVICES 0xFFFFFFFF
+#endif
+
+// Requests in flight at once when updating several devices. Each extra worker
+// opens its own TLS session, which costs a full handshake per sync plus ~40 KB
+// heap, so keep this small. A worker that can't get the heap runs no requests.
+#ifndef DOLYNK_MAX_PARALLEL
+#define DOLYNK_MAX_PARALLEL 3
+#endif
+#ifndef DOLYNK_WORKER_STACK
+#define DOLYNK_WORKER_STACK 8192
+#endif
+
+// Ability masks for DOLYNK_DEVICES entries
+#define DOLYNK_MOTION        (1 << 0) // motionDetect, forced off when arming
+#define DOLYNK_SIREN         (1 << 1) // linkDevAlarm
+#define DOLYNK_STROBE        (1 << 2) // linkageWhiteLight
+#define DOLYNK_ALL_ABILITIES (DOLYNK_MOTION | DOLYNK_SIREN | DOLYNK_STROBE)
+#define DOLYNK_ABILITY_COUNT 3
+
+struct DolynkDevice {
+    const char* id;
+    uint8_t abilities;
+};
+
+enum DolynkBreakerState { BREAKER_CLOSED, BREAKER_OPEN, BREAKER_HALF_OPEN };
+
 String generate_uuid();
 String get_timestamp_ms();
 String hmac_sha512(const String& key, const String& data);
 String sha512_hash(const String& data);
 bool getAccessToken();
-bool callApi(const char* abilityType, const char* status);
+bool dolynk_refresh_token(uint32_t validForS); // fetch a token unless the cached one lasts that long
+DolynkBreakerState dolynk_breaker_state();
+bool dolynk_available();
+bool callApi(const char* deviceId, const char* abilityType, const char* status);
+bool callApi(const char* abilityType, const char* status); // first configured device
+bool getAbilityStatus(const char* deviceId, const char* abilityType, String& status);
 bool toggle_alarms(const char* state);
+bool sync_alarms(const char* state);
+bool verify_alarms();
+// Find which abilities (and under which names) each device supports, unless
+// already known for the firmware it runs now (one device info request each).
+// Kept in NVS. Returns false if any device is left.
+bool dolynk_discover_abilities();
+void forget_alarm_state();
+// Get a token and open the TLS connection the next request will use, so it
+// only has to be signed and sent. dolynk_release() closes the connection.
+bool dolynk_prepare();
+void dolynk_release();
+// Arm or disarm the selected devices (force resends acknowledged abilities).
+// Returns the selected devices whose siren and strobe DoLynk acknowledged.
+uint32_t dolynk_apply(uint32_t deviceMask, bool armed, bool force);
 
 #endif // DOLYNK_H
@@ -0,0 +1,57 @@
+#ifndef LED_ENGINE_H
+#define LED_ENGINE_H
+
+#include <Arduino.h>
+
+// Full-on LED brightness (0-255). Below 255 the LEDs are PWM dimmed, which
+// also cuts LED current on battery units.
+#ifndef LED_BRIGHTNESS
+#define LED_BRIGHTNESS 128
+#endif
+
+// Default periods for the breathing patterns (milliseconds)
+#define LED_BREATHE_PERIOD 3000
+#define LED_PULSE_PERIOD   600
+
+enum Led { LED_GREEN, LED_YELLOW, LED_RED, LED_COUNT };
+
+enum LedPattern {
+  LED_OFF,
+  LED_SOLID,
+  LED_BREATHE, // slow hardware fade up and down
+  LED_PULSE    // fast fade, e.g. while a request is pending
+};
+
+class LedEngine {
+public:
+  /**
+   * Attach the LEDs to LEDC PWM channels and start the animation timer.
+   * Patterns then run in the background; callers never block.
+   */
+  static void begin(uint8_t greenPin, uint8_t yellowPin, uint8_t redPin);
+
+  /**
+   * Set the steady pattern of an LED. Setting the current pattern again
+   * is a no-op, so this can be called every loop.
+   * @param periodMs - breathe/pulse period, 0 for the pattern's default
+   */
+  static void set(Led led, LedPattern pattern, uint16_t periodMs = 0);
+
+  /**
+   * Blink an LED a number of times on top of its steady pattern, which
+   * resumes afterwards. A new blink restarts any blink in progress.
+   */
+  static void blink(Led led, uint8_t times, uint16_t onMs = 100, uint16_t offMs = 100);
+
+  /**
+   * @return true while any blink is still running
+   */
+  static bool busy();
+
+  /**
+   * Stop the animation timer and switch every LED off (before deep sleep)
+   */
+  static void end();
+};
+
+#endif // LED_ENGINE_H
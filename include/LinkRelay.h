@@ -0,0 +1,170 @@
+#ifndef LINK_RELAY_H
+#define LINK_RELAY_H
+
+#include <Arduino.h>
+#include "LinkTransport.h"
+
+// Leaf: time between resends while the gateway hasn't queued a change
+#ifndef LINK_RETRY_MS
+#define LINK_RETRY_MS 100
+#endif
+
+// Leaf: give up if the gateway doesn't queue a change within this time. The
+// gateway doesn't read frames while it waits on DoLynk, so this covers one
+// relayed batch.
+#ifndef LINK_QUEUE_TIMEOUT_MS
+#define LINK_QUEUE_TIMEOUT_MS 1500
+#endif
+
+// Leaf: wait this long for the DoLynk result of a queued change
+#ifndef LINK_APPLY_TIMEOUT_MS
+#define LINK_APPLY_TIMEOUT_MS 10000
+#endif
+
+// Gateway: changes arriving within this time of the first are sent to
+// DoLynk together
+#ifndef LINK_BATCH_MS
+#define LINK_BATCH_MS 20
+#endif
+
+// Gateway: leaves it tracks sequence numbers for; further ones are refused
+#ifndef LINK_MAX_LEAVES
+#define LINK_MAX_LEAVES 16
+#endif
+
+#define LINK_MAGIC 0xA7
+#define LINK_TAG_LEN 12
+
+// Frame types
+#define LINK_STATE   1 // leaf → gateway: arm or disarm devices
+#define LINK_QUEUED  2 // gateway → leaf: accepted, DoLynk call pending
+#define LINK_APPLIED 3 // gateway → leaf: DoLynk acknowledged every device
+#define LINK_FAILED  4 // gateway → leaf: DoLynk didn't acknowledge
+#define LINK_RESYNC  5 // gateway → leaf: stale sequence number, resend above seq
+
+// Flags
+#define LINK_FLAG_ARMED (1 << 0)
+#define LINK_FLAG_FORCE (1 << 1) // resend even what DoLynk already acknowledged
+
+// On the air, little endian. The tag is a truncated HMAC-SHA512 over both
+// MAC addresses and every field before it, so a frame only counts between
+// the two locks it was made for.
+struct __attribute__((packed)) LinkFrame {
+  uint8_t magic;
+  uint8_t type;
+  uint8_t flags;
+  uint8_t reserved;
+  uint32_t epoch;      // gateway's boot id; frames from an older one are stale
+  uint32_t seq;        // leaf's counter, echoed in replies
+  uint32_t nonce;      // leaf's random per change, echoed in replies
+  uint32_t deviceMask; // by index into the gateway's DOLYNK_DEVICES
+  uint8_t tag[LINK_TAG_LEN];
+};
+
+enum LinkResult { LINK_PENDING, LINK_DONE, LINK_REFUSED, LINK_UNREACHABLE };
+
+/*
+ * Leaf side of the relay: sends one change at a time and follows it until
+ * the gateway reports the DoLynk result. Sequence number and the gateway's
+ * epoch are kept by the caller (RTC memory), so they survive deep sleep;
+ * after power loss the gateway's RESYNC puts the leaf back in step.
+ */
+class LinkLeaf {
+public:
+  LinkLeaf(LinkTransport& radio, const uint8_t gateway[6], const char* key, uint32_t& seq, uint32_t& epoch);
+
+  /**
+   * Start sending a change, abandoning any that is still pending
+   */
+  void send(bool armed, uint32_t deviceMask, bool force);
+
+  /**
+   * Resend and read replies. Call until it stops returning LINK_PENDING.
+   * @return LINK_DONE if DoLynk acknowledged every device, LINK_REFUSED if
+   *   the gateway tried and DoLynk didn't (or no result came in time),
+   *   LINK_UNREACHABLE if the gateway never took the change
+   */
+  LinkResult poll();
+
+  uint16_t attempts() const { return sent; }
+
+private:
+  LinkTransport& radio;
+  uint8_t gateway[6];
+  const char* key;
+  uint32_t& seq;
+  uint32_t& epoch;
+  LinkFrame pending;
+  LinkResult result;
+  bool queued;
+  uint16_t sent;
+  unsigned long startedAt;
+  unsigned long lastSentAt;
+
+  void transmit();
+};
+
+/**
+ * Sends the given devices' new state to DoLynk
+ * @return the devices DoLynk acknowledged
+ */
+typedef uint32_t (*LinkForward)(uint32_t deviceMask, bool armed, bool force);
+
+struct LinkGatewayStats {
+  uint32_t accepted;   // changes queued
+  uint32_t duplicates; // resends of a change already queued
+  uint32_t rejected;   // bad tag or malformed
+  uint32_t resyncs;    // stale epoch or sequence number (replays, leaf power loss)
+  uint32_t batches;    // DoLynk rounds
+};
+
+/*
+ * Gateway side: checks and acknowledges leaf frames, collects the changes
+ * that arrive together and forwards them in one DoLynk round.
+ */
+class LinkGateway {
+public:
+  LinkGateway(LinkTransport& radio, const char* key, LinkForward forward);
+
+  /**
+   * Pick a new epoch, so frames recorded before this boot are refused
+   */
+  void begin();
+
+  /**
+   * Handle received frames and forward the batch once it is due
+   */
+  void poll();
+
+  const LinkGatewayStats& stats() const { return counters; }
+
+private:
+  struct Leaf {
+    uint8_t mac[6];
+    uint32_t seq;   // highest accepted
+    uint32_t nonce; // of that change, to recognise resends
+    uint8_t status; // LINK_QUEUED until forwarded, then the result
+  };
+  struct Change {
+    uint8_t leaf;
+    uint8_t flags;
+    uint32_t deviceMask;
+  };
+
+  LinkTransport& radio;
+  const char* key;
+  LinkForward forward;
+  uint32_t epoch;
+  Leaf leaves[LINK_MAX_LEAVES];
+  uint8_t leafCount;
+  Change batch[LINK_MAX_LEAVES];
+  uint8_t batchCount;
+  unsigned long batchStartedAt;
+  LinkGatewayStats counters;
+
+  void handle(const uint8_t mac[6], const LinkFrame& frame);
+  void reply(const uint8_t mac[6], uint8_t type, uint32_t seq, uint32_t nonce);
+  void flush();
+};
+
+#endif // LINK_RELAY_H
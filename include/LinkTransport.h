@@ -0,0 +1,59 @@
+#ifndef LINK_TRANSPORT_H
+#define LINK_TRANSPORT_H
+
+#include <Arduino.h>
+
+#define LINK_FRAME_MAX 250 // ESP-NOW payload limit
+
+/*
+ * Connectionless radio between locks: fire-and-forget frames to a MAC
+ * address, no association. The relay logic only sees this interface, so the
+ * host build can run it over a simulated radio.
+ */
+class LinkTransport {
+public:
+  virtual ~LinkTransport() {}
+
+  /**
+   * Bring the radio up
+   * @param channel WiFi channel to listen and send on, 0 to keep the current one
+   * @return true if frames can be sent
+   */
+  virtual bool begin(uint8_t channel) = 0;
+
+  /**
+   * Queue a frame for one peer. Delivery is not guaranteed.
+   * @return true if the radio accepted it
+   */
+  virtual bool send(const uint8_t mac[6], const uint8_t* data, size_t len) = 0;
+
+  /**
+   * Take the next received frame, without waiting
+   * @param mac set to the sender's address
+   * @return frame length, 0 if none is waiting
+   */
+  virtual size_t receive(uint8_t mac[6], uint8_t* data, size_t capacity) = 0;
+
+  /**
+   * This radio's own address, as peers see it
+   */
+  virtual void address(uint8_t mac[6]) = 0;
+
+  virtual void end() = 0;
+};
+
+/*
+ * ESP-NOW on the WiFi radio. Works alongside a WiFi connection as long as
+ * both sides are on the AP's channel. Received frames are queued by the
+ * WiFi task and taken in receive().
+ */
+class EspNowTransport : public LinkTransport {
+public:
+  bool begin(uint8_t channel) override;
+  bool send(const uint8_t mac[6], const uint8_t* data, size_t len) override;
+  size_t receive(uint8_t mac[6], uint8_t* data, size_t capacity) override;
+  void address(uint8_t mac[6]) override;
+  void end() override;
+};
+
+#endif // LINK_TRANSPORT_H
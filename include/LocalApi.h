@@ -0,0 +1,79 @@
+#ifndef LOCAL_API_H
+#define LOCAL_API_H
+
+#include <Arduino.h>
+
+// The API is only built when setup.h defines LOCAL_API_KEY, the shared
+// secret clients sign their requests with
+#ifndef LOCAL_API_PORT
+#define LOCAL_API_PORT 8080
+#endif
+
+// How far a request's timestamp may be from the device clock (seconds)
+#ifndef LOCAL_API_SKEW_S
+#define LOCAL_API_SKEW_S 30
+#endif
+
+// Event stream subscribers served at once
+#ifndef LOCAL_API_SUBSCRIBERS
+#define LOCAL_API_SUBSCRIBERS 2
+#endif
+
+#define LOCAL_API_SAME_SECOND 4   // requests accepted with one timestamp
+#define LOCAL_API_REQUEST_MAX 512 // request head; longer requests are refused
+#define LOCAL_API_EVENT_MAX 125   // one event, fits a single short WebSocket frame
+#define LOCAL_API_EVENT_QUEUE 8   // events published but not yet streamed
+
+// Replay guard, kept in the RTC state block so it holds across deep sleep
+struct LocalApiReplayGuard {
+  uint32_t time;                            // newest request time accepted, 0: none since power-on
+  uint8_t count;                            // requests accepted with that time
+  uint8_t tags[LOCAL_API_SAME_SECOND][8];   // their signatures, first bytes
+};
+
+// Applies a lock (true) or unlock from the API, returns the lock state
+// the device is now in (or about to be)
+typedef bool (*LocalLockHandler)(bool locked);
+
+/*
+ * Signed HTTP API on the LAN, so an on-site access control server can read
+ * and set the lock state without going through DoLynk:
+ *   GET /state, POST /lock, POST /unlock  ->  {"locked":true}
+ *   GET /events                           ->  WebSocket of JSON events
+ * Requests carry X-Revolock-Time (Unix seconds) and X-Revolock-Sign, the
+ * hex HMAC-SHA512 of "METHOD\nPATH\nTIME" under LOCAL_API_KEY. Each request
+ * must be at least as new as the last one accepted, and not a repeat. Served only
+ * while the device is awake and on WiFi, from static buffers, by the network
+ * task; any task may publish events.
+ */
+class LocalApi {
+public:
+  /**
+   * @param onLock applies lock and unlock commands, on the calling task; it
+   *   must not wait on the network, and leaves the DoLynk sync for after
+   *   the reply
+   */
+  static void begin(LocalLockHandler onLock);
+
+  /**
+   * Answer a pending request, service the event subscribers and stream the
+   * published events. Call from the network task; returns immediately when
+   * nobody is connected. Starts the server once WiFi comes up.
+   */
+  static void handle();
+
+  /**
+   * Queue an event for every subscriber: {"event":"<event>","ms":<uptime>,<fields>}.
+   * Never blocks; dropped if nobody is subscribed or the queue is full.
+   * @param fields further JSON members, e.g. "\"locked\":true", or nullptr
+   */
+  static void publish(const char* event, const char* fields = nullptr);
+
+  /**
+   * Stream what is queued, tell subscribers the device is going to sleep,
+   * close them and stop
+   */
+  static void end();
+};
+
+#endif // LOCAL_API_H
@@ -0,0 +1,68 @@
+#ifndef LOCK_LINK_H
+#define LOCK_LINK_H
+
+#include <Arduino.h>
+
+// Roles, for LINK_ROLE in setup.h
+#define LINK_NONE    0 // talks to DoLynk itself (default)
+#define LINK_LEAF    1 // battery lock: hands alarm changes to a gateway over ESP-NOW
+#define LINK_GATEWAY 2 // mains powered: stays online and relays its leaves' changes
+
+#ifndef LINK_ROLE
+#define LINK_ROLE LINK_NONE
+#endif
+
+// ESP-NOW shares the WiFi radio, so leaves must use the channel of the
+// gateway's access point. 0 keeps the current channel (gateway).
+#ifndef LINK_CHANNEL
+#define LINK_CHANNEL 0
+#endif
+
+/*
+ * The lock's side of its role: where alarm changes go and what has to run
+ * in the background. Without LINK_ROLE everything goes straight to DoLynk.
+ */
+class LockLink {
+public:
+  /**
+   * Bring up the radio for the role (gateway: alongside WiFi). Leaves
+   * start it on first use instead.
+   */
+  static void begin();
+
+  /**
+   * @return whether an alarm change can be sent now (leaf: always; else
+   *   connects and checks DoLynk's breaker)
+   */
+  static bool reachable();
+
+  /**
+   * Arm or disarm this lock's devices, directly or through the gateway
+   * @param force resend what DoLynk already acknowledged (user toggle)
+   * @return true if DoLynk acknowledged every device
+   */
+  static bool setAlarms(bool armed, bool force);
+
+  /**
+   * Get everything setAlarms() needs ready ahead of it (leaf: the radio;
+   * else WiFi, NTP time, token and a TLS connection to DoLynk). Safe to call
+   * from another task while the loop runs; not alongside setAlarms().
+   * @return true if setAlarms() can send at once
+   */
+  static bool prepare();
+
+  /**
+   * Close what prepare() opened
+   * @param radioOff also turn the radio off (it was off before prepare())
+   */
+  static void release(bool radioOff);
+
+  /**
+   * Gateway: relay leaf frames. Call from loop().
+   */
+  static void handle();
+
+  static void end();
+};
+
+#endif // LOCK_LINK_H
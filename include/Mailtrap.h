@@ -3,6 +3,18 @@
 
 #include <Arduino.h>
 
+// Arena for one email's URL, JSON payload and error reply (bytes)
+#ifndef MAILTRAP_ARENA_SIZE
+#define MAILTRAP_ARENA_SIZE 2048
+#endif
+
+// Connect and response timeout (ms)
+#ifndef MAILTRAP_TIMEOUT_MS
+#define MAILTRAP_TIMEOUT_MS 10000
+#endif
+
+// Not reentrant (one shared arena): the firmware sends only from the
+// notification task
 class Mailtrap {
 public:
     static bool sendEmail(const char* fromEmail, const char* fromName,
@@ -0,0 +1,73 @@
+#ifndef MAINTENANCE_H
+#define MAINTENANCE_H
+
+#include <Arduino.h>
+
+// Seconds between periodic maintenance wakes (NTP, token, alarm sync, OTA)
+#ifndef MAINTENANCE_INTERVAL_S
+#define MAINTENANCE_INTERVAL_S 21600 // 6 hours
+#endif
+
+// First retry after a run that left work pending (seconds); doubles with
+// every further failed run, up to MAINTENANCE_INTERVAL_S
+#ifndef MAINTENANCE_RETRY_S
+#define MAINTENANCE_RETRY_S 300
+#endif
+
+// Hours (UTC) in which maintenance wakes may start, e.g. 1 and 5 for the
+// small hours only. The end is exclusive and may wrap past midnight; equal
+// start and end (or 0 and 24) mean any hour.
+#ifndef MAINTENANCE_WINDOW_START_H
+#define MAINTENANCE_WINDOW_START_H 0
+#endif
+#ifndef MAINTENANCE_WINDOW_END_H
+#define MAINTENANCE_WINDOW_END_H 24
+#endif
+
+// Jobs, as bits for defer()
+#define JOB_TIME_SYNC     (1 << 0) // resync the RTC with NTP
+#define JOB_TOKEN_REFRESH (1 << 1) // DoLynk token valid until after the next run
+#define JOB_SYNC_ALARMS   (1 << 2) // send unacknowledged alarm states to DoLynk
+#define JOB_OTA_CHECK     (1 << 3) // only while unlocked
+#define JOB_DISCOVER      (1 << 4) // DoLynk abilities per device, again after a device firmware update
+#define JOB_ALL           (JOB_TIME_SYNC | JOB_TOKEN_REFRESH | JOB_SYNC_ALARMS | JOB_OTA_CHECK | JOB_DISCOVER)
+
+/*
+ * Network work that doesn't have to happen while someone is at the keypad.
+ * Jobs are queued in the RTC state block and run together in one headless
+ * timer wake, so key wakes can leave the radio off.
+ */
+class Maintenance {
+public:
+  /**
+   * Queue jobs for the next run. Runs are retried with backoff until every
+   * job has succeeded.
+   */
+  static void defer(uint8_t jobs);
+
+  /**
+   * Run the queued jobs, plus the periodic ones if they are due. Connects
+   * to WiFi only if there is something to do.
+   * @return true if nothing is left pending
+   */
+  static bool run();
+
+  /**
+   * Arm the deep sleep timer for the next periodic run, or sooner for a
+   * retry if jobs are pending. Call just before sleeping.
+   */
+  static void armTimer();
+
+  /**
+   * For boards that never sleep (gateway): whether run() has work now,
+   * periodic or a retry
+   */
+  static bool due();
+
+  /**
+   * @return whether the last run finished all its jobs
+   */
+  static bool lastRunOk();
+};
+
+#endif // MAINTENANCE_H
@@ -0,0 +1,195 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <Arduino.h>
+#include <atomic>
+
+// Port of the Prometheus endpoint, served only while the device is awake
+#ifndef METRICS_PORT
+#define METRICS_PORT 9100
+#endif
+
+#define METRICS_MAX_BUCKETS 12
+
+// Latency objectives for a '#' press (p95, milliseconds), timed from the key's
+// first raw contact: until the lock state changes locally (debounce, scan
+// and PIN check), and until DoLynk has acknowledged every alarm.
+// p95 is known to a bucket, so pick targets from the histogram bounds.
+#ifndef SLO_TOGGLE_LOCAL_MS
+#define SLO_TOGGLE_LOCAL_MS 100
+#endif
+#ifndef SLO_TOGGLE_ACK_MS
+#define SLO_TOGGLE_ACK_MS 4000
+#endif
+// Samples a histogram needs before its p95 is judged
+#ifndef SLO_MIN_SAMPLES
+#define SLO_MIN_SAMPLES 20
+#endif
+
+/*
+ * Metric types. Updates are one relaxed 32-bit atomic operation: safe from any
+ * task, never blocking and never allocating, so they can sit on hot paths.
+ */
+class Counter {
+public:
+  constexpr Counter() : value(0) {}
+  void inc(uint32_t n = 1) { value.fetch_add(n, std::memory_order_relaxed); }
+  uint32_t get() const { return value.load(std::memory_order_relaxed); }
+private:
+  std::atomic<uint32_t> value;
+};
+
+class Gauge {
+public:
+  constexpr Gauge() : value(0) {}
+  void set(int32_t v) { value.store(v, std::memory_order_relaxed); }
+  int32_t get() const { return value.load(std::memory_order_relaxed); }
+private:
+  std::atomic<int32_t> value;
+};
+
+// Fixed upper bounds (ascending); values above the last go to +Inf
+class Histogram {
+public:
+  template<size_t N>
+  constexpr Histogram(const uint32_t (&upperBounds)[N]) : bounds(upperBounds), bucketCount(N), counts(), sum(0) {
+    static_assert(N <= METRICS_MAX_BUCKETS, "too many histogram buckets");
+  }
+
+  void observe(uint32_t v) {
+    uint8_t i = 0;
+    while (i < bucketCount && v > bounds[i]) i++;
+    counts[i].fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(v, std::memory_order_relaxed);
+  }
+
+  uint32_t count() const {
+    uint32_t n = 0;
+    for (uint8_t i = 0; i <= bucketCount; i++) n += counts[i].load(std::memory_order_relaxed);
+    return n;
+  }
+
+  // Upper bound of the bucket holding the pct-th percentile, UINT32_MAX if
+  // it is past the last bound, 0 if empty
+  uint32_t percentile(uint8_t pct) const {
+    uint32_t n = count();
+    if (n == 0) return 0;
+    uint32_t rank = (n * pct + 99) / 100, seen = 0;
+    for (uint8_t i = 0; i < bucketCount; i++) {
+      seen += counts[i].load(std::memory_order_relaxed);
+      if (seen >= rank) return bounds[i];
+    }
+    return UINT32_MAX;
+  }
+
+  const uint32_t* const bounds;
+  const uint8_t bucketCount;
+  std::atomic<uint32_t> counts[METRICS_MAX_BUCKETS + 1]; // per bucket, last is +Inf
+  std::atomic<uint32_t> sum;
+};
+
+// RevoLock's metrics, exported with a revolock_ prefix
+namespace metric {
+  extern Counter boots;
+  extern Counter keypadKeys;
+  extern Counter passwordAccepted;
+  extern Counter passwordDenied;
+
+  extern Histogram toggleLocalMs;       // '#' contact to lock state changed
+  extern Histogram toggleAckMs;         // '#' contact to DoLynk acknowledging every alarm
+  extern Counter toggleUnacked;         // toggles DoLynk didn't acknowledge in time
+  extern Gauge toggleLocalP95Ms;        // bucket bound, -1 past the last bucket
+  extern Gauge toggleAckP95Ms;
+  extern Gauge toggleLocalSloBreached;
+  extern Gauge toggleAckSloBreached;
+
+  extern Histogram dolynkLatencyMs;     // per HTTP request, retries counted separately
+  extern Counter dolynkOk;
+  extern Counter dolynkHttpErrors;
+  extern Counter dolynkTransportErrors;
+  extern Counter dolynkRejected;        // HTTP 200 with an API error code
+  extern Counter dolynkRetries;
+  extern Counter dolynkCircuitOpen;     // operations skipped by the breaker
+  extern Counter tlsHandshakes;
+  extern Counter dnsHits;               // connections made to a cached address
+  extern Counter dnsMisses;
+  extern Counter dnsStale;              // cached addresses that didn't answer
+
+  extern Histogram requestArenaBytes;   // high-water mark of each request's arena
+  extern Counter requestArenaExhausted;
+  extern Counter stateNvsWrites;
+  extern Counter maintenanceOk;
+  extern Counter maintenanceFailed;     // runs that left jobs pending
+  extern Counter linkDone;              // leaf: changes the gateway got acknowledged
+  extern Counter linkRefused;
+  extern Counter linkUnreachable;       // leaf: gateway never took the change
+  extern Counter linkRelayed;           // gateway: leaf changes queued
+  extern Counter linkRejected;          // gateway: bad, stale or replayed frames
+  extern Histogram localApiUs;          // LAN API request accepted to reply written
+  extern Counter localApiRejected;      // bad or replayed signatures
+  extern Counter warmupUsed;            // warm-ups a correct '#' sent over
+  extern Counter warmupAbandoned;       // torn down after a wrong PIN or timeout
+  extern Counter warmupFailed;
+  extern Histogram wifiConnectMs;      // connect to associated
+  extern Counter wifiConnectsKnown;     // straight to the remembered access point
+  extern Counter wifiConnectsScanned;   // after a scan
+  extern Counter wifiScans;
+  extern Counter wifiRoams;             // moves to a stronger access point while awake
+  extern Counter cpuIdleMs;             // awake at the idle clock, radio off
+  extern Counter cpuRadioMs;            // radio up, waiting on the network
+  extern Counter cpuComputeMs;          // at full clock under a performance lock
+  extern Counter energyMj;              // estimated, while awake
+  extern Counter energyFixedClockMj;    // the same awake time at a fixed full clock
+
+  extern Gauge heapFree;
+  extern Gauge heapMinFree;
+  extern Gauge heapLargestBlock;        // falls below heapFree as the heap fragments
+  extern Gauge wifiRssi;
+  extern Gauge wifiApConnectMs;          // running averages of the access point in use
+  extern Gauge wifiApRequestMs;
+  extern Gauge stackFreeUi;             // bytes of each task's stack never used
+  extern Gauge stackFreeNet;
+  extern Gauge stackFreeNotify;
+}
+
+typedef void (*MetricsSink)(void* ctx, const char* data, size_t len);
+
+class Metrics {
+public:
+  /**
+   * Restore the counters saved before deep sleep, count the boot and start
+   * the HTTP endpoint if WiFi is up
+   */
+  static void begin();
+
+  /**
+   * Answer a pending scrape, if any. Call from the network task; returns
+   * immediately when nobody is connected. Starts the endpoint once WiFi
+   * comes up.
+   */
+  static void handle();
+
+  /**
+   * Stop the endpoint and save counters and histograms to RTC memory
+   */
+  static void end();
+
+  /**
+   * Refresh the sampled gauges (heap, RSSI, task stacks)
+   */
+  static void sample();
+
+  /**
+   * Recompute the toggle p95s and print a warning the first time in a boot
+   * that one is over its SLO. Histograms reset on power loss and when a new
+   * image starts, so a breach points at the running build.
+   */
+  static void checkSlos();
+
+  /**
+   * Write every metric in Prometheus text format, a line at a time
+   */
+  static void render(MetricsSink sink, void* ctx);
+};
+
+#endif // METRICS_H
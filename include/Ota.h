@@ -0,0 +1,37 @@
+#ifndef OTA_H
+#define OTA_H
+
+#include <Arduino.h>
+
+// Maintenance runs between update checks; each check is one small HTTP request
+#ifndef OTA_CHECK_INTERVAL
+#define OTA_CHECK_INTERVAL 4
+#endif
+
+// Give up when the server sends nothing for this long (milliseconds)
+#ifndef OTA_STALL_MS
+#define OTA_STALL_MS 10000
+#endif
+
+class Ota {
+public:
+  /**
+   * Every OTA_CHECK_INTERVAL calls, ask OTA_URL for a delta against the
+   * running image and, if there is one, stream it through the patcher into
+   * the inactive app partition. The delta header must carry a signature by
+   * OTA_PUBLIC_KEY, and the result is verified (source and target SHA-256
+   * from that header, then the app image itself) before it becomes the boot
+   * image. Does nothing unless OTA_URL is defined in setup.h.
+   * @return false if nothing was installed; after an install the board
+   *         restarts into the new image and this doesn't return
+   */
+  static bool update();
+
+  /**
+   * Mark the running image as good once setup() has completed. Until then
+   * a crash makes the bootloader roll back to the previous image.
+   */
+  static void confirmBoot();
+};
+
+#endif // OTA_H
@@ -0,0 +1,129 @@
+#ifndef REQUEST_ARENA_H
+#define REQUEST_ARENA_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+/*
+ * Bump allocator for everything one outbound request builds: URL, headers,
+ * signature, body, the response and its parsed JSON. Allocation moves a
+ * pointer, nothing is freed individually, and reset() drops it all at once.
+ * The buffer is allocated once, so requests never touch the heap for their
+ * own strings and can't fragment it however many are made.
+ *
+ * Not thread safe: give each task that makes requests its own arena.
+ */
+class RequestArena {
+public:
+  RequestArena(uint8_t* buffer, size_t size);
+
+  /**
+   * @return size bytes at the given alignment, or nullptr (and exhausted()
+   * becomes true) if the arena is full
+   */
+  void* alloc(size_t size, size_t align = sizeof(void*));
+
+  /**
+   * Free everything and record the request's high-water mark (metrics)
+   */
+  void reset();
+
+  // Free everything allocated after a mark, e.g. between retry attempts
+  size_t mark() const { return top; }
+  void rewind(size_t mark) { if (mark < top) top = mark; }
+
+  size_t used() const { return top; }
+  size_t capacity() const { return size; }
+  size_t highWater() const { return peak; }  // since the last reset()
+  bool exhausted() const { return failed; }
+
+private:
+  friend class ArenaString;
+  friend class ArenaJsonAllocator;
+
+  uint8_t* const base;
+  const size_t size;
+  size_t top;
+  size_t peak;
+  bool failed;
+
+  // Grow the allocation ending at the top by extra bytes, in place
+  bool extend(const void* end, size_t extra);
+};
+
+// Arena with its own storage, for statics and struct members
+template<size_t N>
+class StaticRequestArena : public RequestArena {
+public:
+  StaticRequestArena() : RequestArena(storage, N) {}
+private:
+  alignas(8) uint8_t storage[N];
+};
+
+// Frees the arena when the request goes out of scope
+class RequestScope {
+public:
+  explicit RequestScope(RequestArena& arena) : arena(arena) { arena.reset(); }
+  ~RequestScope() { arena.reset(); }
+private:
+  RequestArena& arena;
+};
+
+/*
+ * Append-only string in an arena. Grows in place while it is the newest
+ * allocation, otherwise moves to the top. If the arena runs out the string
+ * keeps what fitted and ok() turns false; send nothing built from it.
+ */
+class ArenaString {
+public:
+  explicit ArenaString(RequestArena& arena) : arena(arena), data(nullptr), len(0), failed(false) {}
+  ArenaString(const ArenaString&) = delete;
+  ArenaString& operator=(const ArenaString&) = delete;
+
+  ArenaString& add(const char* s, size_t n);
+  ArenaString& add(const char* s) { return add(s, strlen(s)); }
+  ArenaString& add(const ArenaString& s) { return add(s.c_str(), s.length()); }
+  ArenaString& add(char c) { return add(&c, 1); }
+  ArenaString& addNumber(uint64_t n);
+  ArenaString& addHex(const uint8_t* bytes, size_t n, bool upper = false);
+  ArenaString& addJson(const char* s); // escaped for use inside a JSON string
+
+  // Forget the contents (after the arena was rewound below them)
+  void clear() { data = nullptr; len = 0; failed = false; }
+
+  const char* c_str() const { return data ? data : ""; }
+  size_t length() const { return len; }
+  bool ok() const { return !failed; }
+
+private:
+  RequestArena& arena;
+  char* data;
+  size_t len;
+  bool failed;
+};
+
+// Collects an HTTP response body into an ArenaString (HTTPClient::writeToStream)
+class ArenaStream : public Stream {
+public:
+  explicit ArenaStream(ArenaString& out) : out(out) {}
+  size_t write(uint8_t c) override { out.add((char)c); return out.ok() ? 1 : 0; }
+  size_t write(const uint8_t* buf, size_t n) override { out.add((const char*)buf, n); return out.ok() ? n : 0; }
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+private:
+  ArenaString& out;
+};
+
+// Lets a JsonDocument keep its pools and strings in the arena
+class ArenaJsonAllocator : public ArduinoJson::Allocator {
+public:
+  explicit ArenaJsonAllocator(RequestArena& arena) : arena(arena) {}
+  void* allocate(size_t size) override;
+  void deallocate(void*) override {}  // freed with the arena
+  void* reallocate(void* ptr, size_t newSize) override;
+private:
+  RequestArena& arena;
+};
+
+#endif // REQUEST_ARENA_H
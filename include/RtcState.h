@@ -0,0 +1,90 @@
+#ifndef RTC_STATE_H
+#define RTC_STATE_H
+
+#include <Arduino.h>
+#include "Dolynk.h"
+#include "DnsCache.h"
+#include "WifiStatus.h"
+#include "LocalApi.h"
+
+// Bump whenever DurableState or CachedState changes layout; an RTC block from
+// another version is ignored and rebuilt from NVS.
+#define RTC_STATE_VERSION 7
+
+// Bump whenever DurableState changes layout. An NVS record from another
+// version is ignored, so the firmware starts from defaults (unlocked).
+#define DURABLE_STATE_VERSION 1
+
+// Mirrored to NVS, so it survives power loss, brownouts and restarts. Every
+// change costs a flash write, so only keep things here that rarely change.
+struct DurableState {
+  bool locked;
+  uint8_t ackedStatus[DOLYNK_MAX_DEVICES][DOLYNK_ABILITY_COUNT]; // last status DoLynk acknowledged
+};
+
+// RTC memory only. Losing it costs some repeated work after a power cut.
+struct CachedState {
+  uint16_t syncsSinceVerify;     // DoLynk drift check
+  uint16_t otaCheckCountdown;    // maintenance runs until the next update check
+  uint8_t breakerState;          // DoLynk circuit breaker
+  uint8_t consecutiveFailures;
+  uint64_t breakerOpenedAt;      // ms on the RTC clock
+  char accessToken[96];          // DoLynk app access token, "" if none
+  uint32_t tokenExpiresAt;       // s on the RTC clock
+  uint8_t pendingJobs;           // MaintenanceJob bits waiting for a maintenance wake
+  uint8_t failedRuns;            // consecutive maintenance runs that left jobs pending
+  bool lastRunOk;
+  uint32_t nextPeriodicAt;       // s on the RTC clock
+  DnsCacheEntry dnsCache[DNS_CACHE_SIZE];
+  uint16_t dnsLookupMs;          // average time a real lookup takes
+  uint32_t linkSeq;              // leaf: last change sent to the gateway
+  uint32_t linkEpoch;            // leaf: gateway boot it was sent to
+  uint8_t keyChatter[16];        // keypad bounce scores by key code, so worn keys stay adapted
+  WifiApEntry wifiAps[WIFI_AP_HISTORY]; // access points used, with their statistics
+  uint8_t wifiPreferred;         // index + 1 into wifiAps of the one to connect to first, 0: scan
+  LocalApiReplayGuard apiReplay;
+};
+
+enum RtcStateSource { STATE_FROM_RTC, STATE_FROM_NVS, STATE_DEFAULTS };
+
+/*
+ * The state that survives deep sleep: one checksummed block in RTC memory.
+ * All fields default to zero. Modules read and write the fields directly;
+ * the checksum is only sealed when the block is handed over (flush, sleep).
+ * Fields written by more than one task (the lock state, pendingJobs, the
+ * DNS cache) are written between lock() and unlock(), which flush() also
+ * takes.
+ */
+class RtcState {
+public:
+  /**
+   * Validate the RTC block, or rebuild it from NVS (durable part) and
+   * defaults. Call before anything reads the state.
+   * @return where the state came from
+   */
+  static RtcStateSource begin();
+
+  static DurableState& durable();
+  static CachedState& cached();
+
+  /**
+   * Short critical section for a write to a field shared between tasks.
+   * Never hold it across anything that waits.
+   */
+  static void lock();
+  static void unlock();
+
+  /**
+   * Write the durable fields to NVS if they differ from what is stored there,
+   * and seal the RTC block. Cheap when nothing changed, so call it whenever
+   * something important changed; unflushed changes are written at end().
+   */
+  static void flush();
+
+  /**
+   * Flush before deep sleep
+   */
+  static void end();
+};
+
+#endif // RTC_STATE_H
@@ -0,0 +1,44 @@
+#ifndef SHA512_H
+#define SHA512_H
+
+#include <Arduino.h>
+
+// Longest HMAC message hashed in one pass on the SHA engine; longer ones
+// are streamed through mbedtls. DoLynk's signing string is about 300 bytes.
+#ifndef SHA512_HMAC_INLINE_MAX
+#define SHA512_HMAC_INLINE_MAX 512
+#endif
+
+#define SHA512_BLOCK_SIZE 128
+#define SHA512_DIGEST_SIZE 64
+
+/*
+ * SHA-512 and HMAC-SHA512 for request signing. On the ESP32 each digest is
+ * one pass over the SHA engine, which waits for the engine if another task
+ * is using it. The host build and other targets use mbedtls in software.
+ */
+class Sha512 {
+public:
+  /**
+   * @return whether digests run on the SHA engine
+   */
+  static bool hardware();
+
+  static void hash(const void* data, size_t len, uint8_t out[SHA512_DIGEST_SIZE]);
+
+  /**
+   * HMAC-SHA512 over the concatenation of parts, without building it
+   */
+  static void hmac(const char* key, size_t keyLen, const char* const* parts, const size_t* lengths, int count,
+                   uint8_t out[SHA512_DIGEST_SIZE]);
+
+  /**
+   * The same through mbedtls' streaming API, as before the engine was used
+   * directly. For comparison in benchmarks.
+   */
+  static void hashMbedtls(const void* data, size_t len, uint8_t out[SHA512_DIGEST_SIZE]);
+  static void hmacMbedtls(const char* key, size_t keyLen, const char* const* parts, const size_t* lengths,
+                          int count, uint8_t out[SHA512_DIGEST_SIZE]);
+};
+
+#endif // SHA512_H
@@ -0,0 +1,129 @@
+#ifndef TASKS_H
+#define TASKS_H
+
+#include <Arduino.h>
+
+// The ESP32 runs WiFi and lwIP on the protocol core (0); the application
+// core (1) is left to the keypad and LEDs
+#ifndef UI_TASK_CORE
+#define UI_TASK_CORE 1
+#endif
+#ifndef NET_TASK_CORE
+#define NET_TASK_CORE 0
+#endif
+
+// The UI task preempts everything else of ours; the notification task only
+// runs when the network task waits
+#ifndef UI_TASK_PRIORITY
+#define UI_TASK_PRIORITY 3
+#endif
+#ifndef NET_TASK_PRIORITY
+#define NET_TASK_PRIORITY 2
+#endif
+#ifndef NOTIFY_TASK_PRIORITY
+#define NOTIFY_TASK_PRIORITY 1
+#endif
+
+// Stack sizes (bytes). The high-water marks printed before each sleep and
+// exported as metrics show how much of each is left.
+#ifndef UI_TASK_STACK
+#define UI_TASK_STACK 8192 // as the Arduino loop task had; NVS writes before sleep
+#endif
+#ifndef NET_TASK_STACK
+#define NET_TASK_STACK 12288 // TLS handshakes; maintenance and OTA on a gateway
+#endif
+#ifndef NOTIFY_TASK_STACK
+#define NOTIFY_TASK_STACK 8192
+#endif
+
+// Messages each queue holds; posting never blocks the UI
+#define UI_QUEUE_DEPTH 4
+#define NET_QUEUE_DEPTH 8
+#define NOTIFY_QUEUE_DEPTH 4
+
+// Longest the network task waits for a message before serving the local
+// API and metrics endpoints again
+#define NET_POLL_MS 1
+
+enum UiCommand : uint8_t {
+  UI_LOCK,    // lock command from the local API
+  UI_SYNCED,  // the network task finished a sync the UI asked for
+};
+
+// Messages to the UI task, which owns the lock state and the LEDs
+struct UiMessage {
+  UiCommand command;
+  bool locked;
+  unsigned long requestedAt; // millis()
+};
+
+enum NetCommand : uint8_t {
+  NET_WARMUP,   // first PIN digit: get the link ready
+  NET_ABANDON,  // wrong PIN or entry timeout: close it again
+  NET_SYNC,     // send the lock state to DoLynk
+  NET_SLEEP,    // close everything; the last message (Tasks::end())
+};
+
+struct NetMessage {
+  NetCommand command;
+  bool local;                // NET_SYNC: the change came from the local API
+  unsigned long requestedAt; // NET_SYNC: '#' press or API command, millis()
+};
+
+// Lock state emails
+struct Notification {
+  bool locked;
+};
+
+// What each task runs, called on that task
+struct TaskHandlers {
+  void (*ui)();                             // one pass of the keypad loop; it must yield
+  void (*network)(const NetMessage& msg);
+  void (*networkIdle)();                    // after each message, and at least every NET_POLL_MS
+  void (*notify)(const Notification& note);
+};
+
+/*
+ * The firmware's tasks. A UI task on the application core scans the keypad
+ * and drives the lock state, so key handling never waits on the network.
+ * The network task (DoLynk, warm-up, local API, metrics) and the
+ * notification task (email) run on the protocol core. They only talk
+ * through the bounded queues below.
+ */
+class Tasks {
+public:
+  /**
+   * Create the queues and start the tasks. Call at the end of setup(); the
+   * Arduino loop task isn't needed after that.
+   * @return false if a task or queue couldn't be created
+   */
+  static bool begin(const TaskHandlers& handlers);
+
+  /**
+   * Queue a message for the UI, network or notification task. Never blocks.
+   * @return false if that queue is full
+   */
+  static bool post(const UiMessage& msg);
+  static bool post(const NetMessage& msg);
+  static bool post(const Notification& note);
+
+  /**
+   * UI task: take the next lock command, if any
+   */
+  static bool receive(UiMessage& msg);
+
+  /**
+   * Refresh the stack high-water mark gauges. Called when metrics are
+   * sampled.
+   */
+  static void sample();
+
+  /**
+   * UI task: send NET_SLEEP, wait for the network and notification tasks to
+   * finish their queues and stop, then print every task's stack high-water
+   * mark. Call before sleeping.
+   */
+  static void end();
+};
+
+#endif // TASKS_H
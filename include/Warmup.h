@@ -0,0 +1,35 @@
+#ifndef WARMUP_H
+#define WARMUP_H
+
+#include <Arduino.h>
+
+/*
+ * Speculative network warm-up. The first digit of a PIN has the network
+ * task do what the '#' would otherwise wait for: WiFi association, NTP time
+ * for the signatures, DNS, a valid DoLynk token and an open TLS connection
+ * (leaf: the ESP-NOW radio). A correct '#' then only signs and sends.
+ * Warm-ups that aren't used are torn down and counted. All calls come from
+ * the network task, so a sync queued behind a warm-up finds it done.
+ */
+class Warmup {
+public:
+  /**
+   * Get the link ready, unless it already is. Does nothing on a gateway,
+   * which stays online.
+   */
+  static void start();
+
+  /**
+   * Hand what the warm-up prepared to the lock change about to be sent
+   * @return true if the link was warmed up; false if it failed or none ran
+   */
+  static bool finish();
+
+  /**
+   * The PIN was wrong or timed out: close what the warm-up opened (the
+   * radio too, if it was off)
+   */
+  static void abandon();
+};
+
+#endif // WARMUP_H
@@ -6,31 +6,109 @@
 // Status update interval (milliseconds) - throttle requests to avoid overloading the cloud
 #define STATUS_UPDATE_INTERVAL 30000 // 30 seconds
 
+#ifndef NTP_SERVER
+#define NTP_SERVER "pool.ntp.org"
+#endif
+
+// Networks to join, in priority order: { "ssid", "password" }, ...
+#ifndef WIFI_NETWORKS
+#define WIFI_NETWORKS { { WIFI_SSID, WIFI_PASSWORD } }
+#endif
+
+// Signal (dBm) below which an access point counts as weak: a lower-priority
+// network with a stronger one wins, and while awake the device looks for a
+// better access point
+#ifndef WIFI_ROAM_RSSI
+#define WIFI_ROAM_RSSI -72
+#endif
+
+// How much stronger (dB) another access point must be to move to it
+#ifndef WIFI_ROAM_MARGIN_DB
+#define WIFI_ROAM_MARGIN_DB 8
+#endif
+
+// While connected: how often the signal is checked, and the least time
+// between two roaming scans (ms)
+#ifndef WIFI_ROAM_CHECK_MS
+#define WIFI_ROAM_CHECK_MS 5000
+#endif
+#ifndef WIFI_ROAM_SCAN_MS
+#define WIFI_ROAM_SCAN_MS 60000
+#endif
+
+// How long a connect straight to the remembered access point may take
+// before the device scans instead (ms)
+#ifndef WIFI_KNOWN_AP_TIMEOUT
+#define WIFI_KNOWN_AP_TIMEOUT 3000
+#endif
+
+#define WIFI_SCAN_MS_PER_CHANNEL 80 // active scan dwell; ~1 s for every channel
+#define WIFI_AP_HISTORY 4           // access points whose statistics are kept
+#define WIFI_AP_MAX_FAILURES 2      // failed connects in a row before an access point is passed over
+
+// One access point the device has used, kept in the RTC state block
+struct WifiApEntry {
+  uint8_t bssid[6];
+  uint8_t network;    // index into WIFI_NETWORKS
+  uint8_t channel;    // 0: free slot
+  int8_t rssi;        // last measured
+  uint8_t failures;   // connects in a row that didn't associate
+  uint16_t connects;
+  uint16_t connectMs; // running average, connect to associated
+  uint16_t requests;
+  uint16_t requestMs; // running average of the DoLynk requests made over it
+};
+
 class WifiStatus {
 public:
   /**
-   * Initialize WiFi connection
+   * Connect: straight to the access point that served last time if it is
+   * still good, otherwise to the best one a scan finds
    * @return true if successfully connected, false otherwise
    */
   static bool initWiFi();
-  
-  
+
+  /**
+   * Connect if needed and make sure the clock has been set by NTP (request
+   * signatures need it). Both waits are bounded by WIFI_TIMEOUT.
+   * @return true if online with a valid clock
+   */
+  static bool ensureOnline();
+
+  /**
+   * Roaming: while connected, check the signal and, when it is weak, scan in
+   * the background and move to a clearly stronger access point. Call from
+   * the network task between requests; returns at once otherwise.
+   */
+  static void handle();
+
+  /**
+   * Count a DoLynk request's latency against the access point in use. Any task.
+   */
+  static void noteRequest(uint32_t ms);
+
   /**
    * Check if cloud/WiFi connection is active
    * @return true if connected, false otherwise
    */
   static bool isWifiConnected();
-  
+
   /**
    * Get WiFi signal strength in dBm
    * @return RSSI value (negative value, closer to 0 is stronger)
    */
   static int getSignalStrength();
-  
+
   /**
    * Disconnect from WiFi
    */
   static void disconnect();
+
+  /**
+   * Keep this boot's request latencies with the access point in use. Call
+   * before sleeping, once the network task has stopped.
+   */
+  static void end();
 };
 
 #endif // WIFI_STATUS_H
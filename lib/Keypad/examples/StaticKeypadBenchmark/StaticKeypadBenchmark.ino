@@ -0,0 +1,74 @@
+/* @file StaticKeypadBenchmark.ino
+|| @version 1.0
+||
+|| @description
+|| | Compares scan time of the runtime Keypad class against the
+|| | compile-time StaticKeypad for the same 4x4 matrix.
+|| |
+|| | For code size, set BENCH_CLASS to 1 (Keypad only) and then to 2
+|| | (StaticKeypad only), build each, and compare the flash usage the
+|| | build reports (e.g. `pio run -t size`). 0 builds both for timing.
+|| #
+*/
+#include <Keypad.h>
+#include <StaticKeypad.h>
+
+#define BENCH_CLASS 0	// 0 = both, 1 = Keypad only, 2 = StaticKeypad only
+#define SCANS 2000
+
+const byte ROWS = 4;
+const byte COLS = 4;
+constexpr char keys[ROWS][COLS] = {
+	{'1','2','3','A'},
+	{'4','5','6','B'},
+	{'7','8','9','C'},
+	{'*','0','#','D'}
+};
+
+#if BENCH_CLASS != 2
+byte rowPins[ROWS] = {16, 17, 18, 13};
+byte colPins[COLS] = {26, 25, 33, 32};
+Keypad kpd = Keypad( makeKeymap(keys), rowPins, colPins, ROWS, COLS );
+#endif
+
+#if BENCH_CLASS != 1
+StaticKeypad<ROWS, COLS, keys, 16, 17, 18, 13, 26, 25, 33, 32> skpd;
+#endif
+
+// Time getKeys() calls that actually scan: each call is spaced past the
+// 1 mS default scan interval so the library never skips the scan.
+template<class K>
+void bench(const char *name, K &k) {
+	k.setDebounceTime(1);
+	unsigned long total = 0;
+	unsigned long worst = 0;
+	for (int i = 0; i < SCANS; i++) {
+		delay(2);
+		unsigned long t = micros();
+		k.getKeys();
+		t = micros() - t;
+		total += t;
+		if (t > worst) worst = t;
+	}
+	Serial.print(name);
+	Serial.print(": mean ");
+	Serial.print((float)total / SCANS, 2);
+	Serial.print(" uS, worst ");
+	Serial.print(worst);
+	Serial.println(" uS per scan");
+}
+
+void setup(){
+	Serial.begin(115200);
+}
+
+void loop(){
+#if BENCH_CLASS != 2
+	bench("Keypad      ", kpd);
+#endif
+#if BENCH_CLASS != 1
+	bench("StaticKeypad", skpd);
+#endif
+	Serial.println();
+	delay(1000);
+}
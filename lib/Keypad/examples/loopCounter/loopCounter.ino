@@ -20,9 +20,10 @@ unsigned long timer_t = 0;
 void setup(){
 	Serial.begin(9600);
 	
-	// Try playing with different debounceTime settings to see how it affects
-	// the number of times per second your loop will run. The library prevents
-	// setting it to anything below 1 millisecond.
+	// Try playing with different scan intervals to see how they affect the
+	// number of times per second your loop will run. Keys are debounced over
+	// a number of scans, so debounceTime is kept in step by the library.
+	kpd.setScanInterval(1000);	// setScanInterval(uS)
 	kpd.setDebounceTime(10);	// setDebounceTime(mS)
 }
 
@@ -31,7 +32,7 @@ void loop(){
 	
 	// Report the number of times through the loop in 1 second. This will give
 	// you a relative idea of just how much the debounceTime has changed the
-	// speed of your code. If you set a high debounceTime your loopCount will
+	// speed of your code. If you set a long scan interval your loopCount will
 	// look good but your keypresses will start to feel sluggish.
 	if ((millis() - timer_t) > 1000) {
 		Serial.print("Your loop code ran ");
@@ -0,0 +1,88 @@
+/*
+||
+|| @file KeyDebouncer.h
+|| @version 1.0
+||
+|| @description
+|| | Per-key integrating debouncer shared by Keypad and StaticKeypad.
+|| | Every scan feeds one raw sample per key into a counter that moves
+|| | towards the raw level and back; the debounced level only flips once
+|| | the counter reaches the key's window. A clean key therefore changes
+|| | state a few samples after its contact does, while a bouncing one has
+|| | to settle first.
+|| |
+|| | Each key keeps a chatter score: a running average of how many samples
+|| | went the wrong way during its recent transitions. Its window grows by
+|| | that many samples, so a worn key that bounces on every press gets the
+|| | window it needs within a few presses, and clean transitions shrink it
+|| | again. Sketches that sleep can keep the scores across wakes with
+|| | chatterScore()/setChatterScore().
+|| #
+||
+|| @license
+|| | This library is free software; you can redistribute it and/or
+|| | modify it under the terms of the GNU Lesser General Public
+|| | License as published by the Free Software Foundation; version
+|| | 2.1 of the License.
+|| |
+|| | This library is distributed in the hope that it will be useful,
+|| | but WITHOUT ANY WARRANTY; without even the implied warranty of
+|| | MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+|| | Lesser General Public License for more details.
+|| |
+|| | You should have received a copy of the GNU Lesser General Public
+|| | License along with this library; if not, write to the Free Software
+|| | Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+|| #
+||
+*/
+
+#ifndef KEY_DEBOUNCER_H
+#define KEY_DEBOUNCER_H
+
+#include <Arduino.h>
+
+#define DEBOUNCE_WINDOW_MAX 63	// samples; the counter is 6 bits wide
+#define CHATTER_PER_SAMPLE 16	// score per sample of extra window
+
+struct KeyIntegrator {
+	uint8_t count : 6;		// samples towards the other level
+	uint8_t level : 1;		// debounced state, 1 = pressed
+	uint8_t reversals;		// samples that went back during this transition
+	uint8_t chatter;		// bounce score, 0..255
+};
+
+// Samples a key needs before its debounced level flips.
+inline byte debounceWindow(const KeyIntegrator &k, byte baseWindow) {
+	uint16_t window = baseWindow + k.chatter / CHATTER_PER_SAMPLE;
+	return window > DEBOUNCE_WINDOW_MAX ? DEBOUNCE_WINDOW_MAX : window;
+}
+
+// Feed one raw sample (true = closed). Returns true if the debounced level
+// changed. Glitches that die out before the window count as reversals of
+// the key's next transition.
+inline bool integrate(KeyIntegrator &k, bool raw, byte baseWindow) {
+	if (raw == (bool)k.level) {
+		if (k.count) {
+			k.count--;
+			if (k.reversals < 255) k.reversals++;
+		}
+		return false;
+	}
+	if (++k.count < debounceWindow(k, baseWindow)) return false;
+
+	k.level = raw;
+	k.count = 0;
+	uint16_t target = k.reversals * CHATTER_PER_SAMPLE;
+	k.chatter = (k.chatter * 3 + (target > 255 ? 255 : target)) / 4;
+	k.reversals = 0;
+	return true;
+}
+
+#endif
+
+/*
+|| @changelog
+|| | 1.0 2026-10-19 - RevoLock : Initial Release
+|| #
+*/
@@ -40,7 +40,9 @@ Keypad::Keypad(char *userKeymap, byte *row, byte *col, byte numRows, byte numCol
 
 	begin(userKeymap);
 
-	setDebounceTime(10);
+	memset(integrator, 0, sizeof(integrator));
+	scanInterval = KEYPAD_SCAN_US;
+	setDebounceTime(KEYPAD_DEBOUNCE_MS);
 	setHoldTime(500);
 	keypadEventListener = 0;
 
@@ -69,11 +71,12 @@ char Keypad::getKey() {
 bool Keypad::getKeys() {
 	bool keyActivity = false;
 
-	// Limit how often the keypad is scanned. This makes the loop() run 10 times as fast.
-	if ( (millis()-startTime)>debounceTime ) {
+	// One scan is one debounce sample, so scan at a steady rate however
+	// fast the loop() runs.
+	if ( (micros()-startTime)>=scanInterval ) {
 		scanKeys();
 		keyActivity = updateList();
-		startTime = millis();
+		startTime = micros();
 	}
 
 	return keyActivity;
@@ -116,9 +119,11 @@ bool Keypad::updateList() {
 	// Add new keys to empty slots in the key list.
 	for (byte r=0; r<sizeKpd.rows; r++) {
 		for (byte c=0; c<sizeKpd.columns; c++) {
-			boolean button = bitRead(bitMap[r],c);
-			char keyChar = keymap[r * sizeKpd.columns + c];
 			int keyCode = r * sizeKpd.columns + c;
+			char keyChar = keymap[keyCode];
+			// The list only ever sees debounced levels.
+			integrate(integrator[keyCode], bitRead(bitMap[r],c), debounceSamples);
+			boolean button = integrator[keyCode].level;
 			int idx = findInList (keyCode);
 			// Key is already on the list so set its next state.
 			if (idx > -1)	{
@@ -231,9 +236,35 @@ byte Keypad::numKeys() {
 	return sizeof(key)/sizeof(Key);
 }
 
-// Minimum debounceTime is 1 mS. Any lower *will* slow down the loop().
+// How long (mS) a clean key must hold a new level before it counts.
+// Chattering keys get longer, see KeyDebouncer.h.
 void Keypad::setDebounceTime(uint debounce) {
-	debounce<1 ? debounceTime=1 : debounceTime=debounce;
+	debounceTime = debounce;
+	updateDebounceSamples();
+}
+
+// Time between scans in uS. Each scan is one debounce sample.
+void Keypad::setScanInterval(uint interval) {
+	interval<1 ? scanInterval=1 : scanInterval=interval;
+	updateDebounceSamples();
+}
+
+void Keypad::updateDebounceSamples() {
+	uint samples = (debounceTime * 1000UL + scanInterval - 1) / scanInterval;
+	debounceSamples = samples<1 ? 1 : (samples>DEBOUNCE_WINDOW_MAX ? DEBOUNCE_WINDOW_MAX : samples);
+}
+
+// Scans the key currently needs to change state, chatter included.
+byte Keypad::debounceWindow(int keyCode) {
+	return ::debounceWindow(integrator[keyCode], debounceSamples);
+}
+
+uint8_t Keypad::chatterScore(int keyCode) {
+	return integrator[keyCode].chatter;
+}
+
+void Keypad::setChatterScore(int keyCode, uint8_t score) {
+	integrator[keyCode].chatter = score;
 }
 
 void Keypad::setHoldTime(uint hold) {
@@ -266,6 +297,8 @@ void Keypad::transitionTo(byte idx, KeyState nextState) {
 
 /*
 || @changelog
+|| | 3.3 2026-10-19 - RevoLock         : Replaced scan throttling with a per-key integrating debouncer.
+|| | 3.2 2026-10-19 - RevoLock         : Made scanKeys() virtual and protected for port-wide expander backends.
 || | 3.1 2013-01-15 - Mark Stanley     : Fixed missing RELEASED & IDLE status when using a single key.
 || | 3.0 2012-07-12 - Mark Stanley     : Made library multi-keypress by default. (Backwards compatible)
 || | 3.0 2012-07-12 - Mark Stanley     : Modified pin functions to support Keypad_I2C
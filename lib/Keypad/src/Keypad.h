@@ -34,6 +34,7 @@
 #define KEYPAD_H
 
 #include "Key.h"
+#include "KeyDebouncer.h"
 
 // bperrybap - Thanks for a well reasoned argument and the following macro(s).
 // See http://arduino.cc/forum/index.php/topic,142041.msg1069480.html#msg1069480
@@ -68,6 +69,8 @@ typedef struct {
 
 #define LIST_MAX 10		// Max number of keys on the active list.
 #define MAPSIZE 10		// MAPSIZE is the number of rows (times 16 columns)
+#define KEYPAD_SCAN_US 1000	// Default time between scans (one debounce sample)
+#define KEYPAD_DEBOUNCE_MS 4	// Default time a clean key must hold a level
 #define makeKeymap(x) ((char*)x)
 
 
@@ -81,7 +84,7 @@ public:
 	virtual void pin_write(byte pinNum, boolean level) { digitalWrite(pinNum, level); }
 	virtual int  pin_read(byte pinNum) { return digitalRead(pinNum); }
 
-	uint bitMap[MAPSIZE];	// 10 row x 16 column array of bits. Except Due which has 32 columns.
+	uint bitMap[MAPSIZE];	// 10 row x 16 column array of bits, raw. Except Due which has 32 columns.
 	Key key[LIST_MAX];
 	unsigned long holdTimer;
 
@@ -91,6 +94,10 @@ public:
 	void begin(char *userKeymap);
 	bool isPressed(char keyChar);
 	void setDebounceTime(uint);
+	void setScanInterval(uint);
+	byte debounceWindow(int keyCode);
+	uint8_t chatterScore(int keyCode);
+	void setChatterScore(int keyCode, uint8_t score);
 	void setHoldTime(uint);
 	void addEventListener(void (*listener)(char));
 	int findInList(char keyChar);
@@ -99,18 +106,27 @@ public:
 	bool keyStateChanged();
 	byte numKeys();
 
-private:
-	unsigned long startTime;
-	char *keymap;
+protected:
     byte *rowPins;
     byte *columnPins;
 	KeypadSize sizeKpd;
+
+	// Fills bitMap. Backends that can read a whole port at once (I2C
+	// expanders) override this instead of the per-pin functions.
+	virtual void scanKeys();
+
+private:
+	unsigned long startTime;
+	char *keymap;
 	uint debounceTime;
+	uint scanInterval;		// microseconds
+	byte debounceSamples;	// base window, debounceTime in scans
+	KeyIntegrator integrator[MAPSIZE * 16];	// by key code
 	uint holdTime;
 	bool single_key;
 
-	void scanKeys();
 	bool updateList();
+	void updateDebounceSamples();
 	void nextKeyState(byte n, boolean button);
 	void transitionTo(byte n, KeyState nextState);
 	void (*keypadEventListener)(char);
@@ -120,6 +136,8 @@ private:
 
 /*
 || @changelog
+|| | 3.3 2026-10-19 - RevoLock         : Replaced scan throttling with a per-key integrating debouncer.
+|| | 3.2 2026-10-19 - RevoLock         : Made scanKeys() virtual and protected for port-wide expander backends.
 || | 3.1 2013-01-15 - Mark Stanley     : Fixed missing RELEASED & IDLE status when using a single key.
 || | 3.0 2012-07-12 - Mark Stanley     : Made library multi-keypress by default. (Backwards compatible)
 || | 3.0 2012-07-12 - Mark Stanley     : Modified pin functions to support Keypad_I2C
@@ -0,0 +1,329 @@
+/*
+||
+|| @file StaticKeypad.h
+|| @version 1.0
+||
+|| @description
+|| | Compile-time specialised variant of Keypad for matrices whose size,
+|| | keymap and pins are known when the sketch is built. Geometry, keymap
+|| | and pins are template parameters, so the scan loops unroll into
+|| | straight-line pin accesses, key characters are read straight from the
+|| | keymap's fixed address, the key bitmap is a single integer just wide
+|| | enough for Rows * Cols keys, and key lookups go through tables indexed
+|| | by the key code instead of searching the active list.
+|| |
+|| | The public interface and key state machine match Keypad, so it can
+|| | replace it in sketches that only use getKey()/getKeys().
+|| |
+|| |   constexpr char keys[4][4] = { ... };
+|| |   StaticKeypad<4, 4, keys,  16,17,18,13,  26,25,33,32> keypad;
+|| |                             \__ rows __/  \__ cols __/
+|| #
+||
+|| @license
+|| | This library is free software; you can redistribute it and/or
+|| | modify it under the terms of the GNU Lesser General Public
+|| | License as published by the Free Software Foundation; version
+|| | 2.1 of the License.
+|| |
+|| | This library is distributed in the hope that it will be useful,
+|| | but WITHOUT ANY WARRANTY; without even the implied warranty of
+|| | MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+|| | Lesser General Public License for more details.
+|| |
+|| | You should have received a copy of the GNU Lesser General Public
+|| | License along with this library; if not, write to the Free Software
+|| | Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+|| #
+||
+*/
+
+#ifndef STATIC_KEYPAD_H
+#define STATIC_KEYPAD_H
+
+#include "Keypad.h"
+
+namespace keypad_detail {
+
+	// Compile-time index, used to unroll loops through overload resolution.
+	template<byte N> struct Index {};
+
+	// The I-th entry of a pin pack.
+	template<byte I, byte First, byte... Rest> struct PinAt {
+		static const byte value = PinAt<I - 1, Rest...>::value;
+	};
+	template<byte First, byte... Rest> struct PinAt<0, First, Rest...> {
+		static const byte value = First;
+	};
+
+	template<bool Cond, class T, class F> struct Select { typedef T type; };
+	template<class T, class F> struct Select<false, T, F> { typedef F type; };
+
+	// Smallest unsigned integer holding one bit per key.
+	template<byte Keys> struct KeyBits {
+		typedef typename Select<(Keys <= 8), uint8_t,
+				typename Select<(Keys <= 16), uint16_t,
+				typename Select<(Keys <= 32), uint32_t, uint64_t>::type>::type>::type type;
+	};
+
+	inline byte lowestBit(uint32_t bits) { return __builtin_ctz(bits); }
+	inline byte lowestBit(uint64_t bits) { return __builtin_ctzll(bits); }
+}
+
+template<byte Rows, byte Cols, const char (&Keymap)[Rows][Cols], byte... Pins>
+class StaticKeypad {
+public:
+	static_assert(sizeof...(Pins) == Rows + Cols, "StaticKeypad needs Rows row pins followed by Cols column pins");
+	static_assert(Rows * Cols <= 64, "StaticKeypad supports at most 64 keys");
+
+	static const byte KEYS = Rows * Cols;
+	typedef typename keypad_detail::KeyBits<KEYS>::type bitmap_t;
+
+	StaticKeypad() {
+		for (byte i=0; i<KEYS; i++) slotOf[i] = -1;
+		bitMap = 0;
+		listed = 0;
+		settling = 0;
+		memset(integrator, 0, sizeof(integrator));
+		memset(contactAt, 0, sizeof(contactAt));
+		scanInterval = KEYPAD_SCAN_US;
+		setDebounceTime(KEYPAD_DEBOUNCE_MS);
+		setHoldTime(500);
+		keypadEventListener = 0;
+		startTime = 0;
+		single_key = false;
+	}
+
+	bitmap_t bitMap;		// One bit per key, bit (r * Cols + c), raw.
+	Key key[LIST_MAX];
+	unsigned long holdTimer;
+
+	// Returns a single key only. Same semantics as Keypad::getKey().
+	char getKey() {
+		single_key = true;
+
+		if (getKeys() && key[0].stateChanged && (key[0].kstate==PRESSED))
+			return key[0].kchar;
+
+		single_key = false;
+
+		return NO_KEY;
+	}
+
+	// Populate the key list.
+	bool getKeys() {
+		bool keyActivity = false;
+
+		if ( (micros()-startTime)>=scanInterval ) {
+			scanKeys();
+			keyActivity = updateList();
+			startTime = micros();
+		}
+
+		return keyActivity;
+	}
+
+	// When (mS) the key getKey() last returned first made contact, before
+	// the debounce window and scan interval. 0 if no key was returned.
+	unsigned long pressedAt() {
+		return key[0].kcode >= 0 ? contactAt[key[0].kcode] : 0;
+	}
+
+	KeyState getState() { return key[0].kstate; }
+	bool keyStateChanged() { return key[0].stateChanged; }
+	byte numKeys() { return sizeof(key)/sizeof(Key); }
+
+	bool isPressed(char keyChar) {
+		for (byte i=0; i<LIST_MAX; i++) {
+			if ( key[i].kchar == keyChar ) {
+				if ( (key[i].kstate == PRESSED) && key[i].stateChanged )
+					return true;
+			}
+		}
+		return false;
+	}
+
+	int findInList(char keyChar) {
+		for (byte i=0; i<LIST_MAX; i++) {
+			if (key[i].kchar == keyChar) return i;
+		}
+		return -1;
+	}
+
+	// Table lookup instead of a list search.
+	int findInList(int keyCode) {
+		return (keyCode >= 0 && keyCode < KEYS) ? slotOf[keyCode] : -1;
+	}
+
+	char waitForKey() {
+		char waitKey = NO_KEY;
+		while( (waitKey = getKey()) == NO_KEY );
+		return waitKey;
+	}
+
+	// How long (mS) a clean key must hold a new level, and the time between
+	// scans (uS). Same meaning as in Keypad.
+	void setDebounceTime(uint debounce) { debounceTime = debounce; updateDebounceSamples(); }
+	void setScanInterval(uint interval) { interval<1 ? scanInterval=1 : scanInterval=interval; updateDebounceSamples(); }
+	byte debounceWindow(int keyCode) { return ::debounceWindow(integrator[keyCode], debounceSamples); }
+	uint8_t chatterScore(int keyCode) { return integrator[keyCode].chatter; }
+	void setChatterScore(int keyCode, uint8_t score) { integrator[keyCode].chatter = score; }
+	void setHoldTime(uint hold) { holdTime = hold; }
+	void addEventListener(void (*listener)(char)) { keypadEventListener = listener; }
+
+	// Hardware scan, fully unrolled: one pin access per row/column operation.
+	void scanKeys() {
+		bitmap_t bits = 0;
+		releaseRows(keypad_detail::Index<Rows>());
+		scanCols(bits, keypad_detail::Index<Cols>());
+		bitMap = bits;
+	}
+
+private:
+	int8_t slotOf[KEYS];	// Key code -> slot in key[], or -1.
+	bitmap_t listed;		// Key codes currently occupying a slot.
+	bitmap_t settling;		// Keys debounced as pressed or still integrating.
+	KeyIntegrator integrator[KEYS];
+	unsigned long contactAt[KEYS];	// millis() of the first closed sample of the last press
+	unsigned long startTime;
+	uint debounceTime;
+	uint scanInterval;
+	byte debounceSamples;
+	uint holdTime;
+	bool single_key;
+	void (*keypadEventListener)(char);
+
+	void updateDebounceSamples() {
+		uint samples = (debounceTime * 1000UL + scanInterval - 1) / scanInterval;
+		debounceSamples = samples<1 ? 1 : (samples>DEBOUNCE_WINDOW_MAX ? DEBOUNCE_WINDOW_MAX : samples);
+	}
+
+	template<byte I> static byte pin() { return keypad_detail::PinAt<I, Pins...>::value; }
+
+	// Re-initialise the row pins. Allows sharing these pins with other hardware.
+	static void releaseRows(keypad_detail::Index<0>) {}
+	template<byte R> static void releaseRows(keypad_detail::Index<R>) {
+		releaseRows(keypad_detail::Index<R - 1>());
+		pinMode(pin<R - 1>(), INPUT_PULLUP);
+	}
+
+	template<byte C> static void readRows(bitmap_t &, keypad_detail::Index<0>) {}
+	template<byte C, byte R> static void readRows(bitmap_t &bits, keypad_detail::Index<R>) {
+		readRows<C>(bits, keypad_detail::Index<R - 1>());
+		if (!digitalRead(pin<R - 1>()))		// keypress is active low
+			bits |= bitmap_t(1) << ((R - 1) * Cols + C);
+	}
+
+	static void scanCols(bitmap_t &, keypad_detail::Index<0>) {}
+	template<byte C> static void scanCols(bitmap_t &bits, keypad_detail::Index<C>) {
+		scanCols(bits, keypad_detail::Index<C - 1>());
+		const byte col = pin<Rows + C - 1>();
+		pinMode(col, OUTPUT);
+		digitalWrite(col, LOW);				// Begin column pulse output.
+		readRows<C - 1>(bits, keypad_detail::Index<Rows>());
+		digitalWrite(col, HIGH);			// End column pulse.
+		pinMode(col, INPUT);
+	}
+
+	// Same list semantics as Keypad::updateList(), but only the keys that are
+	// pressed, settling or already on the list are visited, in key code order.
+	bool updateList() {
+		// Idle keypad and nothing on the list: nothing can change.
+		if (!bitMap && !listed && !settling) return false;
+
+		bool anyActivity = false;
+
+		// Delete any IDLE keys
+		for (byte i=0; i<LIST_MAX; i++) {
+			if (key[i].kstate==IDLE && key[i].kchar!=NO_KEY) {
+				slotOf[key[i].kcode] = -1;
+				listed &= ~(bitmap_t(1) << key[i].kcode);
+				key[i].kchar = NO_KEY;
+				key[i].kcode = -1;
+				key[i].stateChanged = false;
+			}
+			else if (key[i].kstate==IDLE) {
+				key[i].stateChanged = false;
+			}
+		}
+
+		for (bitmap_t pending = bitMap | listed | settling; pending; pending &= pending - 1) {
+			byte code = keypad_detail::lowestBit(sizeof(bitmap_t) > 4 ? (uint64_t)pending : (uint32_t)pending);
+			KeyIntegrator &k = integrator[code];
+			bool raw = (bitMap >> code) & 1;
+			if (raw && !k.level && !k.count) contactAt[code] = millis();
+			integrate(k, raw, debounceSamples);
+			if (k.level || k.count) settling |= bitmap_t(1) << code;
+			else settling &= ~(bitmap_t(1) << code);
+			boolean button = k.level;
+			int idx = slotOf[code];
+			if (idx > -1) {
+				nextKeyState(idx, button);
+			}
+			else if (button) {
+				for (byte i=0; i<LIST_MAX; i++) {
+					if (key[i].kchar==NO_KEY) {
+						key[i].kchar = Keymap[code / Cols][code % Cols];
+						key[i].kcode = code;
+						key[i].kstate = IDLE;
+						slotOf[code] = i;
+						listed |= bitmap_t(1) << code;
+						nextKeyState(i, button);
+						break;
+					}
+				}
+			}
+		}
+
+		for (byte i=0; i<LIST_MAX; i++) {
+			if (key[i].stateChanged) anyActivity = true;
+		}
+
+		return anyActivity;
+	}
+
+	void nextKeyState(byte idx, boolean button) {
+		key[idx].stateChanged = false;
+
+		switch (key[idx].kstate) {
+			case IDLE:
+				if (button==CLOSED) {
+					transitionTo (idx, PRESSED);
+					holdTimer = millis(); }
+				break;
+			case PRESSED:
+				if ((millis()-holdTimer)>holdTime)
+					transitionTo (idx, HOLD);
+				else if (button==OPEN)
+					transitionTo (idx, RELEASED);
+				break;
+			case HOLD:
+				if (button==OPEN)
+					transitionTo (idx, RELEASED);
+				break;
+			case RELEASED:
+				transitionTo (idx, IDLE);
+				break;
+		}
+	}
+
+	void transitionTo(byte idx, KeyState nextState) {
+		key[idx].kstate = nextState;
+		key[idx].stateChanged = true;
+
+		if (keypadEventListener!=NULL && (!single_key || idx==0)) {
+			keypadEventListener(key[idx].kchar);
+		}
+	}
+};
+
+#endif
+
+/*
+|| @changelog
+|| | 1.3 2026-10-19 - RevoLock : pressedAt() gives the raw contact time of the key getKey() returned.
+|| | 1.2 2026-10-19 - RevoLock : Keymap is a template parameter.
+|| | 1.1 2026-10-19 - RevoLock : Per-key integrating debouncer, scans at a fixed interval.
+|| | 1.0 2026-10-19 - RevoLock : Initial Release
+|| #
+*/
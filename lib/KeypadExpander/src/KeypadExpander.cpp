@@ -0,0 +1,161 @@
+/*
+||
+|| @file KeypadExpander.cpp
+|| @version 1.0
+||
+|| @description
+|| | Matrix keypad wired to an I2C GPIO expander (PCF8574, MCP23017).
+|| #
+||
+|| @license
+|| | This library is free software; you can redistribute it and/or
+|| | modify it under the terms of the GNU Lesser General Public
+|| | License as published by the Free Software Foundation; version
+|| | 2.1 of the License.
+|| #
+||
+*/
+#include <KeypadExpander.h>
+
+// MCP23017 registers, BANK=0 (A/B pairs are adjacent and auto-increment)
+#define MCP_IODIRA   0x00
+#define MCP_GPINTENA 0x04
+#define MCP_IOCON    0x0A
+#define MCP_GPPUA    0x0C
+#define MCP_GPIOA    0x12
+#define MCP_OLATA    0x14
+
+/* ---------------- PCF8574 ---------------- */
+
+// Quasi-bidirectional pins have no direction, so the masks aren't needed.
+bool PCF8574Port::begin(uint16_t /* rowMask */, uint16_t /* colMask */) {
+	// All ones: every pin a pulled-up input, columns released.
+	wire.beginTransmission(address);
+	wire.write(0xFF);
+	transactions++;
+	return wire.endTransmission() == 0;
+}
+
+bool PCF8574Port::scan(uint16_t driveLow, uint16_t &pins) {
+	wire.beginTransmission(address);
+	wire.write((uint8_t)~driveLow);
+	if (wire.endTransmission(false) != 0) {		// Repeated start, keep the bus.
+		transactions++;
+		return false;
+	}
+	uint8_t n = wire.requestFrom(address, (uint8_t)1);
+	transactions++;
+	if (n != 1) return false;
+	pins = wire.read();
+	return true;
+}
+
+/* ---------------- MCP23017 ---------------- */
+
+bool MCP23017Port::writeRegister16(uint8_t reg, uint16_t value) {
+	wire.beginTransmission(address);
+	wire.write(reg);
+	wire.write(value & 0xFF);
+	wire.write(value >> 8);
+	transactions++;
+	return wire.endTransmission() == 0;
+}
+
+bool MCP23017Port::begin(uint16_t rowMask, uint16_t cols) {
+	colMask = cols;
+
+	wire.beginTransmission(address);
+	wire.write(MCP_IOCON);
+	wire.write(0x44);		// MIRROR: one INT pin for both ports, ODR: open drain
+	transactions++;
+	if (wire.endTransmission() != 0) return false;
+
+	return writeRegister16(MCP_OLATA, 0x0000)		// Columns drive low when outputs
+		&& writeRegister16(MCP_IODIRA, 0xFFFF)		// Everything released
+		&& writeRegister16(MCP_GPPUA, rowMask)		// Row pull-ups
+		&& writeRegister16(MCP_GPINTENA, rowMask);	// Interrupt on row change
+}
+
+bool MCP23017Port::scan(uint16_t driveLow, uint16_t &pins) {
+	uint16_t iodir = 0xFFFF & ~(driveLow & colMask);
+
+	// Write IODIRA/B, then point at GPIOA and read GPIOA/B, all between one
+	// START and STOP. Reading GPIO also clears a pending interrupt.
+	wire.beginTransmission(address);
+	wire.write(MCP_IODIRA);
+	wire.write(iodir & 0xFF);
+	wire.write(iodir >> 8);
+	uint8_t err = wire.endTransmission(false);
+	if (err == 0) {
+		wire.beginTransmission(address);
+		wire.write(MCP_GPIOA);
+		err = wire.endTransmission(false);
+	}
+	if (err != 0) {
+		transactions++;
+		return false;
+	}
+	uint8_t n = wire.requestFrom(address, (uint8_t)2);
+	transactions++;
+	if (n != 2) return false;
+	pins = wire.read();
+	pins |= (uint16_t)wire.read() << 8;
+	return true;
+}
+
+/* ---------------- KeypadExpander ---------------- */
+
+KeypadExpander::KeypadExpander(char *userKeymap, byte *row, byte *col, byte numRows, byte numCols,
+                               ExpanderPort &port, int8_t intPin)
+	: Keypad(userKeymap, row, col, numRows, numCols), skippedScans(0),
+	  port(port), intPin(intPin), colMask(0), parked(false) {
+	for (byte c=0; c<numCols; c++) colMask |= 1 << col[c];
+}
+
+bool KeypadExpander::begin() {
+	uint16_t rowMask = 0;
+	for (byte r=0; r<sizeKpd.rows; r++) rowMask |= 1 << rowPins[r];
+	for (byte r=0; r<MAPSIZE; r++) bitMap[r] = 0;
+
+	if (intPin >= 0) pinMode(intPin, INPUT_PULLUP);
+	parked = false;
+	return port.begin(rowMask, colMask);
+}
+
+void KeypadExpander::scanKeys() {
+	// Parked with INT idle: no row has changed since every key was up.
+	if (parked && digitalRead(intPin) == HIGH) {
+		skippedScans++;
+		return;
+	}
+
+	bool anyDown = false;
+	for (byte c=0; c<sizeKpd.columns; c++) {
+		uint16_t pins = 0xFFFF;
+		port.scan(1 << columnPins[c], pins);
+		for (byte r=0; r<sizeKpd.rows; r++) {
+			bool down = !((pins >> rowPins[r]) & 1);	// keypress is active low
+			bitWrite(bitMap[r], c, down);
+			anyDown = anyDown || down;
+		}
+	}
+
+	parked = false;
+	if (intPin < 0 || anyDown) return;
+
+	// Nothing down: park every column low so the next press asserts INT.
+	// The read also clears INT; a row already low means a key went down
+	// in between, so stay unparked and catch it on the next scan.
+	uint16_t pins = 0;
+	if (!port.scan(colMask, pins)) return;
+	parked = true;
+	for (byte r=0; r<sizeKpd.rows; r++) {
+		if (!((pins >> rowPins[r]) & 1)) parked = false;
+	}
+}
+
+/*
+|| @changelog
+|| | 1.0 2026-10-19 - RevoLock : Initial Release
+|| #
+*/
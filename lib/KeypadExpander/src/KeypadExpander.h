@@ -0,0 +1,113 @@
+/*
+||
+|| @file KeypadExpander.h
+|| @version 1.0
+||
+|| @description
+|| | Matrix keypad wired to an I2C GPIO expander (PCF8574, MCP23017).
+|| |
+|| | Building an expander backend on Keypad's pin_mode/pin_write/pin_read
+|| | hooks costs one bus transaction per pin operation, i.e.
+|| | rows + cols * (4 + rows) transactions per scan. KeypadExpander
+|| | overrides the whole scan instead: each column is driven and every
+|| | row read back in a single transaction (write, repeated start, read),
+|| | so a scan costs cols transactions.
+|| |
+|| | With the expander's INT output wired to intPin, the columns are
+|| | parked low between scans while no key is down. Any press then
+|| | changes a row input and asserts INT; until it does, scans are
+|| | skipped without touching the bus.
+|| #
+||
+|| @license
+|| | This library is free software; you can redistribute it and/or
+|| | modify it under the terms of the GNU Lesser General Public
+|| | License as published by the Free Software Foundation; version
+|| | 2.1 of the License.
+|| #
+||
+*/
+
+#ifndef KEYPAD_EXPANDER_H
+#define KEYPAD_EXPANDER_H
+
+#include <Keypad.h>
+#include <Wire.h>
+
+// Up to 16 expander pins, bit n = pin n (P0-P7, or GPA0-7 then GPB0-7).
+class ExpanderPort {
+public:
+	ExpanderPort() : transactions(0) {}
+	virtual ~ExpanderPort() {}
+
+	// Configure row pins as pulled-up inputs, column pins released, and
+	// interrupt-on-change for the rows where the chip supports it.
+	virtual bool begin(uint16_t rowMask, uint16_t colMask) = 0;
+
+	// Drive the driveLow pins low, release every other column, and read
+	// all pins back. One bus transaction.
+	virtual bool scan(uint16_t driveLow, uint16_t &pins) = 0;
+
+	uint32_t transactions;	// Completed START..STOP sequences on the bus.
+};
+
+// PCF8574/PCF8574A: quasi-bidirectional pins, a written 1 is a weak
+// pull-up input, a written 0 drives low. INT asserts on any input change
+// and clears on read.
+class PCF8574Port : public ExpanderPort {
+public:
+	PCF8574Port(TwoWire &wire, uint8_t address) : wire(wire), address(address) {}
+
+	bool begin(uint16_t rowMask, uint16_t colMask);
+	bool scan(uint16_t driveLow, uint16_t &pins);
+
+private:
+	TwoWire &wire;
+	uint8_t address;
+};
+
+// MCP23017 in BANK=0 mode. Output latches stay 0; a column is driven by
+// making it an output, released by making it an input again.
+class MCP23017Port : public ExpanderPort {
+public:
+	MCP23017Port(TwoWire &wire, uint8_t address) : wire(wire), address(address), colMask(0) {}
+
+	bool begin(uint16_t rowMask, uint16_t colMask);
+	bool scan(uint16_t driveLow, uint16_t &pins);
+
+private:
+	TwoWire &wire;
+	uint8_t address;
+	uint16_t colMask;
+
+	bool writeRegister16(uint8_t reg, uint16_t value);
+};
+
+class KeypadExpander : public Keypad {
+public:
+	// row/col are expander pin numbers. intPin is the MCU pin wired to the
+	// expander's INT output (active low), or -1 to scan on every getKeys().
+	KeypadExpander(char *userKeymap, byte *row, byte *col, byte numRows, byte numCols,
+	               ExpanderPort &port, int8_t intPin = -1);
+
+	bool begin();
+
+	uint32_t skippedScans;	// Scans avoided because INT was idle.
+
+protected:
+	void scanKeys();
+
+private:
+	ExpanderPort &port;
+	int8_t intPin;
+	uint16_t colMask;
+	bool parked;
+};
+
+#endif
+
+/*
+|| @changelog
+|| | 1.0 2026-10-19 - RevoLock : Initial Release
+|| #
+*/
@@ -0,0 +1,212 @@
+// Host bench: the flash audit log over the simulated partition.
+//
+// Fills the production layout (128 KB) past its capacity, then reboots and
+// checks that time-range queries read only the sectors they need and return
+// what a full scan filtered by time would, that the log keeps the newest
+// records when it wraps and that a record torn by a power cut is skipped.
+// Checks that a device still on the old partition table keeps the log in
+// its spiffs partition.
+// Repeats the queries on a 1 MB layout to show they don't grow with the log.
+// Each phase is a separate boot with the flash in shared memory, so every
+// one of them mounts the log from flash.
+//
+// Build and run: pio run -e bench_audit -t exec
+
+#include <Arduino.h>
+#include <AuditLog.h>
+#include <esp_partition.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <new>
+#include <vector>
+#include "sim.h"
+
+static const uint32_t START = 1767225600;   // 2026-01-01
+static const uint32_t DAY = 86400;
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+  printf("  %-56s %s\n", what, ok ? "ok" : "FAILED");
+  if (!ok) failures++;
+}
+
+/* =========================================================
+   RIG
+   ========================================================= */
+// Run one boot in a child process; its flash writes stay in the shared world
+static void boot(void (*phase)()) {
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == 0) {
+    failures = 0;
+    phase();
+    fflush(stdout);
+    _exit(failures ? 1 : 0);
+  }
+  int status = 0;
+  waitpid(pid, &status, 0);
+  if (!WIFEXITED(status) || WEXITSTATUS(status)) failures++;
+}
+
+static void setWallClock(uint32_t unixTime) {
+  sim::World& w = sim::world();
+  w.wallValid = true;
+  w.wallOffsetUs = (int64_t)unixTime * 1000000 - (int64_t)sim::now_us();
+}
+
+// A busy site: a record every 5 to 25 minutes, around the clock
+static uint32_t fill(uint32_t records, uint32_t from) {
+  AuditLog::begin();
+  uint32_t t = from;
+  for (uint32_t i = 0; i < records; i++) {
+    t += 300 + random(1200);
+    setWallClock(t);
+    AuditLog::record(i % 3 ? AUDIT_SYNC : AUDIT_UNLOCK, i % 7, AUDIT_ACKED);
+    if (i % AUDIT_QUEUE_DEPTH == AUDIT_QUEUE_DEPTH - 1) AuditLog::flush();
+  }
+  AuditLog::flush();
+  return t;
+}
+
+static void collect(void* ctx, const AuditRecord& r) {
+  ((std::vector<AuditRecord>*)ctx)->push_back(r);
+}
+
+static void count(void* ctx, const AuditRecord&) {
+  (*(uint32_t*)ctx)++;
+}
+
+// Range queries against the full scan filtered by time
+static void queryRanges(uint32_t last) {
+  std::vector<AuditRecord> all;
+  AuditQueryStats full = AuditLog::query(0, UINT32_MAX, collect, &all);
+  printf("  full scan: %u records in %u sectors, %u ms\n", full.records, full.sectors, full.ms);
+
+  bool ordered = true;
+  for (size_t i = 1; i < all.size(); i++) ordered = ordered && all[i - 1].time <= all[i].time;
+  check(ordered, "records come back oldest first");
+  check(!all.empty() && all.back().time == last, "newest record kept");
+  check(full.records >= (full.sectors - 1) * AUDIT_RECORDS_PER_SECTOR, "only the oldest sector's worth is lost to wrapping");
+
+  struct { const char* name; uint32_t span; } ranges[] = { { "last hour", 3600 }, { "last day", DAY }, { "last week", 7 * DAY },
+                                                           { "last 30 days", 30 * DAY } };
+  bool matches = true, fewer = true;
+  for (auto& range : ranges) {
+    uint32_t from = last - range.span, n = 0, expected = 0;
+    AuditQueryStats q = AuditLog::query(from, last, count, &n);
+    for (const AuditRecord& r : all) expected += r.time >= from && r.time <= last;
+    printf("  %-13s %5u records from %3u of %3u sectors, %3u ms\n", range.name, q.records, q.sectorsRead, q.sectors, q.ms);
+    matches = matches && n == expected && q.records == expected;
+    fewer = fewer && q.sectorsRead <= expected / AUDIT_RECORDS_PER_SECTOR + 2;
+  }
+  check(matches, "range queries match the filtered full scan");
+  check(fewer, "range queries read only the sectors they overlap");
+}
+
+/* =========================================================
+   PHASES
+   ========================================================= */
+static uint32_t* last = nullptr; // newest record's time, across boots
+
+static void fillProduction() {
+  uint32_t before = sim::world().flash.erases;
+  uint64_t startedUs = sim::now_us();
+  *last = fill(40000, START);
+  printf("\n128 KB partition: 40000 records written, %u sector erases, %.1f s of flash time\n",
+         sim::world().flash.erases - before, (sim::now_us() - startedUs) / 1e6);
+}
+
+static void queryProduction() {
+  printf("\nAfter a reboot\n");
+  queryRanges(*last);
+}
+
+// Power goes off halfway through writing a record: some bits of the next
+// free slot are already cleared
+static void tearRecord() {
+  AuditLog::begin();
+  uint32_t before = 0;
+  AuditLog::query(0, UINT32_MAX, count, &before);
+  const esp_partition_t* p = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, AUDIT_PARTITION);
+  for (size_t offset = 0; offset < p->size; offset += AUDIT_SECTOR_SIZE) {
+    for (size_t slot = 0; slot < AUDIT_RECORDS_PER_SECTOR; slot++) {
+      AuditRecord r;
+      size_t at = offset + AUDIT_HEADER_SIZE + slot * sizeof(r);
+      esp_partition_read(p, at, &r, sizeof(r));
+      uint32_t header;
+      esp_partition_read(p, offset, &header, sizeof(header));
+      if (r.time != 0xFFFFFFFF || header == 0xFFFFFFFF) continue;
+      const uint8_t torn[4] = { 0x12, 0x34, 0x00, 0x00 }; // time written, nothing else
+      esp_partition_write(p, at, torn, sizeof(torn));
+      *last = before;
+      return;
+    }
+  }
+}
+
+static void afterTear() {
+  printf("\nRecord torn by a power cut\n");
+  uint32_t before = *last, after = 0;
+  setWallClock(START + 1000 * DAY);
+  AuditLog::begin();
+  AuditLog::record(AUDIT_POWER_ON, AUDIT_SLOT_NONE, AUDIT_OK);
+  AuditLog::flush();
+  std::vector<AuditRecord> all;
+  AuditLog::query(0, UINT32_MAX, collect, &all);
+  after = all.size();
+  check(after == before + 1 || after == before + 1 - AUDIT_RECORDS_PER_SECTOR, "torn record skipped, the next one appended after it");
+  check(!all.empty() && all.back().event == AUDIT_POWER_ON, "log continues");
+}
+
+// A device flashed before the audit log, updated over OTA: the table still
+// has the unused spiffs partition where the audit one would be
+static void oldTable() {
+  printf("\nOld partition table\n");
+  sim::relabel_partition(AUDIT_PARTITION, AUDIT_LEGACY_PARTITION, ESP_PARTITION_SUBTYPE_DATA_SPIFFS);
+  setWallClock(START);
+  AuditLog::begin();
+  AuditLog::record(AUDIT_POWER_ON, AUDIT_SLOT_NONE, AUDIT_OK);
+  AuditLog::flush();
+  uint32_t n = 0;
+  AuditLog::query(0, UINT32_MAX, count, &n);
+  check(n == 1, "log kept in the spiffs partition");
+}
+
+static void large() {
+  sim::resize_partition(AUDIT_PARTITION, 0x100000);
+  uint64_t startedUs = sim::now_us();
+  *last = fill(120000, START);
+  printf("\n1 MB partition: 120000 records written in %.1f s of flash time\n", (sim::now_us() - startedUs) / 1e6);
+}
+
+static void queryLarge() {
+  sim::resize_partition(AUDIT_PARTITION, 0x100000);
+  printf("\nAfter a reboot\n");
+  queryRanges(*last);
+}
+
+int main() {
+  sim::World* world = (sim::World*)mmap(nullptr, sizeof(sim::World) + sizeof(uint32_t), PROT_READ | PROT_WRITE,
+                                        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  new (world) sim::World();
+  last = (uint32_t*)(world + 1);
+  sim::use_world(world);
+  Serial.echo = false;
+
+  boot(fillProduction);
+  boot(queryProduction);
+  boot(tearRecord);
+  boot(afterTear);
+
+  new (world) sim::World(); // blank flash
+  boot(oldTable);
+
+  new (world) sim::World();
+  boot(large);
+  boot(queryLarge);
+
+  printf("\n%s\n", failures ? "FAILURES" : "all checks passed");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,189 @@
+// Host benchmark: 4x4 keypad on a simulated PCF8574 over a simulated I2C bus.
+//
+// Compares bus transactions and time on the wire per scan for
+//   - a per-pin backend (Keypad's pin_mode/pin_write/pin_read hooks, one
+//     transaction per pin operation, as a Keypad_I2C-style port would do),
+//   - KeypadExpander polling (one transaction per column),
+//   - KeypadExpander with the INT line (idle scans skip the bus).
+//
+// Build and run: pio run -e bench_keypad -t exec
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <Keypad.h>
+#include <KeypadExpander.h>
+
+static const uint8_t EXPANDER_ADDR = 0x20;
+static const uint8_t INT_PIN = 4;
+static const int SCANS = 1000;
+
+static const byte ROWS = 4;
+static const byte COLS = 4;
+static char keys[ROWS][COLS] = {
+  {'1','2','3','A'},
+  {'4','5','6','B'},
+  {'7','8','9','C'},
+  {'*','0','#','D'}
+};
+static byte rowBits[ROWS] = {0, 1, 2, 3};  // P0-P3
+static byte colBits[COLS] = {4, 5, 6, 7};  // P4-P7
+
+/* =========================================================
+   SIMULATED PCF8574 WITH A KEY MATRIX ON ITS PINS
+   ========================================================= */
+class SimPcf8574 : public I2CDevice {
+public:
+  bool pressed[ROWS][COLS] = {};
+
+  void onWrite(const uint8_t* data, size_t len) override {
+    if (len) latch = data[len - 1];
+    snapshot = inputs();             // a write also clears INT
+  }
+
+  size_t onRead(uint8_t* data, size_t len) override {
+    for (size_t i = 0; i < len; i++) data[i] = inputs();
+    snapshot = inputs();
+    return len;
+  }
+
+  // INT is active low and asserted while inputs differ from the last read
+  bool intAsserted() const { return inputs() != snapshot; }
+
+private:
+  uint8_t latch = 0xFF;
+  uint8_t snapshot = 0xFF;
+
+  // A pin reads low if its latch drives it low, or a pressed key joins it
+  // to a column that is driven low.
+  uint8_t inputs() const {
+    uint8_t value = latch;
+    for (byte r = 0; r < ROWS; r++) {
+      for (byte c = 0; c < COLS; c++) {
+        if (!pressed[r][c]) continue;
+        bool rowLow = !(latch & (1 << rowBits[r]));
+        bool colLow = !(latch & (1 << colBits[c]));
+        if (rowLow || colLow) value &= ~((1 << rowBits[r]) | (1 << colBits[c]));
+      }
+    }
+    return value;
+  }
+};
+
+/* =========================================================
+   PER-PIN BACKEND ON THE VIRTUAL HOOKS
+   ========================================================= */
+class PerPinKeypad : public Keypad {
+public:
+  PerPinKeypad(char* map, byte* rows, byte* cols, byte nr, byte nc)
+    : Keypad(map, rows, cols, nr, nc) {}
+
+  void pin_mode(byte pin, byte mode) {
+    if (mode != OUTPUT) bitSet(latch, pin);   // quasi-bidirectional input
+    writeLatch();
+  }
+  void pin_write(byte pin, boolean level) {
+    bitWrite(latch, pin, level);
+    writeLatch();
+  }
+  int pin_read(byte pin) {
+    Wire.requestFrom(EXPANDER_ADDR, (uint8_t)1);
+    return (Wire.read() >> pin) & 1;
+  }
+
+private:
+  uint8_t latch = 0xFF;
+
+  void writeLatch() {
+    Wire.beginTransmission(EXPANDER_ADDR);
+    Wire.write(latch);
+    Wire.endTransmission();
+  }
+};
+
+/* =========================================================
+   BENCH
+   ========================================================= */
+struct Result {
+  double idleTransactions, idleUs;
+  double heldTransactions, heldUs;
+  bool detected;
+};
+
+template<class K>
+static Result run(K& kpd, SimPcf8574& chip) {
+  Result res = {};
+  kpd.setDebounceTime(1);
+
+  // Typing check: press '5', expect exactly that key
+  chip.pressed[1][1] = true;
+  char got = NO_KEY;
+  for (int i = 0; i < 10 && got == NO_KEY; i++) {
+    delay(2);
+    got = kpd.getKey();
+  }
+  chip.pressed[1][1] = false;
+  for (int i = 0; i < 10; i++) { delay(2); kpd.getKey(); }
+  res.detected = got == '5';
+
+  for (int held = 0; held < 2; held++) {
+    chip.pressed[2][3] = held;
+    uint32_t tx = Wire.transactions;
+    uint64_t us = Wire.busTimeUs;
+    for (int i = 0; i < SCANS; i++) {
+      delay(2);
+      kpd.getKeys();
+    }
+    double txPerScan = (double)(Wire.transactions - tx) / SCANS;
+    double usPerScan = (double)(Wire.busTimeUs - us) / SCANS;
+    if (held) { res.heldTransactions = txPerScan; res.heldUs = usPerScan; }
+    else      { res.idleTransactions = txPerScan; res.idleUs = usPerScan; }
+  }
+  chip.pressed[2][3] = false;
+  return res;
+}
+
+static void report(const char* name, const Result& r) {
+  printf("  %-26s %8.1f %10.0f %8.1f %10.0f   %s\n", name,
+         r.idleTransactions, r.idleUs, r.heldTransactions, r.heldUs,
+         r.detected ? "ok" : "MISSED");
+}
+
+int main() {
+  const uint32_t clocks[] = {100000, 400000};
+
+  for (uint32_t hz : clocks) {
+    printf("\n4x4 keypad on PCF8574 @ %lu kHz, %d scans\n", (unsigned long)(hz / 1000), SCANS);
+    printf("  %-26s %8s %10s %8s %10s\n", "backend", "idle tx", "idle us", "held tx", "held us");
+
+    {
+      sim::reset();
+      SimPcf8574 chip;
+      Wire.begin(-1, -1, hz);
+      Wire.attach(EXPANDER_ADDR, &chip);
+      PerPinKeypad kpd(makeKeymap(keys), rowBits, colBits, ROWS, COLS);
+      report("per-pin hooks", run(kpd, chip));
+    }
+    {
+      sim::reset();
+      SimPcf8574 chip;
+      Wire.begin(-1, -1, hz);
+      Wire.attach(EXPANDER_ADDR, &chip);
+      PCF8574Port port(Wire, EXPANDER_ADDR);
+      KeypadExpander kpd(makeKeymap(keys), rowBits, colBits, ROWS, COLS, port);
+      kpd.begin();
+      report("KeypadExpander (polling)", run(kpd, chip));
+    }
+    {
+      sim::reset();
+      SimPcf8574 chip;
+      Wire.begin(-1, -1, hz);
+      Wire.attach(EXPANDER_ADDR, &chip);
+      sim::set_input_model(INT_PIN, [&chip](uint8_t) { return chip.intAsserted() ? LOW : HIGH; });
+      PCF8574Port port(Wire, EXPANDER_ADDR);
+      KeypadExpander kpd(makeKeymap(keys), rowBits, colBits, ROWS, COLS, port, INT_PIN);
+      kpd.begin();
+      report("KeypadExpander (INT)", run(kpd, chip));
+    }
+  }
+  return 0;
+}
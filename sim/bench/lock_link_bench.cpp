@@ -0,0 +1,273 @@
+// Host bench: ESP-NOW relay between leaf locks and a gateway, over the
+// in-process simulated radio.
+//
+// Checks that changes reach DoLynk once per batch, survive frame loss, and
+// that replayed, forged and stale frames don't, then compares a leaf's radio
+// time per toggle with a lock that joins WiFi and talks to DoLynk itself.
+//
+// Build and run: pio run -e bench_link -t exec
+
+#include <Arduino.h>
+#include <LinkRelay.h>
+#include <SimRadio.h>
+#include <algorithm>
+#include <string.h>
+#include "sim.h"
+
+static const char* KEY = "bench-shared-key";
+static const int LEAVES = 6;
+static const uint32_t DOLYNK_ROUND_MS = 350; // one parallel fan-out to DoLynk
+
+/* =========================================================
+   FAKE DOLYNK BEHIND THE GATEWAY
+   ========================================================= */
+static uint32_t forwardCalls = 0;
+static uint32_t failingDevices = 0;  // devices DoLynk doesn't acknowledge
+static uint32_t armedDevices = 0;    // what DoLynk ends up with
+
+static uint32_t forward(uint32_t deviceMask, bool armed, bool) {
+  forwardCalls++;
+  delay(DOLYNK_ROUND_MS);
+  armedDevices = armed ? armedDevices | deviceMask : armedDevices & ~deviceMask;
+  return deviceMask & ~failingDevices;
+}
+
+/* =========================================================
+   RIG
+   ========================================================= */
+static void macFor(int i, uint8_t mac[6]) {
+  const uint8_t base[6] = {0x24, 0x6F, 0x28, 0x00, 0x00, 0x00};
+  memcpy(mac, base, 6);
+  mac[5] = i;
+}
+
+struct LeafLock {
+  uint8_t mac[6];
+  SimRadio radio;
+  uint32_t seq = 0;    // RTC memory on the real lock
+  uint32_t epoch = 0;
+  LinkLeaf link;
+  LinkResult result = LINK_DONE;
+  uint64_t startedUs = 0, doneUs = 0;
+
+  LeafLock(SimAir& air, int i, const uint8_t gateway[6], const char* key)
+    : radio(air, (macFor(i, mac), mac)), link(radio, gateway, key, seq, epoch) {}
+};
+
+struct Rig {
+  SimAir air;
+  uint8_t gatewayMac[6];
+  SimRadio gatewayRadio;
+  LinkGateway gateway;
+  std::vector<LeafLock*> leaves;
+
+  Rig() : gatewayRadio(air, (macFor(0, gatewayMac), gatewayMac)), gateway(gatewayRadio, KEY, forward) {
+    forwardCalls = 0;
+    armedDevices = 0;
+    gatewayRadio.begin(0);
+    gateway.begin();
+    for (int i = 1; i <= LEAVES; i++) leaves.push_back(new LeafLock(air, i, gatewayMac, KEY));
+  }
+  ~Rig() {
+    for (LeafLock* l : leaves) delete l;
+  }
+
+  void start(LeafLock& l, bool armed, bool force = true) {
+    l.radio.begin(0);
+    l.startedUs = sim::now_us();
+    l.link.send(armed, 1u << index(l), force);
+    l.result = LINK_PENDING;
+  }
+
+  int index(LeafLock& l) {
+    for (size_t i = 0; i < leaves.size(); i++) if (leaves[i] == &l) return i;
+    return 0;
+  }
+
+  // Poll everyone until every leaf has a result
+  void settle() {
+    bool pending = true;
+    while (pending) {
+      pending = false;
+      for (LeafLock* l : leaves) {
+        if (l->result != LINK_PENDING) continue;
+        l->result = l->link.poll();
+        if (l->result == LINK_PENDING) pending = true;
+        else { l->doneUs = sim::now_us(); l->radio.end(); } // back to sleep
+      }
+      gateway.poll();
+      delay(1);
+    }
+    for (int i = 0; i < 50; i++) { gateway.poll(); delay(1); } // drain late frames
+  }
+};
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+  printf("  %-52s %s\n", what, ok ? "ok" : "FAILED");
+  if (!ok) failures++;
+}
+
+/* =========================================================
+   SCENARIOS
+   ========================================================= */
+static void concurrentToggles() {
+  printf("\n%d leaves toggle within the same batch window\n", LEAVES);
+  sim::reset();
+  Rig rig;
+  for (LeafLock* l : rig.leaves) rig.start(*l, true);
+  rig.settle();
+
+  bool allDone = true;
+  uint64_t worstUs = 0;
+  for (LeafLock* l : rig.leaves) {
+    allDone &= l->result == LINK_DONE;
+    worstUs = std::max(worstUs, l->doneUs - l->startedUs);
+  }
+  printf("  DoLynk rounds %u, frames on air %u, slowest leaf %.1f ms\n",
+         forwardCalls, rig.air.sent, worstUs / 1000.0);
+  check(allDone, "every leaf acknowledged");
+  check(forwardCalls == 1, "one DoLynk round for the whole batch");
+  check(armedDevices == (1u << LEAVES) - 1, "every leaf's device armed");
+}
+
+static void lossyToggles(uint32_t lossPermille) {
+  const int TOGGLES = 300;
+  sim::reset();
+  Rig rig;
+  rig.air.lossPermille = lossPermille;
+
+  int done = 0, refused = 0, unreachable = 0;
+  uint32_t frames = 0;
+  std::vector<uint32_t> latencyMs;
+  for (int t = 0; t < TOGGLES; t++) {
+    LeafLock& l = *rig.leaves[t % LEAVES];
+    uint32_t before = rig.air.sent;
+    rig.start(l, t & 1);
+    rig.settle();
+    frames += rig.air.sent - before;
+    if (l.result == LINK_DONE) done++;
+    if (l.result == LINK_REFUSED) refused++;
+    if (l.result == LINK_UNREACHABLE) unreachable++;
+    latencyMs.push_back((l.doneUs - l.startedUs) / 1000);
+    delay(5000);
+  }
+  std::sort(latencyMs.begin(), latencyMs.end());
+  printf("\n%d toggles, %u.%u%% frame loss\n", TOGGLES, lossPermille / 10, lossPermille % 10);
+  printf("  done %d, refused %d, unreachable %d; %.1f frames per toggle, p50 %u ms, p95 %u ms\n",
+         done, refused, unreachable, (double)frames / TOGGLES,
+         latencyMs[TOGGLES / 2], latencyMs[TOGGLES * 95 / 100]);
+  check(done == TOGGLES || lossPermille >= 300, "every toggle acknowledged");
+}
+
+static void replayAndForgery() {
+  printf("\nReplayed, forged and stale frames\n");
+  sim::reset();
+  Rig rig;
+  LeafLock& l = *rig.leaves[0];
+
+  rig.start(l, true);
+  rig.settle();
+  check(l.result == LINK_DONE, "leaf arms its device");
+
+  // The last accepted STATE frame, as an eavesdropper recorded it
+  SimFrame recorded;
+  for (const SimFrame& f : rig.air.capture) {
+    if (f.data.size() == sizeof(LinkFrame) && ((const LinkFrame*)f.data.data())->type == LINK_STATE) recorded = f;
+  }
+  rig.start(l, false);
+  rig.settle();
+  check(l.result == LINK_DONE && armedDevices == 0, "leaf disarms");
+
+  uint32_t calls = forwardCalls;
+  rig.air.transmit(recorded.from, recorded.to, recorded.data.data(), recorded.data.size());
+  rig.settle();
+  check(forwardCalls == calls && armedDevices == 0, "replayed arm frame doesn't reach DoLynk");
+
+  LinkFrame forged;
+  memcpy(&forged, recorded.data.data(), sizeof(forged));
+  forged.seq += 100;
+  forged.flags ^= LINK_FLAG_ARMED;
+  uint32_t rejected = rig.gateway.stats().rejected;
+  rig.air.transmit(recorded.from, recorded.to, (const uint8_t*)&forged, sizeof(forged));
+  rig.settle();
+  check(forwardCalls == calls && rig.gateway.stats().rejected == rejected + 1, "frame edited without the key is rejected");
+
+  rig.air.transmit(recorded.from, rig.gatewayMac, recorded.data.data(), 3);
+  rig.settle();
+  check(forwardCalls == calls, "truncated frame is rejected");
+
+  LeafLock stranger(rig.air, 50, rig.gatewayMac, "wrong-key");
+  rig.leaves.push_back(&stranger);
+  rig.start(stranger, true);
+  rig.settle();
+  rig.leaves.pop_back();
+  check(stranger.result == LINK_UNREACHABLE && forwardCalls == calls, "leaf with the wrong key gets nowhere");
+}
+
+static void restarts() {
+  printf("\nLeaf power loss and gateway restart\n");
+  sim::reset();
+  Rig rig;
+  LeafLock& l = *rig.leaves[0];
+  for (int i = 0; i < 5; i++) {
+    rig.start(l, i & 1);
+    rig.settle();
+  }
+
+  l.seq = 0; // RTC memory lost
+  l.epoch = 0;
+  uint32_t resyncs = rig.gateway.stats().resyncs;
+  rig.start(l, true);
+  rig.settle();
+  check(l.result == LINK_DONE && rig.gateway.stats().resyncs == resyncs + 1, "leaf recovers its counter after one RESYNC");
+  printf("  %u frames for that toggle\n", l.link.attempts());
+
+  rig.gateway.begin(); // new epoch, sequence table lost
+  rig.start(l, false);
+  rig.settle();
+  check(l.result == LINK_DONE, "leaf follows a restarted gateway");
+
+  failingDevices = 1u << 0;
+  rig.start(l, true);
+  rig.settle();
+  failingDevices = 0;
+  check(l.result == LINK_REFUSED, "DoLynk failure is reported to the leaf");
+
+  rig.gatewayRadio.end(); // gateway down
+  rig.start(l, false);
+  rig.settle();
+  check(l.result == LINK_UNREACHABLE, "missing gateway is reported as unreachable");
+  printf("  gave up after %u frames\n", l.link.attempts());
+}
+
+// A leaf's radio time per toggle against joining WiFi and talking to DoLynk
+// directly, with the simulator's default network model
+static void radioTime() {
+  sim::reset();
+  Rig rig;
+  LeafLock& l = *rig.leaves[0];
+  uint64_t onUs = 0;
+  for (int i = 0; i < 20; i++) {
+    rig.start(l, i & 1);
+    rig.settle();
+    onUs += l.doneUs - l.startedUs;
+  }
+  sim::NetworkModel net;
+  double directMs = net.associateMs + net.associateJitterMs / 2.0 + net.dnsMs + net.handshakeMs + DOLYNK_ROUND_MS;
+  printf("\nRadio on per toggle: leaf %.0f ms (of which DoLynk %u ms at the gateway), direct WiFi ~%.0f ms\n",
+         onUs / 20 / 1000.0, DOLYNK_ROUND_MS, directMs);
+}
+
+int main() {
+  concurrentToggles();
+  lossyToggles(0);
+  lossyToggles(100);
+  lossyToggles(300);
+  replayAndForgery();
+  restarts();
+  radioTime();
+  printf("\n%s\n", failures ? "FAILURES" : "all checks passed");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,259 @@
+#ifndef SIM_ARDUINO_H
+#define SIM_ARDUINO_H
+
+// Host (Linux) stand-in for the parts of the Arduino-ESP32 core RevoLock
+// uses. Time is virtual: millis()/micros() only move when delay() or the
+// simulation advances them, so scenarios run as fast as the host allows.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <sys/time.h>
+#include <string>
+#include <algorithm>
+#include <functional>
+
+using std::min;
+using std::max;
+
+typedef uint8_t byte;
+typedef bool boolean;
+typedef uint16_t word;
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT          0x01
+#define OUTPUT         0x03
+#define PULLUP         0x04
+#define INPUT_PULLUP   0x05
+#define PULLDOWN       0x08
+#define INPUT_PULLDOWN 0x09
+
+// RTC slow memory: kept in its own section so the simulator can carry it
+// across simulated deep sleep while every other global starts fresh.
+#define RTC_DATA_ATTR   __attribute__((section("rtc_data")))
+#define RTC_NOINIT_ATTR __attribute__((section("rtc_data")))
+#define IRAM_ATTR
+
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+#define bitSet(value, bit) ((value) |= (1UL << (bit)))
+#define bitClear(value, bit) ((value) &= ~(1UL << (bit)))
+#define bitWrite(value, bit, bitvalue) ((bitvalue) ? bitSet(value, bit) : bitClear(value, bit))
+
+template<class T> T constrain(T x, T lo, T hi) { return x < lo ? lo : (x > hi ? hi : x); }
+
+/* =========================================================
+   STRING
+   ========================================================= */
+class String {
+public:
+  String() {}
+  String(const char* s) : s_(s ? s : "") {}
+  String(const std::string& s) : s_(s) {}
+  String(const String& o) = default;
+  explicit String(char c) : s_(1, c) {}
+  String(int v) : s_(std::to_string(v)) {}
+  String(unsigned int v) : s_(std::to_string(v)) {}
+  String(long v) : s_(std::to_string(v)) {}
+  String(unsigned long v) : s_(std::to_string(v)) {}
+  String(long long v) : s_(std::to_string(v)) {}
+  String(unsigned long long v) : s_(std::to_string(v)) {}
+  String(float v, unsigned int decimals = 2) { format(v, decimals); }
+  String(double v, unsigned int decimals = 2) { format(v, decimals); }
+  String& operator=(const String& o) = default;
+
+  const char* c_str() const { return s_.c_str(); }
+  unsigned int length() const { return s_.size(); }
+  bool isEmpty() const { return s_.empty(); }
+  bool reserve(unsigned int n) { s_.reserve(n); return true; }
+
+  char charAt(unsigned int i) const { return i < s_.size() ? s_[i] : 0; }
+  char operator[](unsigned int i) const { return charAt(i); }
+  char& operator[](unsigned int i) { return s_[i]; }
+
+  bool equals(const String& o) const { return s_ == o.s_; }
+  bool operator==(const String& o) const { return s_ == o.s_; }
+  bool operator==(const char* o) const { return s_ == (o ? o : ""); }
+  bool operator!=(const String& o) const { return s_ != o.s_; }
+  bool operator!=(const char* o) const { return !(*this == o); }
+  bool operator<(const String& o) const { return s_ < o.s_; }
+
+  String& operator+=(const String& o) { s_ += o.s_; return *this; }
+  String& operator+=(const char* o) { if (o) s_ += o; return *this; }
+  String& operator+=(char c) { s_ += c; return *this; }
+  String& operator+=(int v) { s_ += std::to_string(v); return *this; }
+  String& operator+=(unsigned int v) { s_ += std::to_string(v); return *this; }
+  String& operator+=(long v) { s_ += std::to_string(v); return *this; }
+  String& operator+=(unsigned long v) { s_ += std::to_string(v); return *this; }
+  bool concat(const String& o) { s_ += o.s_; return true; }
+  bool concat(const char* o, unsigned int n) { s_.append(o, n); return true; }
+
+  int indexOf(char c, unsigned int from = 0) const { return pos(s_.find(c, from)); }
+  int indexOf(const String& o, unsigned int from = 0) const { return pos(s_.find(o.s_, from)); }
+  int lastIndexOf(char c) const { return pos(s_.rfind(c)); }
+  bool startsWith(const String& p) const { return s_.compare(0, p.s_.size(), p.s_) == 0; }
+  bool endsWith(const String& p) const {
+    return s_.size() >= p.s_.size() && s_.compare(s_.size() - p.s_.size(), p.s_.size(), p.s_) == 0;
+  }
+  String substring(unsigned int from) const { return from < s_.size() ? String(s_.substr(from)) : String(); }
+  String substring(unsigned int from, unsigned int to) const {
+    if (from > to) std::swap(from, to);
+    return from < s_.size() ? String(s_.substr(from, to - from)) : String();
+  }
+
+  void toLowerCase() { for (auto& c : s_) c = tolower((unsigned char)c); }
+  void toUpperCase() { for (auto& c : s_) c = toupper((unsigned char)c); }
+  void trim() {
+    size_t a = s_.find_first_not_of(" \t\r\n");
+    size_t b = s_.find_last_not_of(" \t\r\n");
+    s_ = a == std::string::npos ? std::string() : s_.substr(a, b - a + 1);
+  }
+  void remove(unsigned int index, unsigned int count = (unsigned int)-1) { if (index < s_.size()) s_.erase(index, count); }
+  void replace(const String& from, const String& to) {
+    if (from.s_.empty()) return;
+    for (size_t p = 0; (p = s_.find(from.s_, p)) != std::string::npos; p += to.s_.size()) s_.replace(p, from.s_.size(), to.s_);
+  }
+  long toInt() const { return atol(s_.c_str()); }
+  float toFloat() const { return atof(s_.c_str()); }
+
+  const std::string& str() const { return s_; }
+
+private:
+  std::string s_;
+
+  static int pos(size_t p) { return p == std::string::npos ? -1 : (int)p; }
+  void format(double v, unsigned int decimals) {
+    char buf[48];
+    snprintf(buf, sizeof(buf), "%.*f", (int)decimals, v);
+    s_ = buf;
+  }
+};
+
+inline String operator+(const String& a, const String& b) { String r(a); r += b; return r; }
+inline String operator+(const String& a, const char* b) { String r(a); r += b; return r; }
+inline String operator+(const char* a, const String& b) { String r(a); r += b; return r; }
+inline String operator+(const String& a, char b) { String r(a); r += b; return r; }
+
+/* =========================================================
+   STREAMS
+   ========================================================= */
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* buf, size_t n) {
+    size_t k = 0;
+    while (k < n && write(buf[k])) k++;
+    return k;
+  }
+};
+
+class Stream : public Print {
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+};
+
+/* =========================================================
+   SERIAL
+   ========================================================= */
+#define DEC 10
+#define HEX 16
+
+class HardwareSerial {
+public:
+  void begin(unsigned long) {}
+  void end() {}
+  void flush() { if (echo) fflush(stdout); }
+  operator bool() const { return true; }
+  int available() { return 0; }
+  int read() { return -1; }
+
+  size_t write(uint8_t c) { return out(std::string(1, (char)c)); }
+  size_t write(const uint8_t* buf, size_t n) { return out(std::string((const char*)buf, n)); }
+
+  size_t print(const String& s) { return out(s.str()); }
+  size_t print(const char* s) { return out(s ? s : ""); }
+  size_t print(char c) { return out(std::string(1, c)); }
+  size_t print(int v, int base = DEC) { return number((long)v, base); }
+  size_t print(unsigned int v, int base = DEC) { return number((unsigned long)v, base); }
+  size_t print(long v, int base = DEC) { return number(v, base); }
+  size_t print(unsigned long v, int base = DEC) { return number(v, base); }
+  size_t print(long long v, int base = DEC) { return number((long)v, base); }
+  size_t print(unsigned long long v, int base = DEC) { return number((unsigned long)v, base); }
+  size_t print(double v, int decimals = 2) { return out(String(v, decimals).str()); }
+
+  template<class T> size_t println(const T& v) { size_t n = print(v); return n + out("\r\n"); }
+  template<class T> size_t println(const T& v, int f) { size_t n = print(v, f); return n + out("\r\n"); }
+  size_t println() { return out("\r\n"); }
+
+  size_t printf(const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+  bool echo = true;               // copy output to stdout
+  std::function<void(const std::string&)> tap; // observe output (tests, scenarios)
+
+private:
+  size_t out(const std::string& s);
+  size_t number(long v, int base);
+  size_t number(unsigned long v, int base);
+};
+
+extern HardwareSerial Serial;
+
+/* =========================================================
+   TIME, GPIO, RANDOM
+   ========================================================= */
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t level);
+int digitalRead(uint8_t pin);
+
+uint32_t esp_random();
+long random(long max);
+long random(long min, long max);
+void randomSeed(unsigned long seed);
+
+// SNTP: the wall clock becomes valid once WiFi is up and the (simulated)
+// server answers. time() and gettimeofday() read the virtual clock.
+void configTime(long gmtOffset_sec, int daylightOffset_sec, const char* server1,
+                const char* server2 = nullptr, const char* server3 = nullptr);
+
+/* =========================================================
+   CHIP
+   ========================================================= */
+// Heap figures are nominal: the host heap says nothing about the device's
+class EspClass {
+public:
+  uint32_t getHeapSize() { return 327680; }
+  uint32_t getFreeHeap() { return 240000; }
+  uint32_t getMinFreeHeap() { return 220000; }
+  uint32_t getMaxAllocHeap() { return 110000; }
+  // Only called when the firmware can't go on, which is a bug on the host
+  [[noreturn]] void restart() {
+    fprintf(stderr, "[sim] ESP.restart()\n");
+    abort();
+  }
+};
+
+extern EspClass ESP;
+
+// CPU clock (esp32-hal-cpu). Every boot starts at 240 MHz; the CPU-bound
+// part of a TLS handshake takes longer at lower clocks.
+bool setCpuFrequencyMhz(uint32_t mhz);
+uint32_t getCpuFrequencyMhz();
+
+#include "freertos/FreeRTOS.h"
+#include "sim.h"
+
+#endif // SIM_ARDUINO_H
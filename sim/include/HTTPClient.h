@@ -0,0 +1,66 @@
+#ifndef SIM_HTTP_CLIENT_H
+#define SIM_HTTP_CLIENT_H
+
+// HTTPClient stand-in. Requests go to the handler installed with
+// sim::set_http_handler(); connect and response latency come from the
+// world's network model and are charged to the virtual clock.
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <vector>
+
+#define HTTPC_ERROR_CONNECTION_REFUSED  (-1)
+#define HTTPC_ERROR_SEND_HEADER_FAILED  (-2)
+#define HTTPC_ERROR_SEND_PAYLOAD_FAILED (-3)
+#define HTTPC_ERROR_NOT_CONNECTED       (-4)
+#define HTTPC_ERROR_CONNECTION_LOST     (-5)
+#define HTTPC_ERROR_NO_HTTP_SERVER      (-7)
+#define HTTPC_ERROR_READ_TIMEOUT        (-11)
+
+#define HTTP_CODE_OK 200
+
+class HTTPClient {
+public:
+  HTTPClient() {}
+  ~HTTPClient() { end(); delete ownClient; }
+
+  bool begin(const String& url);
+  bool begin(WiFiClient& client, const String& url);
+  void end();
+
+  void setReuse(bool reuse) { this->reuse = reuse; }
+  void setTimeout(uint16_t ms) { readTimeoutMs = ms; }
+  void setConnectTimeout(int32_t ms) { connectTimeoutMs = ms; }
+  void addHeader(const String& name, const String& value) { headers.push_back({name, value}); }
+
+  int GET();
+  int POST(const String& body);
+  int POST(const uint8_t* body, size_t len) { return POST(String(std::string((const char*)body, len))); }
+  String getString() { return response; }
+  // Copies the body and consumes it from the connection
+  int writeToStream(Stream* stream) {
+    if (!client) return HTTPC_ERROR_NOT_CONNECTED;
+    size_t n = stream->write((const uint8_t*)response.c_str(), response.length());
+    client->rxPos = client->rx.size();
+    return (int)n;
+  }
+  WiFiClient* getStreamPtr() { return client; }
+  int getSize() { return (int)response.length(); }
+  bool connected() { return client && client->connected(); }
+
+private:
+  WiFiClient* client = nullptr;
+  WiFiClient* ownClient = nullptr;
+  std::string url;
+  std::string host;
+  std::string path;
+  std::vector<std::pair<String, String>> headers;
+  String response;
+  bool reuse = true;
+  uint16_t readTimeoutMs = 5000;
+  int32_t connectTimeoutMs = 5000;
+
+  int send(const char* method, const String& body);
+};
+
+#endif // SIM_HTTP_CLIENT_H
@@ -0,0 +1,57 @@
+#ifndef SIM_RADIO_H
+#define SIM_RADIO_H
+
+// In-process stand-in for ESP-NOW: every SimRadio on a SimAir hears the
+// frames addressed to it after a fixed airtime, minus a share lost at
+// random. Delivery runs on the virtual clock, so the relay logic can be
+// exercised end to end in one process.
+
+#include <LinkTransport.h>
+#include <deque>
+#include <vector>
+
+struct SimFrame {
+  uint8_t from[6];
+  uint8_t to[6];
+  std::vector<uint8_t> data;
+};
+
+class SimRadio;
+
+class SimAir {
+public:
+  uint32_t airtimeUs = 800;       // per frame, ESP-NOW at 1 Mbps plus MAC overhead
+  uint32_t lossPermille = 0;
+  uint32_t sent = 0;
+  uint32_t lost = 0;
+  std::vector<SimFrame> capture;  // everything transmitted, for replay tests
+
+  void join(SimRadio* radio);
+
+  // Put a frame on the air as if from any address (replays, forgeries)
+  void transmit(const uint8_t from[6], const uint8_t to[6], const uint8_t* data, size_t len);
+
+private:
+  std::vector<SimRadio*> radios;
+};
+
+class SimRadio : public LinkTransport {
+public:
+  SimRadio(SimAir& air, const uint8_t mac[6]);
+
+  bool begin(uint8_t channel) override;
+  bool send(const uint8_t mac[6], const uint8_t* data, size_t len) override;
+  size_t receive(uint8_t mac[6], uint8_t* data, size_t capacity) override;
+  void address(uint8_t mac[6]) override;
+  void end() override;
+
+  bool on = false;                // a sleeping or powered-off lock hears nothing
+
+private:
+  friend class SimAir;
+  SimAir& air;
+  uint8_t mac[6];
+  std::deque<SimFrame> inbox;
+};
+
+#endif // SIM_RADIO_H
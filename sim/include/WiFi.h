@@ -0,0 +1,145 @@
+#ifndef SIM_WIFI_H
+#define SIM_WIFI_H
+
+// WiFi stand-in. Association completes after the latency configured in
+// sim::world().net, or never if the scenario says the AP is down. A connect
+// by SSID alone joins the first matching access point in the world's list,
+// whatever its signal, as the driver's fast scan does; one with a channel
+// and BSSID joins that access point and skips the scan. Below weakRssi
+// every round trip over the joined access point takes longer.
+
+#include <Arduino.h>
+
+typedef enum {
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_DISCONNECTED = 6,
+} wl_status_t;
+
+#define WIFI_SCAN_RUNNING (-1)
+#define WIFI_SCAN_FAILED (-2)
+
+typedef enum { WIFI_OFF = 0, WIFI_STA = 1, WIFI_AP = 2, WIFI_AP_STA = 3 } wifi_mode_t;
+
+class IPAddress {
+public:
+  IPAddress() : addr(0) {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : addr(a | (b << 8) | (c << 16) | ((uint32_t)d << 24)) {}
+  IPAddress(uint32_t a) : addr(a) {}
+  operator uint32_t() const { return addr; }
+  uint8_t operator[](int i) const { return (addr >> (8 * i)) & 0xFF; }
+  String toString() const {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%u.%u.%u.%u", (*this)[0], (*this)[1], (*this)[2], (*this)[3]);
+    return String(buf);
+  }
+private:
+  uint32_t addr;
+};
+
+class WiFiClass {
+public:
+  wifi_mode_t mode(wifi_mode_t m) { currentMode = m; return m; }
+  wifi_mode_t getMode() { return currentMode; }
+  wl_status_t begin(const char* ssid, const char* password = nullptr, int32_t channel = 0,
+                    const uint8_t* bssid = nullptr, bool connect = true);
+  wl_status_t status();
+  bool disconnect(bool wifiOff = false, bool eraseAp = false);
+  bool setSleep(bool) { return true; }
+  int8_t RSSI();
+  int32_t channel();
+  String SSID();
+  uint8_t* BSSID();
+
+  // Scan results last until scanDelete() or the next scan
+  int16_t scanNetworks(bool async = false, bool showHidden = false, bool passive = false,
+                       uint32_t maxMsPerChannel = 300, uint8_t channel = 0);
+  int16_t scanComplete();
+  void scanDelete();
+  String SSID(uint8_t i);
+  int32_t RSSI(uint8_t i);
+  uint8_t* BSSID(uint8_t i);
+  int32_t channel(uint8_t i);
+  IPAddress localIP();
+  String macAddress();
+  uint8_t* macAddress(uint8_t* mac);
+  int hostByName(const char* host, IPAddress& result);
+
+private:
+  wifi_mode_t currentMode = WIFI_OFF;
+};
+
+extern WiFiClass WiFi;
+
+// TCP client on the simulated network. Outbound it only tracks which host
+// it is connected to; requests are exchanged by HTTPClient. Connecting
+// charges the DNS lookup (by name only), TCP and, for secure clients, TLS
+// time. A client accepted by WiFiServer talks to a sim::LanPeer instead.
+class WiFiClient {
+public:
+  virtual ~WiFiClient() {}
+  int connect(const char* host, uint16_t port, int32_t timeoutMs = 30000);
+  int connect(IPAddress ip, uint16_t port, int32_t timeoutMs = 30000);
+  bool connected() const { return peer ? peer->open : !host.empty(); }
+  void stop() {
+    if (peer) peer->open = false;
+    peer.reset();
+    host.clear();
+    rx.clear();
+    rxPos = 0;
+  }
+  operator bool() const { return connected(); }
+  void setTimeout(uint32_t) {}
+  void setNoDelay(bool) {}
+  int available() {
+    if (peer) return (int)(peer->toDevice.size() - peer->readPos);
+    return (int)(rx.size() - rxPos);
+  }
+  int read() {
+    if (peer) return peer->readPos < peer->toDevice.size() ? (uint8_t)peer->toDevice[peer->readPos++] : -1;
+    return rxPos < rx.size() ? (uint8_t)rx[rxPos++] : -1;
+  }
+  size_t readBytes(uint8_t* dst, size_t n) {
+    std::string& src = peer ? peer->toDevice : rx;
+    size_t& pos = peer ? peer->readPos : rxPos;
+    n = std::min(n, src.size() - pos);
+    memcpy(dst, src.data() + pos, n);
+    pos += n;
+    return n;
+  }
+  size_t write(const uint8_t* data, size_t n) {
+    if (!peer) return n;
+    if (!peer->open) return 0;
+    peer->fromDevice.append((const char*)data, n);
+    return n;
+  }
+
+  std::string host;    // host:port while connected
+  bool secure = false;
+  std::string rx;      // unread response body
+  size_t rxPos = 0;
+  sim::LanConnection peer;
+
+protected:
+  int handshake(const std::string& name, uint16_t port, int32_t timeoutMs);
+};
+
+// Listening socket. Accepts connections queued by sim::lan_connect().
+class WiFiServer {
+public:
+  explicit WiFiServer(uint16_t port = 80) : port(port) {}
+  ~WiFiServer() { end(); }
+  void begin();
+  void end();
+  void setNoDelay(bool) {}
+  WiFiClient available();
+  operator bool() const { return listening; }
+
+private:
+  uint16_t port;
+  bool listening = false;
+};
+
+#endif // SIM_WIFI_H
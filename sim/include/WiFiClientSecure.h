@@ -0,0 +1,21 @@
+#ifndef SIM_WIFI_CLIENT_SECURE_H
+#define SIM_WIFI_CLIENT_SECURE_H
+
+#include <WiFi.h>
+
+class WiFiClientSecure : public WiFiClient {
+public:
+  WiFiClientSecure() { secure = true; }
+  void setInsecure() {}
+  void setCACert(const char*) {}
+  void setHandshakeTimeout(unsigned long seconds) { handshakeTimeoutMs = seconds * 1000; }
+  using WiFiClient::connect;
+  // Connect to a known address; host is only used for SNI
+  int connect(IPAddress ip, uint16_t port, const char* host, const char* caCert,
+              const char* cert, const char* privateKey);
+
+private:
+  uint32_t handshakeTimeoutMs = 120000;
+};
+
+#endif // SIM_WIFI_CLIENT_SECURE_H
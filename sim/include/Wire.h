@@ -0,0 +1,52 @@
+#ifndef SIM_WIRE_H
+#define SIM_WIRE_H
+
+// Host I2C bus. Devices are models attached by address; every transfer
+// advances the virtual clock by its time on the wire at the bus clock,
+// and START..STOP sequences are counted as transactions.
+
+#include <Arduino.h>
+#include <vector>
+
+class I2CDevice {
+public:
+  virtual ~I2CDevice() {}
+  virtual void onWrite(const uint8_t* data, size_t len) = 0;
+  virtual size_t onRead(uint8_t* data, size_t len) = 0;
+};
+
+class TwoWire {
+public:
+  bool begin(int sda = -1, int scl = -1, uint32_t frequency = 0);
+  void setClock(uint32_t frequency) { clockHz = frequency; }
+
+  void beginTransmission(uint8_t address);
+  size_t write(uint8_t data);
+  uint8_t endTransmission(bool sendStop = true);
+  uint8_t requestFrom(uint8_t address, uint8_t quantity, bool sendStop = true);
+  int available() { return (int)(rx.size() - rxPos); }
+  int read() { return rxPos < rx.size() ? rx[rxPos++] : -1; }
+
+  // Simulation side
+  void attach(uint8_t address, I2CDevice* device);
+  uint32_t transactions = 0;  // completed START..STOP sequences
+  uint64_t busTimeUs = 0;     // total time spent on the wire
+
+private:
+  uint32_t clockHz = 100000;
+  bool inTransaction = false;
+  uint8_t txAddress = 0;
+  std::vector<uint8_t> tx;
+  std::vector<uint8_t> rx;
+  size_t rxPos = 0;
+  I2CDevice* devices[128] = {};
+  double pendingUs = 0;
+
+  void start();
+  void stop();
+  void clockBits(unsigned bits);
+};
+
+extern TwoWire Wire;
+
+#endif // SIM_WIRE_H
@@ -0,0 +1,27 @@
+#ifndef SIM_RTC_IO_H
+#define SIM_RTC_IO_H
+
+// RTC GPIO and deep sleep stand-ins. Levels set here are what the wake
+// logic sees while the simulated chip sleeps.
+
+#include <stdint.h>
+#include "driver/gpio.h"
+#include "esp_sleep.h"
+
+typedef enum {
+  RTC_GPIO_MODE_INPUT_ONLY,
+  RTC_GPIO_MODE_OUTPUT_ONLY,
+  RTC_GPIO_MODE_INPUT_OUTPUT,
+  RTC_GPIO_MODE_DISABLED,
+} rtc_gpio_mode_t;
+
+esp_err_t rtc_gpio_init(gpio_num_t pin);
+esp_err_t rtc_gpio_deinit(gpio_num_t pin);
+esp_err_t rtc_gpio_set_direction(gpio_num_t pin, rtc_gpio_mode_t mode);
+esp_err_t rtc_gpio_set_level(gpio_num_t pin, uint32_t level);
+esp_err_t rtc_gpio_pullup_en(gpio_num_t pin);
+esp_err_t rtc_gpio_pullup_dis(gpio_num_t pin);
+esp_err_t rtc_gpio_pulldown_en(gpio_num_t pin);
+esp_err_t rtc_gpio_pulldown_dis(gpio_num_t pin);
+
+#endif // SIM_RTC_IO_H
@@ -0,0 +1,23 @@
+#ifndef SIM_ESP_OTA_OPS_H
+#define SIM_ESP_OTA_OPS_H
+
+// Only the running image's identity. Build with -DSIM_APP_ELF_SHA=... to
+// stand in for a different image.
+
+#include <stddef.h>
+#include <string.h>
+
+#ifndef SIM_APP_ELF_SHA
+#define SIM_APP_ELF_SHA "5e1f0c0ffee0c0de5e1f0c0ffee0c0de5e1f0c0ffee0c0de5e1f0c0ffee0c0de"
+#endif
+
+// Hex ELF SHA-256, truncated to fit (size includes the terminator)
+static inline int esp_ota_get_app_elf_sha256(char* dst, size_t size) {
+  if (size == 0) return 0;
+  size_t n = strlen(SIM_APP_ELF_SHA) < size - 1 ? strlen(SIM_APP_ELF_SHA) : size - 1;
+  memcpy(dst, SIM_APP_ELF_SHA, n);
+  dst[n] = '\0';
+  return (int)n;
+}
+
+#endif // SIM_ESP_OTA_OPS_H
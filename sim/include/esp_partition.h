@@ -0,0 +1,50 @@
+#ifndef SIM_ESP_PARTITION_H
+#define SIM_ESP_PARTITION_H
+
+// The data partitions of partitions.csv, backed by the world's flash so
+// they survive deep sleep and power cuts. NOR semantics: erase sets a
+// 4 KB sector to 0xFF, writes can only clear bits. Reads, writes and
+// erases take flash time on the virtual clock, stalling every task as the
+// flash cache does on the chip.
+
+#include <stddef.h>
+#include <stdint.h>
+#include "driver/gpio.h"
+
+#define ESP_ERR_INVALID_ARG 0x102
+#define ESP_ERR_INVALID_SIZE 0x104
+#define SPI_FLASH_SEC_SIZE 4096
+
+typedef enum {
+  ESP_PARTITION_TYPE_APP = 0x00,
+  ESP_PARTITION_TYPE_DATA = 0x01,
+} esp_partition_type_t;
+
+typedef enum {
+  ESP_PARTITION_SUBTYPE_DATA_SPIFFS = 0x82,
+  ESP_PARTITION_SUBTYPE_ANY = 0xff,
+} esp_partition_subtype_t;
+
+typedef struct {
+  esp_partition_type_t type;
+  uint8_t subtype;
+  uint32_t address;
+  uint32_t size;
+  char label[17];
+  bool encrypted;
+} esp_partition_t;
+
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char* label);
+esp_err_t esp_partition_read(const esp_partition_t* partition, size_t src_offset, void* dst, size_t size);
+esp_err_t esp_partition_write(const esp_partition_t* partition, size_t dst_offset, const void* src, size_t size);
+esp_err_t esp_partition_erase_range(const esp_partition_t* partition, size_t offset, size_t size);
+
+namespace sim {
+// Give a partition another size, up to what DATA_FLASH_SIZE leaves it
+// (benchmarks of larger layouts). Call before the firmware opens it.
+bool resize_partition(const char* label, uint32_t size);
+// Give a partition another label and subtype (an older partition table)
+bool relabel_partition(const char* label, const char* to, uint8_t subtype);
+}
+
+#endif // SIM_ESP_PARTITION_H
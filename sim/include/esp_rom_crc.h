@@ -0,0 +1,26 @@
+#ifndef SIM_ESP_ROM_CRC_H
+#define SIM_ESP_ROM_CRC_H
+
+// The ROM's little-endian CRC-32 (IEEE 802.3) and CRC-8, done in software
+
+#include <stdint.h>
+
+static inline uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t* buf, uint32_t len) {
+  crc = ~crc;
+  while (len--) {
+    crc ^= *buf++;
+    for (int i = 0; i < 8; i++) crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+  }
+  return ~crc;
+}
+
+static inline uint8_t esp_rom_crc8_le(uint8_t crc, const uint8_t* buf, uint32_t len) {
+  crc = ~crc;
+  while (len--) {
+    crc ^= *buf++;
+    for (int i = 0; i < 8; i++) crc = (crc >> 1) ^ (0x8C & (0u - (crc & 1)));
+  }
+  return ~crc;
+}
+
+#endif // SIM_ESP_ROM_CRC_H
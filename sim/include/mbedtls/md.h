@@ -0,0 +1,34 @@
+#ifndef SIM_MBEDTLS_MD_H
+#define SIM_MBEDTLS_MD_H
+
+// mbedtls message digest API, SHA-512 only, backed by a portable
+// software implementation for the host build.
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum { MBEDTLS_MD_NONE = 0, MBEDTLS_MD_SHA512 = 8 } mbedtls_md_type_t;
+
+typedef struct mbedtls_md_info_t mbedtls_md_info_t;
+
+typedef struct {
+  uint64_t state[8];
+  uint64_t length;
+  uint8_t block[128];
+  size_t used;
+  uint8_t hmacKey[128];  // key padded to the block size, HMAC only
+  int hmac;
+} mbedtls_md_context_t;
+
+const mbedtls_md_info_t* mbedtls_md_info_from_type(mbedtls_md_type_t type);
+void mbedtls_md_init(mbedtls_md_context_t* ctx);
+void mbedtls_md_free(mbedtls_md_context_t* ctx);
+int mbedtls_md_setup(mbedtls_md_context_t* ctx, const mbedtls_md_info_t* info, int hmac);
+int mbedtls_md_starts(mbedtls_md_context_t* ctx);
+int mbedtls_md_update(mbedtls_md_context_t* ctx, const unsigned char* input, size_t len);
+int mbedtls_md_finish(mbedtls_md_context_t* ctx, unsigned char* output);
+int mbedtls_md_hmac_starts(mbedtls_md_context_t* ctx, const unsigned char* key, size_t keylen);
+int mbedtls_md_hmac_update(mbedtls_md_context_t* ctx, const unsigned char* input, size_t len);
+int mbedtls_md_hmac_finish(mbedtls_md_context_t* ctx, unsigned char* output);
+
+#endif // SIM_MBEDTLS_MD_H
@@ -0,0 +1,11 @@
+#ifndef SIM_MBEDTLS_SHA1_H
+#define SIM_MBEDTLS_SHA1_H
+
+// mbedtls one-shot SHA-1 backed by a portable software implementation.
+
+#include <stddef.h>
+#include <stdint.h>
+
+int mbedtls_sha1(const unsigned char* input, size_t len, unsigned char output[20]);
+
+#endif // SIM_MBEDTLS_SHA1_H
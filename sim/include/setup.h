@@ -0,0 +1,27 @@
+#ifndef SETUP_H
+#define SETUP_H
+
+// Credentials for the host simulator. The DoLynk stand-in checks request
+// signatures against these, so they only need to agree with each other.
+
+#define DEVICE_PASSWORD "1234"
+
+#define WIFI_SSID "sim-ap"
+#define WIFI_PASSWORD "sim-password"
+
+#define ACCESS_KEY "sim_access_key"
+#define SECRET_ACCESS_KEY "sim_secret_access_key"
+#define PRODUCT_ID "sim_product"
+#define DEVICE_ID "sim_device"
+#define BASE_URL "https://open-api-sg.dolynkcloud.com/open-api"
+
+#define MAILTRAP_TOKEN "sim_mailtrap_token"
+#define MAILTRAP_SANDBOX_ID "0"
+#define MAILTRAP_SENDER "noreply@revolock.com"
+#define MAILTRAP_RECIPIENT "admin@revolock.com"
+
+#define WIFI_TIMEOUT 10000
+
+#define LOCAL_API_KEY "sim_local_api_key"
+
+#endif // SETUP_H
@@ -0,0 +1,230 @@
+#ifndef SIM_H
+#define SIM_H
+
+// Simulation controls that firmware code never calls: the world model
+// (virtual clock, network, deep sleep, RTC memory), GPIO wiring, timed
+// events and the HTTP stand-in.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace sim {
+
+const int PIN_COUNT = 40;
+const size_t RTC_MEMORY_SIZE = 8192;   // ESP32 RTC slow memory
+const int NVS_ENTRIES = 32;
+const size_t NVS_VALUE_SIZE = 512;
+const int MAX_ACCESS_POINTS = 4;
+const size_t DATA_FLASH_SIZE = 0x100000; // room for the data partitions the firmware opens
+
+/* ---------------- World ---------------- */
+// One access point of the site's network
+struct AccessPoint {
+  char ssid[33] = "sim-ap";
+  uint8_t bssid[6] = {0x02, 0x00, 0x5E, 0x00, 0x00, 0x01};
+  uint8_t channel = 1;
+  int8_t rssi = -60;                 // at the lock
+  uint64_t fadeFromUs = 0;           // 20 dB weaker in [fadeFromUs, fadeUntilUs)
+  uint64_t fadeUntilUs = 0;
+};
+
+struct NetworkModel {
+  bool wifiAvailable = true;
+  uint32_t associateMs = 1200;       // WiFi association + DHCP, including the driver's scan
+  uint32_t associateJitterMs = 800;
+  uint32_t knownApSavingMs = 400;    // saved when the channel and BSSID are given
+  uint32_t scanMs = 1000;            // scan of every channel
+  AccessPoint aps[MAX_ACCESS_POINTS]; // a connect by SSID alone joins the first that matches
+  uint8_t apCount = 1;
+  int8_t weakRssi = -67;             // below this, retransmits stretch every round trip
+  uint32_t weakMsPerDb = 20;
+  uint32_t ntpMs = 300;              // first SNTP answer
+  uint32_t dnsMs = 40;
+  uint32_t addressEpoch = 0;         // bump to move every server to a new address
+  uint32_t handshakeMs = 450;        // TCP + TLS on a new connection, at 240 MHz
+  uint32_t handshakeCpuMs = 150;     // of which key exchange, scaling with the CPU clock
+  uint32_t rttMs = 120;              // request to response
+  uint32_t rttJitterMs = 80;
+  uint32_t failurePermille = 0;      // answered with HTTP 500
+  uint32_t timeoutPermille = 0;      // never answered
+};
+
+struct SleepState {
+  bool ext0Armed = false;
+  uint8_t ext0Pin = 0;
+  uint8_t ext0Level = 0;
+  bool ext1Armed = false;
+  uint64_t ext1Mask = 0;
+  int ext1Mode = 0;
+  bool timerArmed = false;
+  uint64_t timerUs = 0;
+  bool held[PIN_COUNT] = {};         // gpio_hold_en / rtc_gpio level while asleep
+  uint8_t heldLevel[PIN_COUNT] = {};
+  bool pulldown[PIN_COUNT] = {};
+  int wakeCause = 0;                 // esp_sleep_wakeup_cause_t of the current boot
+  uint64_t ext1Status = 0;
+};
+
+struct NetworkCounters {
+  uint32_t requests = 0;
+  uint32_t handshakes = 0;
+  uint32_t failures = 0;     // 5xx and transport errors
+  uint32_t dnsLookups = 0;
+  uint32_t apConnects[MAX_ACCESS_POINTS] = {};
+  uint32_t apRequests[MAX_ACCESS_POINTS] = {};
+  uint64_t apRequestMs[MAX_ACCESS_POINTS] = {}; // sum over the requests
+  uint32_t scans = 0;
+};
+
+struct FlashCounters {
+  uint64_t readBytes = 0;
+  uint32_t writes = 0;
+  uint32_t erases = 0;
+};
+// One key/value pair of the NVS partition (Preferences)
+struct NvsEntry {
+  bool used = false;
+  char ns[16] = {};
+  char key[16] = {};
+  uint16_t len = 0;
+  uint8_t data[NVS_VALUE_SIZE];
+};
+
+// Everything that outlives a single boot. Plain data, so a runner can
+// keep it in memory shared across forked boots.
+struct World {
+  uint64_t clockUs = 0;
+  uint64_t rngState = 0x9E3779B97F4A7C15ull;
+  bool wallValid = false;            // set by the first SNTP sync, kept across deep sleep
+  int64_t wallOffsetUs = 0;          // epoch us = clockUs + wallOffsetUs
+  uint64_t ntpEpochUs = 1767225600ull * 1000000ull; // epoch at clock 0 (2026-01-01)
+  NetworkModel net;
+  SleepState sleep;
+  NetworkCounters counters;
+  uint32_t boots = 0;
+  bool rtcValid = false;
+  size_t rtcSize = 0;
+  uint8_t rtc[RTC_MEMORY_SIZE];
+  NvsEntry nvs[NVS_ENTRIES];         // survives power loss
+  uint32_t nvsWrites = 0;
+  bool flashValid = false;           // dataFlash reads erased (0xFF) until first used
+  uint8_t dataFlash[DATA_FLASH_SIZE]; // esp_partition data partitions, survive power loss
+  FlashCounters flash;
+};
+
+World& world();
+void use_world(World* w);             // default is a process-local instance
+
+
+/* ---------------- Virtual clock ---------------- */
+uint64_t now_us();
+
+// Move virtual time forward, running timed events that fall due on the
+// way at their exact time, then notify the clock listeners. While FreeRTOS
+// tasks exist, the caller sleeps instead and the others run until then.
+void advance_us(uint64_t us);
+
+// advance_us() without the task switch; used by the task scheduler
+void clock_to(uint64_t whenUs);
+
+// Hand the CPU to other tasks until the clock reaches whenUs (FreeRTOS.cpp)
+void sleep_until(uint64_t whenUs);
+
+// Idle fast path for the tasks' one-tick polls. Once no task has queued or
+// given anything for a while, a poll of a tick or less wakes on the next
+// multiple of tickUs instead, but never after quietUntil(now): the next
+// time the runner's inputs need every tick (now or earlier while they do).
+// Timed events still run at their exact time. tickUs 0, the default, keeps
+// every poll exact.
+typedef std::function<uint64_t(uint64_t nowUs)> QuietUntil;
+void set_idle_tick(uint64_t tickUs, QuietUntil quietUntil);
+
+typedef std::function<void(uint64_t nowUs)> ClockListener;
+void on_advance(ClockListener listener);
+
+// Run fn when the virtual clock reaches whenUs. Returns an id for cancel().
+uint32_t at(uint64_t whenUs, std::function<void()> fn);
+void cancel(uint32_t id);
+
+/* ---------------- GPIO ---------------- */
+int pin_mode(uint8_t pin);
+int pin_level(uint8_t pin);           // last level written by the firmware
+
+// Model an external circuit driving an input: returns the level
+// digitalRead() sees, or -1 to fall back to pull-ups/pull-downs.
+typedef std::function<int(uint8_t pin)> InputModel;
+void set_input_model(uint8_t pin, InputModel model);
+
+// Observe every digitalWrite()/pinMode() (LED timelines, bus sniffing).
+typedef std::function<void(uint8_t pin, uint8_t mode, uint8_t level)> PinListener;
+void on_pin_change(PinListener listener);
+
+// Duty of the LEDC channel attached to a pin, 0 if none.
+uint32_t led_duty(uint8_t pin);
+
+/* ---------------- Randomness ---------------- */
+void seed(uint64_t seed);
+
+/* ---------------- HTTP ---------------- */
+struct HttpRequest {
+  std::string method;
+  std::string host;
+  std::string path;
+  std::vector<std::pair<std::string, std::string>> headers;
+  std::string body;
+
+  std::string header(const char* name) const;
+};
+
+struct HttpResponse {
+  int code;
+  std::string body;
+  uint32_t extraLatencyMs = 0;
+};
+
+typedef std::function<HttpResponse(const HttpRequest&)> HttpHandler;
+void set_http_handler(HttpHandler handler);
+
+NetworkCounters& network_counters();
+
+/* ---------------- LAN ---------------- */
+// A host on the LAN connected to a WiFiServer on the device: the device
+// reads toDevice and writes to fromDevice. Either side closes by clearing
+// open.
+struct LanPeer {
+  std::string toDevice;
+  std::string fromDevice;
+  size_t readPos = 0;     // bytes of toDevice the device has read
+  bool open = true;
+};
+typedef std::shared_ptr<LanPeer> LanConnection;
+
+// Connect to the device's port. Refused (open is false) unless WiFi is up
+// and a server listens on it; otherwise the next WiFiServer::available()
+// accepts it.
+LanConnection lan_connect(uint16_t port);
+
+/* ---------------- Boot lifecycle ---------------- */
+// Start a boot: restore RTC memory from the world (or keep the image's
+// initial values on a cold boot) and clear per-boot state.
+void begin_boot();
+
+// Called by esp_deep_sleep_start() after RTC memory has been saved to the
+// world. Must not return; the default handler exits the process.
+void set_deep_sleep_handler(std::function<void()> handler);
+
+// Cut and restore power between boots: RTC memory, GPIO holds and the
+// wall clock are lost, NVS is kept. The next boot is a power-on boot.
+void power_cycle();
+
+/* ---------------- Reset ---------------- */
+// Clear clock, pins, events and listeners between independent runs.
+void reset();
+
+}
+
+#endif // SIM_H
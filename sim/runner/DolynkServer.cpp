@@ -0,0 +1,145 @@
+#include "DolynkServer.h"
+#include <Arduino.h>
+#include <mbedtls/md.h>
+#include "setup.h"
+
+namespace sim {
+
+static std::string hex(const unsigned char* bytes, size_t n, bool upper) {
+  static const char* digits[2] = {"0123456789abcdef", "0123456789ABCDEF"};
+  std::string out;
+  for (size_t i = 0; i < n; i++) {
+    out += digits[upper][bytes[i] >> 4];
+    out += digits[upper][bytes[i] & 0xF];
+  }
+  return out;
+}
+
+static std::string sha512Hex(const std::string& data) {
+  unsigned char out[64];
+  mbedtls_md_context_t ctx;
+  mbedtls_md_init(&ctx);
+  mbedtls_md_setup(&ctx, mbedtls_md_info_from_type(MBEDTLS_MD_SHA512), 0);
+  mbedtls_md_starts(&ctx);
+  mbedtls_md_update(&ctx, (const unsigned char*)data.data(), data.size());
+  mbedtls_md_finish(&ctx, out);
+  mbedtls_md_free(&ctx);
+  return hex(out, sizeof(out), false);
+}
+
+static std::string hmacHex(const std::string& key, const std::string& data) {
+  unsigned char out[64];
+  mbedtls_md_context_t ctx;
+  mbedtls_md_init(&ctx);
+  mbedtls_md_setup(&ctx, mbedtls_md_info_from_type(MBEDTLS_MD_SHA512), 1);
+  mbedtls_md_hmac_starts(&ctx, (const unsigned char*)key.data(), key.size());
+  mbedtls_md_hmac_update(&ctx, (const unsigned char*)data.data(), data.size());
+  mbedtls_md_hmac_finish(&ctx, out);
+  mbedtls_md_free(&ctx);
+  return hex(out, sizeof(out), true);
+}
+
+// Value of a flat "key":"value" pair; enough for the bodies RevoLock sends.
+static std::string field(const std::string& json, const char* key) {
+  std::string needle = std::string("\"") + key + "\":\"";
+  size_t start = json.find(needle);
+  if (start == std::string::npos) return std::string();
+  start += needle.size();
+  size_t end = json.find('"', start);
+  return end == std::string::npos ? std::string() : json.substr(start, end - start);
+}
+
+static DolynkAbility* findAbility(DolynkServerState& state, const std::string& device, const std::string& ability,
+                                  bool create) {
+  for (int i = 0; i < state.abilityCount; i++) {
+    DolynkAbility& a = state.abilities[i];
+    if (device == a.deviceId && ability == a.ability) return &a;
+  }
+  if (!create || state.abilityCount >= (int)(sizeof(state.abilities) / sizeof(state.abilities[0]))) return nullptr;
+  DolynkAbility& a = state.abilities[state.abilityCount++];
+  snprintf(a.deviceId, sizeof(a.deviceId), "%s", device.c_str());
+  snprintf(a.ability, sizeof(a.ability), "%s", ability.c_str());
+  snprintf(a.status, sizeof(a.status), "off");
+  return &a;
+}
+
+static bool modelHas(const DolynkServerState& state, const std::string& ability) {
+  for (int i = 0; i < state.modelAbilityCount; i++) {
+    if (ability == state.modelAbilities[i]) return true;
+  }
+  return state.modelAbilityCount == 0;
+}
+
+static HttpResponse reply(const DolynkServerState& state, const std::string& body) {
+  HttpResponse res{200, body};
+  res.extraLatencyMs = state.processingMs;
+  return res;
+}
+
+HttpResponse dolynk_handle(DolynkServerState& state, const HttpRequest& req) {
+  const std::string prefix = "/open-api";
+  if (req.host.find("dolynkcloud") == std::string::npos) return HttpResponse{200, ""};
+
+  uint64_t now = now_us();
+  for (int i = 0; i < state.outageCount; i++) {
+    if (now >= state.outageStartUs[i] && now < state.outageEndUs[i]) {
+      state.outageRejected++;
+      return HttpResponse{503, ""};
+    }
+  }
+
+  std::string path = req.path.compare(0, prefix.size(), prefix) == 0 ? req.path.substr(prefix.size()) : req.path;
+  std::string token = req.header("AppAccessToken");
+  std::string timestamp = req.header("Timestamp");
+  std::string nonce = req.header("Nonce");
+
+  if (path == "/api-base/auth/getAppAccessToken") {
+    std::string expected = hmacHex(SECRET_ACCESS_KEY, std::string(ACCESS_KEY) + timestamp + nonce + "POST");
+    if (req.header("Sign") != expected) {
+      state.rejected++;
+      return reply(state, "{\"code\":\"401\",\"msg\":\"sign error\"}");
+    }
+    state.tokensIssued++;
+    return reply(state, "{\"code\":\"200\",\"data\":{\"appAccessToken\":\"sim-token-" +
+                        std::to_string(state.tokensIssued) + "\",\"expireTime\":604800}}");
+  }
+
+  std::string expected = hmacHex(SECRET_ACCESS_KEY, std::string(ACCESS_KEY) + token + timestamp + nonce +
+                                 "POST\n" + sha512Hex(req.body));
+  if (token.compare(0, 10, "sim-token-") != 0 || req.header("Sign") != expected) {
+    state.rejected++;
+    return reply(state, "{\"code\":\"401\",\"msg\":\"sign error\"}");
+  }
+
+  std::string device = field(req.body, "deviceId");
+  if (path == "/api-iot/device/getDeviceInfo") {
+    state.infoCalls++;
+    return reply(state, "{\"code\":\"200\",\"data\":{\"deviceId\":\"" + device + "\",\"version\":\"" +
+                        state.firmwareVersion + "\"}}");
+  }
+
+  std::string ability = field(req.body, "abilityType");
+  if (!modelHas(state, ability)) {
+    state.unsupported++;
+    return reply(state, "{\"code\":\"1001\",\"msg\":\"ability not supported\"}");
+  }
+
+  if (path == "/api-iot/device/setAbilityStatus") {
+    DolynkAbility* a = findAbility(state, device, ability, true);
+    if (!a) return reply(state, "{\"code\":\"500\",\"msg\":\"too many abilities\"}");
+    snprintf(a->status, sizeof(a->status), "%s", field(req.body, "status").c_str());
+    state.setCalls++;
+    state.lastAckUs = now;
+    return reply(state, "{\"code\":\"200\",\"msg\":\"success\",\"data\":null}");
+  }
+
+  if (path == "/api-iot/device/getAbilityStatus") {
+    DolynkAbility* a = findAbility(state, device, ability, false);
+    state.getCalls++;
+    return reply(state, std::string("{\"code\":\"200\",\"data\":{\"status\":\"") + (a ? a->status : "off") + "\"}}");
+  }
+
+  return HttpResponse{404, ""};
+}
+
+}
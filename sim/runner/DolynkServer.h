@@ -0,0 +1,50 @@
+#ifndef SIM_DOLYNK_SERVER_H
+#define SIM_DOLYNK_SERVER_H
+
+// DoLynk open API stand-in: issues tokens, checks request signatures and
+// keeps ability status per device. State is plain data so it can live in
+// memory shared across forked boots.
+
+#include <sim.h>
+
+namespace sim {
+
+struct DolynkAbility {
+  char deviceId[48];
+  char ability[32];
+  char status[8];
+};
+
+struct DolynkServerState {
+  DolynkAbility abilities[64];
+  int abilityCount = 0;
+
+  // Ability names the device model has; any other is refused. Empty: all.
+  char modelAbilities[8][32];
+  int modelAbilityCount = 0;
+
+  uint32_t tokensIssued = 0;
+  uint32_t setCalls = 0;
+  uint32_t getCalls = 0;
+  uint32_t rejected = 0;          // bad signature or unknown token
+  uint32_t unsupported = 0;       // calls for an ability the model lacks
+  uint32_t infoCalls = 0;         // getDeviceInfo
+  char firmwareVersion[32] = "2.840.0000000.3.R";
+  uint64_t lastAckUs = 0;         // last accepted setAbilityStatus
+
+  // Scheduled outages: the API answers 503 while one is active
+  uint64_t outageStartUs[32];
+  uint64_t outageEndUs[32];
+  int outageCount = 0;
+  uint32_t outageRejected = 0;
+
+  uint32_t processingMs = 30;     // server time per request
+};
+
+// Handle one request for the DoLynk host; other hosts get a 200 with an
+// empty body.
+HttpResponse dolynk_handle(DolynkServerState& state, const HttpRequest& req);
+
+}
+
+#endif // SIM_DOLYNK_SERVER_H
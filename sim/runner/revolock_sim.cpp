@@ -0,0 +1,700 @@
+// Whole-firmware host simulator. Each boot runs setup()/loop() in a forked
+// child against the virtual clock; deep sleep ends the child, and the
+// parent fast-forwards to the next wake-up from the scripted key presses.
+// RTC memory, the world model, the DoLynk stand-in and the statistics live
+// in shared memory so they carry over from boot to boot.
+//
+//   revolock_sim --days 1000 --per-day 8 --seed 1 --rtt 120 --fail 20
+
+#include <Arduino.h>
+#include <esp_sleep.h>
+#include "DolynkServer.h"
+#include "Metrics.h"
+#include "CpuPower.h"
+#include "LocalApi.h"
+#include "AuditLog.h"
+#include "setup.h"
+#include <mbedtls/md.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <chrono>
+#include <new>
+#include <random>
+#include <vector>
+
+void setup();
+void loop();
+
+/* =========================================================
+   KEYPAD WIRING (mirrors src/main.cpp)
+   ========================================================= */
+static const uint8_t rowPins[4] = {16, 17, 18, 13};
+static const uint8_t colPins[4] = {26, 25, 33, 32};
+static const char keymap[4][4] = {
+  {'1','2','3','A'},
+  {'4','5','6','B'},
+  {'7','8','9','C'},
+  {'*','0','#','D'}
+};
+
+static const uint64_t MS = 1000;
+static const uint64_t SECOND = 1000 * MS;
+static const uint64_t DAY = 86400 * SECOND;
+static const uint64_t BOOT_US = 250 * MS;        // ROM + bootloader + app start before setup()
+static const uint64_t MAX_AWAKE_US = 3600 * SECOND;
+static const uint64_t POWER_OFF_US = 30 * SECOND;  // length of a power cut
+static const uint64_t IDLE_TICK_US = 50 * MS;      // poll step while nothing is going on
+static const uint64_t KEY_SETTLE_US = 100 * MS;    // every tick after a key breaks, for the debouncer
+
+struct KeyPress {
+  uint64_t atUs;
+  uint32_t holdUs;
+  uint8_t row, col;
+  char key;
+};
+
+/* =========================================================
+   STATISTICS
+   ========================================================= */
+struct Samples {
+  static const uint32_t CAPACITY = 1 << 18;
+  uint32_t count;
+  uint32_t values[CAPACITY];   // microseconds (or plain counts)
+
+  void add(uint64_t v) {
+    if (count < CAPACITY) values[count++] = (uint32_t)std::min<uint64_t>(v, UINT32_MAX);
+  }
+};
+
+struct Stats {
+  Samples wakeToReady;       // '*' press -> "System initialized"
+  Samples hashToLocked;      // '#' press -> "SITE LOCKED/UNLOCKED"
+  Samples hashToAck;         // '#' press -> DoLynk accepted the last ability
+  Samples keyToEvent;        // digit press -> "Key pressed"
+  Samples lanToReply;        // LAN command sent -> full reply received
+  Samples awake;             // key press -> deep sleep
+  Samples requestsPerBoot;
+
+  uint32_t boots, keyWakes, timerWakes;
+  uint32_t toggles, denied, abandoned, deferred;
+  uint32_t hashPresses;
+  uint32_t digitPresses, digitEvents;
+  uint32_t stuckBoots;
+  uint32_t powerCuts, lockStateLost;
+  uint32_t lanSent, lanAnswered, lanRefused, lanRejected, lanToggles, lanEvents;
+  uint64_t awakeUs;
+  uint64_t phaseUs[PHASE_COUNT];  // CpuPower's accounting, summed over boots
+  uint64_t energyUj, fixedClockUj;
+};
+
+struct Shared {
+  sim::World world;
+  sim::DolynkServerState server;
+  Stats stats;
+  uint64_t wakePressUs;      // key press that caused the current boot, 0 for others
+  uint64_t sleptAtUs;
+  bool lockKnown;            // lock state the firmware last reported
+  bool locked;
+  char metrics[16384];       // device's /metrics page as of its last sleep
+  size_t metricsLen;
+};
+
+/* =========================================================
+   OPTIONS AND SCENARIO
+   ========================================================= */
+struct Options {
+  int days = 30;
+  int perDay = 8;
+  uint64_t seed = 1;
+  int wrongPercent = 10;
+  int abandonPercent = 5;
+  int outages = 0;
+  int powerCuts = 0;
+  int dnsMoves = 0;
+  uint32_t bounceMs = 0;
+  int lanPercent = 0;
+  std::string abilities;     // comma-separated names the DoLynk device model has
+  int apFades = 0;           // access points that fade for a few hours once
+  bool verbose = false;
+  bool metrics = false;
+  bool exact = false;        // every poll on its own tick, even while idle
+  sim::NetworkModel net;
+};
+
+static void usage() {
+  fprintf(stderr,
+    "usage: revolock_sim [--days N] [--per-day N] [--seed N] [--wrong PCT] [--abandon PCT]\n"
+    "                    [--rtt MS] [--jitter MS] [--handshake MS] [--associate MS]\n"
+    "                    [--fail PERMILLE] [--timeout PERMILLE] [--outages N] [--power-cuts N] [--no-wifi] [--verbose]\n"
+    "                    [--dns-moves N] [--bounce MS] [--lan PCT] [--abilities NAME,...] [--metrics]\n"
+    "                    [--aps SSID:RSSI:CHANNEL,...] [--ap-fade N] [--exact]\n");
+  exit(1);
+}
+
+// "sim-ap:-84:1,sim-ap:-58:6": one access point each, BSSIDs numbered in order
+static void parseAccessPoints(sim::NetworkModel& net, const char* list) {
+  net.apCount = 0;
+  for (const char* p = list; *p && net.apCount < sim::MAX_ACCESS_POINTS;) {
+    sim::AccessPoint& ap = net.aps[net.apCount];
+    int rssi = 0, channel = 0, used = 0;
+    char ssid[33];
+    if (sscanf(p, "%32[^:]:%d:%d%n", ssid, &rssi, &channel, &used) != 3) usage();
+    snprintf(ap.ssid, sizeof(ap.ssid), "%s", ssid);
+    ap.rssi = rssi;
+    ap.channel = channel;
+    ap.bssid[5] = net.apCount + 1;
+    net.apCount++;
+    p += used;
+    if (*p == ',') p++;
+  }
+  if (!net.apCount) usage();
+}
+
+static Options parseOptions(int argc, char** argv) {
+  Options o;
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    auto next = [&]() -> long { if (i + 1 >= argc) usage(); return atol(argv[++i]); };
+    if (a == "--days") o.days = next();
+    else if (a == "--per-day") o.perDay = next();
+    else if (a == "--seed") o.seed = next();
+    else if (a == "--wrong") o.wrongPercent = next();
+    else if (a == "--abandon") o.abandonPercent = next();
+    else if (a == "--rtt") o.net.rttMs = next();
+    else if (a == "--jitter") o.net.rttJitterMs = next();
+    else if (a == "--handshake") o.net.handshakeMs = next();
+    else if (a == "--associate") o.net.associateMs = next();
+    else if (a == "--fail") o.net.failurePermille = next();
+    else if (a == "--timeout") o.net.timeoutPermille = next();
+    else if (a == "--outages") o.outages = next();
+    else if (a == "--power-cuts") o.powerCuts = next();
+    else if (a == "--dns-moves") o.dnsMoves = next();
+    else if (a == "--bounce") o.bounceMs = next();
+    else if (a == "--lan") o.lanPercent = next();
+    else if (a == "--abilities") { if (i + 1 >= argc) usage(); o.abilities = argv[++i]; }
+    else if (a == "--aps") { if (i + 1 >= argc) usage(); parseAccessPoints(o.net, argv[++i]); }
+    else if (a == "--ap-fade") o.apFades = next();
+    else if (a == "--no-wifi") o.net.wifiAvailable = false;
+    else if (a == "--verbose") o.verbose = true;
+    else if (a == "--metrics") o.metrics = true;
+    else if (a == "--exact") o.exact = true;
+    else usage();
+  }
+  return o;
+}
+
+static void findKey(char key, uint8_t& row, uint8_t& col) {
+  for (uint8_t r = 0; r < 4; r++)
+    for (uint8_t c = 0; c < 4; c++)
+      if (keymap[r][c] == key) { row = r; col = c; return; }
+}
+
+// People wake the panel with '*', wait for the LEDs, then type the PIN.
+// Some mistype it and retry, some walk away halfway through.
+static std::vector<KeyPress> makeScenario(const Options& o, std::mt19937_64& rng) {
+  std::vector<KeyPress> presses;
+  auto uniform = [&](uint64_t lo, uint64_t hi) { return lo + rng() % (hi - lo + 1); };
+  auto press = [&](uint64_t& t, char key) {
+    KeyPress p;
+    p.atUs = t;
+    p.holdUs = uniform(80, 200) * MS;
+    p.key = key;
+    findKey(key, p.row, p.col);
+    presses.push_back(p);
+    t += p.holdUs + uniform(150, 500) * MS;
+  };
+  auto type = [&](uint64_t& t, const char* digits) { for (const char* d = digits; *d; d++) press(t, *d); };
+
+  for (int day = 0; day < o.days; day++) {
+    std::vector<uint64_t> starts;
+    for (int i = 0; i < o.perDay; i++) starts.push_back(day * DAY + uniform(7 * 3600, 22 * 3600) * SECOND);
+    std::sort(starts.begin(), starts.end());
+
+    uint64_t busyUntil = day * DAY;
+    for (uint64_t start : starts) {
+      uint64_t t = std::max(start, busyUntil + 3 * 60 * SECOND);
+      press(t, '*');
+      t += uniform(3000, 6000) * MS;
+
+      int roll = uniform(0, 99);
+      if (roll < o.abandonPercent) {
+        type(t, "12");
+      } else {
+        if (roll < o.abandonPercent + o.wrongPercent) {
+          type(t, "9999");
+          press(t, '#');
+          t += uniform(1000, 3000) * MS;
+        }
+        type(t, DEVICE_PASSWORD);
+        press(t, '#');
+      }
+      busyUntil = t;
+    }
+  }
+  return presses;
+}
+
+// An on-site access control server follows some '#' presses with a
+// command of its own over the local API while the device is still awake
+struct LanCommand {
+  uint64_t atUs;
+  const char* method;
+  const char* path;
+};
+
+static std::vector<LanCommand> makeLanCommands(const Options& o, const std::vector<uint64_t>& hashes, std::mt19937_64& rng) {
+  static const char* const paths[3] = {"/state", "/lock", "/unlock"};
+  std::vector<LanCommand> commands;
+  for (uint64_t hash : hashes) {
+    if ((int)(rng() % 100) >= o.lanPercent) continue;
+    int kind = rng() % 3;
+    commands.push_back({hash + (2000 + rng() % 38000) * MS, kind ? "POST" : "GET", paths[kind]});
+  }
+  return commands;
+}
+
+/* =========================================================
+   ONE BOOT (child process)
+   ========================================================= */
+static Shared* shared;
+static std::vector<KeyPress> presses;
+static std::vector<LanCommand> lanCommands;
+static std::vector<uint64_t> hashTimes;
+static std::vector<uint64_t> digitTimes;
+static uint64_t bounceUs;                 // contact chatter after make and break
+static std::vector<uint64_t> powerCuts;
+static std::vector<uint64_t> dnsMoves;    // servers move to new addresses
+static uint64_t endUs;
+
+// Presses are time-ordered and never overlap, so a cursor is enough.
+static size_t pressCursor = 0;
+
+// Closed while held, and at random in 200 us slices for bounceUs after the
+// contact makes and after it breaks
+static bool contactClosed(const KeyPress& p, uint64_t now) {
+  uint64_t release = p.atUs + p.holdUs;
+  if (now < p.atUs || now >= release + bounceUs) return false;
+  if (now >= p.atUs + bounceUs && now < release) return true;
+  uint64_t h = (p.atUs ^ (now / 200)) * 0x9E3779B97F4A7C15ull;
+  return (h >> 61) & 1;
+}
+
+static int keypadRow(uint8_t pin) {
+  uint64_t now = sim::now_us();
+  while (pressCursor < presses.size() && presses[pressCursor].atUs + presses[pressCursor].holdUs + bounceUs <= now) pressCursor++;
+  for (size_t i = pressCursor; i < presses.size() && presses[i].atUs <= now; i++) {
+    const KeyPress& p = presses[i];
+    if (rowPins[p.row] != pin || !contactClosed(p, now)) continue;
+    uint8_t col = colPins[p.col];
+    if (sim::pin_mode(col) == OUTPUT && sim::pin_level(col) == LOW) return LOW;
+  }
+  return -1;
+}
+
+static uint64_t lastPress(const std::vector<uint64_t>& times, uint64_t now) {
+  auto it = std::upper_bound(times.begin(), times.end(), now);
+  return it == times.begin() ? 0 : *(it - 1);
+}
+
+static void onSerialLine(const std::string& line) {
+  Stats& stats = shared->stats;
+  uint64_t now = sim::now_us();
+
+  if (line.find("System initialized") != std::string::npos) {
+    if (shared->wakePressUs) stats.wakeToReady.add(now - shared->wakePressUs);
+    bool locked = line.find("UNLOCKED") == std::string::npos;
+    if (shared->lockKnown && locked != shared->locked) stats.lockStateLost++;
+    shared->lockKnown = true;
+    shared->locked = locked;
+  } else if (line == "SITE LOCKED" || line == "SITE UNLOCKED") {
+    shared->lockKnown = true;
+    shared->locked = line == "SITE LOCKED";
+    uint64_t hash = lastPress(hashTimes, now);
+    stats.toggles++;
+    stats.hashToLocked.add(now - hash);
+    if (shared->server.lastAckUs >= hash) stats.hashToAck.add(shared->server.lastAckUs - hash);
+  } else if (line == "SITE LOCKED (local API)" || line == "SITE UNLOCKED (local API)") {
+    shared->lockKnown = true;
+    shared->locked = line == "SITE LOCKED (local API)";
+    stats.lanToggles++;
+  } else if (line.find("Key pressed") != std::string::npos) { // may follow a warm-up's WiFi dots
+    stats.digitEvents++;
+    stats.keyToEvent.add(now - lastPress(digitTimes, now));
+  } else if (line.find("ACCESS DENIED") != std::string::npos) {
+    stats.denied++;
+  } else if (line.find("Password entry timeout") != std::string::npos) {
+    stats.abandoned++;
+  } else if (line.find("DoLynk unavailable") != std::string::npos) {
+    stats.deferred++;
+  }
+}
+
+/* =========================================================
+   LAN CLIENT (child process)
+   ========================================================= */
+static size_t lanCursor = 0;
+static sim::LanConnection lanRequest, lanEvents;
+static uint64_t lanSentUs = 0;
+static size_t lanEventsPos = 0;   // parsed bytes of the event stream
+
+static void sendSigned(sim::LanConnection& c, const char* method, const char* path, const char* extra) {
+  const sim::World& w = shared->world;
+  char stamp[16], sign[129];
+  snprintf(stamp, sizeof(stamp), "%llu", (unsigned long long)((w.clockUs + w.ntpEpochUs) / SECOND));
+  std::string msg = std::string(method) + "\n" + path + "\n" + stamp;
+  unsigned char digest[64];
+  mbedtls_md_context_t ctx;
+  mbedtls_md_init(&ctx);
+  mbedtls_md_setup(&ctx, mbedtls_md_info_from_type(MBEDTLS_MD_SHA512), 1);
+  mbedtls_md_hmac_starts(&ctx, (const unsigned char*)LOCAL_API_KEY, strlen(LOCAL_API_KEY));
+  mbedtls_md_hmac_update(&ctx, (const unsigned char*)msg.data(), msg.size());
+  mbedtls_md_hmac_finish(&ctx, digest);
+  mbedtls_md_free(&ctx);
+  for (int i = 0; i < 64; i++) snprintf(sign + 2 * i, 3, "%02x", digest[i]);
+  c->toDevice += std::string(method) + " " + path + " HTTP/1.1\r\nHost: revolock\r\nX-Revolock-Time: " + stamp
+               + "\r\nX-Revolock-Sign: " + sign + "\r\n" + extra + "\r\n";
+}
+
+// Count the text frames (events) the device has sent since the last call
+static void readEvents() {
+  std::string& in = lanEvents->fromDevice;
+  if (!lanEventsPos) {
+    size_t head = in.find("\r\n\r\n");
+    if (head == std::string::npos) return;
+    lanEventsPos = head + 4;
+  }
+  while (lanEventsPos + 2 <= in.size() && lanEventsPos + 2 + (in[lanEventsPos + 1] & 0x7F) <= in.size()) {
+    if ((in[lanEventsPos] & 0x0F) == 0x1) shared->stats.lanEvents++;
+    lanEventsPos += 2 + (in[lanEventsPos + 1] & 0x7F);
+  }
+}
+
+static void lanTick(uint64_t now) {
+  Stats& stats = shared->stats;
+  if (lanEvents) readEvents();
+
+  if (lanRequest) {
+    const std::string& in = lanRequest->fromDevice;
+    size_t head = in.find("\r\n\r\n");
+    if (head == std::string::npos && lanRequest->open) return;
+    if (head != std::string::npos) {
+      stats.lanToReply.add(now - lanSentUs);
+      stats.lanAnswered++;
+      if (in.compare(9, 3, "401") == 0) stats.lanRejected++;
+    }
+    lanRequest.reset();
+  }
+
+  if (lanCursor >= lanCommands.size() || lanCommands[lanCursor].atUs > now) return;
+  const LanCommand& cmd = lanCommands[lanCursor++];
+  stats.lanSent++;
+  lanRequest = sim::lan_connect(LOCAL_API_PORT);
+  if (!lanRequest->open) {
+    stats.lanRefused++;
+    lanRequest.reset();
+    return;
+  }
+  // Watch the event stream from the first command of the boot on
+  if (!lanEvents) {
+    lanEvents = sim::lan_connect(LOCAL_API_PORT);
+    sendSigned(lanEvents, "GET", "/events", "Upgrade: websocket\r\nConnection: Upgrade\r\n"
+               "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n");
+  }
+  sendSigned(lanRequest, cmd.method, cmd.path, "");
+  lanSentUs = now;
+}
+
+// Until when the scripted users and LAN server leave the device alone, for
+// the idle fast path: from a key's make until the debouncer has seen it
+// break, and while a LAN command waits for its reply, every tick counts.
+static size_t quietCursor = 0;
+
+static uint64_t quietUntil(uint64_t now, uint64_t cutUs) {
+  if (lanRequest) return now;
+  while (quietCursor < presses.size() &&
+         presses[quietCursor].atUs + presses[quietCursor].holdUs + bounceUs + KEY_SETTLE_US <= now) quietCursor++;
+  uint64_t until = std::min(cutUs, endUs);
+  if (quietCursor < presses.size()) until = std::min<uint64_t>(until, presses[quietCursor].atUs);
+  if (lanCursor < lanCommands.size()) until = std::min(until, lanCommands[lanCursor].atUs);
+  return std::max(until, now);
+}
+
+static void runBoot(const Options& o) {
+  sim::use_world(&shared->world);
+  sim::begin_boot();
+  Serial.echo = o.verbose;
+
+  for (uint8_t pin : rowPins) sim::set_input_model(pin, keypadRow);
+  sim::set_http_handler([](const sim::HttpRequest& req) { return sim::dolynk_handle(shared->server, req); });
+
+  static std::string pending;
+  Serial.tap = [](const std::string& s) {
+    for (char c : s) {
+      if (c == '\n') { onSerialLine(pending); pending.clear(); }
+      else if (c != '\r') pending += c;
+    }
+  };
+
+  const uint64_t bootUs = sim::now_us();
+  pressCursor = std::lower_bound(presses.begin(), presses.end(), bootUs > SECOND ? bootUs - SECOND : 0,
+    [](const KeyPress& p, uint64_t t) { return p.atUs < t; }) - presses.begin();
+  lanCursor = std::lower_bound(lanCommands.begin(), lanCommands.end(), bootUs,
+    [](const LanCommand& c, uint64_t t) { return c.atUs < t; }) - lanCommands.begin();
+  quietCursor = pressCursor;
+  const uint64_t cutUs = *std::lower_bound(powerCuts.begin(), powerCuts.end(), bootUs);
+  if (!o.exact) sim::set_idle_tick(IDLE_TICK_US, [cutUs](uint64_t now) { return quietUntil(now, cutUs); });
+  sim::on_advance([bootUs, cutUs](uint64_t now) {
+    lanTick(now);
+    if (now >= endUs) { fflush(stdout); _exit(2); }
+    if (now >= cutUs) { fflush(stdout); _exit(4); }
+    if (now - bootUs > MAX_AWAKE_US) { shared->stats.stuckBoots++; fflush(stdout); _exit(3); }
+  });
+  sim::set_deep_sleep_handler([]() {
+    shared->sleptAtUs = sim::now_us();
+    PowerUsage power = CpuPower::usage();
+    for (int p = 0; p < PHASE_COUNT; p++) shared->stats.phaseUs[p] += power.phaseUs[p];
+    shared->stats.energyUj += power.energyUj;
+    shared->stats.fixedClockUj += power.fixedClockUj;
+    shared->metricsLen = 0;
+    Metrics::render([](void*, const char* data, size_t len) {
+      len = std::min(len, sizeof(shared->metrics) - shared->metricsLen);
+      memcpy(shared->metrics + shared->metricsLen, data, len);
+      shared->metricsLen += len;
+    }, nullptr);
+  });
+
+  setup();
+  for (;;) loop();
+}
+
+/* =========================================================
+   WAKE-UP (parent)
+   ========================================================= */
+// Next time the sleeping chip wakes: a key press that connects the ext0
+// pin to a pin held at the wake level, or the wake timer.
+static bool nextWake(uint64_t sleptAt, size_t& cursor, uint64_t& wakeAt, uint64_t& pressAt, int& cause) {
+  const sim::SleepState& s = shared->world.sleep;
+  uint64_t timerAt = s.timerArmed ? sleptAt + s.timerUs : UINT64_MAX;
+
+  while (cursor < presses.size() && presses[cursor].atUs < sleptAt) cursor++;
+  if (s.ext0Armed) {
+    for (size_t i = cursor; i < presses.size() && presses[i].atUs < timerAt; i++) {
+      uint8_t row = rowPins[presses[i].row], col = colPins[presses[i].col];
+      int other = row == s.ext0Pin ? col : col == s.ext0Pin ? row : -1;
+      if (other >= 0 && s.held[other] && s.heldLevel[other] == s.ext0Level) {
+        cursor = i + 1;
+        wakeAt = pressAt = presses[i].atUs;
+        cause = ESP_SLEEP_WAKEUP_EXT0;
+        return wakeAt < endUs;
+      }
+    }
+  }
+  if (timerAt == UINT64_MAX) return false;
+  wakeAt = timerAt;
+  pressAt = 0;
+  cause = ESP_SLEEP_WAKEUP_TIMER;
+  return wakeAt < endUs;
+}
+
+/* =========================================================
+   REPORT
+   ========================================================= */
+static void report(const char* name, const Samples& s, double scale, const char* unit) {
+  if (!s.count) {
+    printf("  %-28s %8s\n", name, "-");
+    return;
+  }
+  std::vector<uint32_t> v(s.values, s.values + s.count);
+  auto pct = [&](double p) {
+    size_t k = std::min(v.size() - 1, (size_t)(p * v.size()));
+    std::nth_element(v.begin(), v.begin() + k, v.end());
+    return v[k] / scale;
+  };
+  double p50 = pct(0.50), p90 = pct(0.90), p99 = pct(0.99);
+  double mx = *std::max_element(v.begin(), v.end()) / scale;
+  printf("  %-28s %8u %9.1f %9.1f %9.1f %9.1f  %s\n", name, s.count, p50, p90, p99, mx, unit);
+}
+
+/* =========================================================
+   AUDIT LOG
+   ========================================================= */
+// Read the device's audit log back from its flash, as the "audit" console
+// command would: all of it, then only the last simulated day
+static void printWifi() {
+  const sim::NetworkModel& net = shared->world.net;
+  const sim::NetworkCounters& c = shared->world.counters;
+  printf("  wifi: %u scans;", c.scans);
+  for (int i = 0; i < net.apCount; i++) {
+    printf(" %s ch %u %d dBm: %u connects, %u requests avg %.0f ms%s", net.aps[i].ssid, net.aps[i].channel, net.aps[i].rssi,
+           c.apConnects[i], c.apRequests[i], c.apRequests[i] ? (double)c.apRequestMs[i] / c.apRequests[i] : 0.0,
+           i + 1 < net.apCount ? ";" : "\n");
+  }
+}
+
+static void countAudit(void* ctx, const AuditRecord& r) {
+  uint32_t* byEvent = (uint32_t*)ctx;
+  if (r.event <= AUDIT_SYNC) byEvent[r.event]++;
+}
+
+static void printAudit() {
+  uint32_t byEvent[AUDIT_SYNC + 1] = {};
+  AuditQueryStats all = AuditLog::query(0, UINT32_MAX, countAudit, byEvent);
+  uint32_t now = time(nullptr);
+  uint32_t ignored[AUDIT_SYNC + 1] = {};
+  AuditQueryStats day = AuditLog::query(now - 86400, now, countAudit, ignored);
+  printf("  audit log: %u records (%u lock changes, %u PIN failures, %u syncs, %u power-ons) in %u sectors, read in %u ms;"
+         " last day %u records from %u sectors in %u ms\n",
+         all.records, byEvent[AUDIT_LOCK] + byEvent[AUDIT_UNLOCK], byEvent[AUDIT_PIN], byEvent[AUDIT_SYNC],
+         byEvent[AUDIT_POWER_ON], all.sectors, all.ms, day.records, day.sectorsRead, day.ms);
+}
+
+int main(int argc, char** argv) {
+  Options o = parseOptions(argc, argv);
+  auto wallStart = std::chrono::steady_clock::now();
+
+  void* mem = mmap(nullptr, sizeof(Shared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED) { perror("mmap"); return 1; }
+  shared = new (mem) Shared();
+  shared->world.net = o.net;
+  sim::use_world(&shared->world);
+  sim::seed(o.seed);
+
+  std::mt19937_64 rng(o.seed);
+  presses = makeScenario(o, rng);
+  for (const KeyPress& p : presses) {
+    if (p.key == '#') hashTimes.push_back(p.atUs);
+    else if (p.key != '*') digitTimes.push_back(p.atUs);
+  }
+  shared->stats.hashPresses = hashTimes.size();
+  shared->stats.digitPresses = digitTimes.size();
+  bounceUs = o.bounceMs * MS;
+  lanCommands = makeLanCommands(o, hashTimes, rng);
+  endUs = (uint64_t)o.days * DAY;
+
+  for (int i = 0; i < o.powerCuts; i++) powerCuts.push_back(rng() % endUs);
+  powerCuts.push_back(UINT64_MAX);
+  std::sort(powerCuts.begin(), powerCuts.end());
+  for (int i = 0; i < o.dnsMoves; i++) dnsMoves.push_back(rng() % endUs);
+  std::sort(dnsMoves.begin(), dnsMoves.end());
+
+  sim::DolynkServerState& server = shared->server;
+  for (size_t start = 0; start < o.abilities.size() && server.modelAbilityCount < 8;) {
+    size_t end = std::min(o.abilities.find(',', start), o.abilities.size());
+    snprintf(server.modelAbilities[server.modelAbilityCount++], sizeof(server.modelAbilities[0]), "%s",
+             o.abilities.substr(start, end - start).c_str());
+    start = end + 1;
+  }
+
+  for (int i = 0; i < o.outages && i < 32; i++) {
+    uint64_t start = rng() % endUs;
+    shared->server.outageStartUs[i] = start;
+    shared->server.outageEndUs[i] = start + (1 + rng() % 6) * 3600 * SECOND;
+    shared->server.outageCount++;
+  }
+
+  for (int i = 0; i < o.apFades && i < shared->world.net.apCount; i++) {
+    sim::AccessPoint& ap = shared->world.net.aps[i];
+    ap.fadeFromUs = rng() % endUs;
+    ap.fadeUntilUs = ap.fadeFromUs + (1 + rng() % 6) * 3600 * SECOND;
+  }
+
+  // Power-on: the first boot has no wake-up cause
+  uint64_t wakeAt = 0, pressAt = 0;
+  int cause = ESP_SLEEP_WAKEUP_UNDEFINED;
+  size_t cursor = 0;
+  Stats& stats = shared->stats;
+
+  for (;;) {
+    shared->world.clockUs = wakeAt + BOOT_US;
+    shared->world.sleep.wakeCause = cause;
+    shared->world.net.addressEpoch = std::upper_bound(dnsMoves.begin(), dnsMoves.end(), wakeAt) - dnsMoves.begin();
+    shared->wakePressUs = pressAt;
+    shared->sleptAtUs = 0;
+    uint32_t requestsBefore = shared->world.counters.requests;
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) { perror("fork"); return 1; }
+    if (pid == 0) runBoot(o);
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    stats.boots++;
+    if (cause == ESP_SLEEP_WAKEUP_EXT0) stats.keyWakes++;
+    if (cause == ESP_SLEEP_WAKEUP_TIMER) stats.timerWakes++;
+    // Power cut while awake: everything since the last sleep is lost
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 4) {
+      uint64_t cut = *std::lower_bound(powerCuts.begin(), powerCuts.end(), wakeAt);
+      stats.powerCuts++;
+      sim::power_cycle();
+      wakeAt = cut + POWER_OFF_US;
+      pressAt = 0;
+      cause = ESP_SLEEP_WAKEUP_UNDEFINED;
+      continue;
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || !shared->sleptAtUs) break;
+
+    uint64_t awake = shared->sleptAtUs - wakeAt;
+    stats.awake.add(awake);
+    stats.awakeUs += awake;
+    stats.requestsPerBoot.add(shared->world.counters.requests - requestsBefore);
+
+    if (!nextWake(shared->sleptAtUs, cursor, wakeAt, pressAt, cause)) wakeAt = UINT64_MAX;
+
+    // Power cut while asleep: the board comes back up on its own
+    uint64_t cut = *std::lower_bound(powerCuts.begin(), powerCuts.end(), shared->sleptAtUs);
+    if (cut < wakeAt && cut < endUs) {
+      stats.powerCuts++;
+      sim::power_cycle();
+      wakeAt = cut + POWER_OFF_US;
+      pressAt = 0;
+      cause = ESP_SLEEP_WAKEUP_UNDEFINED;
+    }
+    if (wakeAt >= endUs) break;
+  }
+
+  double wallS = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+  const sim::NetworkCounters& net = shared->world.counters;
+
+  printf("\nRevoLock simulation: %d days, %d interactions/day, seed %llu\n",
+         o.days, o.perDay, (unsigned long long)o.seed);
+  printf("  %u boots (%u key wakes, %u timer wakes) in %.1f s wall time, awake %.2f%% of the time\n",
+         stats.boots, stats.keyWakes, stats.timerWakes, wallS, 100.0 * stats.awakeUs / std::max<uint64_t>(endUs, 1));
+  printf("\n  %-28s %8s %9s %9s %9s %9s\n", "", "n", "p50", "p90", "p99", "max");
+  report("wake -> ready", stats.wakeToReady, 1000, "ms");
+  report("digit -> key event", stats.keyToEvent, 1000, "ms");
+  report("'#' -> SITE LOCKED/UNLOCKED", stats.hashToLocked, 1000, "ms");
+  report("'#' -> DoLynk ack", stats.hashToAck, 1000, "ms");
+  if (o.lanPercent) report("LAN command -> reply", stats.lanToReply, 1000, "ms");
+  report("awake per boot", stats.awake, 1e6, "s");
+  report("requests per boot", stats.requestsPerBoot, 1, "");
+
+  uint32_t answered = stats.toggles + stats.denied;
+  printf("\n  outcomes: %u toggles, %u denied, %u abandoned, %u deferred (DoLynk unavailable), %u of %u '#' presses unanswered\n",
+         stats.toggles, stats.denied, stats.abandoned, stats.deferred,
+         stats.hashPresses > answered ? stats.hashPresses - answered : 0, stats.hashPresses);
+  printf("  keypad: %u digit presses, %u key events\n", stats.digitPresses, stats.digitEvents);
+  printf("  network: %u requests, %u TLS handshakes, %u DNS lookups, %u failures\n",
+         net.requests, net.handshakes, net.dnsLookups, net.failures);
+  uint64_t cpuUs = std::max<uint64_t>(stats.phaseUs[PHASE_IDLE] + stats.phaseUs[PHASE_RADIO] + stats.phaseUs[PHASE_COMPUTE], 1);
+  printf("  cpu: idle %.1f%%, radio %.1f%%, compute %.2f%% of awake time; ~%.0f J estimated, %.0f J at a fixed %u MHz (%+.1f%%)\n",
+         100.0 * stats.phaseUs[PHASE_IDLE] / cpuUs, 100.0 * stats.phaseUs[PHASE_RADIO] / cpuUs,
+         100.0 * stats.phaseUs[PHASE_COMPUTE] / cpuUs, stats.energyUj / 1e6, stats.fixedClockUj / 1e6, CPU_MAX_MHZ,
+         100.0 * ((double)stats.energyUj - stats.fixedClockUj) / std::max<uint64_t>(stats.fixedClockUj, 1));
+  printf("  DoLynk: %u tokens, %u set, %u get, %u rejected, %u unsupported ability, %u refused during outages\n",
+         server.tokensIssued, server.setCalls, server.getCalls, server.rejected, server.unsupported, server.outageRejected);
+  printWifi();
+  printAudit();
+  if (o.lanPercent) {
+    printf("  local API: %zu commands, %u found the device awake, %u answered (%u rejected), %u refused, %u lock changes, %u events streamed\n",
+           lanCommands.size(), stats.lanSent, stats.lanAnswered, stats.lanRejected, stats.lanRefused, stats.lanToggles, stats.lanEvents);
+  }
+  if (o.powerCuts) {
+    printf("  power: %u cuts, lock state lost %u times, %u NVS writes\n",
+           stats.powerCuts, stats.lockStateLost, shared->world.nvsWrites);
+  }
+  if (stats.stuckBoots) printf("  WARNING: %u boots never went back to sleep\n", stats.stuckBoots);
+  if (o.metrics) printf("\n%.*s", (int)shared->metricsLen, shared->metrics);
+  return 0;
+}
@@ -0,0 +1,218 @@
+#include <Arduino.h>
+#include <stdarg.h>
+#include <vector>
+#include <algorithm>
+
+HardwareSerial Serial;
+EspClass ESP;
+
+/* =========================================================
+   WORLD
+   ========================================================= */
+static sim::World localWorld;
+static sim::World* currentWorld = &localWorld;
+
+sim::World& sim::world() {
+  return *currentWorld;
+}
+
+void sim::use_world(World* w) {
+  currentWorld = w ? w : &localWorld;
+}
+
+/* =========================================================
+   VIRTUAL CLOCK
+   ========================================================= */
+struct SimEvent {
+  uint64_t whenUs;
+  uint32_t id;
+  std::function<void()> fn;
+};
+
+static std::vector<sim::ClockListener> clockListeners;
+static std::vector<SimEvent> events;     // kept sorted by (whenUs, id)
+static uint32_t nextEventId = 1;
+
+uint64_t sim::now_us() {
+  return currentWorld->clockUs;
+}
+
+void sim::advance_us(uint64_t us) {
+  sim::sleep_until(currentWorld->clockUs + us);
+}
+
+void sim::clock_to(uint64_t target) {
+  // Events may schedule more events or advance time themselves
+  while (!events.empty() && events.front().whenUs <= target) {
+    SimEvent ev = std::move(events.front());
+    events.erase(events.begin());
+    if (ev.whenUs > currentWorld->clockUs) currentWorld->clockUs = ev.whenUs;
+    ev.fn();
+  }
+  if (target > currentWorld->clockUs) currentWorld->clockUs = target;
+  for (auto& listener : clockListeners) listener(currentWorld->clockUs);
+}
+
+void sim::on_advance(ClockListener listener) {
+  clockListeners.push_back(listener);
+}
+
+uint32_t sim::at(uint64_t whenUs, std::function<void()> fn) {
+  SimEvent ev{whenUs, nextEventId++, std::move(fn)};
+  auto pos = std::upper_bound(events.begin(), events.end(), ev,
+    [](const SimEvent& a, const SimEvent& b) { return a.whenUs < b.whenUs; });
+  events.insert(pos, std::move(ev));
+  return nextEventId - 1;
+}
+
+void sim::cancel(uint32_t id) {
+  for (auto it = events.begin(); it != events.end(); ++it) {
+    if (it->id == id) { events.erase(it); return; }
+  }
+}
+
+unsigned long millis() {
+  return (unsigned long)(currentWorld->clockUs / 1000);
+}
+
+unsigned long micros() {
+  return (unsigned long)currentWorld->clockUs;
+}
+
+void delay(unsigned long ms) {
+  sim::advance_us((uint64_t)ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us) {
+  sim::advance_us(us);
+}
+
+void yield() {}
+
+/* =========================================================
+   GPIO
+   ========================================================= */
+struct SimPin {
+  uint8_t mode = INPUT;
+  uint8_t level = LOW;
+  sim::InputModel model;
+};
+
+static SimPin pins[sim::PIN_COUNT];
+static std::vector<sim::PinListener> pinListeners;
+
+int sim::pin_mode(uint8_t pin) {
+  return pin < PIN_COUNT ? pins[pin].mode : INPUT;
+}
+
+int sim::pin_level(uint8_t pin) {
+  return pin < PIN_COUNT ? pins[pin].level : LOW;
+}
+
+void sim::set_input_model(uint8_t pin, InputModel model) {
+  if (pin < PIN_COUNT) pins[pin].model = model;
+}
+
+void sim::on_pin_change(PinListener listener) {
+  pinListeners.push_back(listener);
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  if (pin >= sim::PIN_COUNT) return;
+  pins[pin].mode = mode;
+  for (auto& listener : pinListeners) listener(pin, mode, pins[pin].level);
+}
+
+void digitalWrite(uint8_t pin, uint8_t level) {
+  if (pin >= sim::PIN_COUNT) return;
+  pins[pin].level = level ? HIGH : LOW;
+  for (auto& listener : pinListeners) listener(pin, pins[pin].mode, pins[pin].level);
+}
+
+int digitalRead(uint8_t pin) {
+  if (pin >= sim::PIN_COUNT) return LOW;
+  SimPin& p = pins[pin];
+  if (p.mode == OUTPUT) return p.level;
+  if (p.model) {
+    int level = p.model(pin);
+    if (level >= 0) return level;
+  }
+  if (p.mode == INPUT_PULLUP) return HIGH;
+  return LOW;
+}
+
+/* =========================================================
+   RANDOM
+   ========================================================= */
+void sim::seed(uint64_t seed) {
+  currentWorld->rngState = seed ? seed : 0x9E3779B97F4A7C15ull;
+}
+
+uint32_t esp_random() {
+  // xorshift64*: deterministic so scenarios are reproducible
+  currentWorld->rngState ^= currentWorld->rngState >> 12;
+  currentWorld->rngState ^= currentWorld->rngState << 25;
+  currentWorld->rngState ^= currentWorld->rngState >> 27;
+  return (uint32_t)((currentWorld->rngState * 0x2545F4914F6CDD1Dull) >> 32);
+}
+
+long random(long max) {
+  return max > 0 ? (long)(esp_random() % (uint32_t)max) : 0;
+}
+
+long random(long min, long max) {
+  return min < max ? min + random(max - min) : min;
+}
+
+void randomSeed(unsigned long seed) {
+  sim::seed(seed);
+}
+
+/* =========================================================
+   SERIAL
+   ========================================================= */
+size_t HardwareSerial::out(const std::string& s) {
+  if (echo) fwrite(s.data(), 1, s.size(), stdout);
+  if (tap) tap(s);
+  return s.size();
+}
+
+size_t HardwareSerial::number(long v, int base) {
+  if (v < 0 && base == DEC) return out("-") + number((unsigned long)-v, base);
+  return number((unsigned long)v, base);
+}
+
+size_t HardwareSerial::number(unsigned long v, int base) {
+  char buf[40];
+  snprintf(buf, sizeof(buf), base == HEX ? "%lX" : "%lu", v);
+  return out(buf);
+}
+
+size_t HardwareSerial::printf(const char* fmt, ...) {
+  char buf[512];
+  va_list args;
+  va_start(args, fmt);
+  int n = vsnprintf(buf, sizeof(buf), fmt, args);
+  va_end(args);
+  if (n < 0) return 0;
+  if ((size_t)n < sizeof(buf)) return out(std::string(buf, n));
+
+  std::string big(n + 1, '\0');
+  va_start(args, fmt);
+  vsnprintf(&big[0], big.size(), fmt, args);
+  va_end(args);
+  big.resize(n);
+  return out(big);
+}
+
+/* =========================================================
+   RESET
+   ========================================================= */
+void sim::reset() {
+  currentWorld->clockUs = 0;
+  clockListeners.clear();
+  events.clear();
+  pinListeners.clear();
+  for (auto& p : pins) p = SimPin();
+  Serial.tap = nullptr;
+}
@@ -0,0 +1,328 @@
+#include <Arduino.h>
+#include <WiFi.h>
+#include <esp_timer.h>
+#include <esp_sleep.h>
+#include <driver/gpio.h>
+#include <driver/rtc_io.h>
+#include <driver/ledc.h>
+#include <unistd.h>
+
+// RTC slow memory is everything the linker placed in the "rtc_data"
+// section; these bracket it (weak, in case nothing is RTC_DATA_ATTR).
+extern "C" uint8_t __start_rtc_data[] __attribute__((weak));
+extern "C" uint8_t __stop_rtc_data[] __attribute__((weak));
+
+/* =========================================================
+   CPU CLOCK
+   ========================================================= */
+static uint32_t cpuMhz = 240;
+
+bool setCpuFrequencyMhz(uint32_t mhz) {
+  if (mhz != 240 && mhz != 160 && mhz != 80 && mhz != 40 && mhz != 20 && mhz != 10) return false;
+  cpuMhz = mhz;
+  return true;
+}
+
+uint32_t getCpuFrequencyMhz() {
+  return cpuMhz;
+}
+
+/* =========================================================
+   ESP_TIMER
+   ========================================================= */
+struct SimTimer {
+  esp_timer_cb_t callback;
+  void* arg;
+  uint64_t periodUs;
+  uint32_t eventId;
+};
+
+static void armTimer(SimTimer* timer, uint64_t delayUs) {
+  timer->eventId = sim::at(sim::now_us() + delayUs, [timer]() {
+    timer->eventId = 0;
+    if (timer->periodUs) armTimer(timer, timer->periodUs);
+    timer->callback(timer->arg);
+  });
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* handle) {
+  *handle = new SimTimer{args->callback, args->arg, 0, 0};
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeoutUs) {
+  if (timer->eventId) return ESP_FAIL;
+  timer->periodUs = 0;
+  armTimer(timer, timeoutUs);
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t periodUs) {
+  if (timer->eventId) return ESP_FAIL;
+  timer->periodUs = periodUs;
+  armTimer(timer, periodUs);
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+  if (!timer->eventId) return ESP_FAIL;
+  sim::cancel(timer->eventId);
+  timer->eventId = 0;
+  timer->periodUs = 0;
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+  if (timer->eventId) sim::cancel(timer->eventId);
+  delete timer;
+  return ESP_OK;
+}
+
+int64_t esp_timer_get_time() {
+  return (int64_t)sim::now_us();
+}
+
+/* =========================================================
+   LEDC
+   ========================================================= */
+struct SimLedChannel {
+  int gpio = -1;
+  uint32_t duty = 0;
+  uint32_t target = 0;
+};
+
+static SimLedChannel ledChannels[LEDC_CHANNEL_MAX];
+
+esp_err_t ledc_timer_config(const ledc_timer_config_t*) {
+  return ESP_OK;
+}
+
+esp_err_t ledc_channel_config(const ledc_channel_config_t* config) {
+  if (config->channel >= LEDC_CHANNEL_MAX) return ESP_FAIL;
+  SimLedChannel& ch = ledChannels[config->channel];
+  ch.gpio = config->gpio_num;
+  ch.duty = ch.target = config->duty;
+  return ESP_OK;
+}
+
+esp_err_t ledc_set_duty(ledc_mode_t, ledc_channel_t channel, uint32_t duty) {
+  ledChannels[channel].target = duty;
+  return ESP_OK;
+}
+
+esp_err_t ledc_update_duty(ledc_mode_t, ledc_channel_t channel) {
+  ledChannels[channel].duty = ledChannels[channel].target;
+  return ESP_OK;
+}
+
+uint32_t ledc_get_duty(ledc_mode_t, ledc_channel_t channel) {
+  return ledChannels[channel].duty;
+}
+
+esp_err_t ledc_set_fade_with_time(ledc_mode_t, ledc_channel_t channel, uint32_t duty, int) {
+  ledChannels[channel].target = duty;
+  return ESP_OK;
+}
+
+esp_err_t ledc_fade_start(ledc_mode_t mode, ledc_channel_t channel, ledc_fade_mode_t) {
+  return ledc_update_duty(mode, channel);
+}
+
+// Fades finish as they start, so there is never one left to stop
+esp_err_t ledc_fade_stop(ledc_mode_t, ledc_channel_t) {
+  return ESP_OK;
+}
+
+esp_err_t ledc_fade_func_install(int) {
+  return ESP_OK;
+}
+
+esp_err_t ledc_stop(ledc_mode_t, ledc_channel_t channel, uint32_t) {
+  ledChannels[channel].duty = ledChannels[channel].target = 0;
+  return ESP_OK;
+}
+
+uint32_t sim::led_duty(uint8_t pin) {
+  for (auto& ch : ledChannels) {
+    if (ch.gpio == pin) return ch.duty;
+  }
+  return 0;
+}
+
+/* =========================================================
+   GPIO HOLD AND RTC GPIO
+   ========================================================= */
+static bool rtcInit[sim::PIN_COUNT];
+static uint8_t rtcLevel[sim::PIN_COUNT];
+
+esp_err_t gpio_hold_en(gpio_num_t pin) {
+  sim::SleepState& s = sim::world().sleep;
+  s.held[pin] = true;
+  s.heldLevel[pin] = rtcInit[pin] ? rtcLevel[pin] : sim::pin_level(pin);
+  return ESP_OK;
+}
+
+esp_err_t gpio_hold_dis(gpio_num_t pin) {
+  sim::world().sleep.held[pin] = false;
+  return ESP_OK;
+}
+
+void gpio_deep_sleep_hold_en() {}
+void gpio_deep_sleep_hold_dis() {}
+
+esp_err_t rtc_gpio_init(gpio_num_t pin) {
+  rtcInit[pin] = true;
+  return ESP_OK;
+}
+
+esp_err_t rtc_gpio_deinit(gpio_num_t pin) {
+  rtcInit[pin] = false;
+  return ESP_OK;
+}
+
+esp_err_t rtc_gpio_set_direction(gpio_num_t, rtc_gpio_mode_t) {
+  return ESP_OK;
+}
+
+esp_err_t rtc_gpio_set_level(gpio_num_t pin, uint32_t level) {
+  rtcLevel[pin] = level ? 1 : 0;
+  return ESP_OK;
+}
+
+esp_err_t rtc_gpio_pullup_en(gpio_num_t pin) {
+  sim::world().sleep.pulldown[pin] = false;
+  return ESP_OK;
+}
+
+esp_err_t rtc_gpio_pullup_dis(gpio_num_t) {
+  return ESP_OK;
+}
+
+esp_err_t rtc_gpio_pulldown_en(gpio_num_t pin) {
+  sim::world().sleep.pulldown[pin] = true;
+  return ESP_OK;
+}
+
+esp_err_t rtc_gpio_pulldown_dis(gpio_num_t pin) {
+  sim::world().sleep.pulldown[pin] = false;
+  return ESP_OK;
+}
+
+/* =========================================================
+   DEEP SLEEP
+   ========================================================= */
+static std::function<void()> deepSleepHandler;
+
+esp_err_t esp_sleep_enable_ext0_wakeup(gpio_num_t pin, int level) {
+  sim::SleepState& s = sim::world().sleep;
+  s.ext0Armed = true;
+  s.ext0Pin = pin;
+  s.ext0Level = level ? 1 : 0;
+  return ESP_OK;
+}
+
+esp_err_t esp_sleep_enable_ext1_wakeup(uint64_t mask, esp_sleep_ext1_wakeup_mode_t mode) {
+  sim::SleepState& s = sim::world().sleep;
+  s.ext1Armed = true;
+  s.ext1Mask = mask;
+  s.ext1Mode = mode;
+  return ESP_OK;
+}
+
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t us) {
+  sim::SleepState& s = sim::world().sleep;
+  s.timerArmed = true;
+  s.timerUs = us;
+  return ESP_OK;
+}
+
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause() {
+  return (esp_sleep_wakeup_cause_t)sim::world().sleep.wakeCause;
+}
+
+uint64_t esp_sleep_get_ext1_wakeup_status() {
+  return sim::world().sleep.ext1Status;
+}
+
+void esp_deep_sleep_start() {
+  sim::World& w = sim::world();
+  size_t size = __stop_rtc_data - __start_rtc_data;
+  if (size > sizeof(w.rtc)) {
+    fprintf(stderr, "[sim] RTC data is %zu bytes, more than the %zu available\n", size, sizeof(w.rtc));
+    abort();
+  }
+  if (size) memcpy(w.rtc, __start_rtc_data, size);
+  w.rtcSize = size;
+  w.rtcValid = true;
+
+  Serial.flush();
+  if (deepSleepHandler) deepSleepHandler();
+  fflush(stdout);
+  _exit(0);
+}
+
+void sim::set_deep_sleep_handler(std::function<void()> handler) {
+  deepSleepHandler = handler;
+}
+
+void sim::begin_boot() {
+  World& w = world();
+  size_t size = __stop_rtc_data - __start_rtc_data;
+  // A cold boot (or a rebuilt image) keeps the initial values
+  if (w.rtcValid && w.rtcSize == size && size) memcpy(__start_rtc_data, w.rtc, size);
+
+  // Wake sources are configured per boot; holds survive until released
+  w.sleep.ext0Armed = false;
+  w.sleep.ext1Armed = false;
+  w.sleep.timerArmed = false;
+  for (auto& ch : ledChannels) ch = SimLedChannel();
+  for (int i = 0; i < PIN_COUNT; i++) rtcInit[i] = false;
+  cpuMhz = 240;
+  w.boots++;
+}
+
+void sim::power_cycle() {
+  World& w = world();
+  w.rtcValid = false;
+  w.wallValid = false;
+  w.sleep = SleepState();
+}
+
+/* =========================================================
+   WALL CLOCK AND SNTP
+   ========================================================= */
+// The RTC keeps counting through deep sleep, so before the first sync the
+// wall clock reads seconds since power-on, like the real chip.
+static uint64_t wallUs() {
+  const sim::World& w = sim::world();
+  return w.wallValid ? sim::now_us() + w.wallOffsetUs : sim::now_us();
+}
+
+static void sntpAttempt() {
+  sim::World& w = sim::world();
+  if (w.wallValid) return;
+  if (WiFi.status() == WL_CONNECTED) {
+    w.wallValid = true;
+    w.wallOffsetUs = (int64_t)w.ntpEpochUs;
+    return;
+  }
+  sim::at(sim::now_us() + 1000000, sntpAttempt);   // retry once a second
+}
+
+void configTime(long, int, const char*, const char*, const char*) {
+  sim::at(sim::now_us() + (uint64_t)sim::world().net.ntpMs * 1000, sntpAttempt);
+}
+
+// These replace the C library's versions for the whole simulator binary
+extern "C" time_t time(time_t* out) {
+  time_t t = (time_t)(wallUs() / 1000000);
+  if (out) *out = t;
+  return t;
+}
+
+extern "C" int gettimeofday(struct timeval* tv, void*) {
+  uint64_t us = wallUs();
+  tv->tv_sec = (time_t)(us / 1000000);
+  tv->tv_usec = (suseconds_t)(us % 1000000);
+  return 0;
+}
@@ -0,0 +1,313 @@
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <ucontext.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <deque>
+#include <string>
+#include <vector>
+
+// Cooperative tasks on the virtual clock. Every context (the main loop and
+// each task) has the time it next wants the CPU; whoever advances the clock
+// gives the CPU to the earliest, round-robin among equals. With no tasks
+// this is plain clock advancing.
+
+#define TASK_HOST_STACK (512 * 1024) // host code needs far more than the ESP32 stack depth
+#define IDLE_AFTER_US 100000          // since the last hand-off, before polls may skip ahead
+
+struct SimTask {
+  ucontext_t context;
+  void* stack;
+  TaskFunction_t fn;
+  void* arg;
+  uint64_t readyAt;
+  uint64_t turn;          // order among contexts ready at the same time
+  uint64_t pollAt;        // wake the poll asked for, while moved to the idle grid
+  uint32_t stackDepth;    // what the firmware asked for, in bytes
+  BaseType_t core;
+  bool done;
+};
+
+struct SimSemaphore {
+  UBaseType_t count;
+  UBaseType_t max;
+};
+
+struct SimQueue {
+  UBaseType_t length;
+  UBaseType_t itemSize;
+  std::deque<std::string> items;
+};
+
+static SimTask mainTask = {};
+static SimTask* current = &mainTask;
+static std::vector<SimTask*> tasks; // not counting the main loop
+static uint64_t turns = 0;
+
+static uint64_t idleTickUs = 0;
+static sim::QuietUntil quietUntil;
+static uint64_t lastHandoffUs = 0;  // task started, item queued or semaphore given
+
+// Something to pick up: polls sleeping on the idle grid wake on their next
+// tick instead, as they would have without the fast path
+static void handoff() {
+  uint64_t now = sim::now_us();
+  lastHandoffUs = now;
+  const uint64_t tick = portTICK_PERIOD_MS * 1000;
+  auto recall = [&](SimTask* t) {
+    if (t == current || t->done || !t->pollAt) return;
+    if (t->pollAt < now) t->pollAt += (now - t->pollAt + tick - 1) / tick * tick;
+    if (t->pollAt < t->readyAt) t->readyAt = t->pollAt;
+    t->pollAt = 0;
+  };
+  recall(&mainTask);
+  for (SimTask* t : tasks) recall(t);
+}
+
+static SimTask* earliest() {
+  SimTask* next = mainTask.done ? nullptr : &mainTask;
+  for (SimTask* t : tasks) {
+    if (t->done) continue;
+    if (!next || t->readyAt < next->readyAt || (t->readyAt == next->readyAt && t->turn < next->turn)) next = t;
+  }
+  return next;
+}
+
+// Free finished tasks; never the one running
+static void reap() {
+  for (size_t i = 0; i < tasks.size();) {
+    SimTask* t = tasks[i];
+    if (t->done && t != current) {
+      munmap(t->stack, TASK_HOST_STACK);
+      delete t;
+      tasks.erase(tasks.begin() + i);
+    } else {
+      i++;
+    }
+  }
+}
+
+// Whether a blocked wait can ever end: someone else is left to run
+static bool othersAlive() {
+  if (current != &mainTask && !mainTask.done) return true;
+  for (SimTask* t : tasks) {
+    if (t != current && !t->done) return true;
+  }
+  return false;
+}
+
+static void schedule() {
+  SimTask* next = earliest();
+  if (!next) {
+    fprintf(stderr, "[sim] every task has stopped\n");
+    abort();
+  }
+  if (next->readyAt > sim::now_us()) sim::clock_to(next->readyAt);
+  if (next != current) {
+    SimTask* prev = current;
+    current = next;
+    swapcontext(&prev->context, &next->context);
+  }
+  reap();
+}
+
+void sim::set_idle_tick(uint64_t tickUs, QuietUntil quiet) {
+  idleTickUs = tickUs;
+  quietUntil = quiet;
+}
+
+// Where a poll really wakes: on the idle grid if nothing is going on.
+// Longer waits model real time (round trips, handshakes) and stay exact.
+static uint64_t pollWake(uint64_t whenUs) {
+  uint64_t now = sim::now_us();
+  if (!idleTickUs || whenUs > now + portTICK_PERIOD_MS * 1000 || now - lastHandoffUs < IDLE_AFTER_US) return whenUs;
+  uint64_t quiet = quietUntil ? quietUntil(now) : UINT64_MAX;
+  if (quiet <= now) return whenUs;
+  uint64_t grid = (whenUs + idleTickUs - 1) / idleTickUs * idleTickUs;
+  return std::max(whenUs, std::min(grid, quiet));
+}
+
+void sim::sleep_until(uint64_t whenUs) {
+  reap();
+  if (tasks.empty() && !mainTask.done) {
+    sim::clock_to(whenUs);
+    return;
+  }
+  current->readyAt = pollWake(whenUs);
+  current->pollAt = current->readyAt != whenUs ? whenUs : 0;
+  current->turn = ++turns;
+  schedule();
+}
+
+static void finish() {
+  current->done = true;
+  schedule(); // never comes back
+}
+
+static void trampoline() {
+  current->fn(current->arg);
+  finish();
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char*, uint32_t stackDepth, void* arg,
+                       UBaseType_t, TaskHandle_t* handle) {
+  SimTask* t = new SimTask();
+  // Fresh anonymous pages read as zero: the stack needs no painting, and
+  // only the pages the task touches cost anything
+  t->stack = mmap(nullptr, TASK_HOST_STACK, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (t->stack == MAP_FAILED) {
+    delete t;
+    return pdFAIL;
+  }
+  t->fn = fn;
+  t->arg = arg;
+  t->readyAt = sim::now_us();
+  t->turn = ++turns;
+  t->stackDepth = stackDepth;
+  t->core = tskNO_AFFINITY;
+  getcontext(&t->context);
+  t->context.uc_stack.ss_sp = t->stack;
+  t->context.uc_stack.ss_size = TASK_HOST_STACK;
+  t->context.uc_link = nullptr;
+  makecontext(&t->context, trampoline, 0);
+  tasks.push_back(t);
+  handoff();
+  if (handle) *handle = t;
+  return pdPASS; // starts when the creator next waits
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char* name, uint32_t stackDepth, void* arg,
+                                   UBaseType_t priority, TaskHandle_t* handle, BaseType_t core) {
+  TaskHandle_t t;
+  BaseType_t created = xTaskCreate(fn, name, stackDepth, arg, priority, &t);
+  t->core = core;
+  if (handle) *handle = t;
+  return created;
+}
+
+// The main loop can delete itself too, as the Arduino loop task does once
+// setup() has started the firmware's own tasks
+void vTaskDelete(TaskHandle_t task) {
+  if (!task || task == current) finish(); // never comes back
+  task->done = true;
+}
+
+void vTaskDelay(TickType_t ticks) {
+  delay(ticks * portTICK_PERIOD_MS);
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t) {
+  return 1;
+}
+
+// Bytes of the requested stack depth never touched, going by how deep the
+// host stack got: the first byte from the bottom that isn't zero any more.
+// Pages never mapped in are skipped without reading them.
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+  if (!task) task = current;
+  if (task == &mainTask) return 0;
+  const uint8_t* bottom = (const uint8_t*)task->stack;
+  const size_t page = sysconf(_SC_PAGESIZE);
+  static unsigned char resident[TASK_HOST_STACK / 4096]; // not on the stack being measured
+  size_t untouched = 0;
+  if (page >= 4096 && mincore(task->stack, TASK_HOST_STACK, resident) == 0) {
+    while (untouched < TASK_HOST_STACK && !(resident[untouched / page] & 1)) untouched += page;
+  }
+  while (untouched < TASK_HOST_STACK && !*(const uint64_t*)(bottom + untouched)) untouched += 8;
+  while (untouched < TASK_HOST_STACK && !bottom[untouched]) untouched++;
+  size_t used = TASK_HOST_STACK - untouched;
+  return used < task->stackDepth ? task->stackDepth - used : 0;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+  return current;
+}
+
+TickType_t xTaskGetTickCount() {
+  return (TickType_t)(millis() / portTICK_PERIOD_MS);
+}
+
+BaseType_t xPortGetCoreID() {
+  return current->core == tskNO_AFFINITY ? 1 : current->core; // the Arduino loop's core
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial) {
+  return new SimSemaphore{initial, max};
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary() {
+  return new SimSemaphore{0, 1};
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+  return new SimSemaphore{1, 1};
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) {
+  if (!sem || sem->count >= sem->max) return pdFALSE;
+  sem->count++;
+  handoff();
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks) {
+  if (!sem) return pdFALSE;
+  uint64_t deadline = ticks == portMAX_DELAY ? UINT64_MAX : sim::now_us() + (uint64_t)ticks * portTICK_PERIOD_MS * 1000;
+  while (sem->count == 0) {
+    reap();
+    // With nobody else to run, the semaphore can never be given
+    if (!othersAlive() && ticks == portMAX_DELAY) {
+      fprintf(stderr, "[sim] xSemaphoreTake would block forever\n");
+      abort();
+    }
+    if (sim::now_us() >= deadline) return pdFALSE;
+    delay(portTICK_PERIOD_MS);
+  }
+  sem->count--;
+  return pdTRUE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem) {
+  delete sem;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+  return new SimQueue{length, itemSize, {}};
+}
+
+// Blocking sends and receives poll once per tick, like semaphores
+static bool waitFor(QueueHandle_t queue, TickType_t ticks, bool (*ready)(QueueHandle_t)) {
+  uint64_t deadline = ticks == portMAX_DELAY ? UINT64_MAX : sim::now_us() + (uint64_t)ticks * portTICK_PERIOD_MS * 1000;
+  while (!ready(queue)) {
+    reap();
+    if (!othersAlive() && ticks == portMAX_DELAY) {
+      fprintf(stderr, "[sim] queue wait would block forever\n");
+      abort();
+    }
+    if (sim::now_us() >= deadline) return false;
+    delay(portTICK_PERIOD_MS);
+  }
+  return true;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticks) {
+  if (!queue || !waitFor(queue, ticks, [](QueueHandle_t q) { return q->items.size() < q->length; })) return pdFALSE;
+  queue->items.emplace_back((const char*)item, queue->itemSize);
+  handoff();
+  return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticks) {
+  if (!queue || !waitFor(queue, ticks, [](QueueHandle_t q) { return !q->items.empty(); })) return pdFALSE;
+  memcpy(item, queue->items.front().data(), queue->itemSize);
+  queue->items.pop_front();
+  return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+  return queue ? queue->items.size() : 0;
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+  delete queue;
+}
@@ -0,0 +1,321 @@
+#include <mbedtls/md.h>
+#include <mbedtls/sha256.h>
+#include <mbedtls/sha1.h>
+#include <string.h>
+
+// Portable SHA-1, SHA-256, SHA-512 (FIPS 180-4) and HMAC for the host build.
+
+struct mbedtls_md_info_t {
+  mbedtls_md_type_t type;
+};
+
+static const mbedtls_md_info_t sha512Info = {MBEDTLS_MD_SHA512};
+
+static const uint64_t K[80] = {
+  0x428a2f98d728ae22ull, 0x7137449123ef65cdull, 0xb5c0fbcfec4d3b2full, 0xe9b5dba58189dbbcull,
+  0x3956c25bf348b538ull, 0x59f111f1b605d019ull, 0x923f82a4af194f9bull, 0xab1c5ed5da6d8118ull,
+  0xd807aa98a3030242ull, 0x12835b0145706fbeull, 0x243185be4ee4b28cull, 0x550c7dc3d5ffb4e2ull,
+  0x72be5d74f27b896full, 0x80deb1fe3b1696b1ull, 0x9bdc06a725c71235ull, 0xc19bf174cf692694ull,
+  0xe49b69c19ef14ad2ull, 0xefbe4786384f25e3ull, 0x0fc19dc68b8cd5b5ull, 0x240ca1cc77ac9c65ull,
+  0x2de92c6f592b0275ull, 0x4a7484aa6ea6e483ull, 0x5cb0a9dcbd41fbd4ull, 0x76f988da831153b5ull,
+  0x983e5152ee66dfabull, 0xa831c66d2db43210ull, 0xb00327c898fb213full, 0xbf597fc7beef0ee4ull,
+  0xc6e00bf33da88fc2ull, 0xd5a79147930aa725ull, 0x06ca6351e003826full, 0x142929670a0e6e70ull,
+  0x27b70a8546d22ffcull, 0x2e1b21385c26c926ull, 0x4d2c6dfc5ac42aedull, 0x53380d139d95b3dfull,
+  0x650a73548baf63deull, 0x766a0abb3c77b2a8ull, 0x81c2c92e47edaee6ull, 0x92722c851482353bull,
+  0xa2bfe8a14cf10364ull, 0xa81a664bbc423001ull, 0xc24b8b70d0f89791ull, 0xc76c51a30654be30ull,
+  0xd192e819d6ef5218ull, 0xd69906245565a910ull, 0xf40e35855771202aull, 0x106aa07032bbd1b8ull,
+  0x19a4c116b8d2d0c8ull, 0x1e376c085141ab53ull, 0x2748774cdf8eeb99ull, 0x34b0bcb5e19b48a8ull,
+  0x391c0cb3c5c95a63ull, 0x4ed8aa4ae3418acbull, 0x5b9cca4f7763e373ull, 0x682e6ff3d6b2b8a3ull,
+  0x748f82ee5defb2fcull, 0x78a5636f43172f60ull, 0x84c87814a1f0ab72ull, 0x8cc702081a6439ecull,
+  0x90befffa23631e28ull, 0xa4506cebde82bde9ull, 0xbef9a3f7b2c67915ull, 0xc67178f2e372532bull,
+  0xca273eceea26619cull, 0xd186b8c721c0c207ull, 0xeada7dd6cde0eb1eull, 0xf57d4f7fee6ed178ull,
+  0x06f067aa72176fbaull, 0x0a637dc5a2c898a6ull, 0x113f9804bef90daeull, 0x1b710b35131c471bull,
+  0x28db77f523047d84ull, 0x32caab7b40c72493ull, 0x3c9ebe0a15c9bebcull, 0x431d67c49c100d4cull,
+  0x4cc5d4becb3e42b6ull, 0x597f299cfc657e2aull, 0x5fcb6fab3ad6faecull, 0x6c44198c4a475817ull,
+};
+
+static inline uint64_t rotr(uint64_t x, int n) { return (x >> n) | (x << (64 - n)); }
+
+static void compress(uint64_t state[8], const uint8_t block[128]) {
+  uint64_t w[80];
+  for (int i = 0; i < 16; i++) {
+    w[i] = 0;
+    for (int j = 0; j < 8; j++) w[i] = (w[i] << 8) | block[i * 8 + j];
+  }
+  for (int i = 16; i < 80; i++) {
+    uint64_t s0 = rotr(w[i - 15], 1) ^ rotr(w[i - 15], 8) ^ (w[i - 15] >> 7);
+    uint64_t s1 = rotr(w[i - 2], 19) ^ rotr(w[i - 2], 61) ^ (w[i - 2] >> 6);
+    w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+  }
+
+  uint64_t a = state[0], b = state[1], c = state[2], d = state[3];
+  uint64_t e = state[4], f = state[5], g = state[6], h = state[7];
+  for (int i = 0; i < 80; i++) {
+    uint64_t t1 = h + (rotr(e, 14) ^ rotr(e, 18) ^ rotr(e, 41)) + ((e & f) ^ (~e & g)) + K[i] + w[i];
+    uint64_t t2 = (rotr(a, 28) ^ rotr(a, 34) ^ rotr(a, 39)) + ((a & b) ^ (a & c) ^ (b & c));
+    h = g; g = f; f = e; e = d + t1;
+    d = c; c = b; b = a; a = t1 + t2;
+  }
+  state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+  state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+static void shaStart(mbedtls_md_context_t* ctx) {
+  static const uint64_t H0[8] = {
+    0x6a09e667f3bcc908ull, 0xbb67ae8584caa73bull, 0x3c6ef372fe94f82bull, 0xa54ff53a5f1d36f1ull,
+    0x510e527fade682d1ull, 0x9b05688c2b3e6c1full, 0x1f83d9abfb41bd6bull, 0x5be0cd19137e2179ull,
+  };
+  memcpy(ctx->state, H0, sizeof(H0));
+  ctx->length = 0;
+  ctx->used = 0;
+}
+
+static void shaUpdate(mbedtls_md_context_t* ctx, const uint8_t* data, size_t len) {
+  ctx->length += len;
+  while (len) {
+    size_t n = 128 - ctx->used;
+    if (n > len) n = len;
+    memcpy(ctx->block + ctx->used, data, n);
+    ctx->used += n;
+    data += n;
+    len -= n;
+    if (ctx->used == 128) {
+      compress(ctx->state, ctx->block);
+      ctx->used = 0;
+    }
+  }
+}
+
+static void shaFinish(mbedtls_md_context_t* ctx, uint8_t out[64]) {
+  uint64_t bits = ctx->length * 8;
+  uint8_t pad = 0x80;
+  shaUpdate(ctx, &pad, 1);
+  pad = 0;
+  while (ctx->used != 112) shaUpdate(ctx, &pad, 1);
+  uint8_t lenBytes[16] = {};
+  for (int i = 0; i < 8; i++) lenBytes[15 - i] = (uint8_t)(bits >> (8 * i));
+  shaUpdate(ctx, lenBytes, 16);
+  for (int i = 0; i < 8; i++) {
+    for (int j = 0; j < 8; j++) out[i * 8 + j] = (uint8_t)(ctx->state[i] >> (56 - 8 * j));
+  }
+}
+
+const mbedtls_md_info_t* mbedtls_md_info_from_type(mbedtls_md_type_t type) {
+  return type == MBEDTLS_MD_SHA512 ? &sha512Info : nullptr;
+}
+
+void mbedtls_md_init(mbedtls_md_context_t* ctx) {
+  memset(ctx, 0, sizeof(*ctx));
+}
+
+void mbedtls_md_free(mbedtls_md_context_t* ctx) {
+  memset(ctx, 0, sizeof(*ctx));
+}
+
+int mbedtls_md_setup(mbedtls_md_context_t* ctx, const mbedtls_md_info_t* info, int hmac) {
+  if (!info) return -1;
+  ctx->hmac = hmac;
+  return 0;
+}
+
+int mbedtls_md_starts(mbedtls_md_context_t* ctx) {
+  shaStart(ctx);
+  return 0;
+}
+
+int mbedtls_md_update(mbedtls_md_context_t* ctx, const unsigned char* input, size_t len) {
+  shaUpdate(ctx, input, len);
+  return 0;
+}
+
+int mbedtls_md_finish(mbedtls_md_context_t* ctx, unsigned char* output) {
+  shaFinish(ctx, output);
+  return 0;
+}
+
+int mbedtls_md_hmac_starts(mbedtls_md_context_t* ctx, const unsigned char* key, size_t keylen) {
+  memset(ctx->hmacKey, 0, sizeof(ctx->hmacKey));
+  if (keylen > sizeof(ctx->hmacKey)) {
+    shaStart(ctx);
+    shaUpdate(ctx, key, keylen);
+    shaFinish(ctx, ctx->hmacKey);
+  } else {
+    memcpy(ctx->hmacKey, key, keylen);
+  }
+  uint8_t ipad[128];
+  for (int i = 0; i < 128; i++) ipad[i] = ctx->hmacKey[i] ^ 0x36;
+  shaStart(ctx);
+  shaUpdate(ctx, ipad, sizeof(ipad));
+  return 0;
+}
+
+int mbedtls_md_hmac_update(mbedtls_md_context_t* ctx, const unsigned char* input, size_t len) {
+  shaUpdate(ctx, input, len);
+  return 0;
+}
+
+int mbedtls_md_hmac_finish(mbedtls_md_context_t* ctx, unsigned char* output) {
+  uint8_t inner[64];
+  shaFinish(ctx, inner);
+  uint8_t opad[128];
+  for (int i = 0; i < 128; i++) opad[i] = ctx->hmacKey[i] ^ 0x5c;
+  shaStart(ctx);
+  shaUpdate(ctx, opad, sizeof(opad));
+  shaUpdate(ctx, inner, sizeof(inner));
+  shaFinish(ctx, output);
+  return 0;
+}
+
+/* =========================================================
+   SHA-256
+   ========================================================= */
+static const uint32_t K256[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static inline uint32_t rotr32(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+static void compress256(uint32_t state[8], const uint8_t block[64]) {
+  uint32_t w[64];
+  for (int i = 0; i < 16; i++) {
+    w[i] = ((uint32_t)block[i * 4] << 24) | ((uint32_t)block[i * 4 + 1] << 16) |
+           ((uint32_t)block[i * 4 + 2] << 8) | block[i * 4 + 3];
+  }
+  for (int i = 16; i < 64; i++) {
+    uint32_t s0 = rotr32(w[i - 15], 7) ^ rotr32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+    uint32_t s1 = rotr32(w[i - 2], 17) ^ rotr32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+    w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+  }
+
+  uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+  uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+  for (int i = 0; i < 64; i++) {
+    uint32_t t1 = h + (rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25)) + ((e & f) ^ (~e & g)) + K256[i] + w[i];
+    uint32_t t2 = (rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+    h = g; g = f; f = e; e = d + t1;
+    d = c; c = b; b = a; a = t1 + t2;
+  }
+  state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+  state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+void mbedtls_sha256_init(mbedtls_sha256_context* ctx) {
+  memset(ctx, 0, sizeof(*ctx));
+}
+
+void mbedtls_sha256_free(mbedtls_sha256_context* ctx) {
+  memset(ctx, 0, sizeof(*ctx));
+}
+
+int mbedtls_sha256_starts(mbedtls_sha256_context* ctx, int is224) {
+  static const uint32_t H256[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+  };
+  static const uint32_t H224[8] = {
+    0xc1059ed8, 0x367cd507, 0x3070dd17, 0xf70e5939, 0xffc00b31, 0x68581511, 0x64f98fa7, 0xbefa4fa4,
+  };
+  memcpy(ctx->state, is224 ? H224 : H256, sizeof(ctx->state));
+  ctx->length = 0;
+  ctx->used = 0;
+  ctx->is224 = is224;
+  return 0;
+}
+
+int mbedtls_sha256_update(mbedtls_sha256_context* ctx, const unsigned char* input, size_t len) {
+  ctx->length += len;
+  while (len) {
+    size_t n = 64 - ctx->used;
+    if (n > len) n = len;
+    memcpy(ctx->block + ctx->used, input, n);
+    ctx->used += n;
+    input += n;
+    len -= n;
+    if (ctx->used == 64) {
+      compress256(ctx->state, ctx->block);
+      ctx->used = 0;
+    }
+  }
+  return 0;
+}
+
+int mbedtls_sha256_finish(mbedtls_sha256_context* ctx, unsigned char* output) {
+  uint64_t bits = ctx->length * 8;
+  uint8_t pad = 0x80;
+  mbedtls_sha256_update(ctx, &pad, 1);
+  pad = 0;
+  while (ctx->used != 56) mbedtls_sha256_update(ctx, &pad, 1);
+  uint8_t lenBytes[8];
+  for (int i = 0; i < 8; i++) lenBytes[7 - i] = (uint8_t)(bits >> (8 * i));
+  mbedtls_sha256_update(ctx, lenBytes, 8);
+  int words = ctx->is224 ? 7 : 8;
+  for (int i = 0; i < words; i++) {
+    for (int j = 0; j < 4; j++) output[i * 4 + j] = (uint8_t)(ctx->state[i] >> (24 - 8 * j));
+  }
+  return 0;
+}
+
+int mbedtls_sha256(const unsigned char* input, size_t len, unsigned char* output, int is224) {
+  mbedtls_sha256_context ctx;
+  mbedtls_sha256_init(&ctx);
+  mbedtls_sha256_starts(&ctx, is224);
+  mbedtls_sha256_update(&ctx, input, len);
+  mbedtls_sha256_finish(&ctx, output);
+  mbedtls_sha256_free(&ctx);
+  return 0;
+}
+
+/* =========================================================
+   SHA-1
+   ========================================================= */
+static inline uint32_t rotl32(uint32_t x, int n) { return (x << n) | (x >> (32 - n)); }
+
+static void compress1(uint32_t state[5], const uint8_t block[64]) {
+  uint32_t w[80];
+  for (int i = 0; i < 16; i++) {
+    w[i] = ((uint32_t)block[i * 4] << 24) | ((uint32_t)block[i * 4 + 1] << 16) |
+           ((uint32_t)block[i * 4 + 2] << 8) | block[i * 4 + 3];
+  }
+  for (int i = 16; i < 80; i++) w[i] = rotl32(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+  uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+  for (int i = 0; i < 80; i++) {
+    uint32_t f, k;
+    if (i < 20)      { f = (b & c) | (~b & d);          k = 0x5a827999; }
+    else if (i < 40) { f = b ^ c ^ d;                   k = 0x6ed9eba1; }
+    else if (i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8f1bbcdc; }
+    else             { f = b ^ c ^ d;                   k = 0xca62c1d6; }
+    uint32_t t = rotl32(a, 5) + f + e + k + w[i];
+    e = d; d = c; c = rotl32(b, 30); b = a; a = t;
+  }
+  state[0] += a; state[1] += b; state[2] += c; state[3] += d; state[4] += e;
+}
+
+int mbedtls_sha1(const unsigned char* input, size_t len, unsigned char output[20]) {
+  uint32_t state[5] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0};
+  uint8_t block[64];
+  size_t done = 0;
+  for (; len - done >= 64; done += 64) compress1(state, input + done);
+
+  size_t rest = len - done;
+  memset(block, 0, sizeof(block));
+  memcpy(block, input + done, rest);
+  block[rest] = 0x80;
+  if (rest >= 56) {
+    compress1(state, block);
+    memset(block, 0, sizeof(block));
+  }
+  uint64_t bits = (uint64_t)len * 8;
+  for (int i = 0; i < 8; i++) block[63 - i] = (uint8_t)(bits >> (8 * i));
+  compress1(state, block);
+  for (int i = 0; i < 5; i++) {
+    for (int j = 0; j < 4; j++) output[i * 4 + j] = (uint8_t)(state[i] >> (24 - 8 * j));
+  }
+  return 0;
+}
@@ -0,0 +1,380 @@
+#include <Arduino.h>
+#include <WiFi.h>
+#include <WiFiClientSecure.h>
+#include <HTTPClient.h>
+#include <strings.h>
+
+WiFiClass WiFi;
+
+static sim::HttpHandler httpHandler;
+
+/* =========================================================
+   WIFI
+   ========================================================= */
+// Per boot: the radio starts off after every wake
+static bool associating = false;
+static uint64_t associatedAtUs = 0;
+static int joined = -1;           // access point being joined, -1 if none matches
+
+struct ScanResult {
+  int ap;
+  int8_t rssi;
+};
+static uint64_t scanDoneUs = 0;   // 0: no scan started
+static bool scanned = false;      // results taken
+static std::vector<ScanResult> scanResults;
+
+// An access point's signal at the lock now
+static int8_t apRssi(int i) {
+  const sim::AccessPoint& ap = sim::world().net.aps[i];
+  uint64_t now = sim::now_us();
+  return ap.rssi - (now >= ap.fadeFromUs && now < ap.fadeUntilUs ? 20 : 0);
+}
+
+static bool visible(int i) {
+  return apRssi(i) >= -90;
+}
+
+// Time lost to retransmits per round trip over the joined access point
+static uint32_t retransmitMs() {
+  const sim::NetworkModel& net = sim::world().net;
+  if (joined < 0) return 0;
+  int8_t rssi = apRssi(joined);
+  return rssi < net.weakRssi ? (net.weakRssi - rssi) * net.weakMsPerDb : 0;
+}
+
+wl_status_t WiFiClass::begin(const char* ssid, const char*, int32_t channel, const uint8_t* bssid, bool) {
+  sim::World& w = sim::world();
+  const sim::NetworkModel& net = w.net;
+  associating = true;
+  joined = -1;
+  for (int i = 0; i < net.apCount && joined < 0; i++) {
+    const sim::AccessPoint& ap = net.aps[i];
+    if (strcmp(ap.ssid, ssid) || !visible(i)) continue;
+    if (bssid && memcmp(ap.bssid, bssid, 6)) continue;
+    if (channel && channel != ap.channel) continue;
+    joined = i;
+  }
+  if (joined >= 0) w.counters.apConnects[joined]++;
+
+  uint64_t ms = net.associateMs + random(net.associateJitterMs + 1) + 4 * retransmitMs();
+  if (bssid && channel) ms -= std::min<uint64_t>(ms, net.knownApSavingMs);
+  associatedAtUs = sim::now_us() + ms * 1000;
+  return WL_DISCONNECTED;
+}
+
+wl_status_t WiFiClass::status() {
+  if (!associating) return WL_IDLE_STATUS;
+  if (!sim::world().net.wifiAvailable || joined < 0) return WL_NO_SSID_AVAIL;
+  return sim::now_us() >= associatedAtUs ? WL_CONNECTED : WL_DISCONNECTED;
+}
+
+bool WiFiClass::disconnect(bool wifiOff, bool) {
+  associating = false;
+  joined = -1;
+  if (wifiOff) currentMode = WIFI_OFF;
+  return true;
+}
+
+int8_t WiFiClass::RSSI() {
+  return status() == WL_CONNECTED ? apRssi(joined) : 0;
+}
+
+int32_t WiFiClass::channel() {
+  return status() == WL_CONNECTED ? sim::world().net.aps[joined].channel : 0;
+}
+
+String WiFiClass::SSID() {
+  return String(status() == WL_CONNECTED ? sim::world().net.aps[joined].ssid : "");
+}
+
+uint8_t* WiFiClass::BSSID() {
+  return status() == WL_CONNECTED ? sim::world().net.aps[joined].bssid : nullptr;
+}
+
+// Signals are measured once per scan, give or take 3 dB of fading
+int16_t WiFiClass::scanNetworks(bool async, bool, bool, uint32_t, uint8_t) {
+  sim::World& w = sim::world();
+  w.counters.scans++;
+  scanResults.clear();
+  scanned = false;
+  scanDoneUs = sim::now_us() + (uint64_t)w.net.scanMs * 1000;
+  if (async) return WIFI_SCAN_RUNNING;
+  delay(w.net.scanMs);
+  return scanComplete();
+}
+
+int16_t WiFiClass::scanComplete() {
+  if (!scanDoneUs) return WIFI_SCAN_FAILED;
+  if (sim::now_us() < scanDoneUs) return WIFI_SCAN_RUNNING;
+  if (!scanned) {
+    for (int i = 0; i < sim::world().net.apCount; i++) {
+      if (visible(i)) scanResults.push_back({ i, (int8_t)(apRssi(i) - 3 + (int)random(7)) });
+    }
+    scanned = true;
+  }
+  return (int16_t)scanResults.size();
+}
+
+void WiFiClass::scanDelete() {
+  scanResults.clear();
+  scanDoneUs = 0;
+  scanned = false;
+}
+
+String WiFiClass::SSID(uint8_t i) {
+  return String(i < scanResults.size() ? sim::world().net.aps[scanResults[i].ap].ssid : "");
+}
+
+int32_t WiFiClass::RSSI(uint8_t i) {
+  return i < scanResults.size() ? scanResults[i].rssi : 0;
+}
+
+uint8_t* WiFiClass::BSSID(uint8_t i) {
+  return i < scanResults.size() ? sim::world().net.aps[scanResults[i].ap].bssid : nullptr;
+}
+
+int32_t WiFiClass::channel(uint8_t i) {
+  return i < scanResults.size() ? sim::world().net.aps[scanResults[i].ap].channel : 0;
+}
+
+IPAddress WiFiClass::localIP() {
+  return status() == WL_CONNECTED ? IPAddress(192, 168, 1, 50) : IPAddress();
+}
+
+String WiFiClass::macAddress() {
+  return String("24:6F:28:00:00:01");
+}
+
+uint8_t* WiFiClass::macAddress(uint8_t* mac) {
+  static const uint8_t sim_mac[6] = {0x24, 0x6F, 0x28, 0x00, 0x00, 0x01};
+  memcpy(mac, sim_mac, 6);
+  return mac;
+}
+
+// Where a host currently lives; changes with the world's addressEpoch
+static IPAddress addressOf(const char* host) {
+  uint32_t h = 2166136261u ^ sim::world().net.addressEpoch;
+  for (const char* p = host; *p; p++) h = (h ^ (uint8_t)*p) * 16777619u;
+  return IPAddress(10, (h >> 16) & 0xFF, (h >> 8) & 0xFF, (h & 0xFF) | 1);
+}
+
+int WiFiClass::hostByName(const char* host, IPAddress& result) {
+  if (status() != WL_CONNECTED) return 0;
+  sim::world().counters.dnsLookups++;
+  delay(sim::world().net.dnsMs + retransmitMs());
+  result = addressOf(host);
+  return 1;
+}
+
+int WiFiClient::handshake(const std::string& name, uint16_t port, int32_t timeoutMs) {
+  sim::World& w = sim::world();
+  uint32_t handshakeMs = w.net.handshakeMs / 3;
+  if (secure) {
+    uint32_t cpuMs = std::min(w.net.handshakeCpuMs, w.net.handshakeMs);
+    handshakeMs = w.net.handshakeMs - cpuMs + cpuMs * 240 / getCpuFrequencyMhz();
+  }
+  if ((int32_t)handshakeMs > timeoutMs) {
+    delay(timeoutMs);
+    return 0;
+  }
+  delay(handshakeMs + 3 * retransmitMs()); // TCP and TLS round trips
+  w.counters.handshakes++;
+  host = name + ":" + std::to_string(port);
+  return 1;
+}
+
+int WiFiClient::connect(const char* host, uint16_t port, int32_t timeoutMs) {
+  stop();
+  IPAddress ip;
+  if (!WiFi.hostByName(host, ip)) return 0;
+  return handshake(host, port, timeoutMs);
+}
+
+int WiFiClient::connect(IPAddress ip, uint16_t port, int32_t timeoutMs) {
+  stop();
+  if (WiFi.status() != WL_CONNECTED) return 0;
+  return handshake(ip.toString().c_str(), port, timeoutMs);
+}
+
+// A stale address doesn't answer: the connect runs into its timeout
+int WiFiClientSecure::connect(IPAddress ip, uint16_t port, const char* host, const char*, const char*, const char*) {
+  stop();
+  if (WiFi.status() != WL_CONNECTED) return 0;
+  if (ip != addressOf(host)) {
+    delay(handshakeTimeoutMs);
+    return 0;
+  }
+  return handshake(host, port, handshakeTimeoutMs);
+}
+
+/* =========================================================
+   LAN
+   ========================================================= */
+struct Listener {
+  uint16_t port;
+  std::vector<sim::LanConnection> pending;
+};
+
+static std::vector<Listener> listeners;
+
+static Listener* listenerFor(uint16_t port) {
+  for (Listener& l : listeners) if (l.port == port) return &l;
+  return nullptr;
+}
+
+void WiFiServer::begin() {
+  if (!listening) listeners.push_back({port, {}});
+  listening = true;
+}
+
+void WiFiServer::end() {
+  if (!listening) return;
+  for (size_t i = 0; i < listeners.size(); i++) {
+    if (listeners[i].port != port) continue;
+    for (auto& peer : listeners[i].pending) peer->open = false;
+    listeners.erase(listeners.begin() + i);
+    break;
+  }
+  listening = false;
+}
+
+WiFiClient WiFiServer::available() {
+  WiFiClient client;
+  Listener* l = listening ? listenerFor(port) : nullptr;
+  if (!l || l->pending.empty()) return client;
+  client.peer = l->pending.front();
+  l->pending.erase(l->pending.begin());
+  return client;
+}
+
+sim::LanConnection sim::lan_connect(uint16_t port) {
+  LanConnection peer = std::make_shared<LanPeer>();
+  Listener* l = listenerFor(port);
+  if (l && WiFi.status() == WL_CONNECTED) l->pending.push_back(peer);
+  else peer->open = false;
+  return peer;
+}
+
+/* =========================================================
+   HTTP
+   ========================================================= */
+std::string sim::HttpRequest::header(const char* name) const {
+  for (auto& h : headers) {
+    if (strcasecmp(h.first.c_str(), name) == 0) return h.second;
+  }
+  return std::string();
+}
+
+void sim::set_http_handler(HttpHandler handler) {
+  httpHandler = handler;
+}
+
+sim::NetworkCounters& sim::network_counters() {
+  return world().counters;
+}
+
+bool HTTPClient::begin(const String& url) {
+  if (!ownClient) ownClient = new WiFiClient();
+  ownClient->secure = url.startsWith("https://");
+  return begin(*ownClient, url);
+}
+
+bool HTTPClient::begin(WiFiClient& client, const String& url) {
+  this->client = &client;
+  this->url = url.str();
+  headers.clear();
+  response = String();
+
+  size_t scheme = this->url.find("://");
+  if (scheme == std::string::npos) return false;
+  size_t hostStart = scheme + 3;
+  size_t pathStart = this->url.find('/', hostStart);
+  host = this->url.substr(hostStart, pathStart == std::string::npos ? std::string::npos : pathStart - hostStart);
+  path = pathStart == std::string::npos ? "/" : this->url.substr(pathStart);
+  if (host.find(':') == std::string::npos) host += client.secure ? ":443" : ":80";
+  return true;
+}
+
+void HTTPClient::end() {
+  if (client && !reuse) client->stop();
+  headers.clear();
+}
+
+int HTTPClient::GET() {
+  return send("GET", String());
+}
+
+int HTTPClient::POST(const String& body) {
+  return send("POST", body);
+}
+
+// Requests by the access point they went over
+struct ApTally {
+  int ap = joined;
+  uint64_t startedUs = sim::now_us();
+  ~ApTally() {
+    if (ap < 0) return;
+    sim::world().counters.apRequests[ap]++;
+    sim::world().counters.apRequestMs[ap] += (sim::now_us() - startedUs) / 1000;
+  }
+};
+
+int HTTPClient::send(const char* method, const String& body) {
+  sim::World& w = sim::world();
+  const sim::NetworkModel& net = w.net;
+  response = String();
+  if (!client) return HTTPC_ERROR_NOT_CONNECTED;
+  w.counters.requests++;
+  ApTally tally;
+
+  if (WiFi.status() != WL_CONNECTED) {
+    w.counters.failures++;
+    return HTTPC_ERROR_CONNECTION_REFUSED;
+  }
+
+  // New connection: DNS, TCP and (for https) the TLS handshake
+  if (!client->connected() || client->host != host) {
+    size_t colon = host.find(':');
+    if (!client->connect(host.substr(0, colon).c_str(), atoi(host.c_str() + colon + 1), connectTimeoutMs)) {
+      w.counters.failures++;
+      return HTTPC_ERROR_CONNECTION_REFUSED;
+    }
+  }
+
+  uint32_t roll = esp_random() % 1000;
+  if (roll < net.timeoutPermille) {
+    delay(readTimeoutMs);
+    client->stop();
+    w.counters.failures++;
+    return HTTPC_ERROR_READ_TIMEOUT;
+  }
+
+  sim::HttpRequest req;
+  req.method = method;
+  req.host = host.substr(0, host.find(':'));
+  req.path = path;
+  for (auto& h : headers) req.headers.push_back({h.first.str(), h.second.str()});
+  req.body = body.str();
+
+  // Half the round trip before the server sees the request, half after
+  uint32_t rttMs = net.rttMs + random(net.rttJitterMs + 1) + retransmitMs();
+  delay(rttMs / 2);
+  sim::HttpResponse res = httpHandler ? httpHandler(req) : sim::HttpResponse{404, ""};
+  if (roll < net.timeoutPermille + net.failurePermille) res = sim::HttpResponse{500, "{\"code\":\"500\"}"};
+
+  uint32_t backMs = rttMs - rttMs / 2 + res.extraLatencyMs;
+  if (rttMs / 2 + backMs > readTimeoutMs) {
+    delay(readTimeoutMs - min<uint32_t>(readTimeoutMs, rttMs / 2));
+    client->stop();
+    w.counters.failures++;
+    return HTTPC_ERROR_READ_TIMEOUT;
+  }
+  delay(backMs);
+
+  if (res.code >= 500) w.counters.failures++;
+  response = String(res.body);
+  client->rx = res.body;
+  client->rxPos = 0;
+  return res.code;
+}
@@ -0,0 +1,90 @@
+#include <esp_partition.h>
+#include <sim.h>
+#include <stdio.h>
+#include <string.h>
+
+// Typical SPI NOR timings at 40 MHz: reads stream at ~10 MB/s, a page
+// program costs a fixed setup plus per byte, a sector erase ~45 ms
+#define READ_SETUP_US 5
+#define READ_NS_PER_BYTE 100
+#define WRITE_SETUP_US 20
+#define WRITE_NS_PER_BYTE 2500
+#define ERASE_SECTOR_US 45000
+
+// partitions.csv; data partitions are laid out in the world's dataFlash
+// from DATA_FLASH_BASE on
+#define DATA_FLASH_BASE 0x3D0000
+static esp_partition_t table[] = {
+  { ESP_PARTITION_TYPE_DATA, 0x40, 0x3D0000, 0x20000, "audit", false },
+};
+
+static uint8_t* flash(const esp_partition_t* p, size_t offset) {
+  sim::World& w = sim::world();
+  if (!w.flashValid) {
+    memset(w.dataFlash, 0xFF, sizeof(w.dataFlash));
+    w.flashValid = true;
+  }
+  return w.dataFlash + (p->address - DATA_FLASH_BASE) + offset;
+}
+
+static void stall(uint64_t ns) {
+  sim::clock_to(sim::now_us() + (ns + 999) / 1000);
+}
+
+static bool inside(const esp_partition_t* p, size_t offset, size_t size) {
+  return p && offset <= p->size && size <= p->size - offset;
+}
+
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char* label) {
+  for (const esp_partition_t& p : table) {
+    if (p.type == type && (subtype == ESP_PARTITION_SUBTYPE_ANY || p.subtype == subtype) &&
+        (!label || !strcmp(p.label, label))) return &p;
+  }
+  return nullptr;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t* p, size_t offset, void* dst, size_t size) {
+  if (!inside(p, offset, size)) return ESP_ERR_INVALID_SIZE;
+  memcpy(dst, flash(p, offset), size);
+  sim::world().flash.readBytes += size;
+  stall(READ_SETUP_US * 1000ull + size * READ_NS_PER_BYTE);
+  return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t* p, size_t offset, const void* src, size_t size) {
+  if (!inside(p, offset, size)) return ESP_ERR_INVALID_SIZE;
+  uint8_t* dst = flash(p, offset);
+  for (size_t i = 0; i < size; i++) dst[i] &= ((const uint8_t*)src)[i];
+  sim::world().flash.writes++;
+  stall(WRITE_SETUP_US * 1000ull + size * WRITE_NS_PER_BYTE);
+  return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t* p, size_t offset, size_t size) {
+  if (!inside(p, offset, size)) return ESP_ERR_INVALID_SIZE;
+  if (offset % SPI_FLASH_SEC_SIZE || size % SPI_FLASH_SEC_SIZE) return ESP_ERR_INVALID_ARG;
+  memset(flash(p, offset), 0xFF, size);
+  sim::world().flash.erases += size / SPI_FLASH_SEC_SIZE;
+  stall(size / SPI_FLASH_SEC_SIZE * ERASE_SECTOR_US * 1000ull);
+  return ESP_OK;
+}
+
+bool sim::relabel_partition(const char* label, const char* to, uint8_t subtype) {
+  for (esp_partition_t& p : table) {
+    if (strcmp(p.label, label)) continue;
+    snprintf(p.label, sizeof(p.label), "%s", to);
+    p.subtype = subtype;
+    return true;
+  }
+  return false;
+}
+
+bool sim::resize_partition(const char* label, uint32_t size) {
+  for (esp_partition_t& p : table) {
+    if (strcmp(p.label, label)) continue;
+    if (size % SPI_FLASH_SEC_SIZE || p.address - DATA_FLASH_BASE + size > DATA_FLASH_SIZE) return false;
+    p.size = size;
+    return true;
+  }
+  return false;
+}
@@ -0,0 +1,72 @@
+#include <Preferences.h>
+
+static sim::NvsEntry* find(const char* ns, const char* key) {
+  for (sim::NvsEntry& e : sim::world().nvs) {
+    if (e.used && !strcmp(e.ns, ns) && !strcmp(e.key, key)) return &e;
+  }
+  return nullptr;
+}
+
+bool Preferences::begin(const char* name, bool readOnly, const char*) {
+  if (strlen(name) >= sizeof(ns)) return false;
+  strcpy(ns, name);
+  this->readOnly = readOnly;
+  // Like NVS, a read-only open of a namespace that was never written fails
+  if (readOnly) {
+    bool exists = false;
+    for (const sim::NvsEntry& e : sim::world().nvs) exists = exists || (e.used && !strcmp(e.ns, ns));
+    if (!exists) return false;
+  }
+  open = true;
+  return true;
+}
+
+bool Preferences::clear() {
+  if (!open || readOnly) return false;
+  for (sim::NvsEntry& e : sim::world().nvs) {
+    if (e.used && !strcmp(e.ns, ns)) e.used = false;
+  }
+  sim::world().nvsWrites++;
+  return true;
+}
+
+bool Preferences::remove(const char* key) {
+  if (!open || readOnly) return false;
+  sim::NvsEntry* e = find(ns, key);
+  if (!e) return false;
+  e->used = false;
+  sim::world().nvsWrites++;
+  return true;
+}
+
+bool Preferences::isKey(const char* key) {
+  return open && find(ns, key);
+}
+
+size_t Preferences::putBytes(const char* key, const void* value, size_t len) {
+  if (!open || readOnly || strlen(key) >= sizeof(sim::NvsEntry::key) || len > sim::NVS_VALUE_SIZE) return 0;
+  sim::NvsEntry* e = find(ns, key);
+  for (sim::NvsEntry& slot : sim::world().nvs) {
+    if (!e && !slot.used) e = &slot;
+  }
+  if (!e) return 0;
+  e->used = true;
+  strcpy(e->ns, ns);
+  strcpy(e->key, key);
+  e->len = len;
+  memcpy(e->data, value, len);
+  sim::world().nvsWrites++;
+  return len;
+}
+
+size_t Preferences::getBytes(const char* key, void* buf, size_t maxLen) {
+  sim::NvsEntry* e = open ? find(ns, key) : nullptr;
+  if (!e || e->len > maxLen) return 0;
+  memcpy(buf, e->data, e->len);
+  return e->len;
+}
+
+size_t Preferences::getBytesLength(const char* key) {
+  sim::NvsEntry* e = open ? find(ns, key) : nullptr;
+  return e ? e->len : 0;
+}
@@ -0,0 +1,65 @@
+#include <SimRadio.h>
+#include <Arduino.h>
+#include <string.h>
+#include "sim.h"
+
+#define SIM_RADIO_QUEUE 16 // like the ESP-NOW receive queue
+
+void SimAir::join(SimRadio* radio) {
+  radios.push_back(radio);
+}
+
+void SimAir::transmit(const uint8_t from[6], const uint8_t to[6], const uint8_t* data, size_t len) {
+  SimFrame frame;
+  memcpy(frame.from, from, 6);
+  memcpy(frame.to, to, 6);
+  frame.data.assign(data, data + len);
+  capture.push_back(frame);
+  sent++;
+  if (lossPermille && (uint32_t)random(1000) < lossPermille) {
+    lost++;
+    return;
+  }
+
+  for (SimRadio* radio : radios) {
+    if (memcmp(radio->mac, to, 6) != 0) continue;
+    sim::at(sim::now_us() + airtimeUs, [radio, frame]() {
+      if (radio->on && radio->inbox.size() < SIM_RADIO_QUEUE) radio->inbox.push_back(frame);
+    });
+  }
+}
+
+SimRadio::SimRadio(SimAir& air, const uint8_t mac[6]) : air(air) {
+  memcpy(this->mac, mac, 6);
+  air.join(this);
+}
+
+bool SimRadio::begin(uint8_t) {
+  on = true;
+  return true;
+}
+
+bool SimRadio::send(const uint8_t to[6], const uint8_t* data, size_t len) {
+  if (!on || len > LINK_FRAME_MAX) return false;
+  air.transmit(mac, to, data, len);
+  return true;
+}
+
+size_t SimRadio::receive(uint8_t from[6], uint8_t* data, size_t capacity) {
+  if (inbox.empty()) return 0;
+  SimFrame frame = inbox.front();
+  inbox.pop_front();
+  if (frame.data.size() > capacity) return 0;
+  memcpy(from, frame.from, 6);
+  memcpy(data, frame.data.data(), frame.data.size());
+  return frame.data.size();
+}
+
+void SimRadio::address(uint8_t out[6]) {
+  memcpy(out, mac, 6);
+}
+
+void SimRadio::end() {
+  on = false;
+  inbox.clear();
+}
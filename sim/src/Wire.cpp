@@ -0,0 +1,73 @@
+#include <Wire.h>
+
+TwoWire Wire;
+
+bool TwoWire::begin(int, int, uint32_t frequency) {
+  if (frequency) clockHz = frequency;
+  return true;
+}
+
+void TwoWire::attach(uint8_t address, I2CDevice* device) {
+  devices[address & 0x7F] = device;
+}
+
+// Each byte is 8 data bits plus ACK; START/repeated START and STOP are
+// about one bit time each.
+void TwoWire::clockBits(unsigned bits) {
+  pendingUs += bits * 1e6 / clockHz;
+  uint64_t whole = (uint64_t)pendingUs;
+  pendingUs -= whole;
+  busTimeUs += whole;
+  sim::advance_us(whole);
+}
+
+void TwoWire::start() {
+  inTransaction = true;
+  clockBits(1);
+}
+
+void TwoWire::stop() {
+  clockBits(1);
+  inTransaction = false;
+  transactions++;
+}
+
+void TwoWire::beginTransmission(uint8_t address) {
+  txAddress = address & 0x7F;
+  tx.clear();
+}
+
+size_t TwoWire::write(uint8_t data) {
+  tx.push_back(data);
+  return 1;
+}
+
+uint8_t TwoWire::endTransmission(bool sendStop) {
+  start();
+  I2CDevice* device = devices[txAddress];
+  clockBits(9);                      // address + R/W + ACK
+  if (!device) {
+    stop();
+    return 2;                        // NACK on address
+  }
+  clockBits(9 * tx.size());
+  device->onWrite(tx.data(), tx.size());
+  if (sendStop) stop();
+  return 0;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t quantity, bool sendStop) {
+  start();
+  rx.assign(quantity, 0);
+  rxPos = 0;
+  I2CDevice* device = devices[address & 0x7F];
+  clockBits(9);
+  size_t n = 0;
+  if (device) {
+    n = device->onRead(rx.data(), quantity);
+    clockBits(9 * n);
+  }
+  rx.resize(n);
+  if (sendStop) stop();
+  return (uint8_t)n;
+}
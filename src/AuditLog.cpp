@@ -0,0 +1,280 @@
+#include "AuditLog.h"
+#include <esp_partition.h>
+#include <esp_rom_crc.h>
+#include <freertos/queue.h>
+
+#define AUDIT_MAGIC 0x4C445541 // "AUDL"
+#define AUDIT_ERASED 0xFFFFFFFF
+#define AUDIT_CHUNK 64         // records read at a time
+
+static_assert(sizeof(AuditRecord) == 8, "records are packed 8 bytes");
+
+// Written when a sector is started (magic, seq) and when it fills up
+// (minTime, maxTime), each bit cleared at most once
+struct SectorHeader {
+  uint32_t magic;
+  uint32_t seq;     // 1 for the first sector ever written, then counts up
+  uint32_t minTime; // dated records only; erased while the sector is open
+  uint32_t maxTime;
+};
+static_assert(sizeof(SectorHeader) == AUDIT_HEADER_SIZE, "header size");
+
+// The index: one entry per flash sector
+struct SectorInfo {
+  uint32_t seq;     // 0: not part of the log
+  uint32_t minTime; // UINT32_MAX / 0 while it has no dated records
+  uint32_t maxTime;
+};
+
+static QueueHandle_t queue = nullptr;
+static const esp_partition_t* partition = nullptr;
+static SectorInfo* sectors = nullptr; // the index
+static uint16_t sectorCount = 0;
+static int head = -1;     // sector being appended to, -1 while the log is empty
+static uint16_t fill = 0; // records in the head sector
+static bool mounted = false;
+static bool unusable = false;
+static AuditRecord chunk[AUDIT_CHUNK];
+
+/* =========================================================
+   RECORDS
+   ========================================================= */
+static uint8_t checkOf(const AuditRecord& r) {
+  return esp_rom_crc8_le(0, (const uint8_t*)&r, offsetof(AuditRecord, check));
+}
+
+static size_t recordOffset(int sector, uint16_t slot) {
+  return (size_t)sector * AUDIT_SECTOR_SIZE + AUDIT_HEADER_SIZE + slot * sizeof(AuditRecord);
+}
+
+static bool readRecords(int sector, uint16_t first, uint16_t count) {
+  return esp_partition_read(partition, recordOffset(sector, first), chunk, count * sizeof(AuditRecord)) == ESP_OK;
+}
+
+static void widen(SectorInfo& info, uint32_t time) {
+  if (!time) return;
+  if (time < info.minTime) info.minTime = time;
+  if (time > info.maxTime) info.maxTime = time;
+}
+
+/* =========================================================
+   MOUNT
+   ========================================================= */
+// Records are appended in order, so the written ones are a prefix of the
+// sector: binary search for its end
+static uint16_t countWritten(int sector) {
+  uint16_t lo = 0, hi = AUDIT_RECORDS_PER_SECTOR;
+  while (lo < hi) {
+    uint16_t mid = (lo + hi) / 2;
+    AuditRecord r;
+    if (esp_partition_read(partition, recordOffset(sector, mid), &r, sizeof(r)) != ESP_OK) return 0;
+    if (r.time != AUDIT_ERASED) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+// Time range of a sector whose header doesn't have it: the open one, or one
+// the power went off in before it was closed
+static void scanRange(int sector, uint16_t count) {
+  SectorInfo& info = sectors[sector];
+  info.minTime = UINT32_MAX;
+  info.maxTime = 0;
+  for (uint16_t first = 0; first < count; first += AUDIT_CHUNK) {
+    uint16_t n = min((uint16_t)AUDIT_CHUNK, (uint16_t)(count - first));
+    if (!readRecords(sector, first, n)) return;
+    for (uint16_t i = 0; i < n; i++) {
+      if (chunk[i].check == checkOf(chunk[i])) widen(info, chunk[i].time);
+    }
+  }
+}
+
+// The log's partition, or on the old table the spiffs one in its place
+static const esp_partition_t* findPartition() {
+  const esp_partition_t* p = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, AUDIT_PARTITION);
+  if (p) return p;
+  p = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_SPIFFS, AUDIT_LEGACY_PARTITION);
+  if (!p || p->address != AUDIT_LEGACY_ADDRESS || p->size != AUDIT_LEGACY_SIZE) return nullptr;
+  Serial.println("[Audit] Old partition table - keeping the log in \"" AUDIT_LEGACY_PARTITION "\"");
+  return p;
+}
+
+// Read every sector header into the index, once per boot
+static bool mount() {
+  if (mounted) return true;
+  if (unusable) return false;
+
+  partition = findPartition();
+  sectorCount = partition ? partition->size / AUDIT_SECTOR_SIZE : 0;
+  if (sectorCount >= 2) sectors = (SectorInfo*)calloc(sectorCount, sizeof(SectorInfo));
+  if (!sectors) {
+    Serial.println("[Audit] ERROR: no \"" AUDIT_PARTITION "\" partition - audit log disabled, flash partitions.csv over USB");
+    unusable = true;
+    return false;
+  }
+
+  for (int s = 0; s < sectorCount; s++) {
+    SectorHeader h;
+    if (esp_partition_read(partition, (size_t)s * AUDIT_SECTOR_SIZE, &h, sizeof(h)) != ESP_OK || h.magic != AUDIT_MAGIC) continue;
+    sectors[s] = { h.seq, h.minTime, h.maxTime };
+    if (head < 0 || h.seq > sectors[head].seq) head = s;
+  }
+
+  for (int s = 0; s < sectorCount; s++) {
+    if (!sectors[s].seq) continue;
+    uint16_t count = s == head ? countWritten(s) : AUDIT_RECORDS_PER_SECTOR;
+    if (s == head) fill = count;
+    if (s == head || sectors[s].maxTime == AUDIT_ERASED) scanRange(s, count);
+  }
+  mounted = true;
+  return true;
+}
+
+/* =========================================================
+   APPEND
+   ========================================================= */
+// Write the time range of a full sector into its header
+static void closeSector(int sector) {
+  uint32_t range[2] = { sectors[sector].minTime, sectors[sector].maxTime };
+  esp_partition_write(partition, (size_t)sector * AUDIT_SECTOR_SIZE + offsetof(SectorHeader, minTime), range, sizeof(range));
+}
+
+// Erase the sector after the head (the oldest, once the log has wrapped)
+// and start filling it
+static bool startSector() {
+  if (head >= 0) closeSector(head);
+  int next = head < 0 ? 0 : (head + 1) % sectorCount;
+  uint32_t seq = head < 0 ? 1 : sectors[head].seq + 1;
+
+  sectors[next].seq = 0;
+  if (esp_partition_erase_range(partition, (size_t)next * AUDIT_SECTOR_SIZE, AUDIT_SECTOR_SIZE) != ESP_OK) return false;
+  uint32_t start[2] = { AUDIT_MAGIC, seq };
+  if (esp_partition_write(partition, (size_t)next * AUDIT_SECTOR_SIZE, start, sizeof(start)) != ESP_OK) return false;
+
+  sectors[next] = { seq, UINT32_MAX, 0 };
+  head = next;
+  fill = 0;
+  return true;
+}
+
+static bool append(const AuditRecord& r) {
+  if (!mount()) return false;
+  if (head < 0 || fill == AUDIT_RECORDS_PER_SECTOR) {
+    if (!startSector()) return false;
+  }
+  if (esp_partition_write(partition, recordOffset(head, fill), &r, sizeof(r)) != ESP_OK) return false;
+  fill++;
+  widen(sectors[head], r.time);
+  return true;
+}
+
+/* =========================================================
+   CSV EXPORT
+   ========================================================= */
+struct CsvWriter {
+  AuditSink sink;
+  void* ctx;
+  char buffer[512];
+  size_t len;
+
+  void write(const char* line, size_t n) {
+    if (len + n > sizeof(buffer)) flush();
+    memcpy(buffer + len, line, n);
+    len += n;
+  }
+
+  void flush() {
+    if (len) sink(ctx, buffer, len);
+    len = 0;
+  }
+};
+
+static const char* eventName(uint8_t event) {
+  static const char* const names[] = { "?", "power_on", "unlock", "lock", "pin", "sync" };
+  return event < sizeof(names) / sizeof(names[0]) ? names[event] : "?";
+}
+
+static const char* resultName(uint8_t result) {
+  static const char* const names[] = { "ok", "denied", "timeout", "acked", "unacked", "deferred" };
+  return result < sizeof(names) / sizeof(names[0]) ? names[result] : "?";
+}
+
+static void writeCsv(void* ctx, const AuditRecord& r) {
+  char slot[4], line[48];
+  if (r.slot == AUDIT_SLOT_API) strcpy(slot, "api");
+  else if (r.slot == AUDIT_SLOT_NONE) strcpy(slot, "-");
+  else snprintf(slot, sizeof(slot), "%u", r.slot);
+  int n = snprintf(line, sizeof(line), "%lu,%s,%s,%s\n", (unsigned long)r.time, eventName(r.event), slot, resultName(r.result));
+  ((CsvWriter*)ctx)->write(line, n);
+}
+
+/* =========================================================
+   PUBLIC API
+   ========================================================= */
+void AuditLog::begin() {
+  if (!queue) queue = xQueueCreate(AUDIT_QUEUE_DEPTH, sizeof(AuditRecord));
+}
+
+void AuditLog::record(AuditEvent event, uint8_t slot, AuditResult result) {
+  if (!queue) return;
+  time_t now = time(nullptr);
+  AuditRecord r = { now >= 1000000000 ? (uint32_t)now : 0, event, slot, result, 0 };
+  r.check = checkOf(r);
+  if (xQueueSend(queue, &r, 0) != pdTRUE) Serial.println("[Audit] Queue full - record dropped");
+}
+
+void AuditLog::flush() {
+  AuditRecord r;
+  while (queue && xQueueReceive(queue, &r, 0) == pdTRUE) {
+    if (!append(r) && !unusable) Serial.println("[Audit] Flash write failed - record lost");
+  }
+}
+
+AuditQueryStats AuditLog::query(uint32_t from, uint32_t to, AuditVisitor visit, void* ctx) {
+  AuditQueryStats stats = {};
+  unsigned long startedAt = millis();
+  if (!mount() || head < 0) return stats;
+  bool everything = from == 0 && to == UINT32_MAX;
+
+  // Oldest first: the ring continues after the head sector
+  for (int i = 1; i <= sectorCount; i++) {
+    int s = (head + i) % sectorCount;
+    const SectorInfo& info = sectors[s];
+    if (!info.seq) continue;
+    stats.sectors++;
+    if (!everything && (info.minTime > to || info.maxTime < from)) continue;
+    stats.sectorsRead++;
+
+    uint16_t count = s == head ? fill : AUDIT_RECORDS_PER_SECTOR;
+    for (uint16_t first = 0; first < count; first += AUDIT_CHUNK) {
+      uint16_t n = min((uint16_t)AUDIT_CHUNK, (uint16_t)(count - first));
+      if (!readRecords(s, first, n)) break;
+      for (uint16_t j = 0; j < n; j++) {
+        const AuditRecord& r = chunk[j];
+        if (r.check != checkOf(r)) continue; // torn or never finished
+        if (!everything && (r.time < from || r.time > to)) continue;
+        stats.records++;
+        visit(ctx, r);
+      }
+    }
+  }
+  stats.ms = millis() - startedAt;
+  return stats;
+}
+
+AuditQueryStats AuditLog::exportCsv(uint32_t from, uint32_t to, AuditSink sink, void* ctx) {
+  CsvWriter csv = { sink, ctx, {}, 0 };
+  csv.write("time,event,slot,result\n", 23);
+  AuditQueryStats stats = query(from, to, writeCsv, &csv);
+
+  char summary[80];
+  int n = snprintf(summary, sizeof(summary), "# %u records, %u of %u sectors read, %u ms\n",
+                   (unsigned)stats.records, stats.sectorsRead, stats.sectors, (unsigned)stats.ms);
+  csv.write(summary, n);
+  csv.flush();
+  return stats;
+}
+
+void AuditLog::end() {
+  flush();
+}
@@ -0,0 +1,156 @@
+#include "CpuPower.h"
+#include "Metrics.h"
+#include <esp_timer.h>
+#include <freertos/semphr.h>
+
+#if CONFIG_PM_ENABLE
+#include <esp_pm.h>
+
+// With power management the IDF scales the clock itself: between the
+// configured bounds, up while a lock is held, and the WiFi driver holds
+// its own lock for 80 MHz while the radio is up
+static esp_pm_lock_handle_t pmLock = nullptr;
+#endif
+
+#define RADIO_MIN_MHZ 80
+
+static SemaphoreHandle_t mutex = nullptr; // transitions come from any task
+static uint16_t locks = 0;
+static bool radioOn = false;
+static PowerPhase phase = PHASE_IDLE;
+static uint32_t clockMhz = 0;
+
+static int64_t sinceUs = 0;
+static PowerUsage used = {};
+static PowerUsage reported = {}; // already added to the metrics
+
+/* =========================================================
+   ACCOUNTING
+   ========================================================= */
+static uint32_t currentUa(uint32_t mhz, bool radio) {
+  return POWER_CPU_BASE_MA * 1000 + mhz * POWER_CPU_UA_PER_MHZ + (radio ? POWER_RADIO_MA * 1000 : 0);
+}
+
+// Charge the time since the last transition to the phase that is ending
+static void account() {
+  int64_t now = esp_timer_get_time();
+  uint64_t us = now - sinceUs;
+  sinceUs = now;
+  used.phaseUs[phase] += us;
+  used.energyUj += us * currentUa(clockMhz, radioOn) / 1000 * POWER_SUPPLY_MV / 1000000;
+  used.fixedClockUj += us * currentUa(CPU_MAX_MHZ, radioOn) / 1000 * POWER_SUPPLY_MV / 1000000;
+}
+
+/* =========================================================
+   CLOCK
+   ========================================================= */
+static void lock() {
+  if (mutex) xSemaphoreTake(mutex, portMAX_DELAY);
+}
+
+static void unlock() {
+  if (mutex) xSemaphoreGive(mutex);
+}
+
+// Enter the phase the lock count and radio state call for. Caller holds the mutex.
+static void update() {
+  account();
+  phase = locks ? PHASE_COMPUTE : radioOn ? PHASE_RADIO : PHASE_IDLE;
+  uint32_t mhz = phase == PHASE_COMPUTE ? CPU_MAX_MHZ
+               : phase == PHASE_RADIO ? max((uint32_t)CPU_IDLE_MHZ, (uint32_t)RADIO_MIN_MHZ)
+               : CPU_IDLE_MHZ;
+  if (mhz == clockMhz) return;
+
+#if CONFIG_PM_ENABLE
+  if (pmLock) {
+    if (phase == PHASE_COMPUTE) esp_pm_lock_acquire(pmLock);
+    else if (clockMhz == CPU_MAX_MHZ) esp_pm_lock_release(pmLock);
+    clockMhz = mhz;
+    return;
+  }
+#endif
+  setCpuFrequencyMhz(mhz);
+  clockMhz = mhz;
+}
+
+/* =========================================================
+   PUBLIC API
+   ========================================================= */
+void CpuPower::begin() {
+  if (!mutex) mutex = xSemaphoreCreateMutex();
+  sinceUs = esp_timer_get_time();
+  clockMhz = getCpuFrequencyMhz();
+
+#if CONFIG_PM_ENABLE
+  esp_pm_config_esp32_t pm = {};
+  pm.max_freq_mhz = CPU_MAX_MHZ;
+  pm.min_freq_mhz = CPU_IDLE_MHZ;
+  pm.light_sleep_enable = false; // the keypad is polled, so the loop never really idles
+  if (esp_pm_configure(&pm) == ESP_OK && esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "revolock", &pmLock) == ESP_OK) {
+    esp_pm_lock_acquire(pmLock); // held while clockMhz is CPU_MAX_MHZ
+    clockMhz = CPU_MAX_MHZ;
+  } else {
+    pmLock = nullptr;
+  }
+#endif
+
+  lock();
+  update();
+  unlock();
+}
+
+void CpuPower::acquire() {
+  lock();
+  if (locks++ == 0) update();
+  unlock();
+}
+
+void CpuPower::release() {
+  lock();
+  if (locks && --locks == 0) update();
+  unlock();
+}
+
+void CpuPower::radio(bool on) {
+  lock();
+  if (on != radioOn) {
+    account(); // charge the time so far with the radio as it was
+    radioOn = on;
+    update();
+  }
+  unlock();
+}
+
+PowerUsage CpuPower::usage() {
+  lock();
+  account();
+  PowerUsage u = used;
+  unlock();
+  return u;
+}
+
+void CpuPower::sample() {
+  PowerUsage u = usage();
+  static Counter* const phaseMs[PHASE_COUNT] = { &metric::cpuIdleMs, &metric::cpuRadioMs, &metric::cpuComputeMs };
+
+  // Whole units only; the remainder waits for the next sample
+  for (int p = 0; p < PHASE_COUNT; p++) {
+    uint32_t ms = (u.phaseUs[p] - reported.phaseUs[p]) / 1000;
+    phaseMs[p]->inc(ms);
+    reported.phaseUs[p] += ms * 1000ull;
+  }
+  uint32_t mj = (u.energyUj - reported.energyUj) / 1000;
+  metric::energyMj.inc(mj);
+  reported.energyUj += mj * 1000ull;
+  mj = (u.fixedClockUj - reported.fixedClockUj) / 1000;
+  metric::energyFixedClockMj.inc(mj);
+  reported.fixedClockUj += mj * 1000ull;
+}
+
+void CpuPower::end() {
+  sample();
+  PowerUsage u = usage();
+  Serial.printf("[Power] Idle %.1f s, radio %.1f s, compute %.2f s; ~%.2f J (%.2f J at a fixed %u MHz)\n",
+                u.phaseUs[PHASE_IDLE] / 1e6, u.phaseUs[PHASE_RADIO] / 1e6, u.phaseUs[PHASE_COMPUTE] / 1e6,
+                u.energyUj / 1e6, u.fixedClockUj / 1e6, CPU_MAX_MHZ);
+}
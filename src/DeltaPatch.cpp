@@ -0,0 +1,197 @@
+#include "DeltaPatch.h"
+
+static uint32_t readLE32(const uint8_t* p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+int DeltaPatch::parseHeader(const uint8_t* data, size_t len, DeltaHeader& header) {
+  if (len < DELTA_HEADER_SIZE || memcmp(data, DELTA_MAGIC, 4) != 0) return DELTA_ERR_HEADER;
+  header.sourceSize = readLE32(data + 4);
+  header.targetSize = readLE32(data + 8);
+  memcpy(header.sourceHash, data + 12, 32);
+  memcpy(header.targetHash, data + 44, 32);
+  if (!header.sourceSize || !header.targetSize) return DELTA_ERR_HEADER;
+  return DELTA_OK;
+}
+
+DeltaPatch::DeltaPatch(const DeltaHeader& header, DeltaReadFn read, DeltaWriteFn write, void* ctx)
+  : hdr(header), readSource(read), writeTarget(write), ctx(ctx), status(DELTA_OK),
+    windowPos(0), lzState(LZ_FLAGS), flags(0), flagsLeft(0), matchOffset(0), matchLength(0),
+    matchExtra(0), matchHigh(0), extShift(0), patchState(P_SEEK), varint(0), varintShift(0), remaining(0),
+    sourcePos(0), sourceCacheStart(-1), outUsed(0), outPos(0) {
+  memset(window, 0, sizeof(window));
+  mbedtls_sha256_init(&sha);
+  mbedtls_sha256_starts(&sha, 0);
+}
+
+DeltaPatch::~DeltaPatch() {
+  mbedtls_sha256_free(&sha);
+}
+
+int DeltaPatch::feed(const uint8_t* data, size_t len) {
+  for (size_t i = 0; i < len && status == DELTA_OK; i++) lzByte(data[i]);
+  return status;
+}
+
+int DeltaPatch::finish() {
+  if (status != DELTA_OK) return status;
+  flushOut();
+  if (status != DELTA_OK) return status;
+  if (outPos != hdr.targetSize) return status = DELTA_ERR_SIZE;
+
+  uint8_t digest[32];
+  mbedtls_sha256_finish(&sha, digest);
+  if (memcmp(digest, hdr.targetHash, sizeof(digest)) != 0) status = DELTA_ERR_HASH;
+  return status;
+}
+
+/* =========================================================
+   LZSS LAYER
+   ========================================================= */
+// Each flags byte (LSB first) announces 8 items: 1 = literal byte,
+// 0 = match of two bytes, 12-bit distance - 1 and 4-bit length - 3, where
+// length nibble 15 is followed by a varint with the rest of the length.
+void DeltaPatch::lzByte(uint8_t b) {
+  switch (lzState) {
+    case LZ_FLAGS:
+      flags = b;
+      flagsLeft = 8;
+      lzState = LZ_ITEM;
+      return;
+
+    case LZ_ITEM: {
+      bool literal = flags & 1;
+      flags >>= 1;
+      flagsLeft--;
+      if (literal) {
+        emit(b);
+        if (!flagsLeft) lzState = LZ_FLAGS;
+      } else {
+        matchHigh = b;
+        lzState = LZ_MATCH_LOW;
+      }
+      return;
+    }
+
+    case LZ_MATCH_LOW:
+      matchOffset = (((uint16_t)matchHigh << 4) | (b >> 4)) + 1;
+      matchLength = (b & 0x0F) + 3;
+      if ((b & 0x0F) == 0x0F) {
+        matchExtra = 0;
+        extShift = 0;
+        lzState = LZ_MATCH_EXT;
+        return;
+      }
+      break;
+
+    case LZ_MATCH_EXT:
+      matchExtra |= (uint64_t)(b & 0x7F) << extShift;
+      if (b & 0x80) {
+        extShift += 7;
+        if (extShift > 28) fail(DELTA_ERR_CORRUPT);
+        return;
+      }
+      if (matchExtra > hdr.targetSize) {
+        fail(DELTA_ERR_CORRUPT);
+        return;
+      }
+      matchLength += (uint32_t)matchExtra;
+      break;
+  }
+
+  // Copy the match; it may overlap the bytes it produces (runs)
+  for (uint32_t i = 0; i < matchLength && status == DELTA_OK; i++) {
+    emit(window[(windowPos - matchOffset) & (WINDOW - 1)]);
+  }
+  lzState = flagsLeft ? LZ_ITEM : LZ_FLAGS;
+}
+
+void DeltaPatch::emit(uint8_t b) {
+  window[windowPos] = b;
+  windowPos = (windowPos + 1) & (WINDOW - 1);
+  patchByte(b);
+}
+
+/* =========================================================
+   PATCH RECORD LAYER
+   ========================================================= */
+bool DeltaPatch::varintByte(uint8_t b) {
+  varint |= (uint64_t)(b & 0x7F) << varintShift;
+  if (!(b & 0x80)) return true;
+  varintShift += 7;
+  if (varintShift > 35) fail(DELTA_ERR_CORRUPT);
+  return false;
+}
+
+void DeltaPatch::patchByte(uint8_t b) {
+  switch (patchState) {
+    case P_SEEK:
+      if (!varintByte(b)) return;
+      // zigzag: 0, -1, 1, -2, ...
+      sourcePos += (int64_t)(varint >> 1) ^ -(int64_t)(varint & 1);
+      patchState = P_DIFF_LEN;
+      break;
+
+    case P_DIFF_LEN:
+    case P_EXTRA_LEN:
+      if (!varintByte(b)) return;
+      if (varint > hdr.targetSize - outPos) {
+        fail(DELTA_ERR_RANGE);
+        return;
+      }
+      remaining = (uint32_t)varint;
+      if (patchState == P_DIFF_LEN) patchState = remaining ? P_DIFF : P_EXTRA_LEN;
+      else patchState = remaining ? P_EXTRA : P_SEEK;
+      break;
+
+    case P_DIFF: {
+      uint8_t s;
+      if (!sourceByte(s)) return;
+      put(s + b);
+      if (--remaining == 0) patchState = P_EXTRA_LEN;
+      return;
+    }
+
+    case P_EXTRA:
+      put(b);
+      if (--remaining == 0) patchState = P_SEEK;
+      return;
+  }
+  varint = 0;
+  varintShift = 0;
+}
+
+/* =========================================================
+   SOURCE AND TARGET
+   ========================================================= */
+// Diff records walk the source mostly forwards, so read it in small chunks
+bool DeltaPatch::sourceByte(uint8_t& b) {
+  if (sourcePos < 0 || sourcePos >= (int64_t)hdr.sourceSize) {
+    fail(DELTA_ERR_RANGE);
+    return false;
+  }
+  if (sourceCacheStart < 0 || sourcePos < sourceCacheStart || sourcePos >= sourceCacheStart + (int64_t)SOURCE_CHUNK) {
+    int64_t start = sourcePos & ~(int64_t)(SOURCE_CHUNK - 1);
+    size_t len = min((int64_t)SOURCE_CHUNK, (int64_t)hdr.sourceSize - start);
+    if (!readSource(ctx, (uint32_t)start, sourceCache, len)) {
+      fail(DELTA_ERR_READ);
+      return false;
+    }
+    sourceCacheStart = start;
+  }
+  b = sourceCache[sourcePos++ - sourceCacheStart];
+  return true;
+}
+
+void DeltaPatch::put(uint8_t b) {
+  out[outUsed++] = b;
+  outPos++;
+  if (outUsed == OUT_CHUNK) flushOut();
+}
+
+void DeltaPatch::flushOut() {
+  if (!outUsed) return;
+  mbedtls_sha256_update(&sha, out, outUsed);
+  if (!writeTarget(ctx, out, outUsed)) fail(DELTA_ERR_WRITE);
+  outUsed = 0;
+}
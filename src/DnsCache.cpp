@@ -0,0 +1,163 @@
+#include "DnsCache.h"
+#include <WiFi.h>
+#include <sys/time.h>
+#include "Metrics.h"
+#include "RtcState.h"
+#include "CpuPower.h"
+
+static DnsCacheEntry (&entries)[DNS_CACHE_SIZE] = RtcState::cached().dnsCache;
+static uint16_t& lookupMs = RtcState::cached().dnsLookupMs; // running average of a real lookup
+
+// This boot's numbers, for report(). Like the entries, written by every
+// task that connects (network, DoLynk workers, notification), so only
+// between RtcState::lock() and unlock().
+static uint16_t bootHits = 0;
+static uint16_t bootMisses = 0;
+static uint16_t bootStale = 0;
+static uint32_t bootSavedMs = 0;
+
+static uint32_t nowS() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec;
+}
+
+// Callers hold RtcState::lock()
+static DnsCacheEntry* find(const char* host) {
+  for (int i = 0; i < DNS_CACHE_SIZE; i++) {
+    if (entries[i].host[0] && strcmp(entries[i].host, host) == 0) return &entries[i];
+  }
+  return nullptr;
+}
+
+static void forget(const char* host) {
+  RtcState::lock();
+  DnsCacheEntry* e = find(host);
+  if (e) e->host[0] = '\0';
+  bootStale++;
+  RtcState::unlock();
+}
+
+// Resolve without consulting the cache and remember the answer
+static bool lookup(const char* host, IPAddress& ip) {
+  unsigned long start = millis();
+  if (!WiFi.hostByName(host, ip) || (uint32_t)ip == 0) return false;
+  uint32_t took = millis() - start;
+  uint32_t expiresAt = nowS() + DNS_CACHE_TTL_S;
+
+  RtcState::lock();
+  lookupMs = lookupMs ? (lookupMs * 3 + took) / 4 : took;
+  if (strlen(host) < DNS_HOST_MAX) {
+    DnsCacheEntry* e = find(host);
+    if (!e) {
+      // Free slot, else the one closest to expiry
+      e = &entries[0];
+      for (int i = 0; i < DNS_CACHE_SIZE && e->host[0]; i++) {
+        if (!entries[i].host[0] || entries[i].expiresAt < e->expiresAt) e = &entries[i];
+      }
+      strcpy(e->host, host);
+    }
+    e->ip = ip;
+    e->expiresAt = expiresAt;
+  }
+  RtcState::unlock();
+  return true;
+}
+
+// Cached address only; an expired entry counts as a miss
+static bool cached(const char* host, IPAddress& ip) {
+  uint32_t now = nowS();
+  RtcState::lock();
+  DnsCacheEntry* e = find(host);
+  bool hit = e && now < e->expiresAt;
+  if (hit) ip = e->ip;
+  RtcState::unlock();
+  return hit;
+}
+
+// Split "scheme://host[:port]/..." into host and port
+static bool parseUrl(const char* url, char* host, size_t hostSize, uint16_t& port) {
+  const char* start = strstr(url, "://");
+  if (!start) return false;
+  port = strncmp(url, "https", 5) == 0 ? 443 : 80;
+  start += 3;
+  size_t len = strcspn(start, ":/");
+  if (len == 0 || len >= hostSize) return false;
+  memcpy(host, start, len);
+  host[len] = '\0';
+  if (start[len] == ':') port = atoi(start + len + 1);
+  return true;
+}
+
+// TCP connect and TLS handshake; the handshake's key exchange is the
+// heaviest computation a wake does
+static bool handshake(WiFiClientSecure& client, IPAddress ip, uint16_t port, const char* host) {
+  PerformanceLock boost;
+  return client.connect(ip, port, host, nullptr, nullptr, nullptr);
+}
+
+// Bound the next handshake by what is left of timeoutMs (whole seconds,
+// rounded up); false once nothing is left
+static bool timeLeft(WiFiClientSecure& client, unsigned long start, uint32_t timeoutMs) {
+  uint32_t spent = millis() - start;
+  if (spent >= timeoutMs) return false;
+  client.setHandshakeTimeout((timeoutMs - spent + 999) / 1000);
+  return true;
+}
+
+bool DnsCache::connect(WiFiClientSecure& client, const char* url, uint32_t timeoutMs) {
+  char host[DNS_HOST_MAX];
+  uint16_t port;
+  IPAddress ip;
+  if (!parseUrl(url, host, sizeof(host), port)) return false;
+
+  unsigned long start = millis();
+  timeLeft(client, start, timeoutMs);
+  bool hit = cached(host, ip);
+  if (hit && handshake(client, ip, port, host)) {
+    RtcState::lock();
+    bootHits++;
+    bootSavedMs += lookupMs;
+    RtcState::unlock();
+    metric::dnsHits.inc();
+    return true;
+  }
+  if (hit) {
+    // The server moved or the address went stale: forget it and look again
+    Serial.printf("[Dns] %s didn't answer at %s, looking it up again\n", host, ip.toString().c_str());
+    forget(host);
+    metric::dnsStale.inc();
+  }
+
+  RtcState::lock();
+  bootMisses++;
+  RtcState::unlock();
+  metric::dnsMisses.inc();
+  // A stale hit already spent part of the time: the retry gets the rest
+  return lookup(host, ip) && timeLeft(client, start, timeoutMs) && handshake(client, ip, port, host);
+}
+
+void DnsCache::refresh(uint32_t withinS) {
+  uint32_t deadline = nowS() + withinS;
+  for (int i = 0; i < DNS_CACHE_SIZE; i++) {
+    char host[DNS_HOST_MAX];
+    IPAddress ip;
+    RtcState::lock();
+    bool due = entries[i].host[0] && entries[i].expiresAt <= deadline;
+    if (due) strcpy(host, entries[i].host);
+    RtcState::unlock();
+    if (due && !lookup(host, ip)) Serial.printf("[Dns] Can't resolve %s\n", host);
+  }
+}
+
+void DnsCache::report() {
+  RtcState::lock();
+  uint16_t bootHitsNow = bootHits, bootMissesNow = bootMisses, bootStaleNow = bootStale;
+  uint32_t savedMs = bootSavedMs;
+  RtcState::unlock();
+  if (!bootHitsNow && !bootMissesNow) return;
+  uint32_t hits = metric::dnsHits.get(), misses = metric::dnsMisses.get();
+  Serial.printf("[Dns] %u hits, %u misses, %u stale this boot, ~%lu ms saved (hit rate %u%% since power-on)\n",
+                bootHitsNow, bootMissesNow, bootStaleNow, (unsigned long)savedMs,
+                (unsigned)(hits * 100 / max(hits + misses, (uint32_t)1)));
+}
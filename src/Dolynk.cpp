@@ -1,171 +1,911 @@
+#include "Dolynk.h"
 #include <WiFi.h>
 #include <HTTPClient.h>
-#include <mbedtls/md.h>
+#include <WiFiClientSecure.h>
 #include <ArduinoJson.h>
+#include <Preferences.h>
+#include <esp_rom_crc.h>
+#include <functional>
+#include <atomic>
+#include <new>
 #include "setup.h"
+#include "Metrics.h"
+#include "RequestArena.h"
+#include "RtcState.h"
+#include "DnsCache.h"
+#include "CpuPower.h"
+#include "Sha512.h"
+#include "WifiStatus.h"
 
-String app_access_token = "";
+static void formatUuid(char uuid[37]) {
+    snprintf(uuid, 37, "%08x-%04x-4%03x-%04x-%04x%08x",
+             esp_random(), (esp_random() >> 16) & 0xFFFF, esp_random() & 0x0FFF,
+             (esp_random() >> 16 & 0x3FFF) | 0x8000, esp_random() & 0xFFFF, esp_random());
+}
+
+static uint64_t timestampMs() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+static void toHex(const unsigned char* bytes, size_t n, char* out, bool upper) {
+    const char* digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    for (size_t i = 0; i < n; i++) {
+        out[2 * i] = digits[bytes[i] >> 4];
+        out[2 * i + 1] = digits[bytes[i] & 0x0F];
+    }
+    out[2 * n] = '\0';
+}
+
+// HMAC-SHA512 over the concatenation of parts, without building it
+static void hmacParts(const char* key, const char* const* parts, const size_t* lengths, int count, unsigned char result[64]) {
+    Sha512::hmac(key, strlen(key), parts, lengths, count, result);
+}
+
+static void sha512(const char* data, size_t len, unsigned char result[64]) {
+    Sha512::hash(data, len, result);
+}
 
 String generate_uuid() {
     char uuid[37];
-    snprintf(uuid, sizeof(uuid), "%08x-%04x-4%03x-%04x-%04x%08x",
-             esp_random(), (esp_random() >> 16) & 0xFFFF, esp_random() & 0x0FFF,
-             (esp_random() >> 16 & 0x3FFF) | 0x8000, esp_random() & 0xFFFF, esp_random());
+    formatUuid(uuid);
     return String(uuid);
 }
 
 String get_timestamp_ms() {
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    return String((uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000);
+    return String(timestampMs());
 }
 
 String hmac_sha512(const String& key, const String& data) {
     unsigned char result[64];
-    mbedtls_md_context_t ctx;
-    mbedtls_md_init(&ctx);
-    mbedtls_md_setup(&ctx, mbedtls_md_info_from_type(MBEDTLS_MD_SHA512), 1);
-    mbedtls_md_hmac_starts(&ctx, (unsigned char*)key.c_str(), key.length());
-    mbedtls_md_hmac_update(&ctx, (unsigned char*)data.c_str(), data.length());
-    mbedtls_md_hmac_finish(&ctx, result);
-    mbedtls_md_free(&ctx);
+    const char* parts[] = { data.c_str() };
+    size_t lengths[] = { data.length() };
+    hmacParts(key.c_str(), parts, lengths, 1, result);
     
-    String hex = "";
-    for (int i = 0; i < 64; i++) {
-        char buf[3];
-        snprintf(buf, sizeof(buf), "%02X", result[i]);
-        hex += buf;
-    }
-    return hex;
+    char hex[129];
+    toHex(result, 64, hex, true);
+    return String(hex);
 }
 
 String sha512_hash(const String& data) {
     unsigned char result[64];
-    mbedtls_md_context_t ctx;
-    mbedtls_md_init(&ctx);
-    mbedtls_md_setup(&ctx, mbedtls_md_info_from_type(MBEDTLS_MD_SHA512), 0);
-    mbedtls_md_starts(&ctx);
-    mbedtls_md_update(&ctx, (unsigned char*)data.c_str(), data.length());
-    mbedtls_md_finish(&ctx, result);
-    mbedtls_md_free(&ctx);
+    sha512(data.c_str(), data.length(), result);
+    
+    char hex[129];
+    toHex(result, 64, hex, false);
+    return String(hex);
+}
+
+/* =========================================================
+   RETRY, DEADLINE AND CIRCUIT BREAKER
+   ========================================================= */
+// Breaker state lives in the RTC state block and is timed with the RTC clock
+// (gettimeofday), so a known-bad backend stays skipped across deep sleep.
+static uint8_t& breakerState = RtcState::cached().breakerState;
+static uint8_t& consecutiveFailures = RtcState::cached().consecutiveFailures;
+static uint64_t& breakerOpenedAt = RtcState::cached().breakerOpenedAt;
+
+// Fan-out workers share the breaker, so every transition is taken under this lock
+static portMUX_TYPE breakerMux = portMUX_INITIALIZER_UNLOCKED;
+
+static uint64_t now_ms() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+// Connection errors, timeouts, throttling and server errors are worth retrying;
+// anything else means the backend answered and retrying won't change it.
+static bool isTransient(int httpCode) {
+    if (httpCode == DOLYNK_ERR_NO_MEMORY) return false;
+    return httpCode < 0 || httpCode == 408 || httpCode == 429 || httpCode >= 500;
+}
+
+DolynkBreakerState dolynk_breaker_state() {
+    portENTER_CRITICAL(&breakerMux);
+    if (breakerState == BREAKER_OPEN && now_ms() - breakerOpenedAt >= DOLYNK_BREAKER_COOLDOWN_MS) {
+        breakerState = BREAKER_HALF_OPEN;
+    }
+    DolynkBreakerState state = (DolynkBreakerState)breakerState;
+    portEXIT_CRITICAL(&breakerMux);
+    return state;
+}
+
+bool dolynk_available() {
+    return dolynk_breaker_state() != BREAKER_OPEN;
+}
+
+static void recordOutcome(bool healthy) {
+    portENTER_CRITICAL(&breakerMux);
+    uint8_t previous = breakerState;
+    if (healthy) {
+        breakerState = BREAKER_CLOSED;
+        consecutiveFailures = 0;
+    } else {
+        if (consecutiveFailures < 255) consecutiveFailures++;
+        if (breakerState == BREAKER_HALF_OPEN || consecutiveFailures >= DOLYNK_BREAKER_THRESHOLD) {
+            breakerState = BREAKER_OPEN;
+            breakerOpenedAt = now_ms();
+        }
+    }
+    uint8_t failures = consecutiveFailures;
+    portEXIT_CRITICAL(&breakerMux);
     
-    String hex = "";
-    for (int i = 0; i < 64; i++) {
-        char buf[3];
-        snprintf(buf, sizeof(buf), "%02x", result[i]);
-        hex += buf;
+    if (healthy && previous != BREAKER_CLOSED) {
+        Serial.println("[Dolynk] Circuit closed - backend healthy");
+    } else if (!healthy && breakerState == BREAKER_OPEN && previous != BREAKER_OPEN) {
+        Serial.printf("[Dolynk] Circuit open for %d ms after %d failures\n",
+                      DOLYNK_BREAKER_COOLDOWN_MS, failures);
     }
-    return hex;
 }
 
-bool getAccessToken() {
-    String timestamp = get_timestamp_ms();
-    String nonce = "web-" + generate_uuid() + "-" + timestamp;
-    String signature = hmac_sha512(SECRET_ACCESS_KEY, String(ACCESS_KEY) + timestamp + nonce + "POST");
+// Run one operation under a deadline budget. attempt() gets the remaining
+// budget in ms and returns an HTTP code; transient failures are retried with
+// full-jitter exponential backoff as long as the next attempt fits the budget.
+// A half-open breaker allows a single probe attempt with no retries.
+static int withRetry(const char* what, std::function<int(uint32_t)> attempt) {
+    DolynkBreakerState state = dolynk_breaker_state();
+    if (state == BREAKER_OPEN) {
+        Serial.printf("[Dolynk] %s skipped - circuit open\n", what);
+        metric::dolynkCircuitOpen.inc();
+        return DOLYNK_ERR_CIRCUIT_OPEN;
+    }
+    
+    int maxAttempts = state == BREAKER_HALF_OPEN ? 1 : DOLYNK_MAX_ATTEMPTS;
+    uint64_t deadline = now_ms() + DOLYNK_DEADLINE_MS;
+    int httpCode = DOLYNK_ERR_DEADLINE;
     
+    for (int n = 1; n <= maxAttempts; n++) {
+        uint64_t now = now_ms();
+        if (now >= deadline) break;
+        
+        httpCode = attempt((uint32_t)(deadline - now));
+        if (!isTransient(httpCode)) {
+            recordOutcome(true);
+            return httpCode;
+        }
+        if (n == maxAttempts) break;
+        
+        uint32_t cap = min((uint32_t)DOLYNK_BACKOFF_MAX_MS, (uint32_t)DOLYNK_BACKOFF_BASE_MS << (n - 1));
+        uint32_t wait = esp_random() % (cap + 1);
+        if (now_ms() + wait >= deadline) break;
+        
+        Serial.printf("[Dolynk] %s attempt %d failed (HTTP %d), retrying in %u ms\n", what, n, httpCode, wait);
+        metric::dolynkRetries.inc();
+        delay(wait);
+    }
+    
+    Serial.printf("[Dolynk] %s failed (HTTP %d)\n", what, httpCode);
+    recordOutcome(false);
+    return httpCode;
+}
+
+// Bound both the TCP/TLS connect and the response read by the remaining budget.
+static void applyTimeouts(HTTPClient& http, uint32_t budgetMs) {
+    http.setConnectTimeout(budgetMs);
+    http.setTimeout(min(budgetMs, (uint32_t)UINT16_MAX));
+}
+
+/* =========================================================
+   SESSIONS
+   ========================================================= */
+// A TLS client with keep-alive, so consecutive requests from one task reuse a
+// single connection instead of paying a handshake per call. Each task that
+// talks to DoLynk concurrently needs its own session. Request strings and
+// parsed replies live in the session's arena, not on the heap.
+struct DolynkSession {
+    WiFiClientSecure client;
     HTTPClient http;
-    http.begin(String(BASE_URL) + "/api-base/auth/getAppAccessToken");
+    StaticRequestArena<DOLYNK_ARENA_SIZE> arena;
+    ArenaJsonAllocator json;
+    
+    DolynkSession() : json(arena) {
+        client.setInsecure();
+        http.setReuse(true);
+    }
+};
+
+static DolynkSession& defaultSession() {
+    static DolynkSession session;
+    return session;
+}
+
+// The app access token is cached in the RTC state block, so wakes reuse it
+// until it nears expiry instead of fetching a new one every boot
+static char (&accessToken)[sizeof(CachedState::accessToken)] = RtcState::cached().accessToken;
+static uint32_t& tokenExpiresAt = RtcState::cached().tokenExpiresAt;
+
+static const char tokenPath[] = "/api-base/auth/getAppAccessToken";
+
+static int postOnce(DolynkSession& session, uint32_t budgetMs, const char* path, const ArenaString& body,
+                    const ArenaString& timestamp, const ArenaString& nonce, const ArenaString& signature,
+                    ArenaString& response) {
+    ArenaString url(session.arena);
+    url.add(BASE_URL).add(path);
+    if (session.arena.exhausted()) {
+        Serial.printf("[Dolynk] %s: request doesn't fit in %u bytes\n", path, (unsigned)session.arena.capacity());
+        return DOLYNK_ERR_NO_MEMORY;
+    }
+    
+    char traceId[37];
+    formatUuid(traceId);
+    
+    HTTPClient& http = session.http;
+    applyTimeouts(http, budgetMs);
+    http.begin(session.client, url.c_str());
     http.addHeader("Content-Type", "application/json");
     http.addHeader("Version", "v1");
     http.addHeader("AccessKey", ACCESS_KEY);
-    http.addHeader("Timestamp", timestamp);
-    http.addHeader("Nonce", nonce);
-    http.addHeader("X-TraceId-Header", generate_uuid());
+    if (accessToken[0]) http.addHeader("AppAccessToken", accessToken);
+    http.addHeader("Timestamp", timestamp.c_str());
+    http.addHeader("Nonce", nonce.c_str());
+    http.addHeader("X-TraceId-Header", traceId);
     http.addHeader("ProductId", PRODUCT_ID);
-    http.addHeader("Sign", signature);
+    http.addHeader("Sign", signature.c_str());
     
-    int httpCode = http.POST("{}");
-    String response = http.getString();
+    // A new connection goes to the cached address; HTTPClient reuses it
+    bool reused = session.client.connected();
+    unsigned long start = millis();
+    int code = reused || DnsCache::connect(session.client, url.c_str(), budgetMs)
+             ? http.POST((uint8_t*)body.c_str(), body.length())
+             : HTTPC_ERROR_CONNECTION_REFUSED;
+    ArenaStream sink(response);
+    if (code > 0) http.writeToStream(&sink);
+    http.end();
     
-    if (httpCode == 200) {
-        StaticJsonDocument<1024> doc;
-        DeserializationError error = deserializeJson(doc, response);
-        if (error) {
-            http.end();
-            return false;
-        }
-        if (doc["code"].as<String>() == "200") {
-            app_access_token = doc["data"]["appAccessToken"].as<String>();
-            // Serial.print("[Dolynk] Token obtained: ");
-            // Serial.println(app_access_token);
-            http.end();
-            return true;
+    metric::dolynkLatencyMs.observe(millis() - start);
+    WifiStatus::noteRequest(millis() - start);
+    if (!reused) metric::tlsHandshakes.inc();
+    if (code == 200) metric::dolynkOk.inc();
+    else if (code > 0) metric::dolynkHttpErrors.inc();
+    else metric::dolynkTransportErrors.inc();
+    
+    if (code < 0) session.client.stop(); // don't reuse a broken connection on retry
+    return code;
+}
+
+// The token request is signed without a token or body hash
+enum RequestKind { TOKEN_REQUEST, API_REQUEST };
+
+// Sign and send a request under the retry policy. What an attempt builds is
+// dropped before the next one; the last reply is left in response.
+static int signedPost(DolynkSession& session, RequestKind kind, const char* path, const ArenaString& body,
+                      ArenaString& response) {
+    RequestArena& arena = session.arena;
+    size_t mark = arena.mark();
+    
+    return withRetry(path, [&](uint32_t budgetMs) {
+        arena.rewind(mark);
+        response.clear();
+        
+        char uuid[37];
+        formatUuid(uuid);
+        ArenaString timestamp(arena);
+        timestamp.addNumber(timestampMs());
+        ArenaString nonce(arena);
+        nonce.add("web-").add(uuid).add('-').add(timestamp);
+        
+        // The token request signs AccessKey + Timestamp + Nonce + "POST"; the
+        // others add the token and the body's SHA-512
+        unsigned char digest[64];
+        char bodyHash[129];
+        ArenaString signature(arena);
+        {
+            PerformanceLock boost;
+            sha512(body.c_str(), body.length(), digest);
+            toHex(digest, 64, bodyHash, false);
+            
+            const char* parts[] = { ACCESS_KEY, accessToken, timestamp.c_str(), nonce.c_str(), "POST\n", bodyHash };
+            size_t lengths[] = { strlen(ACCESS_KEY), strlen(accessToken), timestamp.length(), nonce.length(), 5, 128 };
+            if (kind == TOKEN_REQUEST) {
+                lengths[1] = 0;
+                lengths[4] = 4; // "POST" without the newline or body hash
+                hmacParts(SECRET_ACCESS_KEY, parts, lengths, 5, digest);
+            } else {
+                hmacParts(SECRET_ACCESS_KEY, parts, lengths, 6, digest);
+            }
+            signature.addHex(digest, 64, true);
         }
+        
+        return postOnce(session, budgetMs, path, body, timestamp, nonce, signature, response);
+    });
+}
+
+// Replies are parsed at full clock, like signing
+static DeserializationError parseReply(JsonDocument& doc, const ArenaString& response) {
+    PerformanceLock boost;
+    return deserializeJson(doc, response.c_str(), response.length());
+}
+
+// DoLynk sends "code" as a string, but accept a number too
+static int apiCode(JsonDocument& doc) {
+    JsonVariant code = doc["code"];
+    if (code.is<const char*>()) return atoi(code.as<const char*>());
+    return code.as<int>();
+}
+
+static bool apiOk(JsonDocument& doc) {
+    return apiCode(doc) == 200;
+}
+
+bool getAccessToken() {
+    DolynkSession& session = defaultSession();
+    RequestScope scope(session.arena);
+    ArenaString body(session.arena);
+    ArenaString response(session.arena);
+    body.add("{}");
+    
+    accessToken[0] = '\0';
+    tokenExpiresAt = 0;
+    if (signedPost(session, TOKEN_REQUEST, tokenPath, body, response) != 200) return false;
+    
+    JsonDocument doc(&session.json);
+    if (parseReply(doc, response) || !apiOk(doc)) return false;
+    
+    const char* token = doc["data"]["appAccessToken"] | "";
+    if (strlen(token) >= sizeof(accessToken)) {
+        Serial.println("[Dolynk] Access token too long");
+        return false;
     }
-    http.end();
-    return false;
+    strcpy(accessToken, token);
+    uint32_t ttl = doc["data"]["expireTime"] | (uint32_t)DOLYNK_TOKEN_TTL_S;
+    tokenExpiresAt = now_ms() / 1000 + min(ttl, (uint32_t)DOLYNK_TOKEN_TTL_S);
+    // Serial.print("[Dolynk] Token obtained: ");
+    // Serial.println(accessToken);
+    return accessToken[0] != '\0';
+}
+
+static bool tokenValidFor(uint32_t seconds) {
+    return accessToken[0] && now_ms() / 1000 + seconds < tokenExpiresAt;
+}
+
+// Reuse the cached token, or fetch one if it is missing or about to expire
+static bool haveToken() {
+    return tokenValidFor(DOLYNK_TOKEN_MARGIN_S) || getAccessToken();
+}
+
+bool dolynk_refresh_token(uint32_t validForS) {
+    return tokenValidFor(validForS) || getAccessToken();
+}
+
+bool dolynk_prepare() {
+    if (!dolynk_available() || !haveToken()) return false;
+    DolynkSession& session = defaultSession();
+    if (session.client.connected()) return true; // still open from the token request
+    metric::tlsHandshakes.inc();
+    return DnsCache::connect(session.client, BASE_URL, DOLYNK_DEADLINE_MS);
+}
+
+void dolynk_release() {
+    defaultSession().client.stop();
+}
+
+#define API_AUTH_FAILED 401 // sign error: the token expired or was revoked
+
+// Count an API error. An auth failure means the token is no good; fetch a new
+// one next time. Only the expiry is cleared, so fan-out workers can keep
+// reading the token.
+static void apiRejected(JsonDocument& doc) {
+    metric::dolynkRejected.inc();
+    if (apiCode(doc) == API_AUTH_FAILED) tokenExpiresAt = 0;
+}
+
+/* =========================================================
+   DEVICES
+   ========================================================= */
+// Devices that arm/disarm with the lock and the abilities each one supports.
+// Defaults to the single DEVICE_ID with every ability.
+#ifndef DOLYNK_DEVICES
+#define DOLYNK_DEVICES { { DEVICE_ID, DOLYNK_ALL_ABILITIES } }
+#endif
+
+static const DolynkDevice devices[] = DOLYNK_DEVICES;
+static const int deviceCount = sizeof(devices) / sizeof(devices[0]);
+static_assert(deviceCount <= DOLYNK_MAX_DEVICES, "DOLYNK_DEVICES lists more than DOLYNK_MAX_DEVICES devices");
+
+// Caller must hold a valid token; fan-out workers only read it.
+static bool setAbility(DolynkSession& session, const char* deviceId, const char* abilityType, const char* status) {
+    RequestScope scope(session.arena);
+    ArenaString body(session.arena);
+    body.add("{\"deviceId\":\"").addJson(deviceId).add("\",\"channelId\":\"0\",\"abilityType\":\"")
+        .add(abilityType).add("\",\"status\":\"").add(status).add("\"}");
+    
+    // Serial.printf("[Dolynk] Calling API - Device: %s, Ability: %s, Status: %s\n", deviceId, abilityType, status);
+    // Serial.print("[Dolynk] Request body: ");
+    // Serial.println(body.c_str());
+    
+    ArenaString response(session.arena);
+    if (signedPost(session, API_REQUEST, "/api-iot/device/setAbilityStatus", body, response) != 200) return false;
+    
+    JsonDocument doc(&session.json);
+    parseReply(doc, response);
+    
+    bool ok = apiOk(doc);
+    if (!ok) apiRejected(doc);
+    return ok;
+}
+
+bool callApi(const char* deviceId, const char* abilityType, const char* status) {
+    if (!haveToken()) return false;
+    return setAbility(defaultSession(), deviceId, abilityType, status);
 }
 
 bool callApi(const char* abilityType, const char* status) {
-    if (app_access_token.isEmpty() && !getAccessToken()) return false;
+    return callApi(devices[0].id, abilityType, status);
+}
+
+enum QueryResult { QUERY_OK, QUERY_REFUSED, QUERY_FAILED };
+
+#define API_UNSUPPORTED_ABILITY 1001 // the device model has no such ability
+
+// getAbilityStatus, telling "the device has no such ability" apart from not
+// getting an answer. Any other API error (sign error, device offline, rate
+// limit, server error) counts as not getting one, and nothing is learned.
+static QueryResult queryAbility(const char* deviceId, const char* abilityType, String& status) {
+    if (!haveToken()) return QUERY_FAILED;
     
-    String timestamp = get_timestamp_ms();
-    String nonce = "web-" + generate_uuid() + "-" + timestamp;
-    String body = "{\"deviceId\":\"" + String(DEVICE_ID) + "\",\"channelId\":\"0\",\"abilityType\":\"" + abilityType + "\",\"status\":\"" + status + "\"}";
-    String signature = hmac_sha512(SECRET_ACCESS_KEY, String(ACCESS_KEY) + app_access_token + timestamp + nonce + "POST\n" + sha512_hash(body));
+    DolynkSession& session = defaultSession();
+    RequestScope scope(session.arena);
+    ArenaString body(session.arena);
+    body.add("{\"deviceId\":\"").addJson(deviceId).add("\",\"channelId\":\"0\",\"abilityType\":\"")
+        .add(abilityType).add("\"}");
     
-    // Serial.printf("[Dolynk] Calling API - Ability: %s, Status: %s\n", abilityType, status);
-    // Serial.print("[Dolynk] Request body: ");
-    // Serial.println(body);
+    ArenaString response(session.arena);
+    if (signedPost(session, API_REQUEST, "/api-iot/device/getAbilityStatus", body, response) != 200) return QUERY_FAILED;
     
-    HTTPClient http;
-    http.begin(String(BASE_URL) + "/api-iot/device/setAbilityStatus");
-    http.addHeader("Content-Type", "application/json");
-    http.addHeader("Version", "v1");
-    http.addHeader("AccessKey", ACCESS_KEY);
-    http.addHeader("AppAccessToken", app_access_token);
-    http.addHeader("Timestamp", timestamp);
-    http.addHeader("Nonce", nonce);
-    http.addHeader("X-TraceId-Header", generate_uuid());
-    http.addHeader("ProductId", PRODUCT_ID);
-    http.addHeader("Sign", signature);
+    JsonDocument doc(&session.json);
+    if (parseReply(doc, response)) return QUERY_FAILED;
+    if (!apiOk(doc)) {
+        if (apiCode(doc) == API_UNSUPPORTED_ABILITY) return QUERY_REFUSED;
+        apiRejected(doc);
+        return QUERY_FAILED;
+    }
     
-    int httpCode = http.POST(body);
-    String response = http.getString();
+    status = doc["data"]["status"] | "";
+    status.toLowerCase();
+    return QUERY_OK;
+}
+
+bool getAbilityStatus(const char* deviceId, const char* abilityType, String& status) {
+    return queryAbility(deviceId, abilityType, status) == QUERY_OK;
+}
+
+/* =========================================================
+   ACKNOWLEDGED ABILITY STATE
+   ========================================================= */
+enum AlarmAbility { ABILITY_MOTION, ABILITY_SIREN, ABILITY_STROBE, ABILITY_COUNT };
+enum AckStatus : uint8_t { ACK_UNKNOWN = 0, ACK_OFF, ACK_ON };
+
+// Last status DoLynk acknowledged per device and ability. Durable state, so a
+// wake with no lock change costs no cloud calls, even after a power cut.
+static uint8_t (&ackedStatus)[DOLYNK_MAX_DEVICES][DOLYNK_ABILITY_COUNT] = RtcState::durable().ackedStatus;
+static uint16_t& syncsSinceVerify = RtcState::cached().syncsSinceVerify;
+static_assert(ABILITY_COUNT == DOLYNK_ABILITY_COUNT, "DOLYNK_ABILITY_COUNT is out of date");
+
+/* =========================================================
+   ABILITY DISCOVERY
+   ========================================================= */
+// Names device models use for each ability, most common first. The first
+// one a device answers for is the one it is sent.
+static const char* const motionNames[] = { "motionDetect" };
+static const char* const sirenNames[] = { "linkDevAlarm", "alarm", "devAlarm", "audioAlarm", "siren" };
+static const char* const strobeNames[] = { "linkageWhiteLight", "whiteLight", "floodLight", "supplementLight", "light" };
+
+struct AbilityCandidates {
+    const char* const* names;
+    uint8_t count;
+    const char* label;
+};
+
+static const AbilityCandidates candidates[ABILITY_COUNT] = {
+    { motionNames, sizeof(motionNames) / sizeof(motionNames[0]), "motion" },
+    { sirenNames, sizeof(sirenNames) / sizeof(sirenNames[0]), "siren" },
+    { strobeNames, sizeof(strobeNames) / sizeof(strobeNames[0]), "strobe" },
+};
+
+#define ABILITY_NONE 0xFF          // the device answered for none of the names
+#define ABILITIES_NAMESPACE "abilities"
+
+// What discovery found for a device, in NVS under a hash of its ID. Valid
+// while the device runs the same firmware and this image probes the same
+// candidate names.
+struct AbilityRecord {
+    char firmware[32];             // the device's firmware version when probed
+    uint32_t names;                // namesCrc() of the image that probed
+    uint8_t name[ABILITY_COUNT];   // index into candidates, or ABILITY_NONE
+};
+
+struct DeviceAbilities {
+    bool loaded;                   // NVS read this boot
+    bool known;                    // discovered with this image's names
+    char firmware[32];             // device firmware it was discovered on
+    uint8_t name[ABILITY_COUNT];
+};
+
+// Filled on the calling task before any fan-out, so workers only read it
+static DeviceAbilities discovered[DOLYNK_MAX_DEVICES];
+
+static void recordKey(int device, char key[12]) {
+    const char* id = devices[device].id;
+    snprintf(key, 12, "d%08x", (unsigned)esp_rom_crc32_le(0, (const uint8_t*)id, strlen(id)));
+}
+
+// Changes when an image adds, drops or reorders candidate names
+static uint32_t namesCrc() {
+    uint32_t crc = 0;
+    for (int a = 0; a < ABILITY_COUNT; a++) {
+        for (uint8_t i = 0; i < candidates[a].count; i++) {
+            crc = esp_rom_crc32_le(crc, (const uint8_t*)candidates[a].names[i], strlen(candidates[a].names[i]) + 1);
+        }
+    }
+    return crc;
+}
+
+#define DEVICE_INFO_PATH "/api-iot/device/getDeviceInfo"
+
+// The firmware version a device reports, "" if it reports none
+static bool queryFirmware(const char* deviceId, char out[32]) {
+    if (!haveToken()) return false;
     
-    http.end();
+    DolynkSession& session = defaultSession();
+    RequestScope scope(session.arena);
+    ArenaString body(session.arena);
+    body.add("{\"deviceId\":\"").addJson(deviceId).add("\"}");
     
-    StaticJsonDocument<512> doc;
-    deserializeJson(doc, response);
+    ArenaString response(session.arena);
+    if (signedPost(session, API_REQUEST, DEVICE_INFO_PATH, body, response) != 200) return false;
     
-    String apiCode = doc["code"].as<String>();
+    JsonDocument doc(&session.json);
+    if (parseReply(doc, response)) return false;
+    if (!apiOk(doc)) {
+        apiRejected(doc);
+        return false;
+    }
+    snprintf(out, 32, "%s", doc["data"]["version"] | "");
+    return true;
+}
+
+static DeviceAbilities& loadAbilities(int device) {
+    DeviceAbilities& found = discovered[device];
+    if (found.loaded) return found;
+    found.loaded = true;
+    
+    AbilityRecord record;
+    char key[12];
+    recordKey(device, key);
+    Preferences prefs;
+    if (prefs.begin(ABILITIES_NAMESPACE, true)) {
+        if (prefs.getBytesLength(key) == sizeof(record) &&
+            prefs.getBytes(key, &record, sizeof(record)) == sizeof(record) &&
+            record.names == namesCrc()) {
+            memcpy(found.name, record.name, sizeof(found.name));
+            memcpy(found.firmware, record.firmware, sizeof(found.firmware));
+            found.firmware[sizeof(found.firmware) - 1] = 0;
+            found.known = true;
+        }
+        prefs.end();
+    }
+    return found;
+}
+
+static void saveAbilities(int device) {
+    AbilityRecord record;
+    memset(&record, 0, sizeof(record));
+    memcpy(record.firmware, discovered[device].firmware, sizeof(record.firmware));
+    record.names = namesCrc();
+    memcpy(record.name, discovered[device].name, sizeof(record.name));
     
-    return apiCode == "200";
+    char key[12];
+    recordKey(device, key);
+    Preferences prefs;
+    if (prefs.begin(ABILITIES_NAMESPACE, false)) {
+        if (prefs.putBytes(key, &record, sizeof(record)) != sizeof(record)) {
+            Serial.println("[Dolynk] Ability cache write failed");
+        }
+        prefs.end();
+    }
+}
+
+// Configured for the device and, once discovered, actually there
+static bool hasAbility(int device, int ability) {
+    if (!(devices[device].abilities & (1 << ability))) return false;
+    DeviceAbilities& found = loadAbilities(device);
+    return !found.known || found.name[ability] != ABILITY_NONE;
+}
+
+// Until discovery has run, the most common name
+static const char* abilityName(int device, int ability) {
+    const DeviceAbilities& found = discovered[device];
+    uint8_t index = found.known && found.name[ability] != ABILITY_NONE ? found.name[ability] : 0;
+    return candidates[ability].names[index];
+}
+
+// Ask for the status under each candidate name (read-only, so nothing
+// switches on). Returns false if DoLynk didn't answer every probe, or
+// refused every configured ability: that is more likely a wrong device ID
+// or model than a device with nothing, so it is tried again next run.
+static bool probeDevice(int device) {
+    DeviceAbilities& found = discovered[device];
+    const char* id = devices[device].id;
+    uint8_t name[ABILITY_COUNT];
+    bool any = false;
+    
+    for (int a = 0; a < ABILITY_COUNT; a++) {
+        name[a] = ABILITY_NONE;
+        if (!(devices[device].abilities & (1 << a))) continue;
+        for (uint8_t i = 0; i < candidates[a].count; i++) {
+            String status;
+            QueryResult result = queryAbility(id, candidates[a].names[i], status);
+            if (result == QUERY_FAILED) return false;
+            if (result == QUERY_OK) {
+                name[a] = i;
+                any = true;
+                break;
+            }
+        }
+    }
+    if (!any) {
+        Serial.printf("[Dolynk] %s refused every ability - trying again next run\n", id);
+        return false;
+    }
+    memcpy(found.name, name, sizeof(found.name));
+    found.known = true;
+    
+    Serial.printf("[Dolynk] Abilities of %s:", id);
+    for (int a = 0; a < ABILITY_COUNT; a++) {
+        if (!(devices[device].abilities & (1 << a))) continue;
+        Serial.printf(" %s=%s", candidates[a].label, found.name[a] == ABILITY_NONE ? "-" : abilityName(device, a));
+    }
+    Serial.println();
+    return true;
+}
+
+bool dolynk_discover_abilities() {
+    bool complete = true;
+    for (int d = 0; d < deviceCount; d++) {
+        char firmware[32];
+        if (!queryFirmware(devices[d].id, firmware)) {
+            complete = false;
+            continue;
+        }
+        DeviceAbilities& found = loadAbilities(d);
+        if (found.known && strcmp(found.firmware, firmware) == 0) continue;
+        
+        // Until now statuses went out under these names (the first candidate
+        // if nothing was known yet)
+        uint8_t previous[ABILITY_COUNT];
+        for (int a = 0; a < ABILITY_COUNT; a++) previous[a] = found.known ? found.name[a] : 0;
+        
+        memcpy(found.firmware, firmware, sizeof(found.firmware));
+        if (probeDevice(d)) {
+            saveAbilities(d);
+            // A status acknowledged under a name that turned out wrong means nothing
+            for (int a = 0; a < ABILITY_COUNT; a++) {
+                if (found.name[a] != previous[a]) ackedStatus[d][a] = ACK_UNKNOWN;
+            }
+        } else {
+            complete = false;
+        }
+    }
+    return complete;
+}
+
+// Desired status of each ability for an armed/disarmed site. Abilities the
+// device doesn't have are left alone, and motion detection is only forced off
+// when arming.
+static AckStatus desiredStatus(int device, int ability, bool armed) {
+    if (!hasAbility(device, ability)) return ACK_UNKNOWN;
+    if (ability == ABILITY_MOTION) return armed ? ACK_OFF : ACK_UNKNOWN;
+    return armed ? ACK_ON : ACK_OFF;
+}
+
+/* =========================================================
+   FAN-OUT
+   ========================================================= */
+struct AlarmJob {
+    uint8_t device;
+    uint8_t ability;
+    uint8_t status;
+    bool ok;
+};
+
+struct FanOut {
+    AlarmJob* jobs;
+    int count;
+    std::atomic<int> next;
+    SemaphoreHandle_t done;
+};
+
+// Workers pull jobs off a shared index until the list is drained.
+static void runJobs(FanOut& fanOut, DolynkSession& session) {
+    for (int i = fanOut.next++; i < fanOut.count; i = fanOut.next++) {
+        AlarmJob& job = fanOut.jobs[i];
+        job.ok = setAbility(session, devices[job.device].id, abilityName(job.device, job.ability),
+                            job.status == ACK_ON ? "on" : "off");
+    }
+}
+
+// Each worker opens its own session (its own handshake and arena). If that
+// doesn't fit in the heap the worker takes no jobs, and the caller, still
+// pulling from the same list on its own session, ends up running them.
+static void fanOutWorker(void* arg) {
+    FanOut* fanOut = (FanOut*)arg;
+    DolynkSession* session = new (std::nothrow) DolynkSession();
+    if (session) {
+        runJobs(*fanOut, *session);
+        delete session;
+    } else {
+        Serial.println("[Dolynk] No heap for a parallel session, leaving its jobs to the caller");
+    }
+    xSemaphoreGive(fanOut->done);
+    vTaskDelete(NULL);
+}
+
+// Run every job with at most DOLYNK_MAX_PARALLEL requests in flight. The calling
+// task is one of the workers and keeps using the default session, so with a
+// single job (or parallelism of 1) no task is created at all.
+static void dispatch(AlarmJob* jobs, int count) {
+    if (count == 0) return;
+    
+    if (!haveToken()) {
+        for (int i = 0; i < count; i++) jobs[i].ok = false;
+        return;
+    }
+    
+    FanOut fanOut;
+    fanOut.jobs = jobs;
+    fanOut.count = count;
+    fanOut.next = 0;
+    fanOut.done = xSemaphoreCreateCounting(DOLYNK_MAX_PARALLEL, 0);
+    
+    int helpers = fanOut.done ? min(count, DOLYNK_MAX_PARALLEL) - 1 : 0;
+    int started = 0;
+    for (int i = 0; i < helpers; i++) {
+        // On the caller's core, so the keypad's core stays free
+        if (xTaskCreatePinnedToCore(fanOutWorker, "dolynk", DOLYNK_WORKER_STACK, &fanOut,
+                                    uxTaskPriorityGet(NULL), NULL, xPortGetCoreID()) == pdPASS) {
+            started++;
+        }
+    }
+    
+    runJobs(fanOut, defaultSession());
+    
+    for (int i = 0; i < started; i++) xSemaphoreTake(fanOut.done, portMAX_DELAY);
+    if (fanOut.done) vSemaphoreDelete(fanOut.done);
+}
+
+// Per device and ability: true unless a request was sent and failed.
+static bool abilityOk[DOLYNK_MAX_DEVICES][ABILITY_COUNT];
+
+static int applyAlarms(uint32_t deviceMask, bool armed, bool force) {
+    AlarmJob jobs[DOLYNK_MAX_DEVICES * ABILITY_COUNT];
+    int count = 0;
+    
+    for (int d = 0; d < deviceCount; d++) {
+        if (!(deviceMask & (1u << d))) continue;
+        for (int a = 0; a < ABILITY_COUNT; a++) {
+            AckStatus want = desiredStatus(d, a, armed);
+            abilityOk[d][a] = true;
+            if (want == ACK_UNKNOWN) continue;
+            if (!force && ackedStatus[d][a] == want) continue;
+            jobs[count++] = { (uint8_t)d, (uint8_t)a, (uint8_t)want, false };
+        }
+    }
+    
+    dispatch(jobs, count);
+    
+    for (int i = 0; i < count; i++) {
+        AlarmJob& job = jobs[i];
+        abilityOk[job.device][job.ability] = job.ok;
+        ackedStatus[job.device][job.ability] = job.ok ? static_cast<AckStatus>(job.status) : ACK_UNKNOWN;
+    }
+    return count;
+}
+
+static const char* abilityResult(int device, int ability) {
+    if (!hasAbility(device, ability)) return "-";
+    return abilityOk[device][ability] ? "OK" : "FAIL";
+}
+
+// Devices whose siren and strobe are both acknowledged (or not sent)
+static uint32_t devicesOk(uint32_t deviceMask) {
+    uint32_t ok = 0;
+    for (int d = 0; d < deviceCount; d++) {
+        if ((deviceMask & (1u << d)) && abilityOk[d][ABILITY_SIREN] && abilityOk[d][ABILITY_STROBE]) ok |= 1u << d;
+    }
+    return ok;
+}
+
+static bool reportAlarms(uint32_t deviceMask, bool armed, const char* label) {
+    bool allOk = true;
+    
+    for (int d = 0; d < deviceCount; d++) {
+        if (!(deviceMask & (1u << d))) continue;
+        Serial.printf("Alarms %s%s [%s]: Siren=%s, Strobe=%s\n", 
+                      armed ? "ON" : "OFF", label, devices[d].id,
+                      abilityResult(d, ABILITY_SIREN), 
+                      abilityResult(d, ABILITY_STROBE));
+        allOk = allOk && abilityOk[d][ABILITY_SIREN] && abilityOk[d][ABILITY_STROBE];
+    }
+    return allOk;
+}
+
+// The device refused a name it had acknowledged a status for, so it no longer
+// has that ability (or never did, if discovery hasn't run yet). Once
+// discovered, the ability is dropped until the firmware changes.
+static void markUnsupported(int device, int ability) {
+    Serial.printf("[Dolynk] %s no longer supports %s\n", devices[device].id, abilityName(device, ability));
+    ackedStatus[device][ability] = ACK_UNKNOWN;
+    DeviceAbilities& found = discovered[device];
+    if (!found.known) return;
+    found.name[ability] = ABILITY_NONE;
+    saveAbilities(device);
+}
+
+bool verify_alarms() {
+    bool drift = false;
+    
+    for (int d = 0; d < deviceCount; d++) {
+        for (int a = 0; a < ABILITY_COUNT; a++) {
+            if (ackedStatus[d][a] == ACK_UNKNOWN) continue;
+            
+            String reported;
+            QueryResult result = queryAbility(devices[d].id, abilityName(d, a), reported);
+            if (result == QUERY_REFUSED) {
+                markUnsupported(d, a);
+                continue;
+            }
+            if (result == QUERY_FAILED) {
+                ackedStatus[d][a] = ACK_UNKNOWN; // can't confirm, resend on next sync
+                continue;
+            }
+            AckStatus actual = reported == "on" ? ACK_ON : ACK_OFF;
+            if (actual != ackedStatus[d][a]) {
+                Serial.printf("[Dolynk] Drift on %s/%s: expected %s, reported %s\n", devices[d].id, abilityName(d, a),
+                              ackedStatus[d][a] == ACK_ON ? "on" : "off", reported.c_str());
+                ackedStatus[d][a] = ACK_UNKNOWN;
+                drift = true;
+            }
+        }
+    }
+    return !drift;
+}
+
+void forget_alarm_state() {
+    memset(ackedStatus, ACK_UNKNOWN, sizeof(ackedStatus));
 }
 
 bool toggle_alarms(const char* state) {
     String status = String(state);
     status.toLowerCase();
+    bool armed = status == "on";
     
-    if (status == "on") callApi("motionDetect", "off");
-    
-    bool siren = callApi("linkDevAlarm", status.c_str());
-    bool strobe = callApi("linkageWhiteLight", status.c_str());
-    
-    Serial.printf("Alarms %s: Siren=%s, Strobe=%s\n", 
-                  status == "on" ? "ON" : "OFF",
-                  siren ? "OK" : "FAIL", 
-                  strobe ? "OK" : "FAIL");
-    return siren && strobe;
+    applyAlarms(DOLYNK_OWN_DEVICES, armed, true);
+    return reportAlarms(DOLYNK_OWN_DEVICES, armed, "");
 }
 
-void test_abilities() {
-    const char* alarmTypes[] = {"linkDevAlarm", "alarm", "devAlarm", "audioAlarm", "siren"};
-    const char* lightTypes[] = {"linkageWhiteLight", "whiteLight", "floodLight", "supplementLight", "light"};
+bool sync_alarms(const char* state) {
+    String status = String(state);
+    status.toLowerCase();
+    bool armed = status == "on";
     
-    for (int i = 0; i < 5; i++) {
-        callApi(alarmTypes[i], "on");
-        delay(2000);
-        callApi(alarmTypes[i], "off");
-        delay(1000);
+    if (++syncsSinceVerify >= DOLYNK_VERIFY_INTERVAL) {
+        syncsSinceVerify = 0;
+        verify_alarms();
     }
     
-    for (int i = 0; i < 5; i++) {
-        callApi(lightTypes[i], "on");
-        delay(2000);
-        callApi(lightTypes[i], "off");
-        delay(1000);
+    if (applyAlarms(DOLYNK_OWN_DEVICES, armed, false) == 0) {
+        Serial.printf("Alarms %s: already acknowledged, no cloud calls\n", armed ? "ON" : "OFF");
+        return true;
     }
+    return reportAlarms(DOLYNK_OWN_DEVICES, armed, " (sync)");
+}
+
+uint32_t dolynk_apply(uint32_t deviceMask, bool armed, bool force) {
+    if (deviceCount < 32) deviceMask &= (1u << deviceCount) - 1;
+    if (applyAlarms(deviceMask, armed, force) > 0) reportAlarms(deviceMask, armed, " (relay)");
+    return devicesOk(deviceMask);
 }
 
 // void setup() {
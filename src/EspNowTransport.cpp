@@ -0,0 +1,82 @@
+#include "LinkTransport.h"
+#include "setup.h"
+#include "LockLink.h"
+#include "CpuPower.h"
+
+#if LINK_ROLE != LINK_NONE
+
+#include <WiFi.h>
+#include <esp_now.h>
+#include <esp_wifi.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+
+#define RX_QUEUE_DEPTH 16
+
+struct RxFrame {
+  uint8_t mac[6];
+  uint8_t len;
+  uint8_t data[LINK_FRAME_MAX];
+};
+
+static QueueHandle_t rxQueue = nullptr;
+static bool started = false;
+
+// Runs in the WiFi task: copy the frame out and return quickly
+static void onReceive(const uint8_t* mac, const uint8_t* data, int len) {
+  if (len <= 0 || len > LINK_FRAME_MAX) return;
+  RxFrame frame;
+  memcpy(frame.mac, mac, 6);
+  frame.len = len;
+  memcpy(frame.data, data, len);
+  xQueueSend(rxQueue, &frame, 0); // dropped if full, the sender retries
+}
+
+bool EspNowTransport::begin(uint8_t channel) {
+  if (started) return true;
+  if (WiFi.getMode() == WIFI_OFF) WiFi.mode(WIFI_STA); // radio on, not associated
+  CpuPower::radio(true);
+  if (channel) esp_wifi_set_channel(channel, WIFI_SECOND_CHAN_NONE);
+  if (!rxQueue) rxQueue = xQueueCreate(RX_QUEUE_DEPTH, sizeof(RxFrame));
+
+  if (esp_now_init() != ESP_OK) {
+    Serial.println("[Link] ESP-NOW init failed");
+    return false;
+  }
+  esp_now_register_recv_cb(onReceive);
+  started = true;
+  return true;
+}
+
+bool EspNowTransport::send(const uint8_t mac[6], const uint8_t* data, size_t len) {
+  if (!started) return false;
+  if (!esp_now_is_peer_exist(mac)) {
+    esp_now_peer_info_t peer = {};
+    memcpy(peer.peer_addr, mac, 6);
+    peer.channel = 0; // whatever channel the radio is on
+    peer.encrypt = false; // frames carry their own HMAC
+    if (esp_now_add_peer(&peer) != ESP_OK) return false;
+  }
+  return esp_now_send(mac, data, len) == ESP_OK;
+}
+
+size_t EspNowTransport::receive(uint8_t mac[6], uint8_t* data, size_t capacity) {
+  RxFrame frame;
+  if (!rxQueue || xQueueReceive(rxQueue, &frame, 0) != pdTRUE) return 0;
+  if (frame.len > capacity) return 0;
+  memcpy(mac, frame.mac, 6);
+  memcpy(data, frame.data, frame.len);
+  return frame.len;
+}
+
+void EspNowTransport::address(uint8_t mac[6]) {
+  WiFi.macAddress(mac);
+}
+
+void EspNowTransport::end() {
+  if (!started) return;
+  esp_now_deinit();
+  started = false;
+}
+
+#endif // LINK_ROLE != LINK_NONE
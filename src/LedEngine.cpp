@@ -0,0 +1,194 @@
+#include "LedEngine.h"
+#include <driver/ledc.h>
+#include <esp_timer.h>
+
+#define LEDC_MODE       LEDC_LOW_SPEED_MODE
+#define LEDC_TIMER      LEDC_TIMER_0
+#define LEDC_RESOLUTION LEDC_TIMER_8_BIT
+#define LEDC_FREQ_HZ    5000
+#define TICK_US         10000 // animation timer period
+
+// What callers asked for. Written by the caller's task, read by the timer.
+struct LedSpec {
+  LedPattern pattern;
+  uint16_t periodMs;
+  uint8_t blinks;     // remaining blinks, 0 when no blink is running
+  uint8_t blinkSeq;   // bumped on every blink() to restart the sequence
+  uint16_t onMs;
+  uint16_t offMs;
+};
+
+// What the hardware is currently doing. Only touched by the timer.
+struct LedOutput {
+  ledc_channel_t channel;
+  LedPattern pattern;
+  uint16_t periodMs;
+  uint8_t blinkSeq;
+  bool phaseOn;       // blink: LED on; breathe: fading up
+  bool fading;
+  uint32_t phaseStart;
+  uint32_t duty;
+};
+
+static LedSpec specs[LED_COUNT];
+static LedOutput outputs[LED_COUNT];
+static portMUX_TYPE specMux = portMUX_INITIALIZER_UNLOCKED;
+static esp_timer_handle_t tickTimer = nullptr;
+
+static uint16_t defaultPeriod(LedPattern pattern) {
+  if (pattern == LED_BREATHE) return LED_BREATHE_PERIOD;
+  if (pattern == LED_PULSE) return LED_PULSE_PERIOD;
+  return 0;
+}
+
+/* =========================================================
+   HARDWARE
+   ========================================================= */
+// Set a duty immediately; skipped when the LED is already there. A fade
+// still running would carry on over the new duty, so it stops first.
+static void writeDuty(LedOutput& out, uint32_t duty) {
+  if (duty == out.duty && !out.fading) return;
+  if (out.fading) ledc_fade_stop(LEDC_MODE, out.channel);
+  ledc_set_duty(LEDC_MODE, out.channel, duty);
+  ledc_update_duty(LEDC_MODE, out.channel);
+  out.duty = duty;
+  out.fading = false;
+}
+
+// Let the LEDC fade engine ramp to a duty on its own
+static void fadeTo(LedOutput& out, uint32_t duty, uint16_t ms) {
+  ledc_set_fade_with_time(LEDC_MODE, out.channel, duty, ms);
+  ledc_fade_start(LEDC_MODE, out.channel, LEDC_FADE_NO_WAIT);
+  out.duty = duty;
+  out.fading = true;
+}
+
+/* =========================================================
+   ANIMATION
+   ========================================================= */
+static void tickLed(int i, uint32_t now) {
+  LedOutput& out = outputs[i];
+
+  portENTER_CRITICAL(&specMux);
+  LedSpec spec = specs[i];
+  portEXIT_CRITICAL(&specMux);
+
+  // A blink overrides the steady pattern until it finishes
+  if (spec.blinks > 0) {
+    if (out.blinkSeq != spec.blinkSeq) {
+      out.blinkSeq = spec.blinkSeq;
+      out.phaseOn = true;
+      out.phaseStart = now;
+      writeDuty(out, LED_BRIGHTNESS);
+    } else if (now - out.phaseStart >= (out.phaseOn ? spec.onMs : spec.offMs)) {
+      out.phaseStart = now;
+      if (out.phaseOn) {
+        out.phaseOn = false;
+        writeDuty(out, 0);
+      } else {
+        portENTER_CRITICAL(&specMux);
+        if (specs[i].blinkSeq == spec.blinkSeq && specs[i].blinks > 0) specs[i].blinks--;
+        bool more = specs[i].blinks > 0;
+        portEXIT_CRITICAL(&specMux);
+        if (more) {
+          out.phaseOn = true;
+          writeDuty(out, LED_BRIGHTNESS);
+        }
+      }
+    }
+    out.pattern = (LedPattern)-1; // reapply the steady pattern afterwards
+    return;
+  }
+
+  bool breathing = spec.pattern == LED_BREATHE || spec.pattern == LED_PULSE;
+
+  if (out.pattern != spec.pattern || out.periodMs != spec.periodMs) {
+    out.pattern = spec.pattern;
+    out.periodMs = spec.periodMs;
+    out.phaseStart = now;
+    if (breathing) {
+      out.phaseOn = true;
+      fadeTo(out, LED_BRIGHTNESS, spec.periodMs / 2);
+    } else {
+      writeDuty(out, spec.pattern == LED_SOLID ? LED_BRIGHTNESS : 0);
+    }
+  } else if (breathing && now - out.phaseStart >= spec.periodMs / 2) {
+    out.phaseStart = now;
+    out.phaseOn = !out.phaseOn;
+    fadeTo(out, out.phaseOn ? LED_BRIGHTNESS : 0, spec.periodMs / 2);
+  }
+}
+
+static void onTick(void*) {
+  uint32_t now = millis();
+  for (int i = 0; i < LED_COUNT; i++) tickLed(i, now);
+}
+
+/* =========================================================
+   PUBLIC API
+   ========================================================= */
+void LedEngine::begin(uint8_t greenPin, uint8_t yellowPin, uint8_t redPin) {
+  ledc_timer_config_t timer = {};
+  timer.speed_mode = LEDC_MODE;
+  timer.duty_resolution = LEDC_RESOLUTION;
+  timer.timer_num = LEDC_TIMER;
+  timer.freq_hz = LEDC_FREQ_HZ;
+  timer.clk_cfg = LEDC_AUTO_CLK;
+  ledc_timer_config(&timer);
+
+  const uint8_t pins[LED_COUNT] = {greenPin, yellowPin, redPin};
+  for (int i = 0; i < LED_COUNT; i++) {
+    ledc_channel_config_t channel = {};
+    channel.gpio_num = pins[i];
+    channel.speed_mode = LEDC_MODE;
+    channel.channel = (ledc_channel_t)i;
+    channel.timer_sel = LEDC_TIMER;
+    channel.duty = 0;
+    ledc_channel_config(&channel);
+
+    specs[i] = {LED_OFF, 0, 0, 0, 0, 0};
+    outputs[i] = {(ledc_channel_t)i, LED_OFF, 0, 0, false, false, 0, 0};
+  }
+  ledc_fade_func_install(0);
+
+  esp_timer_create_args_t args = {};
+  args.callback = onTick;
+  args.name = "leds";
+  esp_timer_create(&args, &tickTimer);
+  esp_timer_start_periodic(tickTimer, TICK_US);
+}
+
+void LedEngine::set(Led led, LedPattern pattern, uint16_t periodMs) {
+  if (periodMs == 0) periodMs = defaultPeriod(pattern);
+  portENTER_CRITICAL(&specMux);
+  specs[led].pattern = pattern;
+  specs[led].periodMs = periodMs;
+  portEXIT_CRITICAL(&specMux);
+}
+
+void LedEngine::blink(Led led, uint8_t times, uint16_t onMs, uint16_t offMs) {
+  portENTER_CRITICAL(&specMux);
+  specs[led].blinks = times;
+  specs[led].blinkSeq++;
+  specs[led].onMs = onMs;
+  specs[led].offMs = offMs;
+  portEXIT_CRITICAL(&specMux);
+}
+
+bool LedEngine::busy() {
+  bool running = false;
+  portENTER_CRITICAL(&specMux);
+  for (int i = 0; i < LED_COUNT; i++) running = running || specs[i].blinks > 0;
+  portEXIT_CRITICAL(&specMux);
+  return running;
+}
+
+void LedEngine::end() {
+  if (!tickTimer) return; // never started (headless maintenance wake)
+  esp_timer_stop(tickTimer);
+  esp_timer_delete(tickTimer);
+  tickTimer = nullptr;
+  for (int i = 0; i < LED_COUNT; i++) {
+    ledc_stop(LEDC_MODE, outputs[i].channel, 0);
+  }
+}
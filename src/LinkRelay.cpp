@@ -0,0 +1,240 @@
+#include "LinkRelay.h"
+#include <mbedtls/md.h>
+
+/* =========================================================
+   FRAME SIGNING
+   ========================================================= */
+static void frameTag(const char* key, const uint8_t from[6], const uint8_t to[6],
+                     const LinkFrame& frame, uint8_t tag[LINK_TAG_LEN]) {
+  unsigned char digest[64];
+  mbedtls_md_context_t ctx;
+  mbedtls_md_init(&ctx);
+  mbedtls_md_setup(&ctx, mbedtls_md_info_from_type(MBEDTLS_MD_SHA512), 1);
+  mbedtls_md_hmac_starts(&ctx, (const unsigned char*)key, strlen(key));
+  mbedtls_md_hmac_update(&ctx, from, 6);
+  mbedtls_md_hmac_update(&ctx, to, 6);
+  mbedtls_md_hmac_update(&ctx, (const unsigned char*)&frame, offsetof(LinkFrame, tag));
+  mbedtls_md_hmac_finish(&ctx, digest);
+  mbedtls_md_free(&ctx);
+  memcpy(tag, digest, LINK_TAG_LEN);
+}
+
+static void sign(const char* key, const uint8_t from[6], const uint8_t to[6], LinkFrame& frame) {
+  frameTag(key, from, to, frame, frame.tag);
+}
+
+static bool verify(const char* key, const uint8_t from[6], const uint8_t to[6], const LinkFrame& frame) {
+  uint8_t expected[LINK_TAG_LEN];
+  frameTag(key, from, to, frame, expected);
+  uint8_t diff = 0; // constant time
+  for (int i = 0; i < LINK_TAG_LEN; i++) diff |= expected[i] ^ frame.tag[i];
+  return diff == 0 && frame.magic == LINK_MAGIC;
+}
+
+// Copy the next well-sized frame out of the radio; false when none is left
+static bool nextFrame(LinkTransport& radio, uint8_t mac[6], LinkFrame& frame, bool& malformed) {
+  uint8_t buf[LINK_FRAME_MAX];
+  size_t len = radio.receive(mac, buf, sizeof(buf));
+  if (len == 0) return false;
+  malformed = len != sizeof(LinkFrame);
+  if (!malformed) memcpy(&frame, buf, sizeof(frame));
+  return true;
+}
+
+/* =========================================================
+   LEAF
+   ========================================================= */
+LinkLeaf::LinkLeaf(LinkTransport& radio, const uint8_t gateway[6], const char* key, uint32_t& seq, uint32_t& epoch)
+  : radio(radio), key(key), seq(seq), epoch(epoch), result(LINK_DONE), queued(false), sent(0) {
+  memcpy(this->gateway, gateway, 6);
+}
+
+void LinkLeaf::send(bool armed, uint32_t deviceMask, bool force) {
+  memset(&pending, 0, sizeof(pending));
+  pending.magic = LINK_MAGIC;
+  pending.type = LINK_STATE;
+  pending.flags = (armed ? LINK_FLAG_ARMED : 0) | (force ? LINK_FLAG_FORCE : 0);
+  pending.epoch = epoch;
+  pending.seq = ++seq;
+  pending.nonce = esp_random();
+  pending.deviceMask = deviceMask;
+
+  result = LINK_PENDING;
+  queued = false;
+  sent = 0;
+  startedAt = millis();
+  transmit();
+}
+
+void LinkLeaf::transmit() {
+  uint8_t self[6];
+  radio.address(self);
+  sign(key, self, gateway, pending);
+  radio.send(gateway, (const uint8_t*)&pending, sizeof(pending));
+  sent++;
+  lastSentAt = millis();
+}
+
+LinkResult LinkLeaf::poll() {
+  if (result != LINK_PENDING) return result;
+
+  uint8_t self[6], mac[6];
+  radio.address(self);
+  LinkFrame reply;
+  bool malformed;
+  while (nextFrame(radio, mac, reply, malformed)) {
+    // Only the gateway's answers to this change count
+    if (malformed || memcmp(mac, gateway, 6) != 0 || reply.nonce != pending.nonce ||
+        !verify(key, gateway, self, reply)) {
+      continue;
+    }
+    if (reply.type == LINK_RESYNC) {
+      // The gateway restarted, or this leaf lost its counter with power
+      if (queued) continue;
+      epoch = reply.epoch;
+      seq = reply.seq;
+      pending.epoch = epoch;
+      pending.seq = ++seq;
+      transmit();
+      continue;
+    }
+    if (reply.seq != pending.seq || reply.epoch != pending.epoch) continue;
+    if (reply.type == LINK_QUEUED) queued = true;
+    if (reply.type == LINK_APPLIED) return result = LINK_DONE;
+    if (reply.type == LINK_FAILED) return result = LINK_REFUSED;
+  }
+
+  unsigned long now = millis();
+  if (!queued) {
+    if (now - startedAt >= LINK_QUEUE_TIMEOUT_MS) return result = LINK_UNREACHABLE;
+    if (now - lastSentAt >= LINK_RETRY_MS) transmit();
+  } else {
+    if (now - startedAt >= LINK_APPLY_TIMEOUT_MS) return result = LINK_REFUSED;
+    // Once queued, an occasional resend recovers a lost result
+    if (now - lastSentAt >= LINK_RETRY_MS * 10) transmit();
+  }
+  return LINK_PENDING;
+}
+
+/* =========================================================
+   GATEWAY
+   ========================================================= */
+LinkGateway::LinkGateway(LinkTransport& radio, const char* key, LinkForward forward)
+  : radio(radio), key(key), forward(forward), epoch(0), leafCount(0), batchCount(0), batchStartedAt(0), counters() {
+}
+
+void LinkGateway::begin() {
+  epoch = esp_random() | 1; // 0 is a leaf that has never heard from a gateway
+  leafCount = 0;
+  batchCount = 0;
+}
+
+void LinkGateway::reply(const uint8_t mac[6], uint8_t type, uint32_t seq, uint32_t nonce) {
+  LinkFrame frame;
+  memset(&frame, 0, sizeof(frame));
+  frame.magic = LINK_MAGIC;
+  frame.type = type;
+  frame.epoch = epoch;
+  frame.seq = seq;
+  frame.nonce = nonce;
+
+  uint8_t self[6];
+  radio.address(self);
+  sign(key, self, mac, frame);
+  radio.send(mac, (const uint8_t*)&frame, sizeof(frame));
+}
+
+void LinkGateway::handle(const uint8_t mac[6], const LinkFrame& frame) {
+  uint8_t self[6];
+  radio.address(self);
+  if (frame.type != LINK_STATE || !verify(key, mac, self, frame)) {
+    counters.rejected++;
+    return;
+  }
+
+  Leaf* leaf = nullptr;
+  for (uint8_t i = 0; i < leafCount && !leaf; i++) {
+    if (memcmp(leaves[i].mac, mac, 6) == 0) leaf = &leaves[i];
+  }
+  if (!leaf) {
+    // Never evict: a forgotten leaf's recorded frames would count again
+    if (leafCount == LINK_MAX_LEAVES) {
+      counters.rejected++;
+      return;
+    }
+    leaf = &leaves[leafCount++];
+    memcpy(leaf->mac, mac, 6);
+    leaf->seq = frame.seq;
+    leaf->nonce = 0;
+    leaf->status = 0;
+    // A leaf only learns the epoch from a RESYNC, so its first frame never
+    // carries this one: answered below, along with replays from before boot
+  }
+
+  if (frame.epoch == epoch && frame.seq == leaf->seq && frame.nonce == leaf->nonce) {
+    counters.duplicates++; // a resend: repeat where the change is at
+    reply(mac, leaf->status, leaf->seq, leaf->nonce);
+    return;
+  }
+  if (frame.epoch != epoch || frame.seq <= leaf->seq) {
+    counters.resyncs++;
+    reply(mac, LINK_RESYNC, leaf->seq, frame.nonce);
+    return;
+  }
+
+  leaf->seq = frame.seq;
+  leaf->nonce = frame.nonce;
+  leaf->status = LINK_QUEUED;
+  counters.accepted++;
+
+  // A leaf's newer change replaces one still waiting in the batch
+  uint8_t leafIndex = leaf - leaves;
+  uint8_t slot = 0;
+  while (slot < batchCount && batch[slot].leaf != leafIndex) slot++;
+  if (slot == batchCount) {
+    if (batchCount == 0) batchStartedAt = millis();
+    batchCount++;
+  }
+  batch[slot].leaf = leafIndex;
+  batch[slot].flags = frame.flags;
+  batch[slot].deviceMask = frame.deviceMask;
+  reply(mac, LINK_QUEUED, leaf->seq, leaf->nonce);
+}
+
+void LinkGateway::flush() {
+  // The last change to each device wins
+  uint32_t touched = 0, armed = 0, force = 0;
+  for (uint8_t i = 0; i < batchCount; i++) {
+    uint32_t m = batch[i].deviceMask;
+    touched |= m;
+    armed = (armed & ~m) | ((batch[i].flags & LINK_FLAG_ARMED) ? m : 0);
+    force = (force & ~m) | ((batch[i].flags & LINK_FLAG_FORCE) ? m : 0);
+  }
+
+  // At most one DoLynk round per (armed, force) pair
+  uint32_t ok = 0;
+  for (int group = 0; group < 4; group++) {
+    bool groupArmed = group & 1, groupForce = group & 2;
+    uint32_t mask = touched & (groupArmed ? armed : ~armed) & (groupForce ? force : ~force);
+    if (mask) ok |= forward(mask, groupArmed, groupForce);
+  }
+  counters.batches++;
+
+  for (uint8_t i = 0; i < batchCount; i++) {
+    Leaf& leaf = leaves[batch[i].leaf];
+    leaf.status = (batch[i].deviceMask & ~ok) ? LINK_FAILED : LINK_APPLIED;
+    reply(leaf.mac, leaf.status, leaf.seq, leaf.nonce);
+  }
+  batchCount = 0;
+}
+
+void LinkGateway::poll() {
+  uint8_t mac[6];
+  LinkFrame frame;
+  bool malformed;
+  while (nextFrame(radio, mac, frame, malformed)) {
+    if (malformed) counters.rejected++;
+    else handle(mac, frame);
+  }
+  if (batchCount && (millis() - batchStartedAt >= LINK_BATCH_MS || batchCount == LINK_MAX_LEAVES)) flush();
+}
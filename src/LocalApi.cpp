@@ -0,0 +1,349 @@
+#include "LocalApi.h"
+#include "setup.h"
+
+#ifdef LOCAL_API_KEY
+
+#include <WiFi.h>
+#include <freertos/queue.h>
+#include <mbedtls/sha1.h>
+#include <strings.h>
+#include <time.h>
+#include "Metrics.h"
+#include "RtcState.h"
+#include "Sha512.h"
+#include "WifiStatus.h"
+
+// Bound on reading a request head or a frame, so a slow client can't hold
+// up the network task
+#define READ_TIMEOUT_MS 50
+
+static WiFiServer server(LOCAL_API_PORT);
+static bool serving = false;
+static LocalLockHandler lockHandler = nullptr;
+static WiFiClient subscribers[LOCAL_API_SUBSCRIBERS];
+static volatile bool anyone = false; // a subscriber is connected; read by publishing tasks
+
+// All request and reply data lives here; nothing is allocated per request
+static char request[LOCAL_API_REQUEST_MAX + 1];
+static size_t requestLen = 0;
+static char reply[256];
+static uint8_t frame[2 + LOCAL_API_EVENT_MAX];
+
+// Published events wait here for the network task
+struct QueuedEvent {
+  uint8_t len;
+  char text[LOCAL_API_EVENT_MAX + 1]; // + snprintf's terminator
+};
+static QueueHandle_t events = nullptr;
+
+static LocalApiReplayGuard& replay = RtcState::cached().apiReplay;
+
+/* =========================================================
+   REQUEST PARSING
+   ========================================================= */
+// Read up to the blank line ending the head and split it into NUL-terminated
+// lines. Returns false if it doesn't arrive in time or doesn't fit.
+static bool readHead(WiFiClient& client) {
+  size_t len = 0;
+  unsigned long start = millis();
+  while (client.connected() && millis() - start < READ_TIMEOUT_MS) {
+    int c = client.read();
+    if (c < 0) { delay(1); continue; }
+    if (len == LOCAL_API_REQUEST_MAX) return false;
+    request[len++] = c;
+    if (len >= 4 && memcmp(request + len - 4, "\r\n\r\n", 4) == 0) {
+      for (size_t i = 0; i < len; i++) if (request[i] == '\r' || request[i] == '\n') request[i] = '\0';
+      request[len] = '\0';
+      requestLen = len;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Value of a header of the parsed head (names are case-insensitive), or nullptr
+static const char* header(const char* name) {
+  size_t n = strlen(name);
+  const char* end = request + requestLen;
+  for (const char* line = request + strlen(request); line < end; line++) { // after the request line
+    if (*line == '\0') continue;
+    if (strncasecmp(line, name, n) == 0 && line[n] == ':') {
+      const char* value = line + n + 1;
+      while (*value == ' ') value++;
+      return value;
+    }
+    line += strlen(line);
+  }
+  return nullptr;
+}
+
+/* =========================================================
+   AUTHENTICATION
+   ========================================================= */
+static bool authorized(const char* method, const char* path) {
+  const char* stamp = header("X-Revolock-Time");
+  const char* sign = header("X-Revolock-Sign");
+  time_t now = time(nullptr);
+  if (!stamp || !sign || strlen(sign) != 128 || now < 1000000000) return false;
+  long t = atol(stamp);
+  if (labs((long)now - t) > LOCAL_API_SKEW_S) return false;
+
+  uint8_t digest[SHA512_DIGEST_SIZE];
+  const char* parts[] = { method, "\n", path, "\n", stamp };
+  size_t lengths[] = { strlen(method), 1, strlen(path), 1, strlen(stamp) };
+  Sha512::hmac(LOCAL_API_KEY, strlen(LOCAL_API_KEY), parts, lengths, 5, digest);
+
+  // Constant time, either case
+  static const char digits[] = "0123456789abcdef";
+  uint8_t diff = 0;
+  for (int i = 0; i < 64; i++) {
+    diff |= (sign[2 * i] | 0x20) ^ digits[digest[i] >> 4];
+    diff |= (sign[2 * i + 1] | 0x20) ^ digits[digest[i] & 0x0F];
+  }
+  if (diff) return false;
+
+  // Replays: nothing older than the newest request accepted, and within its
+  // second nothing seen before. After a power cut the guard starts at the
+  // current time, so requests captured before it stay refused.
+  if (!replay.time) replay.time = now - 1;
+  if ((uint32_t)t < replay.time) return false;
+  if ((uint32_t)t > replay.time) {
+    replay.time = t;
+    replay.count = 0;
+  }
+  for (uint8_t i = 0; i < replay.count; i++) {
+    if (memcmp(replay.tags[i], digest, sizeof(replay.tags[i])) == 0) return false;
+  }
+  if (replay.count == LOCAL_API_SAME_SECOND) return false;
+  memcpy(replay.tags[replay.count++], digest, sizeof(replay.tags[0]));
+  return true;
+}
+
+/* =========================================================
+   RESPONSES
+   ========================================================= */
+static void respond(WiFiClient& client, int code, const char* body) {
+  const char* reason = code == 200 ? "OK" : code == 400 ? "Bad Request" : code == 401 ? "Unauthorized"
+                     : code == 404 ? "Not Found" : "Service Unavailable";
+  int n = snprintf(reply, sizeof(reply),
+                   "HTTP/1.1 %d %s\r\nContent-Type: application/json\r\nContent-Length: %u\r\nConnection: close\r\n\r\n%s",
+                   code, reason, (unsigned)strlen(body), body);
+  client.write((const uint8_t*)reply, min((size_t)n, sizeof(reply) - 1));
+  client.stop();
+}
+
+static void respondState(WiFiClient& client, bool locked) {
+  respond(client, 200, locked ? "{\"locked\":true}" : "{\"locked\":false}");
+}
+
+/* =========================================================
+   WEBSOCKET EVENT STREAM
+   ========================================================= */
+static void sendFrame(WiFiClient& client, uint8_t opcode, const uint8_t* data, size_t len) {
+  frame[0] = 0x80 | opcode; // final fragment; server frames aren't masked
+  frame[1] = len;
+  memcpy(frame + 2, data, len);
+  client.write(frame, 2 + len);
+}
+
+static void base64(const uint8_t* in, size_t len, char* out) {
+  static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  for (size_t i = 0; i < len; i += 3) {
+    uint32_t v = in[i] << 16 | (i + 1 < len ? in[i + 1] << 8 : 0) | (i + 2 < len ? in[i + 2] : 0);
+    *out++ = table[v >> 18 & 63];
+    *out++ = table[v >> 12 & 63];
+    *out++ = i + 1 < len ? table[v >> 6 & 63] : '=';
+    *out++ = i + 2 < len ? table[v & 63] : '=';
+  }
+  *out = '\0';
+}
+
+static void subscribe(WiFiClient& client) {
+  static const char guid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+  const char* key = header("Sec-WebSocket-Key");
+  const char* upgrade = header("Upgrade");
+  if (!key || !upgrade || strcasecmp(upgrade, "websocket") != 0 || strlen(key) > 32) {
+    respond(client, 400, "{\"error\":\"websocket upgrade expected\"}");
+    return;
+  }
+  WiFiClient* slot = nullptr;
+  for (WiFiClient& s : subscribers) if (!s.connected()) slot = &s;
+  if (!slot) {
+    respond(client, 503, "{\"error\":\"too many subscribers\"}");
+    return;
+  }
+
+  char accept[29];
+  uint8_t hash[20];
+  char keyed[32 + sizeof(guid)];
+  snprintf(keyed, sizeof(keyed), "%s%s", key, guid);
+  mbedtls_sha1((const unsigned char*)keyed, strlen(keyed), hash);
+  base64(hash, sizeof(hash), accept);
+
+  int n = snprintf(reply, sizeof(reply),
+                   "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                   "Sec-WebSocket-Accept: %s\r\n\r\n", accept);
+  client.write((const uint8_t*)reply, n);
+  *slot = client;
+  anyone = true;
+
+  // Start the stream with the current state
+  LocalApi::publish("state", RtcState::durable().locked ? "\"locked\":true" : "\"locked\":false");
+}
+
+// Read len bytes once they have all arrived, waiting at most READ_TIMEOUT_MS;
+// readBytes() alone would wait out the Stream timeout (1 s)
+static bool readFull(WiFiClient& client, uint8_t* dst, size_t len) {
+  unsigned long start = millis();
+  while ((size_t)client.available() < len) {
+    if (!client.connected() || millis() - start >= READ_TIMEOUT_MS) return false;
+    delay(1);
+  }
+  return client.readBytes(dst, len) == len;
+}
+
+// Subscribers only send control frames: answer pings, honour closes and
+// drop anything malformed or trickled
+static void pollSubscriber(WiFiClient& client) {
+  if (!client.connected()) {
+    client.stop();
+    return;
+  }
+  while (client.available() >= 2) {
+    uint8_t head[2], mask[4], payload[125];
+    client.readBytes(head, 2);
+    uint8_t opcode = head[0] & 0x0F;
+    size_t len = head[1] & 0x7F;
+    if (!(head[1] & 0x80) || len > sizeof(payload)
+        || !readFull(client, mask, 4) || !readFull(client, payload, len)) {
+      client.stop();
+      return;
+    }
+    for (size_t i = 0; i < len; i++) payload[i] ^= mask[i & 3];
+
+    if (opcode == 0x8) {        // close: echo it and hang up
+      sendFrame(client, 0x8, payload, min(len, (size_t)2));
+      client.stop();
+      return;
+    }
+    if (opcode == 0x9) sendFrame(client, 0xA, payload, len); // ping -> pong
+  }
+}
+
+// Write the queued events to every subscriber
+static void streamEvents() {
+  QueuedEvent e;
+  bool connected = false;
+  for (WiFiClient& s : subscribers) connected |= s.connected();
+  anyone = connected;
+  while (events && xQueueReceive(events, &e, 0) == pdTRUE) {
+    for (WiFiClient& s : subscribers) {
+      if (s.connected()) sendFrame(s, 0x1, (const uint8_t*)e.text, e.len); // text
+    }
+  }
+}
+
+/* =========================================================
+   PUBLIC API
+   ========================================================= */
+// Key wakes start with the radio off, so the server starts once WiFi is up,
+// and stops if it goes down again (an abandoned warm-up)
+static bool startServer() {
+  if (serving && !WifiStatus::isWifiConnected()) {
+    for (WiFiClient& s : subscribers) s.stop();
+    server.end();
+    serving = false;
+    anyone = false;
+  }
+  if (!serving && WifiStatus::isWifiConnected()) {
+    server.begin();
+    server.setNoDelay(true);
+    serving = true;
+    Serial.printf("[LocalApi] Serving http://%s:%d/\n", WiFi.localIP().toString().c_str(), LOCAL_API_PORT);
+  }
+  return serving;
+}
+
+void LocalApi::begin(LocalLockHandler onLock) {
+  lockHandler = onLock;
+  if (!events) events = xQueueCreate(LOCAL_API_EVENT_QUEUE, sizeof(QueuedEvent));
+  startServer();
+}
+
+void LocalApi::handle() {
+  if (!startServer()) return;
+  for (WiFiClient& s : subscribers) pollSubscriber(s);
+  streamEvents();
+
+  WiFiClient client = server.available();
+  if (!client) return;
+  unsigned long start = micros();
+  client.setNoDelay(true);
+
+  if (!readHead(client)) {
+    respond(client, 400, "{\"error\":\"bad request\"}");
+    return;
+  }
+  // Request line: METHOD PATH VERSION
+  char* method = request;
+  char* path = strchr(method, ' ');
+  char* version = path ? strchr(path + 1, ' ') : nullptr;
+  if (!version) {
+    respond(client, 400, "{\"error\":\"bad request\"}");
+    return;
+  }
+  *path++ = '\0';
+  *version = '\0';
+
+  if (!authorized(method, path)) {
+    metric::localApiRejected.inc();
+    respond(client, 401, "{\"error\":\"bad or missing signature\"}");
+    return;
+  }
+
+  bool get = strcmp(method, "GET") == 0, post = strcmp(method, "POST") == 0;
+  if (get && strcmp(path, "/state") == 0) {
+    respondState(client, RtcState::durable().locked);
+  } else if (post && (strcmp(path, "/lock") == 0 || strcmp(path, "/unlock") == 0)) {
+    respondState(client, lockHandler(path[1] == 'l'));
+  } else if (get && strcmp(path, "/events") == 0) {
+    subscribe(client);
+  } else {
+    respond(client, 404, "{\"error\":\"not found\"}");
+  }
+  metric::localApiUs.observe(micros() - start);
+}
+
+void LocalApi::publish(const char* event, const char* fields) {
+  if (!anyone || !events) return;
+
+  QueuedEvent e;
+  int n = snprintf(e.text, sizeof(e.text), "{\"event\":\"%s\",\"ms\":%lu%s%s}",
+                   event, millis(), fields ? "," : "", fields ? fields : "");
+  if (n < 0 || n > LOCAL_API_EVENT_MAX) return;
+  e.len = n;
+  xQueueSend(events, &e, 0);
+}
+
+void LocalApi::end() {
+  if (!serving) return;
+  publish("sleep");
+  streamEvents();
+  static const uint8_t goingAway[2] = {0x03, 0xE9}; // 1001
+  for (WiFiClient& s : subscribers) {
+    if (s.connected()) sendFrame(s, 0x8, goingAway, sizeof(goingAway));
+    s.stop();
+  }
+  server.end();
+  serving = false;
+  anyone = false;
+}
+
+#else
+
+void LocalApi::begin(LocalLockHandler) {}
+void LocalApi::handle() {}
+void LocalApi::publish(const char*, const char*) {}
+void LocalApi::end() {}
+
+#endif // LOCAL_API_KEY
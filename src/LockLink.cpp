@@ -0,0 +1,142 @@
+#include "LockLink.h"
+#include "setup.h"
+#include "Dolynk.h"
+#include "WifiStatus.h"
+#include <WiFi.h>
+
+#if LINK_ROLE != LINK_NONE
+
+#include "LinkRelay.h"
+#include "Metrics.h"
+
+#ifndef LINK_KEY
+#error "LINK_ROLE needs a shared LINK_KEY in setup.h"
+#endif
+
+static EspNowTransport radio;
+
+#endif
+
+/* =========================================================
+   LEAF: EVERYTHING GOES THROUGH THE GATEWAY
+   ========================================================= */
+#if LINK_ROLE == LINK_LEAF
+
+#include "RtcState.h"
+
+#ifndef LINK_GATEWAY_MAC
+#error "A leaf needs LINK_GATEWAY_MAC in setup.h"
+#endif
+
+// This leaf's devices, by index into the gateway's DOLYNK_DEVICES. No
+// default: every device would let any leaf arm and disarm the whole site.
+#ifndef LINK_DEVICE_MASK
+#error "A leaf needs LINK_DEVICE_MASK in setup.h, the gateway devices it arms"
+#endif
+
+static const uint8_t gatewayMac[6] = {LINK_GATEWAY_MAC};
+static LinkLeaf leaf(radio, gatewayMac, LINK_KEY, RtcState::cached().linkSeq, RtcState::cached().linkEpoch);
+
+void LockLink::begin() {}
+void LockLink::handle() {}
+
+bool LockLink::reachable() {
+  return true; // no association to wait for; a missing gateway shows in setAlarms()
+}
+
+bool LockLink::setAlarms(bool armed, bool force) {
+  unsigned long start = millis();
+  LinkResult result = LINK_UNREACHABLE;
+  if (radio.begin(LINK_CHANNEL)) {
+    leaf.send(armed, LINK_DEVICE_MASK, force);
+    while ((result = leaf.poll()) == LINK_PENDING) delay(1);
+  }
+
+  static const char* const names[] = {"pending", "acknowledged", "not acknowledged", "gateway unreachable"};
+  Serial.printf("[Link] Alarms %s via gateway: %s (%u frames, %lu ms)\n", armed ? "ON" : "OFF",
+                names[result], leaf.attempts(), millis() - start);
+  if (result == LINK_DONE) metric::linkDone.inc();
+  if (result == LINK_REFUSED) metric::linkRefused.inc();
+  if (result == LINK_UNREACHABLE) metric::linkUnreachable.inc();
+  return result == LINK_DONE;
+}
+
+bool LockLink::prepare() {
+  return radio.begin(LINK_CHANNEL);
+}
+
+void LockLink::release(bool radioOff) {
+  radio.end();
+  if (radioOff) WifiStatus::disconnect();
+}
+
+/* =========================================================
+   STANDALONE AND GATEWAY: DOLYNK DIRECTLY
+   ========================================================= */
+#else
+
+bool LockLink::reachable() {
+  return dolynk_available() && WifiStatus::ensureOnline();
+}
+
+bool LockLink::setAlarms(bool armed, bool force) {
+  return force ? toggle_alarms(armed ? "on" : "off") : sync_alarms(armed ? "on" : "off");
+}
+
+bool LockLink::prepare() {
+#if LINK_ROLE == LINK_GATEWAY
+  return true; // always online
+#else
+  return reachable() && dolynk_prepare();
+#endif
+}
+
+void LockLink::release(bool radioOff) {
+#if LINK_ROLE != LINK_GATEWAY
+  dolynk_release();
+  if (radioOff) WifiStatus::disconnect();
+#endif
+}
+
+#endif
+
+#if LINK_ROLE == LINK_GATEWAY
+
+static uint32_t forwardToDolynk(uint32_t deviceMask, bool armed, bool force) {
+  if (!LockLink::reachable()) return 0;
+  return dolynk_apply(deviceMask, armed, force);
+}
+
+static LinkGateway gateway(radio, LINK_KEY, forwardToDolynk);
+static LinkGatewayStats reported = {};
+
+void LockLink::begin() {
+  if (!radio.begin(LINK_CHANNEL)) return;
+  WiFi.setSleep(false); // modem sleep would miss frames between beacons
+  gateway.begin();
+  Serial.printf("[Link] Gateway up on channel %u\n", WiFi.channel());
+}
+
+void LockLink::handle() {
+  gateway.poll();
+  const LinkGatewayStats& s = gateway.stats();
+  metric::linkRelayed.inc(s.accepted - reported.accepted);
+  metric::linkRejected.inc(s.rejected + s.resyncs - reported.rejected - reported.resyncs);
+  reported = s;
+}
+
+#endif
+
+#if LINK_ROLE == LINK_NONE
+
+void LockLink::begin() {}
+void LockLink::handle() {}
+void LockLink::end() {}
+
+#else
+
+void LockLink::end() {
+  radio.end();
+}
+
+#endif
@@ -2,9 +2,8 @@
 #include "setup.h"
 #include <WiFi.h>
 #include <HTTPClient.h>
-
-// Mailtrap Sandbox API configuration (for testing)
-#define MAILTRAP_API_URL "https://sandbox.api.mailtrap.io/api/send/" + String(MAILTRAP_SANDBOX_ID)
+#include "RequestArena.h"
+#include "DnsCache.h"
 
 /**
  * Send email via Mailtrap
@@ -28,33 +27,52 @@ bool Mailtrap::sendEmail(const char* fromEmail, const char* fromName,
     return false;
   }
 
+  // Only one email is sent at a time: the notification task is the only
+  // caller, so nothing else ever touches the arena
+  static StaticRequestArena<MAILTRAP_ARENA_SIZE> arena;
+  RequestScope scope(arena);
+
   // Build JSON payload for Mailtrap API
-  String payload = "{";
-  payload += "\"from\":{\"email\":\"" + String(fromEmail) + "\",\"name\":\"" + String(fromName) + "\"},";
-  payload += "\"to\":[{\"email\":\"" + String(toEmail) + "\",\"name\":\"" + String(toName) + "\"}],";
-  payload += "\"subject\":\"" + String(subject) + "\",";
-  payload += "\"text\":\"" + String(textBody) + "\"";
+  ArenaString payload(arena);
+  payload.add("{\"from\":{\"email\":\"").addJson(fromEmail).add("\",\"name\":\"").addJson(fromName).add("\"},");
+  payload.add("\"to\":[{\"email\":\"").addJson(toEmail).add("\",\"name\":\"").addJson(toName).add("\"}],");
+  payload.add("\"subject\":\"").addJson(subject).add("\",");
+  payload.add("\"text\":\"").addJson(textBody).add("\"");
   
   if (htmlBody != nullptr && strlen(htmlBody) > 0) {
-    payload += ",\"html\":\"" + String(htmlBody) + "\"";
+    payload.add(",\"html\":\"").addJson(htmlBody).add("\"");
   }
   
-  payload += "}";
+  payload.add("}");
+
+  // Mailtrap Sandbox API (for testing)
+  ArenaString apiUrl(arena);
+  apiUrl.add("https://sandbox.api.mailtrap.io/api/send/").add(MAILTRAP_SANDBOX_ID);
+
+  if (arena.exhausted()) {
+    Serial.println("[Mailtrap] Email too large for MAILTRAP_ARENA_SIZE");
+    return false;
+  }
 
   Serial.println("[Mailtrap] Sending email...");
-  Serial.print("[Mailtrap] Payload: ");
-  Serial.println(payload);
 
-  // Send HTTP POST request to Mailtrap Sandbox
+  // Send HTTP POST request to Mailtrap Sandbox, connecting to the cached address
+  WiFiClientSecure client;
+  client.setInsecure();
+  if (!DnsCache::connect(client, apiUrl.c_str(), MAILTRAP_TIMEOUT_MS)) {
+    Serial.println("[Mailtrap] Can't connect");
+    return false;
+  }
   HTTPClient http;
-  String apiUrl = "https://sandbox.api.mailtrap.io/api/send/" + String(MAILTRAP_SANDBOX_ID);
-  http.begin(apiUrl);
+  http.setReuse(true);
+  http.setTimeout(MAILTRAP_TIMEOUT_MS);
+  http.begin(client, apiUrl.c_str());
   
   // Set required headers
   http.addHeader("Content-Type", "application/json");
   http.addHeader("Api-Token", MAILTRAP_TOKEN);
 
-  int httpResponseCode = http.POST(payload);
+  int httpResponseCode = http.POST((uint8_t*)payload.c_str(), payload.length());
 
   Serial.print("[Mailtrap] HTTP Response Code: ");
   Serial.println(httpResponseCode);
@@ -64,8 +82,11 @@ bool Mailtrap::sendEmail(const char* fromEmail, const char* fromName,
     http.end();
     return true;
   } else {
+    ArenaString response(arena);
+    ArenaStream sink(response);
+    if (httpResponseCode > 0) http.writeToStream(&sink);
     Serial.print("[Mailtrap] Failed to send email. Response: ");
-    Serial.println(http.getString());
+    Serial.println(response.c_str());
     http.end();
     return false;
   }
@@ -0,0 +1,151 @@
+#include "Maintenance.h"
+#include "setup.h"
+#include <esp_sleep.h>
+#include <sys/time.h>
+#include "WifiStatus.h"
+#include "Dolynk.h"
+#include "Ota.h"
+#include "Metrics.h"
+#include "RtcState.h"
+#include "DnsCache.h"
+#include "LockLink.h"
+
+// A leaf has no cloud session of its own: it only resyncs its alarms through
+// the gateway, and joins WiFi just for update checks
+#if LINK_ROLE == LINK_LEAF
+#ifdef OTA_URL
+#define ROLE_JOBS (JOB_SYNC_ALARMS | JOB_OTA_CHECK)
+#else
+#define ROLE_JOBS JOB_SYNC_ALARMS
+#endif
+#define WIFI_JOBS JOB_OTA_CHECK
+#else
+#define ROLE_JOBS JOB_ALL
+#define WIFI_JOBS JOB_ALL
+#endif
+
+// Queue and schedule live in the RTC state block, timed with the RTC clock
+static uint8_t& pendingJobs = RtcState::cached().pendingJobs;
+static uint8_t& failedRuns = RtcState::cached().failedRuns;
+static bool& runOk = RtcState::cached().lastRunOk;
+static uint32_t& nextPeriodicAt = RtcState::cached().nextPeriodicAt;
+static uint32_t retryAt = 0; // for due(); sleeping boards use armTimer()
+
+static uint32_t nowS() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec;
+}
+
+// Hours since the window started, against its length (1 to 24 hours), so a
+// window past midnight needs no special case
+static bool inWindow(uint32_t hour) {
+  const uint32_t length = (MAINTENANCE_WINDOW_END_H + 23 - MAINTENANCE_WINDOW_START_H) % 24 + 1;
+  return (hour + 24 - MAINTENANCE_WINDOW_START_H) % 24 < length;
+}
+
+// Move t to the next start of the window unless it already falls inside.
+// Before the first NTP sync there is no time of day, so t is used as is.
+static uint32_t intoWindow(uint32_t t) {
+  if (t < 1000000000 || inWindow(t / 3600 % 24)) return t;
+  uint32_t start = t - t % 86400 + MAINTENANCE_WINDOW_START_H * 3600;
+  return start > t ? start : start + 86400;
+}
+
+static uint32_t retryDelay() {
+  uint32_t delayS = MAINTENANCE_RETRY_S;
+  for (uint8_t i = 1; i < failedRuns && delayS < MAINTENANCE_INTERVAL_S; i++) delayS *= 2;
+  return min(delayS, (uint32_t)MAINTENANCE_INTERVAL_S);
+}
+
+// pendingJobs is also set from the UI task (defer)
+static void setJobs(uint8_t jobs) {
+  RtcState::lock();
+  pendingJobs |= jobs;
+  RtcState::unlock();
+}
+
+static void clearJobs(uint8_t jobs) {
+  RtcState::lock();
+  pendingJobs &= ~jobs;
+  RtcState::unlock();
+}
+
+void Maintenance::defer(uint8_t jobs) {
+  setJobs(jobs & ROLE_JOBS);
+}
+
+bool Maintenance::run() {
+  bool periodic = nowS() >= nextPeriodicAt;
+  if (periodic) setJobs(ROLE_JOBS);
+  clearJobs(~ROLE_JOBS); // the role may have changed with the firmware
+  if (!pendingJobs) return runOk = true;
+
+  Serial.printf("[Maintenance] Running jobs 0x%02x\n", pendingJobs);
+  unsigned long start = millis();
+  bool online = (pendingJobs & WIFI_JOBS) && WifiStatus::ensureOnline();
+
+  // After ensureOnline() the clock is set, so schedule from the real time
+  if (periodic) nextPeriodicAt = intoWindow(nowS() + MAINTENANCE_INTERVAL_S);
+
+  if (online) {
+    if (pendingJobs & JOB_TIME_SYNC) {
+      configTime(0, 0, NTP_SERVER); // SNTP corrects the clock in the background
+      clearJobs(JOB_TIME_SYNC);
+    }
+    // Radio is on anyway: renew addresses that would expire before next time
+    DnsCache::refresh(MAINTENANCE_INTERVAL_S + MAINTENANCE_RETRY_S);
+    if ((pendingJobs & JOB_TOKEN_REFRESH) &&
+        dolynk_refresh_token(MAINTENANCE_INTERVAL_S + MAINTENANCE_RETRY_S)) {
+      clearJobs(JOB_TOKEN_REFRESH);
+    }
+    // Before the sync, so it only sends what the devices have
+    if ((pendingJobs & JOB_DISCOVER) && dolynk_discover_abilities()) {
+      clearJobs(JOB_DISCOVER);
+    }
+  }
+  bool locked = RtcState::durable().locked;
+  if ((pendingJobs & JOB_SYNC_ALARMS) && (online || !(JOB_SYNC_ALARMS & WIFI_JOBS)) &&
+      LockLink::setAlarms(locked, false)) {
+    clearJobs(JOB_SYNC_ALARMS);
+  }
+  if (online && (pendingJobs & JOB_OTA_CHECK)) {
+    clearJobs(JOB_OTA_CHECK); // an install restarts the board
+    // The state block survives the restart, but an image with a new
+    // DURABLE_STATE_VERSION starts from defaults (unlocked), so only
+    // update while unlocked; a locked device checks again next period
+    if (!locked) Ota::update();
+  }
+
+  runOk = pendingJobs == 0;
+  if (runOk) {
+    failedRuns = 0;
+    metric::maintenanceOk.inc();
+    Serial.printf("[Maintenance] Done in %lu ms\n", millis() - start);
+  } else {
+    if (failedRuns < 255) failedRuns++;
+    metric::maintenanceFailed.inc();
+    Serial.printf("[Maintenance] Jobs 0x%02x still pending, retrying in %u s\n",
+                  pendingJobs, (unsigned)retryDelay());
+  }
+  retryAt = intoWindow(nowS() + retryDelay());
+  return runOk;
+}
+
+bool Maintenance::due() {
+  uint32_t now = nowS();
+  return now >= nextPeriodicAt || (pendingJobs && now >= retryAt);
+}
+
+void Maintenance::armTimer() {
+  uint32_t now = nowS();
+  uint32_t wakeAt = nextPeriodicAt;
+  if (pendingJobs) wakeAt = min(wakeAt, intoWindow(now + retryDelay()));
+
+  uint32_t sleepS = wakeAt > now ? wakeAt - now : 1;
+  esp_sleep_enable_timer_wakeup((uint64_t)sleepS * 1000000ULL);
+}
+
+bool Maintenance::lastRunOk() {
+  return runOk;
+}
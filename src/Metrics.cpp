@@ -0,0 +1,342 @@
+#include "Metrics.h"
+#include <WiFi.h>
+#include "WifiStatus.h"
+#include "CpuPower.h"
+#include "Tasks.h"
+
+/* =========================================================
+   METRICS
+   ========================================================= */
+static const uint32_t latencyBoundsMs[] = { 50, 100, 200, 400, 800, 1600, 3200, 6400 };
+static const uint32_t arenaBoundsBytes[] = { 256, 512, 1024, 1536, 2048, 3072, 4096 };
+static const uint32_t toggleLocalBoundsMs[] = { 5, 10, 25, 50, 100, 250, 500, 1000 };
+static const uint32_t localApiBoundsUs[] = { 250, 500, 1000, 2000, 5000, 10000, 20000, 50000 };
+static const uint32_t wifiConnectBoundsMs[] = { 250, 500, 750, 1000, 1500, 2000, 3000, 5000 };
+static const uint32_t toggleAckBoundsMs[] = { 500, 1000, 1500, 2000, 3000, 4000, 6000, 8000, 12000, 16000 };
+
+namespace metric {
+  Counter boots;
+  Counter keypadKeys;
+  Counter passwordAccepted;
+  Counter passwordDenied;
+
+  Histogram toggleLocalMs(toggleLocalBoundsMs);
+  Histogram toggleAckMs(toggleAckBoundsMs);
+  Counter toggleUnacked;
+  Gauge toggleLocalP95Ms;
+  Gauge toggleAckP95Ms;
+  Gauge toggleLocalSloBreached;
+  Gauge toggleAckSloBreached;
+
+  Histogram dolynkLatencyMs(latencyBoundsMs);
+  Counter dolynkOk;
+  Counter dolynkHttpErrors;
+  Counter dolynkTransportErrors;
+  Counter dolynkRejected;
+  Counter dolynkRetries;
+  Counter dolynkCircuitOpen;
+  Counter tlsHandshakes;
+  Counter dnsHits;
+  Counter dnsMisses;
+  Counter dnsStale;
+
+  Histogram requestArenaBytes(arenaBoundsBytes);
+  Counter requestArenaExhausted;
+  Counter stateNvsWrites;
+  Counter maintenanceOk;
+  Counter maintenanceFailed;
+  Counter linkDone;
+  Counter linkRefused;
+  Counter linkUnreachable;
+  Counter linkRelayed;
+  Counter linkRejected;
+  Histogram localApiUs(localApiBoundsUs);
+  Counter localApiRejected;
+  Counter warmupUsed;
+  Counter warmupAbandoned;
+  Counter warmupFailed;
+  Histogram wifiConnectMs(wifiConnectBoundsMs);
+  Counter wifiConnectsKnown;
+  Counter wifiConnectsScanned;
+  Counter wifiScans;
+  Counter wifiRoams;
+  Counter cpuIdleMs;
+  Counter cpuRadioMs;
+  Counter cpuComputeMs;
+  Counter energyMj;
+  Counter energyFixedClockMj;
+
+  Gauge heapFree;
+  Gauge heapMinFree;
+  Gauge heapLargestBlock;
+  Gauge wifiRssi;
+  Gauge wifiApConnectMs;
+  Gauge wifiApRequestMs;
+  Gauge stackFreeUi;
+  Gauge stackFreeNet;
+  Gauge stackFreeNotify;
+}
+
+enum MetricType { METRIC_COUNTER, METRIC_GAUGE, METRIC_HISTOGRAM };
+
+struct MetricEntry {
+  const char* name;
+  const char* labels;   // e.g. outcome="ok", or nullptr
+  const char* help;
+  MetricType type;
+  void* metric;
+};
+
+// Export order. Entries sharing a name (label variants) must be adjacent.
+static const MetricEntry registry[] = {
+  { "revolock_boots_total", nullptr, "Boots, including wakes from deep sleep", METRIC_COUNTER, &metric::boots },
+  { "revolock_keypad_keys_total", nullptr, "Key presses", METRIC_COUNTER, &metric::keypadKeys },
+  { "revolock_password_total", "result=\"accepted\"", "Submitted passwords", METRIC_COUNTER, &metric::passwordAccepted },
+  { "revolock_password_total", "result=\"denied\"", nullptr, METRIC_COUNTER, &metric::passwordDenied },
+  { "revolock_toggle_local_ms", nullptr, "'#' contact to lock state changed", METRIC_HISTOGRAM, &metric::toggleLocalMs },
+  { "revolock_toggle_ack_ms", nullptr, "'#' contact to DoLynk acknowledging every alarm", METRIC_HISTOGRAM, &metric::toggleAckMs },
+  { "revolock_toggle_unacked_total", nullptr, "Toggles DoLynk didn't acknowledge (deferred or failed)", METRIC_COUNTER, &metric::toggleUnacked },
+  { "revolock_toggle_p95_ms", "span=\"local\"", "p95 toggle latency (bucket bound, -1 past the last bucket)", METRIC_GAUGE, &metric::toggleLocalP95Ms },
+  { "revolock_toggle_p95_ms", "span=\"ack\"", nullptr, METRIC_GAUGE, &metric::toggleAckP95Ms },
+  { "revolock_slo_breached", "span=\"local\"", "1 if the p95 is over its SLO", METRIC_GAUGE, &metric::toggleLocalSloBreached },
+  { "revolock_slo_breached", "span=\"ack\"", nullptr, METRIC_GAUGE, &metric::toggleAckSloBreached },
+  { "revolock_dolynk_request_duration_ms", nullptr, "DoLynk HTTP request latency", METRIC_HISTOGRAM, &metric::dolynkLatencyMs },
+  { "revolock_dolynk_requests_total", "outcome=\"ok\"", "DoLynk HTTP requests by outcome", METRIC_COUNTER, &metric::dolynkOk },
+  { "revolock_dolynk_requests_total", "outcome=\"http_error\"", nullptr, METRIC_COUNTER, &metric::dolynkHttpErrors },
+  { "revolock_dolynk_requests_total", "outcome=\"transport_error\"", nullptr, METRIC_COUNTER, &metric::dolynkTransportErrors },
+  { "revolock_dolynk_api_errors_total", nullptr, "DoLynk replies with HTTP 200 but an API error code", METRIC_COUNTER, &metric::dolynkRejected },
+  { "revolock_dolynk_retries_total", nullptr, "DoLynk request retries", METRIC_COUNTER, &metric::dolynkRetries },
+  { "revolock_dolynk_circuit_open_total", nullptr, "DoLynk operations skipped by the circuit breaker", METRIC_COUNTER, &metric::dolynkCircuitOpen },
+  { "revolock_tls_handshakes_total", nullptr, "TLS handshakes (new connections)", METRIC_COUNTER, &metric::tlsHandshakes },
+  { "revolock_dns_lookups_total", "result=\"hit\"", "Connections by DNS cache result", METRIC_COUNTER, &metric::dnsHits },
+  { "revolock_dns_lookups_total", "result=\"miss\"", nullptr, METRIC_COUNTER, &metric::dnsMisses },
+  { "revolock_dns_stale_total", nullptr, "Cached addresses that didn't answer", METRIC_COUNTER, &metric::dnsStale },
+  { "revolock_request_arena_bytes", nullptr, "Arena high-water mark per outbound request", METRIC_HISTOGRAM, &metric::requestArenaBytes },
+  { "revolock_request_arena_exhausted_total", nullptr, "Requests abandoned because their arena was full", METRIC_COUNTER, &metric::requestArenaExhausted },
+  { "revolock_state_nvs_writes_total", nullptr, "Flash writes of the durable state", METRIC_COUNTER, &metric::stateNvsWrites },
+  { "revolock_maintenance_runs_total", "result=\"ok\"", "Maintenance runs by result", METRIC_COUNTER, &metric::maintenanceOk },
+  { "revolock_maintenance_runs_total", "result=\"failed\"", nullptr, METRIC_COUNTER, &metric::maintenanceFailed },
+  { "revolock_link_changes_total", "result=\"acked\"", "Leaf alarm changes sent through the gateway, by result", METRIC_COUNTER, &metric::linkDone },
+  { "revolock_link_changes_total", "result=\"unacked\"", nullptr, METRIC_COUNTER, &metric::linkRefused },
+  { "revolock_link_changes_total", "result=\"unreachable\"", nullptr, METRIC_COUNTER, &metric::linkUnreachable },
+  { "revolock_link_relayed_total", nullptr, "Gateway: leaf changes queued for DoLynk", METRIC_COUNTER, &metric::linkRelayed },
+  { "revolock_link_rejected_total", nullptr, "Gateway: bad, stale or replayed leaf frames", METRIC_COUNTER, &metric::linkRejected },
+  { "revolock_local_api_duration_us", nullptr, "LAN API request accepted to reply written", METRIC_HISTOGRAM, &metric::localApiUs },
+  { "revolock_local_api_rejected_total", nullptr, "LAN API requests with a bad, stale or replayed signature", METRIC_COUNTER, &metric::localApiRejected },
+  { "revolock_warmup_total", "result=\"used\"", "Network warm-ups started by a first digit, by result", METRIC_COUNTER, &metric::warmupUsed },
+  { "revolock_warmup_total", "result=\"abandoned\"", nullptr, METRIC_COUNTER, &metric::warmupAbandoned },
+  { "revolock_warmup_total", "result=\"failed\"", nullptr, METRIC_COUNTER, &metric::warmupFailed },
+  { "revolock_wifi_connect_ms", nullptr, "WiFi connect to associated", METRIC_HISTOGRAM, &metric::wifiConnectMs },
+  { "revolock_wifi_connects_total", "ap=\"remembered\"", "WiFi connects, straight to the remembered access point or after a scan", METRIC_COUNTER, &metric::wifiConnectsKnown },
+  { "revolock_wifi_connects_total", "ap=\"scanned\"", nullptr, METRIC_COUNTER, &metric::wifiConnectsScanned },
+  { "revolock_wifi_scans_total", nullptr, "WiFi scans", METRIC_COUNTER, &metric::wifiScans },
+  { "revolock_wifi_roams_total", nullptr, "Moves to a stronger access point while awake", METRIC_COUNTER, &metric::wifiRoams },
+  { "revolock_cpu_phase_ms_total", "phase=\"idle\"", "Awake time by CPU power phase", METRIC_COUNTER, &metric::cpuIdleMs },
+  { "revolock_cpu_phase_ms_total", "phase=\"radio\"", nullptr, METRIC_COUNTER, &metric::cpuRadioMs },
+  { "revolock_cpu_phase_ms_total", "phase=\"compute\"", nullptr, METRIC_COUNTER, &metric::cpuComputeMs },
+  { "revolock_energy_estimate_mj_total", "clock=\"scaled\"", "Estimated energy while awake (fixed: at full clock throughout)", METRIC_COUNTER, &metric::energyMj },
+  { "revolock_energy_estimate_mj_total", "clock=\"fixed\"", nullptr, METRIC_COUNTER, &metric::energyFixedClockMj },
+  { "revolock_heap_free_bytes", nullptr, "Free heap", METRIC_GAUGE, &metric::heapFree },
+  { "revolock_heap_min_free_bytes", nullptr, "Lowest free heap since boot", METRIC_GAUGE, &metric::heapMinFree },
+  { "revolock_heap_largest_block_bytes", nullptr, "Largest allocatable heap block", METRIC_GAUGE, &metric::heapLargestBlock },
+  { "revolock_wifi_rssi_dbm", nullptr, "WiFi signal strength", METRIC_GAUGE, &metric::wifiRssi },
+  { "revolock_wifi_ap_connect_ms", nullptr, "Running average connect time of the access point in use", METRIC_GAUGE, &metric::wifiApConnectMs },
+  { "revolock_wifi_ap_request_ms", nullptr, "Running average DoLynk request latency over the access point in use", METRIC_GAUGE, &metric::wifiApRequestMs },
+  { "revolock_task_stack_free_bytes", "task=\"ui\"", "Stack never used by each task (high-water mark)", METRIC_GAUGE, &metric::stackFreeUi },
+  { "revolock_task_stack_free_bytes", "task=\"net\"", nullptr, METRIC_GAUGE, &metric::stackFreeNet },
+  { "revolock_task_stack_free_bytes", "task=\"notify\"", nullptr, METRIC_GAUGE, &metric::stackFreeNotify },
+};
+
+static const size_t registrySize = sizeof(registry) / sizeof(registry[0]);
+
+/* =========================================================
+   PERSISTENCE ACROSS DEEP SLEEP
+   ========================================================= */
+// Counters and histograms are copied to RTC memory before sleeping, so they
+// only reset on power loss. The word count doubles as a layout check.
+#define METRICS_RTC_WORDS 112
+
+RTC_DATA_ATTR uint32_t savedMetrics[METRICS_RTC_WORDS];
+RTC_DATA_ATTR uint16_t savedMetricWords = 0;
+
+// Visit every persisted word in registry order
+template<class F> static size_t forEachWord(F f) {
+  size_t n = 0;
+  for (size_t i = 0; i < registrySize; i++) {
+    const MetricEntry& e = registry[i];
+    if (e.type == METRIC_COUNTER) {
+      f(n++, *(Counter*)e.metric);
+    } else if (e.type == METRIC_HISTOGRAM) {
+      Histogram& h = *(Histogram*)e.metric;
+      for (uint8_t b = 0; b <= h.bucketCount; b++) f(n++, h.counts[b]);
+      f(n++, h.sum);
+    }
+  }
+  return n;
+}
+
+struct SaveWord {
+  void operator()(size_t n, Counter& c) const { if (n < METRICS_RTC_WORDS) savedMetrics[n] = c.get(); }
+  void operator()(size_t n, std::atomic<uint32_t>& a) const { if (n < METRICS_RTC_WORDS) savedMetrics[n] = a.load(); }
+};
+
+// Added, not stored: setup() counts requests and syncs before Metrics::begin()
+struct RestoreWord {
+  void operator()(size_t n, Counter& c) const { c.inc(savedMetrics[n]); }
+  void operator()(size_t n, std::atomic<uint32_t>& a) const { a.fetch_add(savedMetrics[n], std::memory_order_relaxed); }
+};
+
+struct CountWord {
+  void operator()(size_t, Counter&) const {}
+  void operator()(size_t, std::atomic<uint32_t>&) const {}
+};
+
+static void saveMetrics() {
+  size_t words = forEachWord(SaveWord());
+  savedMetricWords = words <= METRICS_RTC_WORDS ? words : 0;
+}
+
+static void restoreMetrics() {
+  if (savedMetricWords && savedMetricWords == forEachWord(CountWord())) forEachWord(RestoreWord());
+}
+
+/* =========================================================
+   PROMETHEUS TEXT FORMAT
+   ========================================================= */
+static const char* typeName(MetricType type) {
+  if (type == METRIC_COUNTER) return "counter";
+  if (type == METRIC_GAUGE) return "gauge";
+  return "histogram";
+}
+
+void Metrics::render(MetricsSink sink, void* ctx) {
+  char line[160];
+  auto emit = [&](int n) { if (n > 0) sink(ctx, line, min((size_t)n, sizeof(line) - 1)); };
+
+  for (size_t i = 0; i < registrySize; i++) {
+    const MetricEntry& e = registry[i];
+    if (e.help) {
+      emit(snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s %s\n", e.name, e.help, e.name, typeName(e.type)));
+    }
+
+    const char* open = e.labels ? "{" : "";
+    const char* labels = e.labels ? e.labels : "";
+    const char* close = e.labels ? "}" : "";
+    if (e.type == METRIC_COUNTER) {
+      emit(snprintf(line, sizeof(line), "%s%s%s%s %u\n", e.name, open, labels, close, ((Counter*)e.metric)->get()));
+    } else if (e.type == METRIC_GAUGE) {
+      emit(snprintf(line, sizeof(line), "%s%s%s%s %d\n", e.name, open, labels, close, ((Gauge*)e.metric)->get()));
+    } else {
+      // Buckets are stored per bucket and exported cumulatively
+      Histogram& h = *(Histogram*)e.metric;
+      uint32_t cumulative = 0;
+      for (uint8_t b = 0; b <= h.bucketCount; b++) {
+        cumulative += h.counts[b].load(std::memory_order_relaxed);
+        if (b < h.bucketCount) {
+          emit(snprintf(line, sizeof(line), "%s_bucket{le=\"%u\"} %u\n", e.name, h.bounds[b], cumulative));
+        } else {
+          emit(snprintf(line, sizeof(line), "%s_bucket{le=\"+Inf\"} %u\n", e.name, cumulative));
+        }
+      }
+      emit(snprintf(line, sizeof(line), "%s_sum %u\n%s_count %u\n", e.name,
+                    h.sum.load(std::memory_order_relaxed), e.name, cumulative));
+    }
+  }
+}
+
+void Metrics::sample() {
+  metric::heapFree.set(ESP.getFreeHeap());
+  metric::heapMinFree.set(ESP.getMinFreeHeap());
+  metric::heapLargestBlock.set(ESP.getMaxAllocHeap());
+  if (WifiStatus::isWifiConnected()) metric::wifiRssi.set(WifiStatus::getSignalStrength());
+  CpuPower::sample();
+  Tasks::sample();
+  checkSlos();
+}
+
+/* =========================================================
+   SERVICE LEVEL OBJECTIVES
+   ========================================================= */
+struct Slo {
+  const char* span;
+  Histogram& latency;
+  uint32_t targetMs;
+  Gauge& p95;
+  Gauge& breached;
+};
+
+static Slo slos[] = {
+  { "local", metric::toggleLocalMs, SLO_TOGGLE_LOCAL_MS, metric::toggleLocalP95Ms, metric::toggleLocalSloBreached },
+  { "ack", metric::toggleAckMs, SLO_TOGGLE_ACK_MS, metric::toggleAckP95Ms, metric::toggleAckSloBreached },
+};
+
+void Metrics::checkSlos() {
+  for (Slo& slo : slos) {
+    uint32_t p95 = slo.latency.percentile(95);
+    slo.p95.set(p95 == UINT32_MAX ? -1 : (int32_t)p95);
+
+    // Exact when the target is one of the bucket bounds (the defaults are)
+    bool breached = slo.latency.count() >= SLO_MIN_SAMPLES && p95 > slo.targetMs;
+    if (breached && !slo.breached.get()) {
+      Serial.printf("[Metrics] SLO breach: '#' to %s p95 %s%u ms, target %u ms (%u samples)\n", slo.span,
+                    p95 == UINT32_MAX ? ">" : "<=", p95 == UINT32_MAX ? slo.latency.bounds[slo.latency.bucketCount - 1] : p95,
+                    slo.targetMs, slo.latency.count());
+    }
+    slo.breached.set(breached);
+  }
+}
+
+/* =========================================================
+   HTTP ENDPOINT
+   ========================================================= */
+static WiFiServer server(METRICS_PORT);
+static bool serving = false;
+
+static void writeToClient(void* ctx, const char* data, size_t len) {
+  ((WiFiClient*)ctx)->write((const uint8_t*)data, len);
+}
+
+// Key wakes start with the radio off, so the server starts once WiFi is up
+static bool startServer() {
+  if (!serving && WifiStatus::isWifiConnected()) {
+    server.begin();
+    serving = true;
+    Serial.printf("[Metrics] Serving http://%s:%d/metrics\n", WiFi.localIP().toString().c_str(), METRICS_PORT);
+  }
+  return serving;
+}
+
+void Metrics::begin() {
+  restoreMetrics();
+  metric::boots.inc();
+  sample();
+  startServer();
+}
+
+void Metrics::handle() {
+  if (!startServer()) return;
+  WiFiClient client = server.available();
+  if (!client) return;
+
+  // Skip the request head (any path gets the metrics), but don't let a slow
+  // client hold up the network task's syncs for long
+  unsigned long start = millis();
+  uint8_t matched = 0;
+  while (matched < 4 && client.connected() && millis() - start < 200) {
+    int c = client.read();
+    if (c < 0) { delay(1); continue; }
+    matched = (c == "\r\n\r\n"[matched]) ? matched + 1 : (c == '\r' ? 1 : 0);
+  }
+
+  static const char head[] = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nConnection: close\r\n\r\n";
+  client.write((const uint8_t*)head, sizeof(head) - 1);
+  sample();
+  render(writeToClient, &client);
+  client.stop();
+}
+
+void Metrics::end() {
+  if (serving) server.end();
+  serving = false;
+  saveMetrics();
+}
@@ -0,0 +1,228 @@
+#include "Ota.h"
+#include "setup.h"
+
+#ifdef OTA_URL
+
+#include <WiFi.h>
+#include <HTTPClient.h>
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+#include <mbedtls/sha256.h>
+#include <mbedtls/ecdsa.h>
+#include <new>
+#include "DeltaPatch.h"
+#include "RtcState.h"
+
+#ifndef OTA_PUBLIC_KEY
+#error "OTA_URL needs OTA_PUBLIC_KEY; tools/make_delta.py --key <pem> --public-key prints it"
+#endif
+
+#define OTA_CHUNK 1024 // network read size
+
+// Release signing key, P-256, uncompressed point
+static const uint8_t publicKey[65] = OTA_PUBLIC_KEY;
+
+// Calls until the next check, in the RTC state block; starts at 0 so a fresh
+// flash checks right away
+static uint16_t& checkCountdown = RtcState::cached().otaCheckCountdown;
+
+// Arduino marks a new image valid before setup() unless told otherwise
+extern "C" bool verifyRollbackLater() {
+  return true;
+}
+
+struct OtaTarget {
+  const esp_partition_t* source;
+  esp_ota_handle_t handle;
+};
+
+static bool readSource(void* ctx, uint32_t offset, uint8_t* dst, size_t len) {
+  return esp_partition_read(((OtaTarget*)ctx)->source, offset, dst, len) == ESP_OK;
+}
+
+static bool writeTarget(void* ctx, const uint8_t* src, size_t len) {
+  return esp_ota_write(((OtaTarget*)ctx)->handle, src, len) == ESP_OK;
+}
+
+// Does the partition start with the image the delta was made against?
+static bool partitionMatches(const esp_partition_t* part, uint32_t size, const uint8_t expected[32]) {
+  if (size > part->size) return false;
+
+  uint8_t buf[OTA_CHUNK];
+  uint8_t digest[32];
+  mbedtls_sha256_context sha;
+  mbedtls_sha256_init(&sha);
+  mbedtls_sha256_starts(&sha, 0);
+  bool ok = true;
+  for (uint32_t offset = 0; offset < size && ok; offset += sizeof(buf)) {
+    size_t len = min((uint32_t)sizeof(buf), size - offset);
+    ok = esp_partition_read(part, offset, buf, len) == ESP_OK;
+    if (ok) mbedtls_sha256_update(&sha, buf, len);
+  }
+  mbedtls_sha256_finish(&sha, digest);
+  mbedtls_sha256_free(&sha);
+  return ok && memcmp(digest, expected, sizeof(digest)) == 0;
+}
+
+// Was the header signed with the release key? The header carries the
+// target's SHA-256, which the patcher checks, so this covers the whole image.
+static bool signatureValid(const uint8_t* header, const uint8_t* signature) {
+  uint8_t digest[32];
+  mbedtls_sha256_context sha;
+  mbedtls_sha256_init(&sha);
+  mbedtls_sha256_starts(&sha, 0);
+  mbedtls_sha256_update(&sha, header, DELTA_HEADER_SIZE);
+  mbedtls_sha256_finish(&sha, digest);
+  mbedtls_sha256_free(&sha);
+
+  mbedtls_ecp_group group;
+  mbedtls_ecp_point key;
+  mbedtls_mpi r, s;
+  mbedtls_ecp_group_init(&group);
+  mbedtls_ecp_point_init(&key);
+  mbedtls_mpi_init(&r);
+  mbedtls_mpi_init(&s);
+  bool ok = mbedtls_ecp_group_load(&group, MBEDTLS_ECP_DP_SECP256R1) == 0 &&
+            mbedtls_ecp_point_read_binary(&group, &key, publicKey, sizeof(publicKey)) == 0 &&
+            mbedtls_mpi_read_binary(&r, signature, 32) == 0 &&
+            mbedtls_mpi_read_binary(&s, signature + 32, 32) == 0 &&
+            mbedtls_ecdsa_verify(&group, digest, sizeof(digest), &key, &r, &s) == 0;
+  mbedtls_mpi_free(&s);
+  mbedtls_mpi_free(&r);
+  mbedtls_ecp_point_free(&key);
+  mbedtls_ecp_group_free(&group);
+  return ok;
+}
+
+// Read up to len bytes, waiting at most OTA_STALL_MS for the first one
+static size_t readSome(HTTPClient& http, uint8_t* dst, size_t len, bool exact) {
+  WiFiClient* stream = http.getStreamPtr();
+  size_t got = 0;
+  unsigned long lastData = millis();
+  while (got < len) {
+    size_t avail = stream->available();
+    if (avail) {
+      got += stream->readBytes(dst + got, min(avail, len - got));
+      lastData = millis();
+      if (!exact) break;
+    } else if (!http.connected() || millis() - lastData > OTA_STALL_MS) {
+      break;
+    } else {
+      delay(1);
+    }
+  }
+  return got;
+}
+
+bool Ota::update() {
+  if (checkCountdown > 0) {
+    checkCountdown--;
+    return false;
+  }
+  if (WiFi.status() != WL_CONNECTED) return false;
+  checkCountdown = OTA_CHECK_INTERVAL - 1;
+
+  // Deltas are published under the ELF hash of the build they apply to
+  char elfSha[17];
+  esp_ota_get_app_elf_sha256(elfSha, sizeof(elfSha));
+
+  // HTTP/1.0 rules out a chunked reply; the body may still come without a
+  // length (total -1), and then runs until the server closes the connection
+  HTTPClient http;
+  http.setTimeout(OTA_STALL_MS);
+  http.useHTTP10(true);
+  http.begin(String(OTA_URL) + "/" + elfSha + ".rvd");
+  int code = http.GET();
+  int total = http.getSize();
+  const int prefix = DELTA_HEADER_SIZE + DELTA_SIGNATURE_SIZE;
+  if (code != 200 || (total >= 0 && total <= prefix)) {
+    if (code != 404) Serial.printf("[Ota] Update check failed (%d)\n", code);
+    http.end();
+    return false;
+  }
+
+  uint8_t buf[OTA_CHUNK];
+  DeltaHeader header;
+  if (readSome(http, buf, prefix, true) != (size_t)prefix ||
+      DeltaPatch::parseHeader(buf, DELTA_HEADER_SIZE, header) != DELTA_OK) {
+    Serial.println("[Ota] Not a RevoLock delta");
+    http.end();
+    return false;
+  }
+  if (!signatureValid(buf, buf + DELTA_HEADER_SIZE)) {
+    Serial.println("[Ota] Delta isn't signed with the release key");
+    http.end();
+    return false;
+  }
+
+  OtaTarget target = { esp_ota_get_running_partition(), 0 };
+  const esp_partition_t* next = esp_ota_get_next_update_partition(NULL);
+  if (!next || header.targetSize > next->size ||
+      !partitionMatches(target.source, header.sourceSize, header.sourceHash)) {
+    Serial.println("[Ota] Delta doesn't match the running image");
+    http.end();
+    return false;
+  }
+  if (esp_ota_begin(next, header.targetSize, &target.handle) != ESP_OK) {
+    Serial.println("[Ota] Can't open the update partition");
+    http.end();
+    return false;
+  }
+
+  Serial.printf("[Ota] Applying delta, %u byte image\n", header.targetSize);
+  unsigned long start = millis();
+
+  // Decoder state is ~5 KB, more than the caller's stack (setup() at boot,
+  // or the network task on a gateway) can spare
+  DeltaPatch* patch = new (std::nothrow) DeltaPatch(header, readSource, writeTarget, &target);
+  if (!patch) {
+    esp_ota_abort(target.handle);
+    http.end();
+    Serial.println("[Ota] No heap for the delta decoder");
+    return false;
+  }
+  int status = DELTA_OK;
+  for (int left = total < 0 ? INT_MAX : total - prefix; left > 0 && status == DELTA_OK; ) {
+    size_t n = readSome(http, buf, min(left, (int)sizeof(buf)), false);
+    if (!n) {
+      if (total >= 0) status = DELTA_ERR_SIZE; // else the end of the body; finish() checks it was all there
+      break;
+    }
+    status = patch->feed(buf, n);
+    left -= n;
+  }
+  if (status == DELTA_OK) status = patch->finish();
+  delete patch;
+  http.end();
+
+  if (status != DELTA_OK) {
+    esp_ota_abort(target.handle);
+    Serial.printf("[Ota] Update failed (%d)\n", status);
+    return false;
+  }
+  // esp_ota_end() also checks the app image's own checksum and hash
+  if (esp_ota_end(target.handle) != ESP_OK || esp_ota_set_boot_partition(next) != ESP_OK) {
+    Serial.println("[Ota] New image rejected");
+    return false;
+  }
+
+  Serial.printf("[Ota] Update installed in %lu ms, restarting\n", millis() - start);
+  RtcState::flush(); // the state block survives the restart
+  Serial.flush();
+  esp_restart();
+  return true;
+}
+
+void Ota::confirmBoot() {
+  esp_ota_mark_app_valid_cancel_rollback();
+}
+
+#else
+
+bool Ota::update() {
+  return false;
+}
+
+void Ota::confirmBoot() {}
+
+#endif
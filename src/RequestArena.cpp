@@ -0,0 +1,138 @@
+#include "RequestArena.h"
+#include "Metrics.h"
+
+/* =========================================================
+   ARENA
+   ========================================================= */
+RequestArena::RequestArena(uint8_t* buffer, size_t size)
+  : base(buffer), size(size), top(0), peak(0), failed(false) {}
+
+void* RequestArena::alloc(size_t n, size_t align) {
+  size_t pad = (align - ((uintptr_t)(base + top) & (align - 1))) & (align - 1);
+  if (n > size - top || pad > size - top - n) {
+    failed = true;
+    return nullptr;
+  }
+  void* p = base + top + pad;
+  top += pad + n;
+  if (top > peak) peak = top;
+  return p;
+}
+
+bool RequestArena::extend(const void* end, size_t extra) {
+  if (end != base + top) return false;
+  if (extra > size - top) {
+    failed = true;
+    return false;
+  }
+  top += extra;
+  if (top > peak) peak = top;
+  return true;
+}
+
+void RequestArena::reset() {
+  if (peak) metric::requestArenaBytes.observe(peak);
+  if (failed) metric::requestArenaExhausted.inc();
+  top = 0;
+  peak = 0;
+  failed = false;
+}
+
+/* =========================================================
+   STRING BUILDER
+   ========================================================= */
+ArenaString& ArenaString::add(const char* s, size_t n) {
+  if (failed) return *this;
+
+  // Newest allocation: grow over the terminator in place
+  if (data && arena.extend(data + len + 1, n)) {
+    memcpy(data + len, s, n);
+    len += n;
+    data[len] = '\0';
+    return *this;
+  }
+
+  char* moved = (char*)arena.alloc(len + n + 1, 1);
+  if (!moved) {
+    failed = true;
+    return *this;
+  }
+  if (len) memcpy(moved, data, len);
+  memcpy(moved + len, s, n);
+  data = moved;
+  len += n;
+  data[len] = '\0';
+  return *this;
+}
+
+ArenaString& ArenaString::addNumber(uint64_t n) {
+  char digits[21];
+  char* p = digits + sizeof(digits);
+  do {
+    *--p = '0' + n % 10;
+    n /= 10;
+  } while (n);
+  return add(p, digits + sizeof(digits) - p);
+}
+
+ArenaString& ArenaString::addHex(const uint8_t* bytes, size_t n, bool upper) {
+  const char* digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+  char pair[2];
+  for (size_t i = 0; i < n; i++) {
+    pair[0] = digits[bytes[i] >> 4];
+    pair[1] = digits[bytes[i] & 0x0F];
+    add(pair, 2);
+  }
+  return *this;
+}
+
+ArenaString& ArenaString::addJson(const char* s) {
+  for (; *s; s++) {
+    char c = *s;
+    if (c == '"' || c == '\\') {
+      char escaped[2] = {'\\', c};
+      add(escaped, 2);
+    } else if (c == '\n') {
+      add("\\n", 2);
+    } else if ((uint8_t)c < 0x20) {
+      char escaped[7];
+      snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+      add(escaped, 6);
+    } else {
+      add(c);
+    }
+  }
+  return *this;
+}
+
+/* =========================================================
+   JSON ALLOCATOR
+   ========================================================= */
+// Blocks carry their size so reallocate() can copy them when they can't grow in place
+void* ArenaJsonAllocator::allocate(size_t size) {
+  size_t* block = (size_t*)arena.alloc(sizeof(size_t) + size, sizeof(void*));
+  if (!block) return nullptr;
+  *block = size;
+  return block + 1;
+}
+
+void* ArenaJsonAllocator::reallocate(void* ptr, size_t newSize) {
+  if (!ptr) return allocate(newSize);
+  size_t* block = (size_t*)ptr - 1;
+  size_t oldSize = *block;
+  uint8_t* end = (uint8_t*)ptr + oldSize;
+
+  if (newSize <= oldSize) {
+    // Hand the tail back if nothing was allocated after this block
+    if (end == arena.base + arena.top) arena.top -= oldSize - newSize;
+    *block = newSize;
+    return ptr;
+  }
+  if (arena.extend(end, newSize - oldSize)) {
+    *block = newSize;
+    return ptr;
+  }
+  void* moved = allocate(newSize);
+  if (moved) memcpy(moved, ptr, oldSize);
+  return moved;
+}
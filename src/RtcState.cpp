@@ -0,0 +1,120 @@
+#include "RtcState.h"
+#include "Metrics.h"
+#include <Preferences.h>
+#include <esp_rom_crc.h>
+
+#define STATE_MAGIC 0x52535431 // "RST1"
+#define NVS_NAMESPACE "revolock"
+#define NVS_KEY "state"
+
+struct StateBlock {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t size;         // catches a layout change without a version bump
+  DurableState durable;
+  CachedState cached;
+  DurableState stored;   // what NVS holds, so flush() needn't read flash
+  bool storedValid;
+  uint32_t crc;          // over everything above
+};
+
+struct NvsRecord {
+  uint16_t version;
+  DurableState durable;
+};
+
+// Kept through deep sleep and software resets (OTA, watchdog). After power
+// loss it holds garbage, which the checksum rejects.
+static RTC_NOINIT_ATTR StateBlock block;
+static portMUX_TYPE blockMux = portMUX_INITIALIZER_UNLOCKED;
+
+static uint32_t blockCrc() {
+  return esp_rom_crc32_le(0, (const uint8_t*)&block, offsetof(StateBlock, crc));
+}
+
+static void seal() {
+  block.crc = blockCrc();
+}
+
+RtcStateSource RtcState::begin() {
+  if (block.magic == STATE_MAGIC && block.version == RTC_STATE_VERSION &&
+      block.size == sizeof(StateBlock) && block.crc == blockCrc()) {
+    return STATE_FROM_RTC;
+  }
+
+  memset(&block, 0, sizeof(block));
+  block.magic = STATE_MAGIC;
+  block.version = RTC_STATE_VERSION;
+  block.size = sizeof(StateBlock);
+
+  RtcStateSource source = STATE_DEFAULTS;
+  Preferences prefs;
+  if (prefs.begin(NVS_NAMESPACE, true)) {
+    NvsRecord record;
+    if (prefs.getBytesLength(NVS_KEY) == sizeof(record) &&
+        prefs.getBytes(NVS_KEY, &record, sizeof(record)) == sizeof(record) &&
+        record.version == DURABLE_STATE_VERSION) {
+      block.durable = record.durable;
+      block.stored = record.durable;
+      block.storedValid = true;
+      source = STATE_FROM_NVS;
+    }
+    prefs.end();
+  }
+  seal();
+
+  Serial.println(source == STATE_FROM_NVS ? "[State] RTC state lost, restored from NVS"
+                                          : "[State] No saved state, using defaults");
+  return source;
+}
+
+DurableState& RtcState::durable() {
+  return block.durable;
+}
+
+CachedState& RtcState::cached() {
+  return block.cached;
+}
+
+void RtcState::lock() {
+  portENTER_CRITICAL(&blockMux);
+}
+
+void RtcState::unlock() {
+  portEXIT_CRITICAL(&blockMux);
+}
+
+void RtcState::flush() {
+  // Snapshot what gets written; stored records that snapshot, so a change
+  // made during the NVS write is still different and goes out next time
+  NvsRecord record;
+  memset(&record, 0, sizeof(record));
+  record.version = DURABLE_STATE_VERSION;
+  lock();
+  record.durable = block.durable;
+  bool changed = !block.storedValid || memcmp(&record.durable, &block.stored, sizeof(DurableState)) != 0;
+  unlock();
+
+  if (changed) {
+    Preferences prefs;
+    if (prefs.begin(NVS_NAMESPACE, false)) {
+      if (prefs.putBytes(NVS_KEY, &record, sizeof(record)) == sizeof(record)) {
+        lock();
+        block.stored = record.durable;
+        block.storedValid = true;
+        unlock();
+        metric::stateNvsWrites.inc();
+      } else {
+        Serial.println("[State] NVS write failed");
+      }
+      prefs.end();
+    }
+  }
+  lock();
+  seal();
+  unlock();
+}
+
+void RtcState::end() {
+  flush();
+}
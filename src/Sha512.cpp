@@ -0,0 +1,87 @@
+#include "Sha512.h"
+#include <mbedtls/md.h>
+
+// The original ESP32's engine hashes a whole message per call. mbedtls uses
+// the same engine, but per block and only while no other context holds it;
+// a second concurrent context (parallel DoLynk requests) runs in software.
+#if CONFIG_IDF_TARGET_ESP32 && CONFIG_MBEDTLS_HARDWARE_SHA
+#include <sha/sha_parallel_engine.h>
+#define SHA512_ENGINE 1
+#else
+#define SHA512_ENGINE 0
+#endif
+
+/* =========================================================
+   MBEDTLS
+   ========================================================= */
+void Sha512::hashMbedtls(const void* data, size_t len, uint8_t out[SHA512_DIGEST_SIZE]) {
+  mbedtls_md_context_t ctx;
+  mbedtls_md_init(&ctx);
+  mbedtls_md_setup(&ctx, mbedtls_md_info_from_type(MBEDTLS_MD_SHA512), 0);
+  mbedtls_md_starts(&ctx);
+  mbedtls_md_update(&ctx, (const unsigned char*)data, len);
+  mbedtls_md_finish(&ctx, out);
+  mbedtls_md_free(&ctx);
+}
+
+void Sha512::hmacMbedtls(const char* key, size_t keyLen, const char* const* parts, const size_t* lengths,
+                         int count, uint8_t out[SHA512_DIGEST_SIZE]) {
+  mbedtls_md_context_t ctx;
+  mbedtls_md_init(&ctx);
+  mbedtls_md_setup(&ctx, mbedtls_md_info_from_type(MBEDTLS_MD_SHA512), 1);
+  mbedtls_md_hmac_starts(&ctx, (const unsigned char*)key, keyLen);
+  for (int i = 0; i < count; i++) {
+    mbedtls_md_hmac_update(&ctx, (const unsigned char*)parts[i], lengths[i]);
+  }
+  mbedtls_md_hmac_finish(&ctx, out);
+  mbedtls_md_free(&ctx);
+}
+
+/* =========================================================
+   ONE PASS
+   ========================================================= */
+bool Sha512::hardware() {
+  return SHA512_ENGINE;
+}
+
+void Sha512::hash(const void* data, size_t len, uint8_t out[SHA512_DIGEST_SIZE]) {
+#if SHA512_ENGINE
+  esp_sha(SHA2_512, (const unsigned char*)data, len, out); // takes the engine lock
+#else
+  hashMbedtls(data, len, out);
+#endif
+}
+
+// HMAC(K, m) = H((K ^ opad) || H((K ^ ipad) || m)), each hash in one pass
+// over a stack buffer, so only two engine calls per signature
+void Sha512::hmac(const char* key, size_t keyLen, const char* const* parts, const size_t* lengths, int count,
+                  uint8_t out[SHA512_DIGEST_SIZE]) {
+  size_t total = 0;
+  for (int i = 0; i < count; i++) total += lengths[i];
+  if (total > SHA512_HMAC_INLINE_MAX) {
+    hmacMbedtls(key, keyLen, parts, lengths, count, out);
+    return;
+  }
+
+  uint8_t keyBlock[SHA512_BLOCK_SIZE] = {};
+  if (keyLen > SHA512_BLOCK_SIZE) hash(key, keyLen, keyBlock);
+  else memcpy(keyBlock, key, keyLen);
+
+  uint8_t buf[SHA512_BLOCK_SIZE + SHA512_HMAC_INLINE_MAX];
+  for (int i = 0; i < SHA512_BLOCK_SIZE; i++) buf[i] = keyBlock[i] ^ 0x36;
+  size_t len = SHA512_BLOCK_SIZE;
+  for (int i = 0; i < count; i++) {
+    memcpy(buf + len, parts[i], lengths[i]);
+    len += lengths[i];
+  }
+  uint8_t inner[SHA512_DIGEST_SIZE];
+  hash(buf, len, inner);
+
+  for (int i = 0; i < SHA512_BLOCK_SIZE; i++) buf[i] = keyBlock[i] ^ 0x5C;
+  memcpy(buf + SHA512_BLOCK_SIZE, inner, sizeof(inner));
+  hash(buf, SHA512_BLOCK_SIZE + sizeof(inner), out);
+
+  // The pads are the key in thin disguise
+  memset(keyBlock, 0, sizeof(keyBlock));
+  memset(buf, 0, SHA512_BLOCK_SIZE);
+}
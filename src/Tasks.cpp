@@ -0,0 +1,132 @@
+#include "Tasks.h"
+#include "Metrics.h"
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+
+enum TaskId { TASK_UI, TASK_NET, TASK_NOTIFY, TASK_COUNT };
+
+struct TaskSlot {
+  const char* name;
+  uint32_t stack;
+  UBaseType_t priority;
+  BaseType_t core;
+  Gauge* stackFree;
+  TaskHandle_t handle;     // while running
+  UBaseType_t lowWater;    // bytes never used, as the task stopped
+};
+
+static TaskSlot slots[TASK_COUNT] = {
+  { "ui", UI_TASK_STACK, UI_TASK_PRIORITY, UI_TASK_CORE, &metric::stackFreeUi, nullptr, 0 },
+  { "net", NET_TASK_STACK, NET_TASK_PRIORITY, NET_TASK_CORE, &metric::stackFreeNet, nullptr, 0 },
+  { "notify", NOTIFY_TASK_STACK, NOTIFY_TASK_PRIORITY, NET_TASK_CORE, &metric::stackFreeNotify, nullptr, 0 },
+};
+
+// The notification queue carries a stop marker so it drains before sleep
+struct NotifyItem {
+  bool stop;
+  Notification note;
+};
+
+static TaskHandlers handlers = {};
+static QueueHandle_t uiQueue = nullptr;
+static QueueHandle_t netQueue = nullptr;
+static QueueHandle_t notifyQueue = nullptr;
+static SemaphoreHandle_t stopped = nullptr; // given by each task that stops
+
+/* =========================================================
+   TASKS
+   ========================================================= */
+// Record the high-water mark while the handle is still valid, then go
+static void stop(TaskId id) {
+  slots[id].lowWater = uxTaskGetStackHighWaterMark(NULL);
+  slots[id].handle = nullptr;
+  xSemaphoreGive(stopped);
+  vTaskDelete(NULL);
+}
+
+static void uiTask(void*) {
+  for (;;) handlers.ui(); // sleeps from inside, never returns
+}
+
+static void netTask(void*) {
+  NetMessage msg;
+  for (;;) {
+    if (xQueueReceive(netQueue, &msg, pdMS_TO_TICKS(NET_POLL_MS)) == pdTRUE) {
+      handlers.network(msg);
+      if (msg.command == NET_SLEEP) break;
+    }
+    handlers.networkIdle();
+  }
+  stop(TASK_NET);
+}
+
+static void notifyTask(void*) {
+  NotifyItem item;
+  while (xQueueReceive(notifyQueue, &item, portMAX_DELAY) == pdTRUE && !item.stop) {
+    handlers.notify(item.note);
+  }
+  stop(TASK_NOTIFY);
+}
+
+/* =========================================================
+   PUBLIC API
+   ========================================================= */
+bool Tasks::begin(const TaskHandlers& h) {
+  handlers = h;
+  uiQueue = xQueueCreate(UI_QUEUE_DEPTH, sizeof(UiMessage));
+  netQueue = xQueueCreate(NET_QUEUE_DEPTH, sizeof(NetMessage));
+  notifyQueue = xQueueCreate(NOTIFY_QUEUE_DEPTH, sizeof(NotifyItem));
+  stopped = xSemaphoreCreateCounting(TASK_COUNT, 0);
+  if (!uiQueue || !netQueue || !notifyQueue || !stopped) return false;
+
+  static const TaskFunction_t functions[TASK_COUNT] = { uiTask, netTask, notifyTask };
+  // Workers first, so the UI never posts to a task that isn't there
+  for (int i = TASK_COUNT - 1; i >= 0; i--) {
+    TaskSlot& t = slots[i];
+    if (xTaskCreatePinnedToCore(functions[i], t.name, t.stack, nullptr, t.priority, &t.handle, t.core) != pdPASS) {
+      Serial.printf("[Tasks] Can't start the %s task\n", t.name);
+      return false;
+    }
+  }
+  return true;
+}
+
+bool Tasks::post(const UiMessage& msg) {
+  return uiQueue && xQueueSend(uiQueue, &msg, 0) == pdTRUE;
+}
+
+bool Tasks::post(const NetMessage& msg) {
+  return netQueue && xQueueSend(netQueue, &msg, 0) == pdTRUE;
+}
+
+bool Tasks::post(const Notification& note) {
+  NotifyItem item = { false, note };
+  return notifyQueue && xQueueSend(notifyQueue, &item, 0) == pdTRUE;
+}
+
+bool Tasks::receive(UiMessage& msg) {
+  return uiQueue && xQueueReceive(uiQueue, &msg, 0) == pdTRUE;
+}
+
+void Tasks::sample() {
+  for (TaskSlot& t : slots) {
+    if (t.handle) t.lowWater = uxTaskGetStackHighWaterMark(t.handle);
+    t.stackFree->set(t.lowWater);
+  }
+}
+
+void Tasks::end() {
+  if (!netQueue) return; // headless wake, no tasks
+  // The network task may still post notifications until it stops
+  NetMessage sleep = { NET_SLEEP, false, millis() };
+  xQueueSend(netQueue, &sleep, portMAX_DELAY);
+  xSemaphoreTake(stopped, portMAX_DELAY);
+  NotifyItem last = { true, {} };
+  xQueueSend(notifyQueue, &last, portMAX_DELAY);
+  xSemaphoreTake(stopped, portMAX_DELAY);
+
+  sample();
+  Serial.printf("[Tasks] Stack never used: ui %u B, net %u B, notify %u B\n",
+                (unsigned)slots[TASK_UI].lowWater, (unsigned)slots[TASK_NET].lowWater,
+                (unsigned)slots[TASK_NOTIFY].lowWater);
+}
@@ -0,0 +1,36 @@
+#include "Warmup.h"
+#include "LockLink.h"
+#include "Metrics.h"
+#include "WifiStatus.h"
+
+enum WarmupState { WARMUP_IDLE, WARMUP_READY, WARMUP_FAILED };
+
+static WarmupState state = WARMUP_IDLE;
+static bool ownsRadio = false; // WiFi was down when it started, so abandoning turns it off
+
+void Warmup::start() {
+#if LINK_ROLE != LINK_GATEWAY
+  if (state == WARMUP_READY) return;
+  if (state == WARMUP_FAILED) metric::warmupFailed.inc(); // try again
+
+  unsigned long start = millis();
+  if (state == WARMUP_IDLE) ownsRadio = !WifiStatus::isWifiConnected();
+  state = LockLink::prepare() ? WARMUP_READY : WARMUP_FAILED;
+  Serial.printf("[Warmup] %s in %lu ms\n", state == WARMUP_READY ? "Ready" : "Failed", millis() - start);
+#endif
+}
+
+bool Warmup::finish() {
+  bool ready = state == WARMUP_READY;
+  if (state != WARMUP_IDLE) (ready ? metric::warmupUsed : metric::warmupFailed).inc();
+  state = WARMUP_IDLE;
+  return ready;
+}
+
+void Warmup::abandon() {
+  if (state == WARMUP_IDLE) return;
+  LockLink::release(ownsRadio); // a failed warm-up may have got part of the way
+  (state == WARMUP_READY ? metric::warmupAbandoned : metric::warmupFailed).inc();
+  Serial.println("[Warmup] Abandoned");
+  state = WARMUP_IDLE;
+}
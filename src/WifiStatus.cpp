@@ -1,7 +1,12 @@
 #include "WifiStatus.h"
 #include "setup.h"
+#include "CpuPower.h"
+#include "Metrics.h"
+#include "RtcState.h"
+#include "LockLink.h"
 #include <WiFi.h>
 #include <HTTPClient.h>
+#include <atomic>
 
 // Cloud service endpoint (update with your actual cloud service URL)
 #define CLOUD_ENDPOINT "https://your-cloud-service.com/api/device/status"
@@ -10,34 +15,284 @@
 bool cloudConnected = false;
 unsigned long lastStatusUpdate = 0;
 
+struct WifiNetwork {
+  const char* ssid;
+  const char* password;
+};
+
+static const WifiNetwork networks[] = WIFI_NETWORKS;
+static const uint8_t networkCount = sizeof(networks) / sizeof(networks[0]);
+
+static WifiApEntry (&aps)[WIFI_AP_HISTORY] = RtcState::cached().wifiAps;
+static uint8_t& preferred = RtcState::cached().wifiPreferred; // index + 1 into aps, 0: none yet
+
+// This boot
+static WifiApEntry* current = nullptr; // access point joined
+static std::atomic<uint32_t> requestSumMs(0), requestCount(0); // over current, not yet averaged in
+static unsigned long lastCheckAt = 0;
+static unsigned long lastScanAt = 0;
+static bool scanning = false;
+
+/* =========================================================
+   ACCESS POINT STATISTICS
+   ========================================================= */
+static void formatBssid(const uint8_t* bssid, char out[18]) {
+  snprintf(out, 18, "%02x:%02x:%02x:%02x:%02x:%02x", bssid[0], bssid[1], bssid[2], bssid[3], bssid[4], bssid[5]);
+}
+
+static int networkOf(const char* ssid) {
+  for (int i = 0; i < networkCount; i++) {
+    if (strcmp(networks[i].ssid, ssid) == 0) return i;
+  }
+  return -1;
+}
+
+static WifiApEntry* find(const uint8_t* bssid) {
+  for (WifiApEntry& ap : aps) {
+    if (ap.channel && memcmp(ap.bssid, bssid, 6) == 0) return &ap;
+  }
+  return nullptr;
+}
+
+// The entry for an access point: its own, a free one, else the weakest
+// other than the one in use
+static WifiApEntry* remember(const uint8_t* bssid, uint8_t network, uint8_t channel, int8_t rssi) {
+  WifiApEntry* e = find(bssid);
+  if (!e) {
+    for (WifiApEntry& ap : aps) {
+      if (&ap == current) continue;
+      if (!ap.channel) {
+        e = &ap;
+        break;
+      }
+      if (!e || ap.rssi < e->rssi) e = &ap;
+    }
+    if (preferred == e - aps + 1) preferred = 0;
+    memset(e, 0, sizeof(*e));
+    memcpy(e->bssid, bssid, 6);
+  }
+  e->network = network;
+  e->channel = channel;
+  e->rssi = rssi;
+  return e;
+}
+
+static uint16_t average(uint16_t avg, uint16_t samples, uint32_t value) {
+  return samples ? (avg * 3 + value) / 4 : value;
+}
+
+// Average this boot's requests over the current access point into its entry
+static void foldRequests() {
+  uint32_t n = requestCount.exchange(0), sumMs = requestSumMs.exchange(0);
+  if (!current || !n) return;
+  current->requestMs = average(current->requestMs, current->requests, sumMs / n);
+  current->requests = min((uint32_t)current->requests + n, (uint32_t)UINT16_MAX);
+  metric::wifiApRequestMs.set(current->requestMs);
+}
+
+static void printAp(const char* what, const WifiApEntry& ap, int rssi) {
+  char bssid[18];
+  formatBssid(ap.bssid, bssid);
+  Serial.printf("[WifiStatus] %s %s %s ch %u, %d dBm: %u connects avg %u ms, %u requests avg %u ms\n",
+                what, networks[ap.network].ssid, bssid, ap.channel, rssi, ap.connects, ap.connectMs,
+                ap.requests, ap.requestMs);
+}
+
+/* =========================================================
+   SELECTION
+   ========================================================= */
+// Strong access points (WIFI_ROAM_RSSI or better) by network priority, then
+// signal; weak ones after every strong one, by signal alone
+static int32_t rank(int network, int rssi) {
+  return rssi >= WIFI_ROAM_RSSI ? (networkCount - network) * 256 + rssi + 128 : rssi - 128;
+}
+
+// Best access point in the scan results on the given channel (0: any),
+// skipping ones that failed WIFI_AP_MAX_FAILURES times in a row
+static WifiApEntry* choose(int found, uint8_t channel) {
+  int best = -1, bestNetwork = 0;
+  for (int i = 0; i < found; i++) {
+    int network = networkOf(WiFi.SSID(i).c_str());
+    if (network < 0 || (channel && WiFi.channel(i) != channel)) continue;
+    WifiApEntry* known = find(WiFi.BSSID(i));
+    if (known) known->rssi = WiFi.RSSI(i);
+    if (known && known->failures >= WIFI_AP_MAX_FAILURES) continue;
+    if (best < 0 || rank(network, WiFi.RSSI(i)) > rank(bestNetwork, WiFi.RSSI(best))) {
+      best = i;
+      bestNetwork = network;
+    }
+  }
+  if (best < 0) return nullptr;
+
+  WifiApEntry* chosen = remember(WiFi.BSSID(best), bestNetwork, WiFi.channel(best), WiFi.RSSI(best));
+  for (const WifiApEntry& ap : aps) {
+    if (ap.channel) printAp(&ap == chosen ? "Best" : "Known", ap, ap.rssi);
+  }
+  return chosen;
+}
+
+static int scan() {
+  metric::wifiScans.inc();
+  return WiFi.scanNetworks(false, false, false, WIFI_SCAN_MS_PER_CHANNEL);
+}
+
+/* =========================================================
+   CONNECTING
+   ========================================================= */
+// Count a successful connect against the access point's entry
+static void joined(WifiApEntry& ap, uint32_t took) {
+  ap.connectMs = average(ap.connectMs, ap.connects, took);
+  if (ap.connects < UINT16_MAX) ap.connects++;
+  ap.failures = 0;
+  ap.rssi = WiFi.RSSI();
+  current = &ap;
+  preferred = &ap - aps + 1;
+  metric::wifiConnectMs.observe(took);
+  metric::wifiApConnectMs.set(ap.connectMs);
+  metric::wifiApRequestMs.set(ap.requestMs);
+  printAp("Joined", ap, ap.rssi);
+}
+
+// Associate with one access point, skipping the scan
+static bool join(WifiApEntry& ap, uint32_t timeoutMs) {
+  const WifiNetwork& network = networks[ap.network];
+  unsigned long start = millis();
+  WiFi.begin(network.ssid, network.password, ap.channel, ap.bssid);
+  while (WiFi.status() != WL_CONNECTED && (millis() - start) < timeoutMs) {
+    delay(50);
+  }
+  if (WiFi.status() != WL_CONNECTED) {
+    if (ap.failures < UINT8_MAX) ap.failures++;
+    WiFi.disconnect();
+    return false;
+  }
+  joined(ap, millis() - start);
+  return true;
+}
+
+// Let the driver find the first network itself (e.g. a hidden SSID)
+static bool joinAny() {
+  WiFi.begin(networks[0].ssid, networks[0].password);
+  unsigned long startTime = millis();
+  while (WiFi.status() != WL_CONNECTED && (millis() - startTime) < WIFI_TIMEOUT) {
+    delay(100);
+  }
+  if (WiFi.status() != WL_CONNECTED) return false;
+  int network = networkOf(WiFi.SSID().c_str());
+  joined(*remember(WiFi.BSSID(), network < 0 ? 0 : network, WiFi.channel(), WiFi.RSSI()), millis() - startTime);
+  return true;
+}
+
 /**
  * Initialize WiFi connection for cloud communication
  */
 bool WifiStatus::initWiFi() {
   Serial.println("\n[WifiStatus] Connecting to WiFi...");
-  
+
+  CpuPower::radio(true);
   WiFi.mode(WIFI_STA);
-  WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
-  
-  unsigned long startTime = millis();
-  while (WiFi.status() != WL_CONNECTED && (millis() - startTime) < WIFI_TIMEOUT) {
-    delay(500);
-    Serial.print(".");
-  }
-  
-  if (WiFi.status() == WL_CONNECTED) {
-    Serial.println("\n[WifiStatus] WiFi Connected!");
-    // Serial.print("[WifiStatus] IP Address: ");
-    // Serial.println(WiFi.localIP());
+  current = nullptr;
+  lastCheckAt = millis();
+
+  // Straight to last time's access point while it keeps working
+  WifiApEntry* known = preferred ? &aps[preferred - 1] : nullptr;
+  bool connected = false;
+  if (known && known->channel && known->network < networkCount && known->failures < WIFI_AP_MAX_FAILURES) {
+    connected = join(*known, WIFI_KNOWN_AP_TIMEOUT);
+    if (connected) metric::wifiConnectsKnown.inc();
+    else Serial.println("[WifiStatus] Remembered access point didn't answer - scanning");
+  }
+  if (!connected) {
+    WifiApEntry* best = choose(scan(), 0);
+    WiFi.scanDelete();
+    connected = best ? join(*best, WIFI_TIMEOUT) : joinAny();
+    if (connected) metric::wifiConnectsScanned.inc();
+  }
+
+  if (connected) {
+    Serial.println("[WifiStatus] WiFi Connected!");
     cloudConnected = true;
     return true;
   } else {
-    Serial.println("\n[WifiStatus] WiFi Connection Failed");
+    Serial.println("[WifiStatus] WiFi Connection Failed");
     cloudConnected = false;
     return false;
   }
 }
 
+/**
+ * Connect and set the clock, unless that was already done. The RTC keeps
+ * the time through deep sleep, so NTP is only waited for after power-on.
+ */
+bool WifiStatus::ensureOnline() {
+  if (!isWifiConnected() && !initWiFi()) return false;
+  if (time(nullptr) >= 1000000000) return true;
+
+  configTime(0, 0, NTP_SERVER);
+  unsigned long startTime = millis();
+  while (time(nullptr) < 1000000000 && (millis() - startTime) < WIFI_TIMEOUT) {
+    delay(100);
+  }
+  if (time(nullptr) < 1000000000) {
+    Serial.println("[WifiStatus] No answer from NTP");
+    return false;
+  }
+  return true;
+}
+
+/* =========================================================
+   ROAMING
+   ========================================================= */
+// Move to the best access point of a finished scan if it beats the current
+// one by WIFI_ROAM_MARGIN_DB. A gateway stays on its channel, which its
+// leaves are tuned to.
+static void roam(int found) {
+  int rssi = WiFi.RSSI();
+  uint8_t channel = 0;
+#if LINK_ROLE == LINK_GATEWAY
+  channel = current->channel;
+#endif
+  WifiApEntry* best = choose(found, channel);
+  if (!best || best == current || best->rssi < rssi + WIFI_ROAM_MARGIN_DB) return;
+
+  WifiApEntry* from = current;
+  Serial.printf("[WifiStatus] Roaming: %d dBm here, %d dBm there\n", rssi, best->rssi);
+  foldRequests();
+  WiFi.disconnect();
+  current = nullptr;
+  if (join(*best, WIFI_TIMEOUT)) {
+    metric::wifiRoams.inc();
+    return;
+  }
+  join(*from, WIFI_TIMEOUT); // back to where it was
+}
+
+void WifiStatus::handle() {
+  if (scanning) {
+    int found = WiFi.scanComplete();
+    if (found == WIFI_SCAN_RUNNING) return;
+    scanning = false;
+    if (found > 0 && current && isWifiConnected()) roam(found);
+    WiFi.scanDelete();
+    return;
+  }
+
+  if (!current || !isWifiConnected() || millis() - lastCheckAt < WIFI_ROAM_CHECK_MS) return;
+  lastCheckAt = millis();
+  current->rssi = WiFi.RSSI();
+  if (current->rssi >= WIFI_ROAM_RSSI) return;
+  if (lastScanAt && millis() - lastScanAt < WIFI_ROAM_SCAN_MS) return;
+
+  lastScanAt = millis();
+  metric::wifiScans.inc();
+  scanning = WiFi.scanNetworks(true, false, false, WIFI_SCAN_MS_PER_CHANNEL) == WIFI_SCAN_RUNNING;
+}
+
+void WifiStatus::noteRequest(uint32_t ms) {
+  requestSumMs.fetch_add(ms, std::memory_order_relaxed);
+  requestCount.fetch_add(1, std::memory_order_relaxed);
+}
+
 /**
  * Check if cloud connection is active
  */
@@ -56,7 +311,16 @@ int WifiStatus::getSignalStrength() {
  * Disconnect from cloud/WiFi
  */
 void WifiStatus::disconnect() {
+  foldRequests();
+  if (scanning) WiFi.scanDelete();
+  scanning = false;
+  current = nullptr;
   WiFi.disconnect(true); // true to turn off WiFi radio
+  CpuPower::radio(false);
   cloudConnected = false;
   Serial.println("[WifiStatus] Disconnected from WiFi");
 }
+
+void WifiStatus::end() {
+  foldRequests();
+}
@@ -1,9 +1,22 @@
 #include <Keypad.h>
+#include <StaticKeypad.h>
 #include <driver/rtc_io.h> // Required for pin holding
 #include "setup.h"
 #include "WifiStatus.h"
 #include "Mailtrap.h"
 #include "Dolynk.h"
+#include "LedEngine.h"
+#include "Ota.h"
+#include "Metrics.h"
+#include "RtcState.h"
+#include "Maintenance.h"
+#include "DnsCache.h"
+#include "LockLink.h"
+#include "CpuPower.h"
+#include "LocalApi.h"
+#include "Warmup.h"
+#include "Tasks.h"
+#include "AuditLog.h"
 
 #define TARGET_BOARD_ESP32
 
@@ -14,10 +27,18 @@ const unsigned long SLEEP_TIMEOUT = 60000; //60 seconds of inactivity
 /* =========================================================
   FUNCTION DECLARATIONS
    ========================================================= */
+void uiLoop();
+void networkMessage(const NetMessage& msg);
+void networkIdle();
+void serialConsole();
+void sendNotification(const Notification& note);
 void updateLEDs();
-void handlePasswordToggle();
+void handlePasswordToggle(unsigned long pressedAt);
+void setLockState(bool locked, const char* source);
+void requestSync(unsigned long requestedAt, bool local);
+void syncLockState(unsigned long requestedAt, bool local);
+bool handleLocalLock(bool locked);
 void enterDeepSleep();
-void flashLED(int pin, int times);
 
 /* =========================================================
    PIN CONFIG
@@ -32,25 +53,30 @@ void flashLED(int pin, int times);
 #define ROWS 4
 #define COLS 4
 
-char keymap[ROWS][COLS] = {
+#define ROW_PINS 16,17,18,13
+#define COL_PINS 26,25,33,32 // Column 4 (GPIO32) is the wake-up pin
+
+constexpr char keymap[ROWS][COLS] = {
   {'1','2','3','A'},
   {'4','5','6','B'},
   {'7','8','9','C'},
   {'*','0','#','D'}
 };
 
-byte rowPins[ROWS] = {16,17,18,13};
-byte colPins[COLS] = {26,25,33,32}; // Column 4 (GPIO32) is the wake-up pin
+byte rowPins[ROWS] = {ROW_PINS};
+byte colPins[COLS] = {COL_PINS};
 
-Keypad keypad = Keypad(makeKeymap(keymap), rowPins, colPins, ROWS, COLS);
+// Geometry, keymap and pins are fixed, so use the compile-time specialised keypad
+StaticKeypad<ROWS, COLS, keymap, ROW_PINS, COL_PINS> keypad;
 
 /* =========================================================
    PASSWORD CONFIG
    ========================================================= */
 String enteredPassword;
-RTC_DATA_ATTR bool isLocked = false; // Persists in RTC memory during sleep
+bool& isLocked = RtcState::durable().locked; // Survives sleep (RTC) and power loss (NVS); UI task writes it
 unsigned long lastPasswordInputTime = 0;
 const unsigned long PASSWORD_TIMEOUT = 30000; // 30 seconds
+uint8_t syncsPending = 0; // syncs handed to the network task and not finished yet; UI task only
 
 /* =========================================================
    LED STATE ENUM
@@ -66,9 +92,23 @@ void setup() {
   rtc_gpio_pulldown_dis(GPIO_NUM_26); // Disable the sleep pulldown
 
   Serial.begin(115200);
+  CpuPower::begin(); // idle clock until something CPU-bound runs
   delay(500); // Let serial stabilize
-  Serial.println("\n\n=== System Waking Up ===");
+  esp_sleep_wakeup_cause_t wakeCause = esp_sleep_get_wakeup_cause();
+
+  // Timer wakes are headless: no keypad or LEDs, just the queued network work
+  if (wakeCause == ESP_SLEEP_WAKEUP_TIMER) {
+    Serial.println("\n\n=== Maintenance Wake ===");
+    RtcState::begin();
+    Metrics::begin();
+    Maintenance::run();
+    enterDeepSleep();
+  }
 
+  Serial.println("\n\n=== System Waking Up ===");
+  RtcState::begin();
+  AuditLog::begin();
+  for (int i = 0; i < ROWS * COLS; i++) keypad.setChatterScore(i, RtcState::cached().keyChatter[i]);
 
   // Configure col pins as inputs with pull-ups (they become high when not pressed)
   for (int i = 0; i < COLS; i++) {
@@ -81,55 +121,70 @@ void setup() {
     digitalWrite(rowPins[i], HIGH);
   }
 
-  pinMode(GREEN_PIN, OUTPUT);
-  pinMode(YELLOW_PIN, OUTPUT);
-  pinMode(RED_PIN, OUTPUT);
+  LedEngine::begin(GREEN_PIN, YELLOW_PIN, RED_PIN);
 
-  //Turn on yellow LED during setup
-  digitalWrite(YELLOW_PIN, HIGH);
+  // Pulse yellow LED during setup
+  LedEngine::set(LED_YELLOW, LED_PULSE);
 
-  WifiStatus::initWiFi();
   enteredPassword.reserve(16);
   enteredPassword = ""; // Clear password on wake (start fresh)
 
-    configTime(0, 0, "pool.ntp.org");
-    while (time(nullptr) < 1000000000) delay(500);
-
-  delay(1000); // Wait for initialization to complete
-  
-  // === TOGGLE HERE ===
-  if (isLocked){
-    toggle_alarms("on");
-  } else {
-    toggle_alarms("off");
+  // Key wakes leave the radio off; only a lock change needs the network.
+  // After power-on (or a restart) everything is due at once.
+  if (wakeCause != ESP_SLEEP_WAKEUP_EXT0) {
+    Maintenance::defer(JOB_ALL);
+    Maintenance::run();
+    if (wakeCause == ESP_SLEEP_WAKEUP_UNDEFINED) AuditLog::record(AUDIT_POWER_ON, AUDIT_SLOT_NONE, AUDIT_OK);
   }
-
+  LockLink::begin();
   
   Serial.print("System initialized - Lock state: ");
   Serial.println(isLocked ? "LOCKED" : "UNLOCKED");
-  // Turn off yellow LED after setup
-  if (!WifiStatus::isWifiConnected()) {
-    //flash red LED 3 times
-    flashLED(RED_PIN, 3);
+  // Turn off yellow LED after setup; the boot flashes run in the background
+  if (!Maintenance::lastRunOk()) {
+    //flash red LED 3 times: the last background sync failed
+    LedEngine::blink(LED_RED, 3);
   }else{
     //flash green LED 3 times
-    flashLED(GREEN_PIN, 3);
+    LedEngine::blink(LED_GREEN, 3);
   }
-  digitalWrite(YELLOW_PIN, LOW);
   updateLEDs();
 
+  Metrics::begin();
+  LocalApi::begin(handleLocalLock);
+
   lastActivityTime = millis(); // Reset timer on boot
+  Ota::confirmBoot(); // this image boots fine, no rollback needed
+
+  // From here on the keypad, the network and email each have their own task
+  if (!Tasks::begin({ uiLoop, networkMessage, networkIdle, sendNotification })) {
+    Serial.println("Can't start tasks - restarting");
+    ESP.restart();
+  }
 }
 
 /* =========================================================
    LOOP
    ========================================================= */
+// The Arduino loop task isn't needed once setup() has started the tasks
 void loop() {
+  vTaskDelete(NULL);
+}
+
+/* =========================================================
+   UI TASK
+   ========================================================= */
+// One pass of the keypad loop. Never waits on the network: lock changes go
+// to the network task as messages.
+void uiLoop() {
+#if LINK_ROLE != LINK_GATEWAY
   // Check for inactivity timeout (do this before returning)
   if (millis() - lastActivityTime > SLEEP_TIMEOUT) {
     Serial.println("Timeout - entering sleep");
+    for (int i = 0; i < ROWS * COLS; i++) RtcState::cached().keyChatter[i] = keypad.chatterScore(i);
     enterDeepSleep();
   }
+#endif
 
   // Scan keypad - this must happen every loop
   char key = keypad.getKey();
@@ -137,8 +192,10 @@ void loop() {
   if (key) {
     // Key was pressed
     lastActivityTime = millis(); // Reset inactivity timer
+    metric::keypadKeys.inc();
+    LocalApi::publish("key"); // which key stays private
     
-    flashLED(YELLOW_PIN, 1);
+    LedEngine::blink(LED_YELLOW, 1);
     
     // Handle special keys
     switch (key) {
@@ -148,18 +205,21 @@ void loop() {
         break;
 
       case '#': // submit password to toggle lock/unlock
-        handlePasswordToggle();
+        handlePasswordToggle(keypad.pressedAt()); // contact, not debounced, so latencies include the debounce
         enteredPassword = ""; // always clear after #
         break;
 
-      default: // regular key
+      default: { // regular key
+        // Get the network ready while the PIN is typed
+        if (enteredPassword == "") Tasks::post(NetMessage{ NET_WARMUP, false, 0 });
         enteredPassword += key;
-        Serial.print("Key pressed: ");
-        for (int i = 0; i < enteredPassword.length(); i++) {
-          Serial.print("#");
-        }
-        Serial.println();
+        char masked[24];
+        size_t n = min((size_t)enteredPassword.length(), sizeof(masked) - 1);
+        memset(masked, '#', n);
+        masked[n] = '\0';
+        Serial.printf("Key pressed: %s\n", masked); // one write, so other tasks' output can't split it
         break;
+      }
     }
   }
     
@@ -175,40 +235,201 @@ void loop() {
   if (enteredPassword != "" && millis() - lastPasswordInputTime > PASSWORD_TIMEOUT) {
     Serial.println("Password entry timeout - clearing");
     enteredPassword = "";
+    AuditLog::record(AUDIT_PIN, AUDIT_SLOT_NONE, AUDIT_TIMEOUT);
+    Tasks::post(NetMessage{ NET_ABANDON, false, 0 });
+  }
+
+  // Lock commands from the local API, and finished syncs
+  UiMessage command;
+  while (Tasks::receive(command)) {
+    if (command.command == UI_SYNCED) {
+      if (syncsPending) syncsPending--;
+      continue;
+    }
+    lastActivityTime = millis(); // stay awake for the sync
+    if (command.locked == isLocked) continue;
+    setLockState(command.locked, "api");
+    AuditLog::record(isLocked ? AUDIT_LOCK : AUDIT_UNLOCK, AUDIT_SLOT_API, AUDIT_OK);
+    requestSync(command.requestedAt, true);
   }
 
-  delay(100); //Simple debounce for keypad
+  delay(1); // yield; the keypad scans and debounces on its own schedule
+}
+
+/* =========================================================
+   NETWORK TASK
+   ========================================================= */
+void networkMessage(const NetMessage& msg) {
+  switch (msg.command) {
+    case NET_WARMUP:
+      Warmup::start();
+      break;
+    case NET_ABANDON:
+      Warmup::abandon();
+      break;
+    case NET_SYNC:
+      syncLockState(msg.requestedAt, msg.local);
+      break;
+    case NET_SLEEP:
+      Warmup::abandon();
+      LocalApi::end(); // its subscribers hear about it from this task
+      break;
+  }
+}
+
+void networkIdle() {
+#if LINK_ROLE == LINK_GATEWAY
+  // Mains powered: stay up for the leaves, maintenance runs from here
+  LockLink::handle();
+  if (Maintenance::due()) Maintenance::run();
+#endif
+  Metrics::handle();
+  LocalApi::handle();
+  WifiStatus::handle();
+  AuditLog::flush();
+  serialConsole();
+}
+
+// Console commands, one per line:
+//   audit [FROM [TO]]  the audit log as CSV; FROM and TO are Unix seconds
+void serialConsole() {
+  static char line[40];
+  static size_t len = 0;
+  while (Serial.available()) {
+    char c = Serial.read();
+    if (c != '\n' && c != '\r') {
+      if (len < sizeof(line) - 1) line[len++] = c;
+      continue;
+    }
+    line[len] = '\0';
+    len = 0;
+    if (strncmp(line, "audit", 5)) continue;
+
+    unsigned long from = 0, to = UINT32_MAX;
+    sscanf(line + 5, "%lu %lu", &from, &to);
+    AuditLog::exportCsv(from, to, [](void*, const char* data, size_t n) { Serial.write((const uint8_t*)data, n); }, nullptr);
+  }
+}
+
+/* =========================================================
+   NOTIFICATION TASK
+   ========================================================= */
+void sendNotification(const Notification& note) {
+  // Only sent after a sync, which brought WiFi up if it could
+  if (!WifiStatus::isWifiConnected()) {
+    Serial.println("[Mailtrap] Offline - lock status email not sent");
+    return;
+  }
+  Mailtrap::sendLockStatusEmail(MAILTRAP_RECIPIENT, "Admin", note.locked);
 }
 
 /* =========================================================
    HANDLE PASSWORD TOGGLE
    ========================================================= */
-void handlePasswordToggle() {
+void handlePasswordToggle(unsigned long pressedAt) {
   if (enteredPassword != DEVICE_PASSWORD) {
     Serial.println("ACCESS DENIED, wrong password!!");
+    metric::passwordDenied.inc();
+    AuditLog::record(AUDIT_PIN, AUDIT_SLOT_NONE, AUDIT_DENIED);
+    LocalApi::publish("password", "\"accepted\":false");
+    Tasks::post(NetMessage{ NET_ABANDON, false, 0 });
     return; // do nothing if password is wrong
   }
 
   // correct password → toggle lock
-  isLocked = !isLocked;
-
-  if (isLocked){
-    toggle_alarms("on");
-    Serial.println("SITE LOCKED");
-  //   Mailtrap::sendLockStatusEmail(
-  //     MAILTRAP_RECIPIENT, 
-  //     "Admin",
-  //     true
-  //   );
+  metric::passwordAccepted.inc();
+  LocalApi::publish("password", "\"accepted\":true");
+  setLockState(!isLocked, "keypad");
+  AuditLog::record(isLocked ? AUDIT_LOCK : AUDIT_UNLOCK, 0, AUDIT_OK); // slot 0: DEVICE_PASSWORD
+  metric::toggleLocalMs.observe(millis() - pressedAt);
+  requestSync(pressedAt, false);
+}
+
+/* =========================================================
+   LOCAL API LOCK COMMANDS
+   ========================================================= */
+// Runs on the network task. The UI task owns the lock state, so the command
+// goes to it and is applied within a pass of its loop; the reply goes out
+// before the DoLynk sync, so the caller sees the new state within
+// milliseconds.
+bool handleLocalLock(bool locked) {
+  return Tasks::post(UiMessage{ UI_LOCK, locked, millis() }) ? locked : isLocked;
+}
+
+/* =========================================================
+   CHANGE AND SYNC LOCK STATE
+   ========================================================= */
+void setLockState(bool locked, const char* source) {
+  RtcState::lock(); // the network task may be flushing it
+  isLocked = locked;
+  RtcState::unlock();
+
+  // Pulse the new state's LED while connecting and updating DoLynk;
+  // updateLEDs() keeps it pulsing until the network task reports back
+  LedEngine::set(isLocked ? LED_RED : LED_GREEN, LED_PULSE);
+
+  char fields[48];
+  snprintf(fields, sizeof(fields), "\"locked\":%s,\"source\":\"%s\"", isLocked ? "true" : "false", source);
+  LocalApi::publish("state", fields);
+}
+
+// UI task: hand the sync to the network task, or leave it to maintenance
+// if too many are queued already
+void requestSync(unsigned long requestedAt, bool local) {
+  if (Tasks::post(NetMessage{ NET_SYNC, local, requestedAt })) {
+    syncsPending++;
+    return;
+  }
+  Maintenance::defer(JOB_SYNC_ALARMS);
+  metric::toggleUnacked.inc();
+  AuditLog::record(AUDIT_SYNC, local ? AUDIT_SLOT_API : 0, AUDIT_DEFERRED);
+  Serial.println("Network busy - alarms will sync later");
+}
+
+// Network task: tell the UI a sync is done, so its LED stops pulsing. The
+// UI drains its queue every pass, so this only fails if it has stopped.
+static void syncFinished() {
+  if (!Tasks::post(UiMessage{ UI_SYNCED, isLocked, millis() })) Serial.println("[Tasks] UI queue full - sync end not reported");
+}
+
+// Network task
+void syncLockState(unsigned long requestedAt, bool local) {
+  const char* via = local ? " (local API)" : "";
+  uint8_t slot = local ? AUDIT_SLOT_API : 0;
+  Warmup::finish(); // its connection is the one the sync goes out on
+
+  // Don't make the user wait on a backend that is known to be down; the
+  // acknowledged state no longer matches, so a maintenance wake resyncs it
+  if (!LockLink::reachable()) {
+    Maintenance::defer(JOB_SYNC_ALARMS);
+    RtcState::flush();
+    metric::toggleUnacked.inc();
+    Metrics::checkSlos();
+    LocalApi::publish("alarms", "\"acked\":false");
+    AuditLog::record(AUDIT_SYNC, slot, AUDIT_DEFERRED);
+    Serial.println("DoLynk unavailable - alarms will sync later");
+    Serial.printf("SITE %s%s\n", isLocked ? "LOCKED" : "UNLOCKED", via);
+    syncFinished();
+    return;
+  }
+
+  bool locked = isLocked; // the UI task may change it meanwhile; the next sync sends that
+  bool synced = LockLink::setAlarms(locked, true);
+  Serial.printf("SITE %s%s\n", locked ? "LOCKED" : "UNLOCKED", via);
+#ifdef NOTIFY_LOCK_EMAILS
+  if (!Tasks::post(Notification{ locked })) Serial.println("[Mailtrap] Queue full - lock status email dropped");
+#endif
+  LocalApi::publish("alarms", synced ? "\"acked\":true" : "\"acked\":false");
+  AuditLog::record(AUDIT_SYNC, slot, synced ? AUDIT_ACKED : AUDIT_UNACKED);
+  if (synced) {
+    metric::toggleAckMs.observe(millis() - requestedAt);
   } else {
-    toggle_alarms("off");
-    Serial.println("SITE UNLOCKED");
-  //   Mailtrap::sendLockStatusEmail(
-  //     MAILTRAP_RECIPIENT, 
-  //     "Admin",
-  //     false
-  //   );
+    metric::toggleUnacked.inc();
+    Maintenance::defer(JOB_SYNC_ALARMS);
   }
+  Metrics::checkSlos();
+  RtcState::flush(); // one flash write for the new lock state and its acks
+  syncFinished();
 }
 
 /* =========================================================
@@ -221,25 +442,32 @@ void updateLEDs() {
   else if (isLocked) state = LOCKED;
   else state = UNLOCKED;
 
-  digitalWrite(GREEN_PIN, state == UNLOCKED);
-  digitalWrite(YELLOW_PIN, state == ENTERING);
-  digitalWrite(RED_PIN, state == LOCKED);
-}
-
-void flashLED(int pin, int times) {
-  for (int i = 0; i < times; i++) {
-    digitalWrite(pin, HIGH);
-    delay(100);
-    digitalWrite(pin, LOW);
-    delay(100);
-  }
+  // The state's LED pulses while a sync is on its way to DoLynk. The engine
+  // ignores patterns that haven't changed, so this only touches the
+  // hardware when the state does.
+  LedPattern on = syncsPending ? LED_PULSE : LED_SOLID;
+  LedEngine::set(LED_GREEN, state == UNLOCKED ? on : LED_OFF);
+  LedEngine::set(LED_YELLOW, state == ENTERING ? LED_SOLID : LED_OFF);
+  LedEngine::set(LED_RED, state == LOCKED ? on : LED_OFF);
 }
 
 /* =========================================================
    ENTER DEEP SLEEP ON INACTIVITY
    ========================================================= */
 void enterDeepSleep() {
+  Tasks::end(); // finishes any sync or email in progress, closes the network side
+  AuditLog::end();
+  WifiStatus::end();
+  Maintenance::armTimer();
+  DnsCache::report();
+  RtcState::end();
+
   Serial.println("Entering Sleep (Key-Intersection Mode)...");
+  CpuPower::end();
+  Metrics::end();
+  LocalApi::end();
+  LockLink::end();
+  LedEngine::end();
 
   // 1. Prepare the 'Source' Row
   rtc_gpio_init(GPIO_NUM_13);
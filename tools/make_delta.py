@@ -0,0 +1,353 @@
+#!/usr/bin/env python3
+"""Build compressed delta OTA files for RevoLock.
+
+    tools/make_delta.py old.bin [older.bin ...] new.bin --key ota-key.pem --out-dir ota/
+    tools/make_delta.py --key ota-key.pem --public-key
+
+For every old image this writes <old-elf-sha>.rvd into the output
+directory. Devices running that build fetch OTA_URL/<their-elf-sha>.rvd, so
+a plain static file server (python3 -m http.server) is enough to serve
+updates; a 404 means the device is already up to date or unknown.
+
+Devices only install deltas signed with the release key, an ECDSA P-256
+key made once with
+
+    openssl ecparam -name prime256v1 -genkey -noout -out ota-key.pem
+
+--public-key prints the matching OTA_PUBLIC_KEY line for setup.h. Signing
+runs the openssl command-line tool. Keep the key off the update server.
+
+Format (see include/DeltaPatch.h):
+    header     b"RVD2", source size, target size (u32 LE),
+               SHA-256 of the source image, SHA-256 of the target image
+    signature  ECDSA P-256 over SHA-256 of the header, r and s (32 bytes
+               each, big-endian)
+    payload   LZSS-compressed patch records: seek (signed varint),
+               diff length + bytes added to the source, extra length + bytes
+"""
+
+import argparse
+import hashlib
+import os
+import struct
+import subprocess
+import sys
+import tempfile
+
+MAGIC = b"RVD2"
+WINDOW_BITS = 12
+WINDOW = 1 << WINDOW_BITS
+MIN_MATCH = 3
+SEED = 12              # exact match length that starts a diff region
+ELF_SHA_OFFSET = 176   # image header + segment header + esp_app_desc_t.app_elf_sha256
+
+
+def varint(n):
+    out = bytearray()
+    while True:
+        b = n & 0x7F
+        n >>= 7
+        if n:
+            out.append(b | 0x80)
+        else:
+            out.append(b)
+            return bytes(out)
+
+
+def zigzag(n):
+    return (n << 1) if n >= 0 else ((-n << 1) - 1)
+
+
+# ---------------------------------------------------------------------------
+# Patch records
+# ---------------------------------------------------------------------------
+def diff(old, new):
+    """bsdiff-style approximate matching: regions of the new image that line
+    up with the old one (code shifted by a few bytes, changed addresses)
+    become mostly-zero difference bytes, which compress very well."""
+    index = {}
+    for p in range(0, len(old) - SEED + 1, 4):
+        index.setdefault(old[p:p + SEED], p)
+
+    records = [[0, b"", bytearray()]]   # seek, diff bytes, extra bytes
+    old_ptr = 0                          # decoder's source pointer
+    covered = 0                          # new[:covered] is already encoded
+    last_off = 0
+    i = 0
+    n = len(new)
+    while i + SEED <= n:
+        key = new[i:i + SEED]
+        # Prefer the previous alignment, it keeps seeks short
+        if 0 <= i + last_off and old[i + last_off:i + last_off + SEED] == key:
+            p = i + last_off
+        else:
+            p = index.get(key)
+            if p is None:
+                i += 1
+                continue
+        off = p - i
+
+        # Extend forwards while matches outweigh mismatches
+        score = best = 0
+        end = i
+        j = i
+        limit = min(n, len(old) - off)
+        while j < limit:
+            score += 1 if new[j] == old[j + off] else -1
+            j += 1
+            if score > best:
+                best, end = score, j
+            elif score < best - 64:
+                break
+
+        # And backwards into the bytes not covered yet
+        score = best = 0
+        start = i
+        k = i
+        while k > covered and k + off > 0:
+            k -= 1
+            score += 1 if new[k] == old[k + off] else -1
+            if score > best:
+                best, start = score, k
+            elif score < best - 64:
+                break
+
+        records[-1][2] += new[covered:start]
+        delta = bytes((new[x] - old[x + off]) & 0xFF for x in range(start, end))
+        records.append([start + off - old_ptr, delta, bytearray()])
+        old_ptr = end + off
+        covered = i = end
+        last_off = off
+
+    records[-1][2] += new[covered:]
+    stream = bytearray()
+    for seek, delta, extra in records:
+        stream += varint(zigzag(seek)) + varint(len(delta)) + delta + varint(len(extra)) + extra
+    return bytes(stream)
+
+
+# ---------------------------------------------------------------------------
+# LZSS
+# ---------------------------------------------------------------------------
+def compress(data):
+    out = bytearray()
+    heads = {}
+    chains = {}
+    items = []
+    flags_pos = None
+    count = 0
+
+    def add_item(literal, payload):
+        nonlocal flags_pos, count
+        if count % 8 == 0:
+            flags_pos = len(out)
+            out.append(0)
+        if literal:
+            out[flags_pos] |= 1 << (count % 8)
+        out.extend(payload)
+        count += 1
+
+    def insert(pos):
+        key = data[pos:pos + MIN_MATCH]
+        prev = heads.get(key)
+        if prev is not None:
+            chains[pos] = prev
+        heads[key] = pos
+
+    i = 0
+    n = len(data)
+    while i < n:
+        best_len = best_dist = 0
+        # Runs are the common case in diff output: check distance 1 first
+        if i > 0 and i + MIN_MATCH <= n and data[i] == data[i - 1]:
+            j = i
+            while j < n and data[j] == data[i - 1]:
+                j += 1
+            best_len, best_dist = j - i, 1
+        if best_len < 64:
+            cand = heads.get(data[i:i + MIN_MATCH])
+            tries = 24
+            while cand is not None and tries and i - cand <= WINDOW:
+                length = 0
+                while i + length < n and data[cand + length] == data[i + length] and length < 4096:
+                    length += 1
+                if length > best_len:
+                    best_len, best_dist = length, i - cand
+                cand = chains.get(cand)
+                tries -= 1
+
+        if best_len >= MIN_MATCH:
+            dist = best_dist - 1
+            nibble = min(best_len - MIN_MATCH, 15)
+            payload = bytes([dist >> 4, ((dist & 0xF) << 4) | nibble])
+            if nibble == 15:
+                payload += varint(best_len - MIN_MATCH - 15)
+            add_item(False, payload)
+            # Index only the start of long matches, that's where reuse comes from
+            for p in range(i, min(i + best_len, i + 16)):
+                insert(p)
+            i += best_len
+        else:
+            add_item(True, data[i:i + 1])
+            insert(i)
+            i += 1
+    return bytes(out)
+
+
+# ---------------------------------------------------------------------------
+# Reference decoder, used by --verify
+# ---------------------------------------------------------------------------
+def decompress(data):
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        flags = data[i]
+        i += 1
+        for bit in range(8):
+            if i >= len(data):
+                break
+            if flags & (1 << bit):
+                out.append(data[i])
+                i += 1
+            else:
+                dist = ((data[i] << 4) | (data[i + 1] >> 4)) + 1
+                length = (data[i + 1] & 0xF) + MIN_MATCH
+                i += 2
+                if length == 15 + MIN_MATCH:
+                    shift = extra = 0
+                    while True:
+                        b = data[i]
+                        i += 1
+                        extra |= (b & 0x7F) << shift
+                        shift += 7
+                        if not b & 0x80:
+                            break
+                    length += extra
+                for _ in range(length):
+                    out.append(out[-dist])
+    return bytes(out)
+
+
+def apply(old, payload):
+    stream = decompress(payload)
+    out = bytearray()
+    pos = src = 0
+
+    def read_varint():
+        nonlocal pos
+        shift = value = 0
+        while True:
+            b = stream[pos]
+            pos += 1
+            value |= (b & 0x7F) << shift
+            shift += 7
+            if not b & 0x80:
+                return value
+
+    while pos < len(stream):
+        z = read_varint()
+        src += (z >> 1) ^ -(z & 1)
+        length = read_varint()
+        out += bytes((stream[pos + k] + old[src + k]) & 0xFF for k in range(length))
+        pos += length
+        src += length
+        length = read_varint()
+        out += stream[pos:pos + length]
+        pos += length
+    return bytes(out)
+
+
+# ---------------------------------------------------------------------------
+# Signing
+# ---------------------------------------------------------------------------
+def openssl(*args, data=None):
+    result = subprocess.run(("openssl",) + args, input=data, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+    if result.returncode:
+        sys.exit("openssl %s: %s" % (args[0], result.stderr.decode().strip()))
+    return result.stdout
+
+
+def sign(key, header):
+    """ECDSA signature over the header as raw r || s; openssl gives DER,
+    SEQUENCE { INTEGER r, INTEGER s }"""
+    der = openssl("dgst", "-sha256", "-sign", key, data=header)
+    pos = 2
+    values = []
+    for _ in range(2):
+        if der[pos] != 0x02:
+            sys.exit("unexpected signature encoding")
+        length = der[pos + 1]
+        values.append(int.from_bytes(der[pos + 2:pos + 2 + length], "big"))
+        pos += 2 + length
+    return b"".join(v.to_bytes(32, "big") for v in values)
+
+
+def verify(key, header, signature):
+    der = b""
+    for half in (signature[:32], signature[32:]):
+        v = half.lstrip(b"\0") or b"\0"
+        if v[0] & 0x80:
+            v = b"\0" + v
+        der += bytes([0x02, len(v)]) + v
+    der = bytes([0x30, len(der)]) + der
+    pub = openssl("ec", "-in", key, "-pubout")
+    with tempfile.NamedTemporaryFile(suffix=".pem") as p, tempfile.NamedTemporaryFile() as sig:
+        p.write(pub)
+        p.flush()
+        sig.write(der)
+        sig.flush()
+        return subprocess.run(["openssl", "dgst", "-sha256", "-verify", p.name, "-signature", sig.name],
+                              input=header, stdout=subprocess.DEVNULL).returncode == 0
+
+
+def public_key(key):
+    """The uncompressed point, the last 65 bytes of the DER public key"""
+    point = openssl("ec", "-in", key, "-pubout", "-outform", "DER")[-65:]
+    return "#define OTA_PUBLIC_KEY { " + ", ".join("0x%02x" % b for b in point) + " }"
+
+
+# ---------------------------------------------------------------------------
+def elf_sha(image):
+    return image[ELF_SHA_OFFSET:ELF_SHA_OFFSET + 8].hex()
+
+
+def make_delta(old, new):
+    payload = compress(diff(old, new))
+    header = MAGIC + struct.pack("<II", len(old), len(new)) + hashlib.sha256(old).digest() + hashlib.sha256(new).digest()
+    return header, payload
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("images", nargs="*", help="old images followed by the new image")
+    parser.add_argument("--key", required=True, help="release signing key (PEM, P-256)")
+    parser.add_argument("--public-key", action="store_true", help="print OTA_PUBLIC_KEY for setup.h and exit")
+    parser.add_argument("--out-dir", default="ota", help="where to write the .rvd files")
+    parser.add_argument("--verify", action="store_true", help="decode every delta, check its signature and compare")
+    args = parser.parse_args()
+    if args.public_key:
+        print(public_key(args.key))
+        return
+    if len(args.images) < 2:
+        parser.error("need at least one old image and the new image")
+
+    with open(args.images[-1], "rb") as f:
+        new = f.read()
+    os.makedirs(args.out_dir, exist_ok=True)
+
+    for path in args.images[:-1]:
+        with open(path, "rb") as f:
+            old = f.read()
+        header, payload = make_delta(old, new)
+        signature = sign(args.key, header)
+        size = len(header) + len(signature) + len(payload)
+        name = os.path.join(args.out_dir, elf_sha(old) + ".rvd")
+        with open(name, "wb") as f:
+            f.write(header + signature + payload)
+        print("%s -> %s: %d bytes (%.1f%% of the full image)" % (path, name, size, 100.0 * size / len(new)))
+        if args.verify and (apply(old, payload) != new or not verify(args.key, header, signature)):
+            sys.exit("verification failed for " + path)
+
+
+if __name__ == "__main__":
+    main()